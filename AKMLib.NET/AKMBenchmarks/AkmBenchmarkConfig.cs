@@ -0,0 +1,30 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using BenchmarkDotNet.Configs;
+using BenchmarkDotNet.Diagnosers;
+using BenchmarkDotNet.Exporters;
+using BenchmarkDotNet.Exporters.Csv;
+using BenchmarkDotNet.Exporters.Json;
+
+namespace AKMBenchmarks
+{
+	/// <summary>
+	/// Configuration every benchmark runs with: allocations are measured, and results are exported as GitHub
+	/// markdown for reading, as full JSON for comparing runs and as CSV of the raw measurements, all under
+	/// BenchmarkDotNet.Artifacts/results
+	/// </summary>
+	public class AkmBenchmarkConfig : ManualConfig
+	{
+		/// <summary>
+		/// Default configuration with the memory diagnoser and the exporters added
+		/// </summary>
+		public AkmBenchmarkConfig()
+		{
+			Add(DefaultConfig.Instance);
+			AddDiagnoser(MemoryDiagnoser.Default);
+			AddExporter(MarkdownExporter.GitHub, JsonExporter.Full, CsvMeasurementsExporter.Default);
+		}
+	}
+}
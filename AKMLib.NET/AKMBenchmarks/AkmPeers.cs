@@ -0,0 +1,211 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Enum;
+using AKMCommon.Struct;
+using AKMInterface;
+using AKMLogic;
+using Microsoft.Extensions.Logging.Abstractions;
+using System.Runtime.InteropServices;
+
+namespace AKMBenchmarks
+{
+	/// <summary>
+	/// Both nodes of relationship #1 from appsettings.json, wired back to back: frames one node prepares are processed
+	/// by the other on the calling thread, as they would be after going through Sender and Receiver
+	/// </summary>
+	public sealed class AkmPeers : IDisposable
+	{
+		/// <summary>
+		/// Relationship both nodes belong to
+		/// </summary>
+		public const short RelationshipId = 1;
+		/// <summary>
+		/// Address of the node whose processing is measured
+		/// </summary>
+		public const short LocalAddress = 1;
+		/// <summary>
+		/// Address of the node feeding it frames
+		/// </summary>
+		public const short PeerAddress = 5;
+		/// <summary>
+		/// Key slot of the current fallback key, AKM_CFSK in the C library
+		/// </summary>
+		public const int CurrentFallbackKey = 2;
+
+		private const int ESTABLISH_ROUNDS = 64;
+		private const int KEY_SIZE = 32;
+		private const long NO_TIMEOUT = 1000000000;
+		private static readonly byte[] NodeAddresses = { 1, 0, 5, 0 };
+
+		private readonly List<IntPtr> _unmanaged = new List<IntPtr>();
+		private readonly long _normalEstablishingTimeout;
+
+		/// <summary>
+		/// Cryptographic service provider of both nodes
+		/// </summary>
+		public AkmCrypto Crypto { get; } = new AkmCrypto();
+		/// <summary>
+		/// Node whose processing is measured
+		/// </summary>
+		public AkmRelationship Local { get; }
+		/// <summary>
+		/// Node feeding it frames
+		/// </summary>
+		public AkmRelationship Peer { get; }
+
+		/// <summary>
+		/// Creates both nodes, initialized but not established, with timeouts that never pass during a run
+		/// </summary>
+		public AkmPeers() : this(NO_TIMEOUT)
+		{
+		}
+
+		/// <summary>
+		/// Creates both nodes, initialized but not established, with given normal establishing timeout
+		/// </summary>
+		/// <param name="normalEstablishingTimeout">NSET of both nodes in milliseconds</param>
+		public AkmPeers(long normalEstablishingTimeout)
+		{
+			_normalEstablishingTimeout = normalEstablishingTimeout;
+			Local = Create(0);
+			Peer = Create(2);
+		}
+
+		/// <summary>
+		/// Returns an empty frame from one node to the other carrying given content
+		/// </summary>
+		public AkmDecryptedFrame NewFrame(short source, short target, byte[] content)
+		{
+			var frame = AkmDecryptedFrame.Rent(Crypto, NullLogger.Instance, RelationshipId);
+			frame.SetContent(content);
+			frame.SetSourceAddress(source);
+			frame.SetTargetAddress(target);
+			return frame;
+		}
+
+		/// <summary>
+		/// Frame the sender would put on the wire now, with the event and key its state machine selects
+		/// </summary>
+		public IEncryptedFrame Send(AkmRelationship sender, byte[] content, out AkmEvent sentEvent, AkmEvent? forcedAkmEvent = null)
+		{
+			var source = sender == Local ? LocalAddress : PeerAddress;
+			var target = sender == Local ? PeerAddress : LocalAddress;
+			using var frame = NewFrame(source, target, content);
+			var encFrame = sender.PrepareFrame(frame, forcedAkmEvent);
+			sentEvent = frame.FrameEvent;
+			return encFrame;
+		}
+
+		/// <summary>
+		/// Processes a received frame, dropping the decrypted frame as Receiver does once its content is copied out
+		/// </summary>
+		public static AkmStatus Receive(AkmRelationship receiver, IEncryptedFrame encFrame)
+		{
+			var status = receiver.ProcessFrame(encFrame, out var decFrame);
+			(decFrame as IDisposable)?.Dispose();
+			return status;
+		}
+
+		/// <summary>
+		/// Sends one frame each way
+		/// </summary>
+		/// <returns>True if both nodes sent RecvSE</returns>
+		public bool ExchangeRound()
+		{
+			Receive(Peer, Send(Local, Array.Empty<byte>(), out var localEvent));
+			Receive(Local, Send(Peer, Array.Empty<byte>(), out var peerEvent));
+			return localEvent == AkmEvent.RecvSE && peerEvent == AkmEvent.RecvSE;
+		}
+
+		/// <summary>
+		/// Exchanges frames until both nodes have sent RecvSE in two rounds in a row
+		/// </summary>
+		/// <returns>Number of rounds it took</returns>
+		/// <exception cref="InvalidOperationException">The nodes did not get established</exception>
+		public int Establish()
+		{
+			var settled = 0;
+			for (int round = 1; round <= ESTABLISH_ROUNDS; round++)
+			{
+				settled = ExchangeRound() ? settled + 1 : 0;
+				if (settled == 2)
+					return round;
+			}
+			throw new InvalidOperationException($"Relationship #{RelationshipId} not established after {ESTABLISH_ROUNDS} rounds");
+		}
+
+		/// <summary>
+		/// Gets the peer into fallback establishing the way a lost frame does: the SEI of a rekey the peer starts never
+		/// arrives, the normal establishing timeout passes and the next frame of the local node makes the peer notice
+		/// </summary>
+		public void LosePeerSei()
+		{
+			Send(Peer, Array.Empty<byte>(), out _, AkmEvent.LocalSEI);
+			Thread.Sleep(TimeSpan.FromMilliseconds(_normalEstablishingTimeout + 1));
+			Receive(Peer, Send(Local, Array.Empty<byte>(), out _));
+		}
+
+		/// <inheritdoc/>
+		public void Dispose()
+		{
+			Local.Dispose();
+			Peer.Dispose();
+			Crypto.Dispose();
+			foreach (var ptr in _unmanaged)
+				Marshal.FreeHGlobal(ptr);
+			_unmanaged.Clear();
+		}
+
+		private AkmRelationship Create(int selfAddressIndex)
+		{
+			var pdv = new byte[AkmRelationship.PDV_Size];
+			for (int i = 0; i < pdv.Length; i++)
+				pdv[i] = (byte)(i * 7 + 3);
+
+			var config = new AkmConfiguration
+			{
+				cfgParams = new AkmConfigParams
+				{
+					SK = KEY_SIZE,
+					SRNA = 2,
+					N = 2,
+					//distinct seeds, with all of them zero consecutive fallback cycles diverge the keys, see AkmFallbackCycle_Tests
+					CSS = 0x1111,
+					NSS = 0x2222,
+					FSS = 0x3333,
+					NFSS = 0x4444,
+					SFSS = 0x5555,
+					NSFSS = 0x6666,
+					EFSS = 0x7777,
+					NNRT = NO_TIMEOUT,
+					NSET = _normalEstablishingTimeout,
+					FBSET = NO_TIMEOUT,
+					FSSET = NO_TIMEOUT
+				},
+				pdv = Unmanaged(pdv),
+				nodeAddresses = Unmanaged(NodeAddresses),
+				selfNodeAddress = Unmanaged(NodeAddresses.AsSpan(selfAddressIndex, 2).ToArray())
+			};
+
+			//both nodes start from the same shared keys
+			var keys = new IKey[AkmRelationship.KEY_COUNT];
+			for (int k = 0; k < keys.Length; k++)
+			{
+				var key = new AkmKey(KEY_SIZE);
+				key.SetKey(Enumerable.Range(0, KEY_SIZE).Select(i => (byte)(k * 31 + i)).ToArray());
+				keys[k] = key;
+			}
+			return new AkmRelationship(NullLogger.Instance, new AkmCLibCall(), new AkmKeyFactory(), keys, ref config);
+		}
+
+		private IntPtr Unmanaged(byte[] data)
+		{
+			var ptr = Marshal.AllocHGlobal(data.Length);
+			Marshal.Copy(data, 0, ptr, data.Length);
+			_unmanaged.Add(ptr);
+			return ptr;
+		}
+	}
+}
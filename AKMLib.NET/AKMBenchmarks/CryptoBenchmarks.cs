@@ -0,0 +1,81 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMLogic;
+using BenchmarkDotNet.Attributes;
+
+namespace AKMBenchmarks
+{
+	/// <summary>
+	/// AkmCrypto across payload sizes, through the array API custom code uses and the buffer API frames use
+	/// </summary>
+	[MemoryDiagnoser]
+	public class CryptoBenchmarks
+	{
+		/// <summary>
+		/// Plain data length in bytes
+		/// </summary>
+		[Params(64, 1024, 16 * 1024, 64 * 1024)]
+		public int Size { get; set; }
+
+		private readonly AkmCrypto _crypto = new AkmCrypto();
+		private readonly byte[] _key = Enumerable.Range(0, 32).Select(i => (byte)i).ToArray();
+		private byte[] _data = Array.Empty<byte>();
+		private byte[] _encrypted = Array.Empty<byte>();
+		private byte[] _buffer = Array.Empty<byte>();
+		private readonly byte[] _hash = new byte[32];
+
+		[GlobalSetup]
+		public void Setup()
+		{
+			_data = new byte[Size];
+			new Random(1).NextBytes(_data);
+			_encrypted = _crypto.Encrypt(_data, _key);
+			_buffer = new byte[_encrypted.Length];
+		}
+
+		[GlobalCleanup]
+		public void Cleanup()
+		{
+			_crypto.Dispose();
+		}
+
+		[Benchmark(Baseline = true)]
+		public byte[] Encrypt()
+		{
+			return _crypto.Encrypt(_data, _key);
+		}
+
+		[Benchmark]
+		public int EncryptIntoBuffer()
+		{
+			return _crypto.Encrypt(_data.AsSpan(), _key, _buffer);
+		}
+
+		[Benchmark]
+		public byte[] Decrypt()
+		{
+			return _crypto.Decrypt(_encrypted, _key);
+		}
+
+		[Benchmark]
+		public int DecryptIntoBuffer()
+		{
+			return _crypto.Decrypt(_encrypted.AsSpan(), _key, _buffer);
+		}
+
+		[Benchmark]
+		public byte[] CalculateHash()
+		{
+			return _crypto.CalculateHash(_data);
+		}
+
+		[Benchmark]
+		public byte[] CalculateHashIntoBuffer()
+		{
+			_crypto.CalculateHash(_data.AsSpan(), _hash);
+			return _hash;
+		}
+	}
+}
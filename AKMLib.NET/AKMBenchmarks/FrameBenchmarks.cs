@@ -0,0 +1,99 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Enum;
+using AKMInterface;
+using AKMLogic;
+using BenchmarkDotNet.Attributes;
+using Microsoft.Extensions.Logging.Abstractions;
+
+namespace AKMBenchmarks
+{
+	/// <summary>
+	/// Frame handling outside of the state machine: building a decrypted frame, adding its hash, encrypting it for
+	/// the wire, and decrypting and checking a received one. Frames are rented and disposed as Sender and Receiver
+	/// do, so allocations show what is left per frame once the pooled buffers are warm.
+	/// </summary>
+	[MemoryDiagnoser]
+	public class FrameBenchmarks
+	{
+		/// <summary>
+		/// Frame content length in bytes
+		/// </summary>
+		[Params(64, 1024, 16 * 1024)]
+		public int ContentSize { get; set; }
+
+		private readonly AkmCrypto _crypto = new AkmCrypto();
+		private readonly AkmKey _key = new AkmKey();
+		private byte[] _content = Array.Empty<byte>();
+		private byte[] _received = Array.Empty<byte>();
+
+		[GlobalSetup]
+		public void Setup()
+		{
+			_key.SetKey(Enumerable.Range(0, _key.KeyLength).Select(i => (byte)i).ToArray());
+			_content = new byte[ContentSize];
+			new Random(1).NextBytes(_content);
+
+			//as Receiver hands it over: relationship id followed by the encrypted data, the length taken off
+			var wire = BuildAndEncrypt();
+			_received = new byte[wire.Length - sizeof(long)];
+			wire.AsSpan(0, sizeof(short)).CopyTo(_received);
+			wire.AsSpan(sizeof(short) + sizeof(long)).CopyTo(_received.AsSpan(sizeof(short)));
+		}
+
+		[GlobalCleanup]
+		public void Cleanup()
+		{
+			_crypto.Dispose();
+		}
+
+		[Benchmark(Baseline = true)]
+		public int Build()
+		{
+			using var frame = NewFrame();
+			return frame.Length;
+		}
+
+		[Benchmark]
+		public int BuildAndHash()
+		{
+			using var frame = NewFrame();
+			frame.SetContentHash();
+			return frame.Length;
+		}
+
+		[Benchmark]
+		public byte[] BuildAndEncrypt()
+		{
+			IEncryptedFrame encFrame;
+			using (var frame = NewFrame())
+			{
+				encFrame = frame.Encrypt(_key);
+			}
+			encFrame.SetFrameLength();
+			return encFrame.GetTransmissionData();
+		}
+
+		[Benchmark]
+		public AkmEvent Decrypt()
+		{
+			var encFrame = new AkmEncryptedFrame(_crypto, NullLogger.Instance, _received, AkmPeers.RelationshipId);
+			var decFrame = encFrame.Decrypt(_key) ?? throw new InvalidOperationException("Frame did not decrypt");
+			var akmEvent = decFrame.FrameEvent;
+			((IDisposable)decFrame).Dispose();
+			return akmEvent;
+		}
+
+		private AkmDecryptedFrame NewFrame()
+		{
+			var frame = AkmDecryptedFrame.Rent(_crypto, NullLogger.Instance, AkmPeers.RelationshipId);
+			frame.SetContent(_content);
+			frame.SetSourceAddress(AkmPeers.LocalAddress);
+			frame.SetTargetAddress(AkmPeers.PeerAddress);
+			frame.SetFrameEvent(AkmEvent.RecvSE);
+			return frame;
+		}
+	}
+}
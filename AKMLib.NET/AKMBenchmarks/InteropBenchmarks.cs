@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Enum;
+using AKMCommon.Struct;
+using AKMInterface;
+using BenchmarkDotNet.Attributes;
+using System.Runtime.InteropServices;
+
+namespace AKMBenchmarks
+{
+	/// <summary>
+	/// Cost of handing a received frame's event to the C library: the marshaled DllImport with a pinned source
+	/// address array, as AkmRelationship used to do it, against the blittable AkmNative calls with the address on
+	/// the stack
+	/// </summary>
+	[MemoryDiagnoser]
+	public unsafe class InteropBenchmarks
+	{
+		private static readonly byte[] NodeAddresses = { 1, 0, 5, 0 };
+		private static readonly byte[] PeerAddress = { 5, 0 };
+
+		private IntPtr _relationship;
+
+		[DllImport(AkmNative.LibraryName, CallingConvention = CallingConvention.Cdecl, EntryPoint = "AKMProcess")]
+		private static extern void MarshaledProcess(ref AkmProcessCtx ctx);
+
+		[GlobalSetup]
+		public void Setup()
+		{
+			var pdv = new byte[AKMLogic.AkmRelationship.PDV_Size];
+			for (int i = 0; i < pdv.Length; i++)
+				pdv[i] = (byte)i;
+
+			var ctx = new AkmProcessCtx { time_ms = DateTimeOffset.UtcNow.ToUnixTimeMilliseconds() };
+			fixed (byte* pPdv = pdv, pNodes = NodeAddresses)
+			{
+				var config = new AkmConfiguration
+				{
+					cfgParams = new AkmConfigParams
+					{
+						SK = 32,
+						SRNA = 2,
+						N = 2,
+						NNRT = 1000000000,
+						NSET = 1000000000,
+						FBSET = 1000000000,
+						FSSET = 1000000000
+					},
+					pdv = (IntPtr)pPdv,
+					nodeAddresses = (IntPtr)pNodes,
+					selfNodeAddress = (IntPtr)pNodes
+				};
+				if (AkmNative.AKMInit(&ctx, &config) != AkmStatus.Success)
+					throw new InvalidOperationException("AKMInit failed");
+			}
+			_relationship = ctx.relationship;
+			RunToReturn(&ctx);
+		}
+
+		[GlobalCleanup]
+		public void Cleanup()
+		{
+			AkmNative.AKMFree(_relationship);
+		}
+
+		[Benchmark(Baseline = true)]
+		public AkmStatus MarshaledWithPinnedAddress()
+		{
+			var ctx = Context();
+			var srcAddr = (byte[])PeerAddress.Clone();
+			var hSrcAddr = GCHandle.Alloc(srcAddr, GCHandleType.Pinned);
+			ctx.srcAddr = hSrcAddr.AddrOfPinnedObject();
+			try
+			{
+				do
+				{
+					MarshaledProcess(ref ctx);
+				}
+				while (ctx.cmd.opcode != AkmCmdOpCode.Return);
+			}
+			finally
+			{
+				hSrcAddr.Free();
+			}
+			return (AkmStatus)ctx.cmd.p1;
+		}
+
+		[Benchmark]
+		public AkmStatus BlittableWithStackAddress()
+		{
+			var ctx = Context();
+			byte* srcAddr = stackalloc byte[2];
+			PeerAddress.AsSpan().CopyTo(new Span<byte>(srcAddr, 2));
+			ctx.srcAddr = (IntPtr)srcAddr;
+			return RunToReturn(&ctx);
+		}
+
+		private AkmProcessCtx Context()
+		{
+			return new AkmProcessCtx
+			{
+				relationship = _relationship,
+				akmEvent = AkmEvent.RecvSE,
+				time_ms = DateTimeOffset.UtcNow.ToUnixTimeMilliseconds()
+			};
+		}
+
+		private static AkmStatus RunToReturn(AkmProcessCtx* ctx)
+		{
+			do
+			{
+				AkmNative.AKMProcess(ctx);
+			}
+			while (ctx->cmd.opcode != AkmCmdOpCode.Return);
+			return (AkmStatus)ctx->cmd.p1;
+		}
+	}
+}
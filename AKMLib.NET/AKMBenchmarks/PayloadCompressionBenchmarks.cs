@@ -0,0 +1,181 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Struct;
+using AKMLogic;
+using BenchmarkDotNet.Attributes;
+using BenchmarkDotNet.Columns;
+using BenchmarkDotNet.Configs;
+using BenchmarkDotNet.Reports;
+using BenchmarkDotNet.Running;
+using System.Text;
+
+namespace AKMBenchmarks
+{
+	/// <summary>
+	/// Cost and gain of the payload compression stage on representative payloads: compression alone, and the whole
+	/// encode and encrypt step against encrypting the payload as it is
+	/// </summary>
+	[MemoryDiagnoser]
+	[Config(typeof(Config))]
+	public class PayloadCompressionBenchmarks
+	{
+		private class Config : ManualConfig
+		{
+			public Config()
+			{
+				AddColumn(new WireBytesColumn());
+			}
+		}
+
+		/// <summary>
+		/// Payload corpus, see Corpora.Get
+		/// </summary>
+		[Params("telemetry", "logs", "random", "small")]
+		public string Corpus { get; set; } = "telemetry";
+
+		private readonly AkmAppConfig _appCfg = new AkmAppConfig { CompressPayloads = true };
+		private readonly AkmCrypto _crypto = new AkmCrypto();
+		private readonly byte[] _key = new byte[32];
+		private byte[] _payload = Array.Empty<byte>();
+		private byte[] _block = Array.Empty<byte>();
+		private byte[] _compressed = Array.Empty<byte>();
+		private byte[] _decompressed = Array.Empty<byte>();
+		private int _compressedLength;
+
+		[GlobalSetup]
+		public void Setup()
+		{
+			_payload = Corpora.Get(Corpus);
+			_block = new byte[AkmLz.MaxCompressedLength(_payload.Length)];
+			_compressedLength = AkmLz.Compress(_payload, _block);
+			_compressed = _block.AsSpan(0, _compressedLength).ToArray();
+			_decompressed = new byte[_payload.Length];
+		}
+
+		[GlobalCleanup]
+		public void Cleanup()
+		{
+			_crypto.Dispose();
+		}
+
+		[Benchmark]
+		public int Compress()
+		{
+			return AkmLz.Compress(_payload, _block);
+		}
+
+		[Benchmark]
+		public int Decompress()
+		{
+			return AkmLz.Decompress(_compressed, _decompressed);
+		}
+
+		[Benchmark(Baseline = true)]
+		public byte[] EncryptOnly()
+		{
+			return _crypto.Encrypt(_payload, _key);
+		}
+
+		[Benchmark]
+		public byte[] EncodeAndEncrypt()
+		{
+			return _crypto.Encrypt(AkmPayloadCodec.Encode(_payload, _appCfg), _key);
+		}
+	}
+
+	/// <summary>
+	/// Generated payloads standing for what relationships carry: JSON telemetry, text logs, already compressed or
+	/// encrypted data, and a payload below the compression threshold
+	/// </summary>
+	public static class Corpora
+	{
+		/// <summary>
+		/// Payload of the named corpus
+		/// </summary>
+		public static byte[] Get(string name)
+		{
+			switch (name)
+			{
+				case "telemetry":
+					return Telemetry(16 * 1024);
+				case "logs":
+					return Logs(16 * 1024);
+				case "random":
+					var data = new byte[16 * 1024];
+					new Random(1).NextBytes(data);
+					return data;
+				case "small":
+					return Telemetry(64);
+				default:
+					throw new ArgumentException($"Unknown corpus {name}", nameof(name));
+			}
+		}
+
+		private static byte[] Telemetry(int size)
+		{
+			var random = new Random(1);
+			var sb = new StringBuilder("[");
+			for (int i = 0; sb.Length < size; i++)
+			{
+				sb.Append($"{{\"deviceId\":\"sensor-{i % 50:D4}\",\"timestamp\":{1700000000 + i},\"temperature\":{20 + random.NextDouble() * 5:F2},\"status\":\"OK\",\"relationship\":{i % 8}}},");
+			}
+			return Encoding.UTF8.GetBytes(sb.ToString()).AsSpan(0, size).ToArray();
+		}
+
+		private static byte[] Logs(int size)
+		{
+			var sb = new StringBuilder();
+			for (int i = 0; sb.Length < size; i++)
+			{
+				sb.Append($"2024-05-01T12:{i % 60:D2}:{i * 7 % 60:D2}Z INFO AKMLogic.Sender[0] Frame sent in relationship #{i % 4} to node {i % 9} length {i * 13 % 900}\n");
+			}
+			return Encoding.UTF8.GetBytes(sb.ToString()).AsSpan(0, size).ToArray();
+		}
+	}
+
+	/// <summary>
+	/// Size of the corpus as AkmPayloadCodec puts it in a frame, next to its raw size
+	/// </summary>
+	public class WireBytesColumn : IColumn
+	{
+		/// <inheritdoc/>
+		public string Id => nameof(WireBytesColumn);
+		/// <inheritdoc/>
+		public string ColumnName => "Wire bytes";
+		/// <inheritdoc/>
+		public bool AlwaysShow => true;
+		/// <inheritdoc/>
+		public ColumnCategory Category => ColumnCategory.Custom;
+		/// <inheritdoc/>
+		public int PriorityInCategory => 0;
+		/// <inheritdoc/>
+		public bool IsNumeric => false;
+		/// <inheritdoc/>
+		public UnitType UnitType => UnitType.Dimensionless;
+		/// <inheritdoc/>
+		public string Legend => "Frame content size with compression enabled / raw payload size";
+
+		/// <inheritdoc/>
+		public string GetValue(Summary summary, BenchmarkCase benchmarkCase)
+		{
+			if (!(benchmarkCase.Parameters["Corpus"] is string corpus))
+				return "-";
+			var payload = Corpora.Get(corpus);
+			var content = AkmPayloadCodec.Encode(payload, new AkmAppConfig { CompressPayloads = true });
+			return $"{content.Length} / {payload.Length}";
+		}
+
+		/// <inheritdoc/>
+		public string GetValue(Summary summary, BenchmarkCase benchmarkCase, SummaryStyle style)
+		{
+			return GetValue(summary, benchmarkCase);
+		}
+
+		/// <inheritdoc/>
+		public bool IsAvailable(Summary summary) => true;
+		/// <inheritdoc/>
+		public bool IsDefault(Summary summary, BenchmarkCase benchmarkCase) => false;
+	}
+}
@@ -0,0 +1,19 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using BenchmarkDotNet.Running;
+
+namespace AKMBenchmarks
+{
+	public class Program
+	{
+		/// <summary>
+		/// Runs the benchmarks selected by the arguments, e.g. --filter *PayloadCompression*, or --filter * for all
+		/// </summary>
+		public static void Main(string[] args)
+		{
+			BenchmarkSwitcher.FromAssembly(typeof(Program).Assembly).Run(args, new AkmBenchmarkConfig());
+		}
+	}
+}
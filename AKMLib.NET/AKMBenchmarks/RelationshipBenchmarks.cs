@@ -0,0 +1,211 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Enum;
+using AKMInterface;
+using AKMLogic;
+using BenchmarkDotNet.Attributes;
+
+namespace AKMBenchmarks
+{
+	/// <summary>
+	/// AkmRelationship.ProcessFrame in each state a running relationship can be in, and PrepareFrame.
+	/// Single frame benchmarks replay the same frame, so the state machine settles in the state named and every
+	/// operation takes the same path, as in the established_recv_se and established_retry_dec benches of the C
+	/// library. Transitions are measured as whole cycles, from the event leaving the established state until both
+	/// nodes are established again, the fallback cycle in FallbackCycleBenchmarks. Offline is not covered, a
+	/// relationship only is in it before AKMInit.
+	/// </summary>
+	[MemoryDiagnoser]
+	public class RelationshipBenchmarks
+	{
+		/// <summary>
+		/// Normal establishing timeout of the scenarios going through fallback, in milliseconds
+		/// </summary>
+		internal const long FALLBACK_NSET = 10;
+
+		internal static readonly byte[] Content = new byte[64];
+		private static readonly byte[] UnrelatedKey = Enumerable.Repeat((byte)0xEE, 32).ToArray();
+
+		private AkmPeers _peers = null!;
+		private IEncryptedFrame _frame = null!;
+		private IEncryptedFrame _undecryptable = null!;
+
+		[GlobalSetup(Targets = new[] { nameof(ProcessFrameNormalEstablishing) })]
+		public void SetupNormalEstablishing()
+		{
+			_peers = new AkmPeers();
+			_frame = _peers.Send(_peers.Peer, Content, out var sentEvent);
+			Expect(AkmEvent.RecvSEI, sentEvent);
+		}
+
+		[GlobalSetup(Targets = new[] { nameof(ProcessFrameEstablished), nameof(PrepareFrame), nameof(RekeyCycle) })]
+		public void SetupEstablished()
+		{
+			_peers = new AkmPeers();
+			_peers.Establish();
+			_frame = _peers.Send(_peers.Peer, Content, out var sentEvent);
+			Expect(AkmEvent.RecvSE, sentEvent);
+		}
+
+		[GlobalSetup(Targets = new[] { nameof(ProcessFrameEstablishedRetryDec) })]
+		public void SetupEstablishedRetryDec()
+		{
+			SetupEstablished();
+			using var frame = _peers.NewFrame(AkmPeers.PeerAddress, AkmPeers.LocalAddress, Content);
+			frame.SetFrameEvent(AkmEvent.RecvSE);
+			var key = new AkmKey(UnrelatedKey.Length);
+			key.SetKey(UnrelatedKey);
+			_undecryptable = frame.Encrypt(key);
+		}
+
+		[GlobalSetup(Targets = new[] { nameof(ProcessFrameFallbackEstablishing) })]
+		public void SetupFallbackEstablishing()
+		{
+			_peers = new AkmPeers(FALLBACK_NSET);
+			_peers.Establish();
+			_peers.LosePeerSei();
+			_frame = _peers.Send(_peers.Peer, Content, out var sentEvent);
+			Expect(AkmEvent.RecvSEI, sentEvent);
+			ExpectFallbackKey(_peers, _frame);
+			//the first one is decrypted on retry with the fallback key and switches to fallback establishing
+			AkmPeers.Receive(_peers.Local, _frame);
+		}
+
+		[GlobalCleanup]
+		public void Cleanup()
+		{
+			_peers.Dispose();
+		}
+
+		/// <summary>
+		/// Frame of a peer still initializing the session
+		/// </summary>
+		[Benchmark]
+		public AkmStatus ProcessFrameNormalEstablishing()
+		{
+			return AkmPeers.Receive(_peers.Local, _frame);
+		}
+
+		/// <summary>
+		/// Frame of an established peer, the fast path
+		/// </summary>
+		[Benchmark(Baseline = true)]
+		public AkmStatus ProcessFrameEstablished()
+		{
+			return AkmPeers.Receive(_peers.Local, _frame);
+		}
+
+		/// <summary>
+		/// Frame nothing decrypts, retried with the fallback key and counted as a decryption failure, followed by a
+		/// frame of the established peer
+		/// </summary>
+		[Benchmark]
+		public AkmStatus ProcessFrameEstablishedRetryDec()
+		{
+			AkmPeers.Receive(_peers.Local, _undecryptable);
+			return AkmPeers.Receive(_peers.Local, _frame);
+		}
+
+		/// <summary>
+		/// Frame encrypted with the fallback key while establishing with fallback keys
+		/// </summary>
+		[Benchmark]
+		public AkmStatus ProcessFrameFallbackEstablishing()
+		{
+			return AkmPeers.Receive(_peers.Local, _frame);
+		}
+
+		/// <summary>
+		/// Sending side: frame built, event set by the state machine and encrypted, ready for the send queue
+		/// </summary>
+		[Benchmark]
+		public byte[] PrepareFrame()
+		{
+			using var frame = _peers.NewFrame(AkmPeers.LocalAddress, AkmPeers.PeerAddress, Content);
+			var encFrame = _peers.Local.PrepareFrame(frame);
+			encFrame.SetFrameLength();
+			return encFrame.GetTransmissionData();
+		}
+
+		/// <summary>
+		/// Forced SEI and normal establishing until both nodes are established again, with the retries on the next
+		/// session key while the nodes switch to it
+		/// </summary>
+		[Benchmark]
+		public int RekeyCycle()
+		{
+			AkmPeers.Receive(_peers.Peer, _peers.Send(_peers.Local, Content, out _, AkmEvent.RecvSEI));
+			return _peers.Establish();
+		}
+
+		internal static void Expect(AkmEvent expected, AkmEvent actual)
+		{
+			if (expected != actual)
+				throw new InvalidOperationException($"Peer sent {actual} instead of {expected}, the scenario does not start in the intended state");
+		}
+
+		/// <summary>
+		/// Checks the frame is encrypted with the current fallback key of the peer, as sent once it is in fallback
+		/// </summary>
+		internal static void ExpectFallbackKey(AkmPeers peers, IEncryptedFrame frame)
+		{
+			var key = peers.Peer.GetKeys()[AkmPeers.CurrentFallbackKey]
+				?? throw new InvalidOperationException("Peer has no current fallback key");
+			using var decFrame = frame.Decrypt(key) as AkmDecryptedFrame;
+			if (decFrame == null)
+				throw new InvalidOperationException("Peer frame is not encrypted with its fallback key, the scenario does not start in the intended state");
+		}
+	}
+
+	/// <summary>
+	/// The fallback cycle: the SEI of a rekey the peer starts is lost, and once its normal establishing timeout has
+	/// passed, the fallback SEI, SEC and SEF until both nodes are established again. Getting there takes the timeout,
+	/// so each cycle is one invocation, on a freshly established pair that has lost the SEI in the iteration setup;
+	/// the benchmark configuration has all seeds zero, and after some cycles in a row the fallback keys the two nodes
+	/// regenerate are not the same anymore.
+	/// </summary>
+	[MemoryDiagnoser]
+	[InvocationCount(1)]
+	public class FallbackCycleBenchmarks
+	{
+		private AkmPeers _peers = null!;
+
+		[GlobalSetup]
+		public void Setup()
+		{
+			LosePeerSei();
+			var frame = _peers.Send(_peers.Peer, RelationshipBenchmarks.Content, out var sentEvent);
+			RelationshipBenchmarks.Expect(AkmEvent.RecvSEI, sentEvent);
+			RelationshipBenchmarks.ExpectFallbackKey(_peers, frame);
+			AkmPeers.Receive(_peers.Local, frame);
+			_peers.Establish();
+		}
+
+		[IterationSetup]
+		public void LosePeerSei()
+		{
+			_peers?.Dispose();
+			_peers = new AkmPeers(RelationshipBenchmarks.FALLBACK_NSET);
+			_peers.Establish();
+			_peers.LosePeerSei();
+		}
+
+		[GlobalCleanup]
+		public void Cleanup()
+		{
+			_peers.Dispose();
+		}
+
+		/// <summary>
+		/// Fallback SEI of the peer, then fallback establishing until both nodes are established again
+		/// </summary>
+		[Benchmark]
+		public int FallbackCycle()
+		{
+			AkmPeers.Receive(_peers.Local, _peers.Send(_peers.Peer, RelationshipBenchmarks.Content, out _));
+			return _peers.Establish();
+		}
+	}
+}
@@ -52,6 +52,31 @@ namespace AKMCommon.Struct
 		/// </summary>
 		public byte[] PDV { get; set; }
 
+		/// <summary>
+		/// Maximum number of frames waiting to be sent by a single sender, 0 for default
+		/// </summary>
+		public int SendQueueCapacity { get; set; }
+		/// <summary>
+		/// Time in microseconds a sender may wait for more frames to send them in one write, 0 sends immediately
+		/// </summary>
+		public int SendLatencyBudget { get; set; }
+		/// <summary>
+		/// Compress frame payloads before encryption, see AkmPayloadCodec; all nodes of the relationship must agree
+		/// </summary>
+		public bool CompressPayloads { get; set; }
+		/// <summary>
+		/// Smallest payload in bytes worth compressing, 0 for default
+		/// </summary>
+		public int CompressionThreshold { get; set; }
+		/// <summary>
+		/// Let streams be sent in chunks of their own frames, see Sender.SendStream; all nodes of the relationship must agree
+		/// </summary>
+		public bool ChunkedPayloads { get; set; }
+		/// <summary>
+		/// Largest payload in bytes of one chunk of a stream, 0 for default
+		/// </summary>
+		public int StreamChunkSize { get; set; }
+
 	}
 	/// <summary>
 	/// AKM Frame schema definition regarding lengths and starting indexes of each required part
@@ -25,5 +25,18 @@ namespace AKMCommon.Struct
 		public short SrcAddr { get; set; }
 		public short TrgAddr { get; set; }
 		public AKMCommon.Enum.AkmEvent AkmEvent { get; set; }
+		/// <summary>
+		/// Identifier of the stream FrameData is a chunk of, null if FrameData is a whole payload
+		/// </summary>
+		public uint? StreamId { get; set; }
+		/// <summary>
+		/// Number of the chunk in its stream, starting at 0
+		/// On Receiver.StreamAborted, number of chunks of the stream delivered before it broke off
+		/// </summary>
+		public uint ChunkIndex { get; set; }
+		/// <summary>
+		/// True on the last chunk of a stream
+		/// </summary>
+		public bool IsFinalChunk { get; set; }
 	}
 }
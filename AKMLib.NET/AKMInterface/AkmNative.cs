@@ -0,0 +1,97 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Enum;
+using AKMCommon.Struct;
+using System;
+using System.Runtime.CompilerServices;
+using System.Runtime.InteropServices;
+
+namespace AKMInterface
+{
+	/// <summary>
+	/// Blittable entry points of the C AKM library.
+	/// Every argument is a pointer to a struct laid out as in akm.h or a plain pointer, so calls are made without
+	/// marshaling and without allocating; callers keep the memory fixed, usually on the stack. On .NET 7 and later
+	/// the stubs are generated by LibraryImport, and AKMGetConfig, which only copies a bounded amount of memory,
+	/// skips the GC transition. AKMProcess does not: removing a timed out node may allocate through mem_alloc,
+	/// whose hooks can run any code, and takes time linear in the number of nodes.
+	/// </summary>
+	public static unsafe partial class AkmNative
+	{
+		/// <summary>
+		/// Name of the C AKM library
+		/// </summary>
+		public const string LibraryName = "libakm";
+
+#if NET7_0_OR_GREATER
+		/// <summary>
+		/// Intializes AKM state machine based on provided parameters
+		/// </summary>
+		/// <param name="ctx">AKM processing context</param>
+		/// <param name="config">AKM configuration structure</param>
+		/// <returns>AKM status</returns>
+		[LibraryImport(LibraryName)]
+		[UnmanagedCallConv(CallConvs = new[] { typeof(CallConvCdecl) })]
+		public static partial AkmStatus AKMInit(AkmProcessCtx* ctx, AkmConfiguration* config);
+
+		/// <summary>
+		/// Runs the AKM state machine until its next command
+		/// </summary>
+		/// <param name="ctx">AKM processing context</param>
+		[LibraryImport(LibraryName)]
+		[UnmanagedCallConv(CallConvs = new[] { typeof(CallConvCdecl) })]
+		public static partial void AKMProcess(AkmProcessCtx* ctx);
+
+		/// <summary>
+		/// Frees up resources allocated for given relationship by unmanaged code
+		/// </summary>
+		/// <param name="relationship">pointer to AKM relationship</param>
+		[LibraryImport(LibraryName)]
+		[UnmanagedCallConv(CallConvs = new[] { typeof(CallConvCdecl) })]
+		public static partial void AKMFree(IntPtr relationship);
+
+		/// <summary>
+		/// Copies the configuration currently used by a relationship; PDV and address buffers left null are skipped
+		/// </summary>
+		/// <param name="relationship">pointer to AKM relationship</param>
+		/// <param name="config">configuration receiving the parameters and filling the buffers it points to</param>
+		[LibraryImport(LibraryName)]
+		[UnmanagedCallConv(CallConvs = new[] { typeof(CallConvCdecl) })]
+		[SuppressGCTransition]
+		public static partial void AKMGetConfig(IntPtr relationship, AkmConfiguration* config);
+#else
+		/// <summary>
+		/// Intializes AKM state machine based on provided parameters
+		/// </summary>
+		/// <param name="ctx">AKM processing context</param>
+		/// <param name="config">AKM configuration structure</param>
+		/// <returns>AKM status</returns>
+		[DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+		public static extern AkmStatus AKMInit(AkmProcessCtx* ctx, AkmConfiguration* config);
+
+		/// <summary>
+		/// Runs the AKM state machine until its next command
+		/// </summary>
+		/// <param name="ctx">AKM processing context</param>
+		[DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+		public static extern void AKMProcess(AkmProcessCtx* ctx);
+
+		/// <summary>
+		/// Frees up resources allocated for given relationship by unmanaged code
+		/// </summary>
+		/// <param name="relationship">pointer to AKM relationship</param>
+		[DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+		public static extern void AKMFree(IntPtr relationship);
+
+		/// <summary>
+		/// Copies the configuration currently used by a relationship; PDV and address buffers left null are skipped
+		/// </summary>
+		/// <param name="relationship">pointer to AKM relationship</param>
+		/// <param name="config">configuration receiving the parameters and filling the buffers it points to</param>
+		[DllImport(LibraryName, CallingConvention = CallingConvention.Cdecl)]
+		public static extern void AKMGetConfig(IntPtr relationship, AkmConfiguration* config);
+#endif
+	}
+}
@@ -5,14 +5,14 @@
 using AKMCommon.Enum;
 using AKMCommon.Struct;
 using System;
-using System.Runtime.InteropServices;
 
 namespace AKMInterface
 {
 	/// <summary>
-	/// Default implementation interface for C AKM library calls
+	/// Default implementation interface for C AKM library calls, taking references for callers that do not keep the
+	/// structures fixed; see AkmNative for the pointer-based calls they forward to
 	/// </summary>
-	public interface ICLibCalls
+	public unsafe interface ICLibCalls
 	{
 		/// <summary>
 		/// Intializes AKM state machine based on provided parameters
@@ -20,27 +20,45 @@ namespace AKMInterface
 		/// <param name="ctx">AKM processing context reference</param>
 		/// <param name="config">AKM configuration structure reference</param>
 		/// <returns></returns>
-		[DllImport("libakm", CallingConvention = CallingConvention.Cdecl)]
-		static extern AkmStatus AKMInit(ref AkmProcessCtx ctx, ref AkmConfiguration config);
+		static AkmStatus AKMInit(ref AkmProcessCtx ctx, ref AkmConfiguration config)
+		{
+			fixed (AkmProcessCtx* pCtx = &ctx)
+			fixed (AkmConfiguration* pConfig = &config)
+			{
+				return AkmNative.AKMInit(pCtx, pConfig);
+			}
+		}
 		/// <summary>
 		/// Processes AKM frame
 		/// </summary>
 		/// <param name="ctx">reference to AKM processing context</param>
-		[DllImport("libakm", CallingConvention = CallingConvention.Cdecl)]
-		static extern void AKMProcess(ref AkmProcessCtx ctx);
+		static void AKMProcess(ref AkmProcessCtx ctx)
+		{
+			fixed (AkmProcessCtx* pCtx = &ctx)
+			{
+				AkmNative.AKMProcess(pCtx);
+			}
+		}
 		/// <summary>
 		/// Frees up resources allocated for given relationship by unmanaged code
 		/// </summary>
 		/// <param name="relationship">pointer to AKM relationship</param>
-		[DllImport("libakm", CallingConvention = CallingConvention.Cdecl)]
-		static extern void AKMFree(IntPtr relationship);
+		static void AKMFree(IntPtr relationship)
+		{
+			AkmNative.AKMFree(relationship);
+		}
 
 		/// <summary>
 		/// Returns curently used AKM configuration
 		/// </summary>
 		/// <param name="relationship"></param>
 		/// <param name="config"></param>
-		[DllImport("libakm", CallingConvention = CallingConvention.Cdecl)]
-		static extern void AKMGetConfig(IntPtr relationship, ref AkmConfiguration config);
+		static void AKMGetConfig(IntPtr relationship, ref AkmConfiguration config)
+		{
+			fixed (AkmConfiguration* pConfig = &config)
+			{
+				AkmNative.AKMGetConfig(relationship, pConfig);
+			}
+		}
 	}
 }
@@ -3,6 +3,7 @@
  */
 
 using AKMCommon.Enum;
+using System;
 
 namespace AKMInterface
 {
@@ -72,6 +73,12 @@ namespace AKMInterface
 		/// </summary>
 		/// <returns>byte array with frame's source address</returns>
 		byte[] GetSourceAddressAsByteArray();
+		/// <summary>
+		/// Copies frame's source address without allocating
+		/// </summary>
+		/// <param name="destination">buffer for the address, at least as long as the address</param>
+		/// <returns>length of the address, 0 if the frame has none</returns>
+		int CopySourceAddress(Span<byte> destination);
 
 		/// <summary>
 		/// Gets frame's source address as a numeric short value
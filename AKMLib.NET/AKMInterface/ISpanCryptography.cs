@@ -0,0 +1,45 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using System;
+
+namespace AKMInterface
+{
+	/// <summary>
+	/// Cryptographic service provider working on caller supplied buffers.
+	/// Frames use these methods instead of the ICryptography ones when the provider implements them, so building,
+	/// encrypting, decrypting and checking a frame does not allocate intermediate arrays.
+	/// </summary>
+	public interface ISpanCryptography : ICryptography
+	{
+		/// <summary>
+		/// Length of the data Encrypt produces for given amount of plain data
+		/// </summary>
+		/// <param name="length">plain data length</param>
+		/// <returns>encrypted data length</returns>
+		int GetEncryptedLength(int length);
+		/// <summary>
+		/// Calculate hash for given data
+		/// </summary>
+		/// <param name="data">data to be hashed</param>
+		/// <param name="destination">buffer receiving HashLength bytes of hash value</param>
+		void CalculateHash(ReadOnlySpan<byte> data, Span<byte> destination);
+		/// <summary>
+		/// Decrypt given data using provided key
+		/// </summary>
+		/// <param name="dataToDecrypt">encrypted data</param>
+		/// <param name="key">byte array with key value for decryption</param>
+		/// <param name="destination">buffer receiving decrypted data, at least as long as dataToDecrypt</param>
+		/// <returns>number of bytes written to destination</returns>
+		int Decrypt(ReadOnlySpan<byte> dataToDecrypt, byte[] key, Span<byte> destination);
+		/// <summary>
+		/// Encrypt given data using provided key
+		/// </summary>
+		/// <param name="dataToEncrypt">data for encryption</param>
+		/// <param name="key">byte array with key value for encryption</param>
+		/// <param name="destination">buffer receiving GetEncryptedLength bytes of encrypted data</param>
+		/// <returns>number of bytes written to destination</returns>
+		int Encrypt(ReadOnlySpan<byte> dataToEncrypt, byte[] key, Span<byte> destination);
+	}
+}
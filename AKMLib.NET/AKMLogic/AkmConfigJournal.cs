@@ -0,0 +1,353 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Error;
+using AKMCommon.Struct;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+
+namespace AKMLogic
+{
+	/// <summary>
+	/// Persisted state of a single AKM Relationship
+	/// </summary>
+	public sealed class AkmConfigJournalEntry
+	{
+		/// <summary>
+		/// RelationshipId value
+		/// </summary>
+		public short RelationshipId { get; set; }
+		/// <summary>
+		/// Self Node Address value
+		/// </summary>
+		public byte SelfAddressValue { get; set; }
+		/// <summary>
+		/// Current configuration parameters (seeds, timeouts)
+		/// </summary>
+		public AkmConfigParams ConfigParams { get; set; }
+		/// <summary>
+		/// Current node addresses as returned by AKM library (N * SRNA bytes)
+		/// </summary>
+		public byte[] NodeAddresses { get; set; }
+		/// <summary>
+		/// Current keys, all of the same length
+		/// </summary>
+		public byte[][] Keys { get; set; }
+	}
+
+	/// <summary>
+	/// Append-only journal of AKM configuration changes kept in a memory mapped file.
+	/// Each change appends one checksummed record of the changed relationship only, replay keeps the latest record
+	/// per relationship and stops at the first torn or corrupted one. The file is compacted when superseded records
+	/// dominate it.
+	/// </summary>
+	public sealed class AkmConfigJournal : IDisposable
+	{
+		private const uint FILE_MAGIC = 0x4A4D4B41; // "AKMJ"
+		private const uint FILE_VERSION = 1;
+		private const int FILE_HEADER_SIZE = 8;
+		private const int RECORD_HEADER_SIZE = 8;   // payload length, payload CRC32
+		private const int RECORD_TERMINATOR_SIZE = 4;
+		private const int DEF_INITIAL_CAPACITY = 64 * 1024;
+		private const int DEF_COMPACTION_RATIO = 4;
+
+		private static readonly uint[] _crcTable = CreateCrcTable();
+
+		private readonly object _lock = new object();
+		private readonly string _path;
+		private readonly long _initialCapacity;
+		private readonly int _compactionRatio;
+		private readonly Dictionary<short, AkmConfigJournalEntry> _entries = new Dictionary<short, AkmConfigJournalEntry>();
+		private readonly Dictionary<short, long> _recordSizes = new Dictionary<short, long>();
+		private MemoryMappedFile _file;
+		private MemoryMappedViewAccessor _view;
+		private long _capacity;
+		private long _length;
+		private long _liveLength;
+
+		/// <summary>
+		/// Opens (or creates) the journal and replays it
+		/// </summary>
+		/// <param name="path">Journal file path</param>
+		/// <param name="initialCapacity">Initial size of the mapping in bytes, doubled when exhausted</param>
+		/// <param name="compactionRatio">Compaction is done when the journal is this many times larger than its live records</param>
+		public AkmConfigJournal(string path, long initialCapacity = DEF_INITIAL_CAPACITY, int compactionRatio = DEF_COMPACTION_RATIO)
+		{
+			_path = path;
+			_initialCapacity = Math.Max(initialCapacity, FILE_HEADER_SIZE + RECORD_TERMINATOR_SIZE);
+			_compactionRatio = Math.Max(compactionRatio, 2);
+
+			var fileLength = File.Exists(path) ? new FileInfo(path).Length : 0;
+			Map(Math.Max(fileLength, _initialCapacity));
+			Replay();
+		}
+
+		/// <summary>
+		/// Latest journaled state selected by RelationshipId value
+		/// </summary>
+		public IReadOnlyDictionary<short, AkmConfigJournalEntry> Entries => _entries;
+
+		/// <summary>
+		/// Number of bytes used by the journal
+		/// </summary>
+		public long Length => _length;
+
+		/// <summary>
+		/// Appends the state of a single relationship and flushes it to the file
+		/// </summary>
+		/// <param name="entry">Relationship state to persist</param>
+		public void Append(AkmConfigJournalEntry entry)
+		{
+			var payload = Serialize(entry);
+			var recordSize = RECORD_HEADER_SIZE + payload.Length;
+
+			lock (_lock)
+			{
+				var needed = _length + recordSize + RECORD_TERMINATOR_SIZE;
+				if (needed > _capacity)
+				{
+					var capacity = _capacity * 2;
+					while (capacity < needed)
+						capacity *= 2;
+					Remap(capacity);
+				}
+
+				// The terminator goes first so a torn record never runs into stale bytes
+				_view.Write(_length + recordSize, 0u);
+				_view.WriteArray(_length + RECORD_HEADER_SIZE, payload, 0, payload.Length);
+				_view.Write(_length + 4, Crc32(payload));
+				_view.Write(_length, (uint)payload.Length);
+				_view.Flush();
+
+				_length += recordSize;
+				Track(entry, recordSize);
+
+				if (_length > _initialCapacity / 2 && _length - FILE_HEADER_SIZE > _liveLength * _compactionRatio)
+					CompactLocked();
+			}
+		}
+
+		/// <summary>
+		/// Rewrites the journal keeping only the latest record of each relationship
+		/// </summary>
+		public void Compact()
+		{
+			lock (_lock)
+			{
+				CompactLocked();
+			}
+		}
+
+		/// <summary>
+		/// Releases the file mapping
+		/// </summary>
+		public void Dispose()
+		{
+			lock (_lock)
+			{
+				Unmap();
+			}
+		}
+
+		private void CompactLocked()
+		{
+			var tempPath = _path + ".compact";
+			var capacity = Math.Max(_initialCapacity, (FILE_HEADER_SIZE + _liveLength + RECORD_TERMINATOR_SIZE) * 2);
+
+			using (var stream = new FileStream(tempPath, FileMode.Create, FileAccess.Write, FileShare.None))
+			using (var writer = new BinaryWriter(stream))
+			{
+				writer.Write(FILE_MAGIC);
+				writer.Write(FILE_VERSION);
+				foreach (var entry in _entries.Values)
+				{
+					var payload = Serialize(entry);
+					writer.Write((uint)payload.Length);
+					writer.Write(Crc32(payload));
+					writer.Write(payload);
+				}
+				writer.Flush();
+				stream.SetLength(capacity);
+				stream.Flush(true);
+			}
+
+			Unmap();
+			File.Replace(tempPath, _path, null);
+			Map(capacity);
+
+			_length = FILE_HEADER_SIZE + _liveLength;
+		}
+
+		private void Replay()
+		{
+			var magic = _view.ReadUInt32(0);
+			if (magic == 0)
+			{
+				_view.Write(0, FILE_MAGIC);
+				_view.Write(4, FILE_VERSION);
+				_view.Flush();
+			}
+			else if (magic != FILE_MAGIC || _view.ReadUInt32(4) != FILE_VERSION)
+			{
+				throw new AkmError(AKMCommon.Enum.AkmStatus.FatalError, $"Invalid AKM configuration journal {_path}.");
+			}
+
+			long position = FILE_HEADER_SIZE;
+			while (position + RECORD_HEADER_SIZE <= _capacity)
+			{
+				var payloadLength = _view.ReadUInt32(position);
+				if (payloadLength == 0 || position + RECORD_HEADER_SIZE + payloadLength > _capacity)
+					break;
+
+				var payload = new byte[payloadLength];
+				_view.ReadArray(position + RECORD_HEADER_SIZE, payload, 0, payload.Length);
+				if (_view.ReadUInt32(position + 4) != Crc32(payload))
+					break;
+
+				var recordSize = RECORD_HEADER_SIZE + payloadLength;
+				Track(Deserialize(payload), recordSize);
+				position += recordSize;
+			}
+
+			_length = position;
+		}
+
+		private void Track(AkmConfigJournalEntry entry, long recordSize)
+		{
+			if (_recordSizes.TryGetValue(entry.RelationshipId, out var previousSize))
+				_liveLength -= previousSize;
+
+			_entries[entry.RelationshipId] = entry;
+			_recordSizes[entry.RelationshipId] = recordSize;
+			_liveLength += recordSize;
+		}
+
+		private void Map(long capacity)
+		{
+			_file = MemoryMappedFile.CreateFromFile(_path, FileMode.OpenOrCreate, null, capacity, MemoryMappedFileAccess.ReadWrite);
+			_view = _file.CreateViewAccessor(0, capacity, MemoryMappedFileAccess.ReadWrite);
+			_capacity = capacity;
+		}
+
+		private void Remap(long capacity)
+		{
+			Unmap();
+			Map(capacity);
+		}
+
+		private void Unmap()
+		{
+			_view?.Dispose();
+			_file?.Dispose();
+			_view = null;
+			_file = null;
+		}
+
+		private static byte[] Serialize(AkmConfigJournalEntry entry)
+		{
+			var nodes = entry.NodeAddresses ?? Array.Empty<byte>();
+			var keys = entry.Keys ?? Array.Empty<byte[]>();
+			var keyLength = keys.Length > 0 ? keys[0].Length : 0;
+
+			using (var stream = new MemoryStream())
+			using (var writer = new BinaryWriter(stream))
+			{
+				var p = entry.ConfigParams;
+				writer.Write(entry.RelationshipId);
+				writer.Write(entry.SelfAddressValue);
+				writer.Write(p.SK);
+				writer.Write(p.SRNA);
+				writer.Write(p.N);
+				writer.Write(p.CSS);
+				writer.Write(p.NSS);
+				writer.Write(p.FSS);
+				writer.Write(p.NFSS);
+				writer.Write(p.SFSS);
+				writer.Write(p.NSFSS);
+				writer.Write(p.EFSS);
+				writer.Write(p.NNRT);
+				writer.Write(p.NSET);
+				writer.Write(p.FBSET);
+				writer.Write(p.FSSET);
+				writer.Write((ushort)nodes.Length);
+				writer.Write(nodes);
+				writer.Write((byte)keys.Length);
+				writer.Write((byte)keyLength);
+				foreach (var key in keys)
+				{
+					if (key.Length != keyLength)
+						throw new ArgumentException("All keys must be of the same length.");
+					writer.Write(key);
+				}
+				writer.Flush();
+				return stream.ToArray();
+			}
+		}
+
+		private static AkmConfigJournalEntry Deserialize(byte[] payload)
+		{
+			using (var reader = new BinaryReader(new MemoryStream(payload)))
+			{
+				var entry = new AkmConfigJournalEntry
+				{
+					RelationshipId = reader.ReadInt16(),
+					SelfAddressValue = reader.ReadByte(),
+					ConfigParams = new AkmConfigParams
+					{
+						SK = reader.ReadByte(),
+						SRNA = reader.ReadByte(),
+						N = reader.ReadUInt16(),
+						CSS = reader.ReadUInt32(),
+						NSS = reader.ReadUInt32(),
+						FSS = reader.ReadUInt32(),
+						NFSS = reader.ReadUInt32(),
+						SFSS = reader.ReadUInt32(),
+						NSFSS = reader.ReadUInt32(),
+						EFSS = reader.ReadUInt32(),
+						NNRT = reader.ReadInt64(),
+						NSET = reader.ReadInt64(),
+						FBSET = reader.ReadInt64(),
+						FSSET = reader.ReadInt64()
+					}
+				};
+				entry.NodeAddresses = reader.ReadBytes(reader.ReadUInt16());
+				var keyCount = reader.ReadByte();
+				var keyLength = reader.ReadByte();
+				entry.Keys = new byte[keyCount][];
+				for (int i = 0; i < keyCount; i++)
+				{
+					entry.Keys[i] = reader.ReadBytes(keyLength);
+				}
+				return entry;
+			}
+		}
+
+		private static uint[] CreateCrcTable()
+		{
+			var table = new uint[256];
+			for (uint i = 0; i < table.Length; i++)
+			{
+				var crc = i;
+				for (int bit = 0; bit < 8; bit++)
+				{
+					crc = (crc & 1) != 0 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+				}
+				table[i] = crc;
+			}
+			return table;
+		}
+
+		private static uint Crc32(byte[] data)
+		{
+			var crc = 0xFFFFFFFFu;
+			foreach (var b in data)
+			{
+				crc = _crcTable[(crc ^ b) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+	}
+}
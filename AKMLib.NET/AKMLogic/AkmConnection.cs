@@ -0,0 +1,257 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using Microsoft.Extensions.Logging;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Net.Sockets;
+using System.Threading;
+
+namespace AKMLogic
+{
+	/// <summary>
+	/// Connection to a peer shared by the Senders of all relationships with that peer.
+	/// Frames carry their RelationshipId, so a single socket and a single writer thread serve any number of
+	/// relationships; each Sender keeps its own bounded queue and the writer takes one frame of every relationship
+	/// in turn, so a relationship with a backlog only slows down itself.
+	/// </summary>
+	public sealed class AkmConnection
+	{
+		private const int MAX_BATCH_FRAMES = 64;
+		private const int MAX_BATCH_BYTES = 256 * 1024;
+		private const int IDLE_WAIT_MS = 100;
+
+		private readonly Socket _socket;
+		private readonly ILogger _logger;
+		private readonly Thread _thread;
+		private readonly ManualResetEventSlim _dataReady = new ManualResetEventSlim(false);
+		private readonly long _latencyBudgetTicks;
+		private readonly object _sendersLock = new object();
+		private Sender[] _senders = Array.Empty<Sender>();
+		private int _nextSender;
+		private CancellationToken _cancellationToken;
+
+		/// <summary>
+		/// Constructor, starts the writer thread
+		/// </summary>
+		/// <param name="socket">Connected socket</param>
+		/// <param name="logger">ILogger implementation</param>
+		/// <param name="latencyBudget">Time in microseconds the writer may wait for more frames to send them in one write</param>
+		public AkmConnection(Socket socket, ILogger logger, int latencyBudget = 0)
+		{
+			_socket = socket;
+			_logger = logger;
+			_latencyBudgetTicks = latencyBudget * Stopwatch.Frequency / 1000000;
+			_thread = new Thread(Run);
+			_thread.Start();
+		}
+
+		/// <summary>
+		/// Socket used by this connection
+		/// </summary>
+		public Socket Socket => _socket;
+
+		/// <summary>
+		/// Number of Senders sharing this connection
+		/// </summary>
+		public int SenderCount => Volatile.Read(ref _senders).Length;
+
+		/// <summary>
+		/// Returns value indicating if the writer thread is still running
+		/// </summary>
+		public bool IsRunning => _thread.IsAlive;
+
+		/// <summary>
+		/// Returns value indicating if the writer thread is running and the socket is usable
+		/// </summary>
+		public bool IsActive => IsRunning && IsConnectionAlive;
+
+		private bool IsConnectionAlive
+		{
+			get
+			{
+				if (_socket != null)
+				{
+					//a socket that is not writeable only has a full send buffer, the blocking Send waits for the peer to read
+					//and fails itself on a lost connection
+					try
+					{
+						return !_socket.Poll(1, SelectMode.SelectError);
+					}
+					catch (ObjectDisposedException)
+					{
+						return false;
+					}
+				}
+				return false;
+			}
+		}
+
+		internal void SetCancellationToken(CancellationToken token)
+		{
+			_cancellationToken = token;
+		}
+
+		internal void Register(Sender sender)
+		{
+			lock (_sendersLock)
+			{
+				var senders = new Sender[_senders.Length + 1];
+				Array.Copy(_senders, senders, _senders.Length);
+				senders[_senders.Length] = sender;
+				Volatile.Write(ref _senders, senders);
+			}
+		}
+
+		internal void Unregister(Sender sender)
+		{
+			lock (_sendersLock)
+			{
+				var index = Array.IndexOf(_senders, sender);
+				if (index < 0)
+					return;
+
+				var senders = new Sender[_senders.Length - 1];
+				Array.Copy(_senders, 0, senders, 0, index);
+				Array.Copy(_senders, index + 1, senders, index, senders.Length - index);
+				Volatile.Write(ref _senders, senders);
+			}
+		}
+
+		/// <summary>
+		/// Wakes the writer thread up after a frame was queued
+		/// </summary>
+		internal void Signal()
+		{
+			if (!_dataReady.IsSet)
+				_dataReady.Set();
+		}
+
+		private bool HasPendingFrames()
+		{
+			foreach (var sender in Volatile.Read(ref _senders))
+			{
+				if (!sender.Lanes.IsEmpty)
+					return true;
+			}
+			return false;
+		}
+
+		private void SignalSent()
+		{
+			foreach (var sender in Volatile.Read(ref _senders))
+				sender.SignalSent();
+		}
+
+		/// <summary>
+		/// Starts writer thread
+		/// </summary>
+		private void Run()
+		{
+			var batch = new List<ArraySegment<byte>>(MAX_BATCH_FRAMES);
+
+			while (!_cancellationToken.IsCancellationRequested)
+			{
+				//reset before checking the queues so a frame queued in between still wakes us up
+				_dataReady.Reset();
+				if (!HasPendingFrames())
+				{
+					//an idle writer ends with its socket, it would otherwise keep the process alive after the socket was closed
+					if (!_dataReady.Wait(IDLE_WAIT_MS) && (_socket == null || _socket.SafeHandle.IsClosed))
+						return;
+					continue;
+				}
+
+				if (IsConnectionAlive)
+				{
+					CollectBatch(batch);
+					//a producer that has claimed a queue slot but not yet written it makes the queue look non-empty
+					if (batch.Count == 0)
+						continue;
+					try
+					{
+						_socket.Send(batch);
+						SignalSent();
+					}
+					catch (SocketException sockEx)
+					{
+						_logger?.LogError($"Unable to connect to remote address. {sockEx}");
+						return;
+					}
+					catch (ObjectDisposedException disposedEx)
+					{
+						_logger?.LogError($"Unable to connect to remote address. {disposedEx}");
+						return;
+					}
+					finally
+					{
+						batch.Clear();
+					}
+				}
+				else
+				{
+					_logger?.LogError("Unable to connect to remote address. Sender process will now close.");
+					if (_socket != null)
+					{
+						if (_socket.Connected)
+						{
+							_socket.Shutdown(SocketShutdown.Both);
+							_socket.Disconnect(true);
+						}
+						_socket.Dispose();
+					}
+					return;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Takes queued frames for a single write, waiting up to the latency budget for more of them
+		/// </summary>
+		/// <param name="batch">List receiving the frames</param>
+		private void CollectBatch(List<ArraySegment<byte>> batch)
+		{
+			var batchBytes = 0;
+			var deadline = Stopwatch.GetTimestamp() + _latencyBudgetTicks;
+
+			while (batch.Count < MAX_BATCH_FRAMES && batchBytes < MAX_BATCH_BYTES)
+			{
+				if (TakeRound(batch, ref batchBytes))
+					continue;
+
+				var remaining = deadline - Stopwatch.GetTimestamp();
+				if (remaining <= 0 || _cancellationToken.IsCancellationRequested)
+					break;
+
+				_dataReady.Reset();
+				if (!HasPendingFrames())
+					_dataReady.Wait(TimeSpan.FromTicks(remaining * TimeSpan.TicksPerSecond / Stopwatch.Frequency));
+			}
+		}
+
+		/// <summary>
+		/// Takes at most one frame of every Sender, starting one Sender further than the previous round
+		/// </summary>
+		/// <returns>False if no Sender had a frame</returns>
+		private bool TakeRound(List<ArraySegment<byte>> batch, ref int batchBytes)
+		{
+			var senders = Volatile.Read(ref _senders);
+			var taken = false;
+
+			for (int i = 0; i < senders.Length && batch.Count < MAX_BATCH_FRAMES && batchBytes < MAX_BATCH_BYTES; i++)
+			{
+				if (senders[(_nextSender + i) % senders.Length].Lanes.TryDequeue(out var frame))
+				{
+					batch.Add(new ArraySegment<byte>(frame));
+					batchBytes += frame.Length;
+					taken = true;
+				}
+			}
+			_nextSender = senders.Length > 0 ? (_nextSender + 1) % senders.Length : 0;
+
+			return taken;
+		}
+	}
+}
@@ -4,17 +4,104 @@
 
 using AKMInterface;
 using System;
+using System.Collections.Generic;
 using System.IO;
 using System.Security.Cryptography;
 
 namespace AKMLogic
 {
 	/// <summary>
-	/// Default cryptographic service provider for encryption, decryption and hash value checks
+	/// Default cryptographic service provider for encryption, decryption and hash value checks.
+	/// Encrypted data is the IV block followed by the AES-CBC ciphertext of the data, the IV is random for every
+	/// encryption so equal data does not give equal frames. Up to KEY_CACHE_SIZE keys per thread keep their AES
+	/// instance; on .NET 6 and later frames are then encrypted and decrypted with one-shot CBC calls into the buffers
+	/// of the frames. Cached key copies are wiped when evicted, when their thread is gone and on ClearKeyCache.
 	/// </summary>
-	public class AkmCrypto : ICryptography, IDisposable
+	public class AkmCrypto : ISpanCryptography, IDisposable
 	{
+		private const int AES_BLOCK_SIZE = 16;
+		private const int KEY_CACHE_SIZE = 4;
+
 		private SHA256 _sha256;
+#if NET6_0_OR_GREATER
+		/// <summary>
+		/// AES instance keyed for one key
+		/// </summary>
+		private sealed class KeyedCipher
+		{
+			public byte[] Key;
+			public Aes Aes;
+
+			/// <summary>
+			/// Wipes the key copy and releases the keyed AES instance
+			/// </summary>
+			public void Clear()
+			{
+				CryptographicOperations.ZeroMemory(Key);
+				Aes.Dispose();
+			}
+		}
+
+		/// <summary>
+		/// Keys in use on one thread, the relationship keys rotate so the oldest entry is replaced. Only its own thread
+		/// uses a cache, the lock on it is there for ClearKeyCache called on another thread.
+		/// </summary>
+		private sealed class CipherCache
+		{
+			private readonly KeyedCipher[] _entries = new KeyedCipher[KEY_CACHE_SIZE];
+			private int _next;
+
+			/// <summary>
+			/// Returns the AES instance for given key, keying a new one in place of the oldest if the key is not cached.
+			/// Callers hold the lock on the cache while they use the instance.
+			/// </summary>
+			public KeyedCipher Get(byte[] key)
+			{
+				foreach (var cached in _entries)
+				{
+					if (cached != null && cached.Key.AsSpan().SequenceEqual(key))
+						return cached;
+				}
+
+				var aes = Aes.Create();
+				aes.Key = key;
+				var cipher = new KeyedCipher
+				{
+					Key = (byte[])key.Clone(),
+					Aes = aes
+				};
+				_entries[_next]?.Clear();
+				_entries[_next] = cipher;
+				_next = (_next + 1) % KEY_CACHE_SIZE;
+				return cipher;
+			}
+
+			/// <summary>
+			/// Wipes all entries
+			/// </summary>
+			public void Clear()
+			{
+				for (int i = 0; i < _entries.Length; i++)
+				{
+					_entries[i]?.Clear();
+					_entries[i] = null;
+				}
+			}
+
+			/// <summary>
+			/// Wipes the keys of a thread that has ended
+			/// </summary>
+			~CipherCache()
+			{
+				Clear();
+			}
+		}
+
+		[ThreadStatic]
+		private static CipherCache _cipherCache;
+		//caches of all threads, for ClearKeyCache; the references are weak so caches of ended threads get finalized
+		private static readonly List<WeakReference<CipherCache>> _cipherCaches = new List<WeakReference<CipherCache>>();
+#endif
 		/// <inheritDoc/>
 		public int KeySize { get; } = 256;
 		/// <inheritDoc/>
@@ -53,22 +140,26 @@ namespace AKMLogic
 #if SKIP_ENCRYPTION
                 return dataToEncrypt;
 #else
-
-
-			using var rij = new RijndaelManaged
+#if NET6_0_OR_GREATER
+			if (BlockSize == AES_BLOCK_SIZE * 8)
 			{
-				BlockSize = BlockSize,
-				Padding = PaddingMode.PKCS7,
-				Key = key
-			};
+				var result = new byte[GetEncryptedLength(dataToEncrypt.Length)];
+				Encrypt(dataToEncrypt, key, result);
+				return result;
+			}
+#endif
+			using var rij = CreateLegacyCipher();
+			rij.BlockSize = BlockSize;
+			rij.Padding = PaddingMode.PKCS7;
+			rij.Key = key;
 			rij.GenerateIV();
 
 			ICryptoTransform encryptor = rij.CreateEncryptor(rij.Key, rij.IV);
 
 			using var memoryStream = new MemoryStream();
+			memoryStream.Write(rij.IV, 0, rij.IV.Length);
 			using (var cryptoStream = new CryptoStream(memoryStream, encryptor, CryptoStreamMode.Write))
 			{
-				cryptoStream.Write(rij.IV, 0, rij.IV.Length);
 				cryptoStream.Write(dataToEncrypt, 0, dataToEncrypt.Length);
 			}
 
@@ -81,6 +172,18 @@ namespace AKMLogic
 #if SKIP_ENCRYPTION
                 return dataToDecrypt;
 #else
+#if NET6_0_OR_GREATER
+			if (BlockSize == AES_BLOCK_SIZE * 8)
+			{
+				if (dataToDecrypt.Length < 2 * AES_BLOCK_SIZE)
+					throw new CryptographicException("Encrypted data is shorter than two blocks");
+				var cache = GetCipherCache();
+				lock (cache)
+				{
+					return cache.Get(key).Aes.DecryptCbc(dataToDecrypt.AsSpan(AES_BLOCK_SIZE), dataToDecrypt.AsSpan(0, AES_BLOCK_SIZE), PaddingMode.PKCS7);
+				}
+			}
+#endif
 			using var aes = Aes.Create();
 			aes.KeySize = KeySize;
 			aes.BlockSize = BlockSize;
@@ -103,7 +206,132 @@ namespace AKMLogic
 		/// <inheritDoc/>
 		public byte[] CalculateHash(byte[] data)
 		{
+#if NET5_0_OR_GREATER
+			return SHA256.HashData(data);
+#else
 			return _sha256.ComputeHash(data);
+#endif
+		}
+		/// <inheritDoc/>
+		public int GetEncryptedLength(int length)
+		{
+#if SKIP_ENCRYPTION
+			return length;
+#else
+			var blockSize = BlockSize / 8;
+			return blockSize + (length / blockSize + 1) * blockSize;
+#endif
+		}
+		/// <inheritDoc/>
+		public void CalculateHash(ReadOnlySpan<byte> data, Span<byte> destination)
+		{
+#if NET5_0_OR_GREATER
+			SHA256.HashData(data, destination);
+#else
+			if (!_sha256.TryComputeHash(data, destination, out _))
+				throw new ArgumentException("Destination is shorter than the hash value", nameof(destination));
+#endif
+		}
+		/// <inheritDoc/>
+		public int Encrypt(ReadOnlySpan<byte> dataToEncrypt, byte[] key, Span<byte> destination)
+		{
+#if SKIP_ENCRYPTION
+			dataToEncrypt.CopyTo(destination);
+			return dataToEncrypt.Length;
+#else
+#if NET6_0_OR_GREATER
+			if (BlockSize == AES_BLOCK_SIZE * 8)
+			{
+				var iv = destination.Slice(0, AES_BLOCK_SIZE);
+				RandomNumberGenerator.Fill(iv);
+				var cache = GetCipherCache();
+				lock (cache)
+				{
+					return AES_BLOCK_SIZE + cache.Get(key).Aes.EncryptCbc(dataToEncrypt, iv, destination.Slice(AES_BLOCK_SIZE), PaddingMode.PKCS7);
+				}
+			}
+#endif
+			return CopyTo(Encrypt(dataToEncrypt.ToArray(), key), destination);
+#endif
+		}
+		/// <inheritDoc/>
+		public int Decrypt(ReadOnlySpan<byte> dataToDecrypt, byte[] key, Span<byte> destination)
+		{
+#if SKIP_ENCRYPTION
+			dataToDecrypt.CopyTo(destination);
+			return dataToDecrypt.Length;
+#else
+#if NET6_0_OR_GREATER
+			if (BlockSize == AES_BLOCK_SIZE * 8)
+			{
+				if (dataToDecrypt.Length < 2 * AES_BLOCK_SIZE)
+					throw new CryptographicException("Encrypted data is shorter than two blocks");
+				var cache = GetCipherCache();
+				lock (cache)
+				{
+					return cache.Get(key).Aes.DecryptCbc(dataToDecrypt.Slice(AES_BLOCK_SIZE), dataToDecrypt.Slice(0, AES_BLOCK_SIZE), destination, PaddingMode.PKCS7);
+				}
+			}
+#endif
+			return CopyTo(Decrypt(dataToDecrypt.ToArray(), key), destination);
+#endif
+		}
+
+		private static SymmetricAlgorithm CreateLegacyCipher()
+		{
+#if NET6_0_OR_GREATER
+			//RijndaelManaged is obsolete there and takes no other block size than Aes anyway
+			return Aes.Create();
+#else
+			return new RijndaelManaged();
+#endif
+		}
+
+		private static int CopyTo(byte[] data, Span<byte> destination)
+		{
+			data.CopyTo(destination);
+			return data.Length;
+		}
+
+#if NET6_0_OR_GREATER
+		/// <summary>
+		/// Returns the cipher cache of this thread, registering it for ClearKeyCache when it is created
+		/// </summary>
+		private static CipherCache GetCipherCache()
+		{
+			var cache = _cipherCache;
+			if (cache == null)
+			{
+				cache = _cipherCache = new CipherCache();
+				lock (_cipherCaches)
+				{
+					_cipherCaches.RemoveAll(reference => !reference.TryGetTarget(out _));
+					_cipherCaches.Add(new WeakReference<CipherCache>(cache));
+				}
+			}
+			return cache;
+		}
+#endif
+		/// <summary>
+		/// Wipes the keys cached by all threads and releases their AES instances, so keys of a freed relationship do
+		/// not outlive it. Keys still in use are cached again on their next use.
+		/// </summary>
+		public static void ClearKeyCache()
+		{
+#if NET6_0_OR_GREATER
+			lock (_cipherCaches)
+			{
+				foreach (var reference in _cipherCaches)
+				{
+					if (!reference.TryGetTarget(out var cache))
+						continue;
+					lock (cache)
+					{
+						cache.Clear();
+					}
+				}
+			}
+#endif
 		}
 		/// <inheritDoc/>
 		protected virtual void Dispose(bool disposing)
@@ -6,19 +6,31 @@ using AKMCommon.Enum;
 using AKMInterface;
 using Microsoft.Extensions.Logging;
 using System;
+using System.Buffers;
 using System.Text;
 
 namespace AKMLogic
 {
 	/// <summary>
-	/// Default IDecryptedFrame implementation
+	/// Default IDecryptedFrame implementation.
+	/// Frame bytes live in a buffer rented from the shared array pool, which grows in place as content and hash are
+	/// added. Dispose hands the frame, buffer included, back to a per thread spare slot used by Rent, or returns the
+	/// buffer to the pool; a disposed frame must not be used anymore. Buffers go back to the pool cleared, they held
+	/// decrypted content.
 	/// </summary>
-	public class AkmDecryptedFrame : IDecryptedFrame
+	public class AkmDecryptedFrame : IDecryptedFrame, IDisposable
 	{
-		private byte[] _frameBytes;
-		private readonly ICryptography _crypto;
+		private const int MIN_BUFFER_SIZE = 256;
+		private const int MAX_SPARE_BUFFER_SIZE = 64 * 1024;
 
-		private readonly ILogger _logger;
+		[ThreadStatic]
+		private static AkmDecryptedFrame _spare;
+
+		private byte[] _frameBytes = Array.Empty<byte>();
+		private int _length;
+		private ICryptography _crypto;
+
+		private ILogger _logger;
 		private short _relationshipId;
 		private bool _hashAdded;
 
@@ -33,8 +45,7 @@ namespace AKMLogic
 			private set
 			{
 				_relationshipId = value;
-				var relIdBytes = BitConverter.GetBytes(value);
-				Array.Copy(relIdBytes, 0, _frameBytes, AkmSetup.AkmAppCfg[value].FrameSchema.RelationshipId_Index, sizeof(short));
+				BitConverter.TryWriteBytes(_frameBytes.AsSpan(AkmSetup.AkmAppCfg[value].FrameSchema.RelationshipId_Index, sizeof(short)), value);
 			}
 		}
 		/// <inheritdoc/>
@@ -43,14 +54,51 @@ namespace AKMLogic
 			get { return (AkmEvent)_frameBytes[AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.AkmEvent_Index]; }
 		}
 
+		/// <summary>
+		/// Number of bytes in the frame
+		/// </summary>
+		public int Length => _length;
+
 		/// <inheritdoc/>
 		public AkmDecryptedFrame(ICryptography cryptographyProvider, ILogger logger, short relationshipId)
 		{
 			_crypto = cryptographyProvider;
 			_logger = logger;
-			_frameBytes = new byte[AkmSetup.AkmAppCfg[relationshipId].FrameSchema.AkmDataStart_Index]; //sets the minimun length of an empty frame
+			Reset(relationshipId);
+		}
+
+		/// <summary>
+		/// Returns an empty frame, reusing the one last disposed on this thread if there is one
+		/// </summary>
+		/// <param name="cryptographyProvider">Object implementing ICryptography interface</param>
+		/// <param name="logger">Object implementing ILogger interface</param>
+		/// <param name="relationshipId">Relationship Id numeric value</param>
+		public static AkmDecryptedFrame Rent(ICryptography cryptographyProvider, ILogger logger, short relationshipId)
+		{
+			var frame = _spare;
+			if (frame == null)
+				return new AkmDecryptedFrame(cryptographyProvider, logger, relationshipId);
+
+			_spare = null;
+			frame._crypto = cryptographyProvider;
+			frame._logger = logger;
+			frame.Reset(relationshipId);
+			return frame;
+		}
+
+		/// <summary>
+		/// Empties the frame so it can be filled again, keeping its buffer
+		/// </summary>
+		/// <param name="relationshipId">Relationship Id numeric value</param>
+		public void Reset(short relationshipId)
+		{
+			var minLength = AkmSetup.AkmAppCfg[relationshipId].FrameSchema.AkmDataStart_Index; //sets the minimun length of an empty frame
+			_length = 0;
+			Resize(minLength);
+			_hashAdded = false;
 			RelationshipId = relationshipId;
 		}
+
 		/// <inheritdoc/>
 		public IEncryptedFrame Encrypt(IKey key)
 		{
@@ -60,7 +108,10 @@ namespace AKMLogic
 				SetContentHash();
 			}
 
-			result.SetEncryptedData(_crypto.Encrypt(GetFrameBytesForEncryption(), key.KeyAsBytes));
+			if (_crypto is ISpanCryptography spanCrypto)
+				result.SetEncryptedData(spanCrypto, FrameSpanForEncryption(), key.KeyAsBytes);
+			else
+				result.SetEncryptedData(_crypto.Encrypt(GetFrameBytesForEncryption(), key.KeyAsBytes));
 
 			return result;
 		}
@@ -72,23 +123,37 @@ namespace AKMLogic
 		/// <inheritdoc/>
 		public void SetContent(byte[] contentBytes)
 		{
-			var targetLength = contentBytes.Length + AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.AkmDataStart_Index;
-			if (_frameBytes.Length != targetLength)
-			{
-				Array.Resize(ref _frameBytes, targetLength);
-			}
-			Array.Copy(contentBytes, 0, _frameBytes, AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.AkmDataStart_Index, contentBytes.Length);
+			SetContent(contentBytes.AsSpan());
+		}
+		/// <summary>
+		/// Sets frame content
+		/// </summary>
+		/// <param name="contentBytes">content to be copied into the frame</param>
+		public void SetContent(ReadOnlySpan<byte> contentBytes)
+		{
+			var dataStart = AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.AkmDataStart_Index;
+			Resize(contentBytes.Length + dataStart);
+			contentBytes.CopyTo(_frameBytes.AsSpan(dataStart));
 			_hashAdded = false;
 		}
 		/// <inheritdoc/>
 		public void SetData(byte[] frameData)
 		{
-			var targetLength = frameData.Length + AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length;
-			if (_frameBytes.Length != targetLength)
-			{
-				Array.Resize(ref _frameBytes, targetLength);
-			}
-			Array.Copy(frameData, 0, _frameBytes, AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length, frameData.Length);
+			var relIdLength = AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length;
+			Resize(frameData.Length + relIdLength);
+			Array.Copy(frameData, 0, _frameBytes, relIdLength, frameData.Length);
+		}
+		/// <summary>
+		/// Fills the frame, after the relationship id, with decrypted data
+		/// </summary>
+		/// <param name="crypto">Cryptographic service provider</param>
+		/// <param name="encryptedData">encrypted part of AKM frame</param>
+		/// <param name="key">byte array with key value for decryption</param>
+		internal void SetDecryptedData(ISpanCryptography crypto, ReadOnlySpan<byte> encryptedData, byte[] key)
+		{
+			var relIdLength = AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length;
+			Reserve(relIdLength + encryptedData.Length);
+			_length = relIdLength + crypto.Decrypt(encryptedData, key, _frameBytes.AsSpan(relIdLength));
 		}
 
 		/// <inheritdoc/>
@@ -119,6 +184,13 @@ namespace AKMLogic
 			return _frameBytes.AsSpan(AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.SourceAddress_Index, AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.SourceAddress_Length).ToArray();
 		}
 		/// <inheritdoc/>
+		public int CopySourceAddress(Span<byte> destination)
+		{
+			var address = _frameBytes.AsSpan(AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.SourceAddress_Index, AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.SourceAddress_Length);
+			address.CopyTo(destination);
+			return address.Length;
+		}
+		/// <inheritdoc/>
 		public byte[] GetTargetAddressAsByteArray()
 		{
 			return _frameBytes.AsSpan(AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.TargetAddress_Index, AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.TargetAddress_Length).ToArray();
@@ -126,20 +198,26 @@ namespace AKMLogic
 		/// <inheritdoc/>
 		public byte[] GetFrameBytes()
 		{
-			return _frameBytes;
+			return FrameSpan.ToArray();
 		}
+		/// <summary>
+		/// Frame bytes, valid until the frame is changed or disposed
+		/// </summary>
+		public ReadOnlySpan<byte> FrameSpan => _frameBytes.AsSpan(0, _length);
 		/// <inheritdoc/>
 		public byte[] GetFrameBytesForEncryption()
 		{
-			byte[] forEncryption = new byte[_frameBytes.Length - AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length];
-			Array.Copy(_frameBytes, AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Index + AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length, forEncryption, 0, forEncryption.Length);
-			return forEncryption;
+			return FrameSpanForEncryption().ToArray();
 		}
 		/// <inheritdoc/>
 		public byte[] GetContentBytes()
 		{
-			return _frameBytes.AsSpan(AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.AkmDataStart_Index, _frameBytes.Length - _crypto.HashLength - AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.AkmDataStart_Index).ToArray();
+			return ContentSpan.ToArray();
 		}
+		/// <summary>
+		/// Frame content, valid until the frame is changed or disposed
+		/// </summary>
+		public ReadOnlySpan<byte> ContentSpan => _frameBytes.AsSpan(AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.AkmDataStart_Index, _length - _crypto.HashLength - AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.AkmDataStart_Index);
 		/// <inheritdoc/>
 		public short GetSourceAddressAsShort()
 		{
@@ -153,19 +231,14 @@ namespace AKMLogic
 		/// <inheritdoc/>
 		public void SetContentHash()
 		{
-			byte[] hashed;
-			var oldLength = _frameBytes.Length;
+			var hashLength = _crypto.HashLength;
+			var dataLength = _hashAdded ? _length - hashLength : _length;
 			if (!_hashAdded)
 			{
-				hashed = _crypto.CalculateHash(_frameBytes);
-				Array.Resize<byte>(ref _frameBytes, _frameBytes.Length + hashed.Length);
-			}
-			else
-			{
-				hashed = _crypto.CalculateHash(_frameBytes.AsSpan(0, _frameBytes.Length - _crypto.HashLength).ToArray());
+				Resize(_length + hashLength);
 			}
 
-			Array.Copy(hashed, 0, _frameBytes, oldLength, hashed.Length);
+			CalculateHash(_frameBytes.AsSpan(0, dataLength), _frameBytes.AsSpan(dataLength, hashLength));
 			_hashAdded = true;
 		}
 		/// <inheritdoc/>
@@ -173,14 +246,14 @@ namespace AKMLogic
 		{
 			if (!_hashAdded) return string.Empty;
 
-			return Encoding.UTF8.GetString(_frameBytes.AsSpan(_frameBytes.Length - _crypto.HashLength));
+			return Encoding.UTF8.GetString(_frameBytes.AsSpan(_length - _crypto.HashLength, _crypto.HashLength));
 
 		}
 		/// <inheritdoc/>
 		public byte[] GetContentHashAsByteArray()
 		{
 			if (!_hashAdded) return null;
-			return _frameBytes.AsSpan(_frameBytes.Length - _crypto.HashLength).ToArray();
+			return _frameBytes.AsSpan(_length - _crypto.HashLength, _crypto.HashLength).ToArray();
 		}
 		/// <summary>
 		/// Checks if hash stored in AKM frame is valid
@@ -188,13 +261,77 @@ namespace AKMLogic
 		/// <returns>true if stored and calculated hash values are the same, false if there is a difference</returns>
 		public bool CheckHash()
 		{
-			var dataToBeHashed = _frameBytes.AsSpan(0, _frameBytes.Length - _crypto.HashLength).ToArray();
+			var hashLength = _crypto.HashLength;
+			if (_length < hashLength)
+				return false;
+
+			Span<byte> hash = hashLength <= MIN_BUFFER_SIZE ? stackalloc byte[hashLength] : new byte[hashLength];
+			CalculateHash(_frameBytes.AsSpan(0, _length - hashLength), hash);
+
+			return hash.SequenceEqual(_frameBytes.AsSpan(_length - hashLength, hashLength));
+		}
+
+		/// <summary>
+		/// Gives the frame back for reuse by Rent on this thread, or returns its buffer to the pool
+		/// </summary>
+		public void Dispose()
+		{
+			if (_spare == this)
+				return;
+			if (_spare == null && _frameBytes.Length <= MAX_SPARE_BUFFER_SIZE)
+			{
+				_spare = this;
+				return;
+			}
 
-			var hashString = Encoding.UTF8.GetString(_crypto.CalculateHash(dataToBeHashed));
-			var frameString = Encoding.UTF8.GetString(_frameBytes.AsSpan(_frameBytes.Length - _crypto.HashLength));
+			if (_frameBytes.Length > 0)
+				ArrayPool<byte>.Shared.Return(_frameBytes, clearArray: true);
+			_frameBytes = Array.Empty<byte>();
+			_length = 0;
+		}
 
-			return hashString == frameString;
+		private ReadOnlySpan<byte> FrameSpanForEncryption()
+		{
+			var schema = AkmSetup.AkmAppCfg[RelationshipId].FrameSchema;
+			return _frameBytes.AsSpan(schema.RelationshipId_Index + schema.RelationshipId_Length, _length - schema.RelationshipId_Length);
+		}
+
+		private void CalculateHash(ReadOnlySpan<byte> data, Span<byte> destination)
+		{
+			if (_crypto is ISpanCryptography spanCrypto)
+			{
+				spanCrypto.CalculateHash(data, destination);
+			}
+			else
+			{
+				_crypto.CalculateHash(data.ToArray()).AsSpan(0, destination.Length).CopyTo(destination);
+			}
+		}
+
+		/// <summary>
+		/// Sets frame length, newly exposed bytes are zeroed as in a freshly allocated frame
+		/// </summary>
+		private void Resize(int length)
+		{
+			Reserve(length);
+			if (length > _length)
+				_frameBytes.AsSpan(_length, length - _length).Clear();
+			_length = length;
+		}
+
+		/// <summary>
+		/// Makes sure the buffer holds length bytes, keeping the current frame bytes
+		/// </summary>
+		private void Reserve(int length)
+		{
+			if (length <= _frameBytes.Length)
+				return;
 
+			var buffer = ArrayPool<byte>.Shared.Rent(Math.Max(length, MIN_BUFFER_SIZE));
+			_frameBytes.AsSpan(0, _length).CopyTo(buffer);
+			if (_frameBytes.Length > 0)
+				ArrayPool<byte>.Shared.Return(_frameBytes, clearArray: true);
+			_frameBytes = buffer;
 		}
 	}
 }
@@ -7,18 +7,26 @@ using AKMCommon.Error;
 using AKMInterface;
 using Microsoft.Extensions.Logging;
 using System;
-using System.Linq;
 
 namespace AKMLogic
 {
 	/// <summary>
-	/// Default AKM Endcrypted frame implementation
+	/// Default AKM Endcrypted frame implementation.
+	/// Frames encrypted here are laid out as they go on the wire, with room for the frame length between relationship
+	/// id and encrypted data, so SetFrameLength and GetTransmissionData do not copy the frame. Received frames may
+	/// wrap part of a caller owned buffer, which then has to outlive the frame.
 	/// </summary>
 	public class AkmEncryptedFrame : IEncryptedFrame
 	{
+		private const int FRAME_LENGTH_SIZE = sizeof(long);
+
 		private readonly ICryptography _crypto;
 		private readonly ILogger _logger;
 		private byte[] _frameBytes;
+		private int _length;
+		//where the encrypted data starts, after the relationship id and the frame length when there is room for it
+		private int _dataOffset;
+		private bool _lengthSet;
 		/// <inheritdoc/>
 		public short RelationshipId { get; }
 
@@ -36,39 +44,68 @@ namespace AKMLogic
 		}
 
 		/// <summary>
-		/// Constructor 
+		/// Constructor
 		/// </summary>
 		/// <param name="cryptographyProvider">Object implementing ICryptography interface</param>
 		/// <param name="logger">Object implementing ILogger interface</param>
 		/// <param name="encryptedData">byte array holding encrypted part of AKM frame</param>
 		/// <param name="relationshipId">Relationship Id numeric value</param>
 		public AkmEncryptedFrame(ICryptography cryptographyProvider, ILogger logger, byte[] encryptedData, short relationshipId)
+			: this(cryptographyProvider, logger, encryptedData, encryptedData.Length, relationshipId)
+		{
+		}
+
+		/// <summary>
+		/// Constructor wrapping a frame at the start of a buffer, usually a pooled one
+		/// </summary>
+		/// <param name="cryptographyProvider">Object implementing ICryptography interface</param>
+		/// <param name="logger">Object implementing ILogger interface</param>
+		/// <param name="frameBuffer">buffer starting with relationship id and encrypted part of AKM frame</param>
+		/// <param name="length">number of frame bytes in the buffer</param>
+		/// <param name="relationshipId">Relationship Id numeric value</param>
+		public AkmEncryptedFrame(ICryptography cryptographyProvider, ILogger logger, byte[] frameBuffer, int length, short relationshipId)
 		{
 			_crypto = cryptographyProvider;
 			_logger = logger;
-			_frameBytes = encryptedData;
+			_frameBytes = frameBuffer;
+			_length = length;
 			RelationshipId = relationshipId;
+			_dataOffset = AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length;
 		}
 		/// <inheritdoc/>
 		public byte[] GetEncryptedData()
 		{
-			return _frameBytes.Skip(AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length).ToArray();
+			return EncryptedSpan.ToArray();
 		}
 
 		/// <inheritdoc/>
 		public byte[] GetTransmissionData()
 		{
-			return _frameBytes;
+			var relIdLength = AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length;
+			if (_dataOffset == relIdLength || _lengthSet)
+			{
+				if (_length == _frameBytes.Length)
+					return _frameBytes;
+				return _frameBytes.AsSpan(0, _length).ToArray();
+			}
+
+			//room for the frame length was left but the length was never set
+			var result = new byte[_length - FRAME_LENGTH_SIZE];
+			_frameBytes.AsSpan(0, relIdLength).CopyTo(result);
+			EncryptedSpan.CopyTo(result.AsSpan(relIdLength));
+			return result;
 		}
 		/// <inheritdoc/>
 		public IDecryptedFrame Decrypt(IKey key)
 		{
+			AkmDecryptedFrame result = null;
 			try
 			{
-				var decryptedMessage = _crypto.Decrypt(_frameBytes.AsSpan(AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length).ToArray(), key.KeyAsBytes);
-
-				var result = new AkmDecryptedFrame(_crypto, _logger, RelationshipId);
-				result.SetData(decryptedMessage);
+				result = AkmDecryptedFrame.Rent(_crypto, _logger, RelationshipId);
+				if (_crypto is ISpanCryptography spanCrypto)
+					result.SetDecryptedData(spanCrypto, EncryptedSpan, key.KeyAsBytes);
+				else
+					result.SetData(_crypto.Decrypt(GetEncryptedData(), key.KeyAsBytes));
 
 				if (!result.CheckHash())
 				{
@@ -78,6 +115,7 @@ namespace AKMLogic
 			}
 			catch
 			{
+				result?.Dispose();
 				return null;
 			}
 		}
@@ -85,10 +123,22 @@ namespace AKMLogic
 		/// <inheritdoc/>
 		public void SetEncryptedData(byte[] data)
 		{
-			var _relIdBytes = BitConverter.GetBytes(RelationshipId);
-			_frameBytes = new byte[data.Length + 2];
-			Array.Copy(_relIdBytes, 0, _frameBytes, AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Index, AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length);
-			Array.Copy(data, 0, _frameBytes, AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length, data.Length);
+			Allocate(data.Length);
+			data.CopyTo(_frameBytes, _dataOffset);
+		}
+
+		/// <summary>
+		/// Encrypts data straight into the frame
+		/// </summary>
+		/// <param name="crypto">Cryptographic service provider</param>
+		/// <param name="data">data for encryption</param>
+		/// <param name="key">byte array with key value for encryption</param>
+		internal void SetEncryptedData(ISpanCryptography crypto, ReadOnlySpan<byte> data, byte[] key)
+		{
+			Allocate(crypto.GetEncryptedLength(data.Length));
+			var written = crypto.Encrypt(data, key, _frameBytes.AsSpan(_dataOffset));
+			if (written != _length - _dataOffset)
+				throw new InvalidOperationException($"Encryption produced {written} bytes instead of {_length - _dataOffset}");
 		}
 
 		/// <summary>
@@ -96,30 +146,36 @@ namespace AKMLogic
 		/// </summary>
 		public void SetFrameLength()
 		{
-			var currentLength = _frameBytes.LongLength - AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length; //actual data length
-			var newFrameBytes = new byte[_frameBytes.Length + 8]; //add a bit for int64 value
+			var schema = AkmSetup.AkmAppCfg[RelationshipId].FrameSchema;
+			if (_lengthSet)
+				return;
+			if (_dataOffset == schema.RelationshipId_Length)
+			{
+				//received or wrapped frame, moved to an array with room for the length
+				var encrypted = EncryptedSpan;
+				var relId = _frameBytes.AsSpan(0, schema.RelationshipId_Length).ToArray();
+				Allocate(encrypted.Length);
+				relId.CopyTo(_frameBytes, 0);
+				encrypted.CopyTo(_frameBytes.AsSpan(_dataOffset));
+			}
 
-			Array.Copy(_frameBytes,
-						AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Index,
-						newFrameBytes,
-						AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Index,
-						AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length
-						);
+			BitConverter.TryWriteBytes(_frameBytes.AsSpan(schema.RelationshipId_Index + schema.RelationshipId_Length, FRAME_LENGTH_SIZE), (long)(_length - _dataOffset));
+			_lengthSet = true;
+		}
 
-			Array.Copy(BitConverter.GetBytes(currentLength),
-						0,
-						newFrameBytes,
-						AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Index + AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length,
-						8
-						);
+		private ReadOnlySpan<byte> EncryptedSpan => _frameBytes.AsSpan(_dataOffset, _length - _dataOffset);
 
-			Array.Copy(_frameBytes,
-						AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Index + AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length,
-						newFrameBytes,
-						AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Index + AkmSetup.AkmAppCfg[RelationshipId].FrameSchema.RelationshipId_Length + 8,
-						currentLength
-						);
-			_frameBytes = newFrameBytes;
+		/// <summary>
+		/// Replaces frame bytes with a wire sized array holding relationship id, room for the length and encrypted data
+		/// </summary>
+		private void Allocate(int encryptedLength)
+		{
+			var schema = AkmSetup.AkmAppCfg[RelationshipId].FrameSchema;
+			_dataOffset = schema.RelationshipId_Length + FRAME_LENGTH_SIZE;
+			_length = _dataOffset + encryptedLength;
+			_frameBytes = new byte[_length];
+			_lengthSet = false;
+			BitConverter.TryWriteBytes(_frameBytes.AsSpan(schema.RelationshipId_Index, schema.RelationshipId_Length), RelationshipId);
 		}
 	}
 }
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using System;
+using System.Diagnostics;
+using System.Threading;
+
+namespace AKMLogic
+{
+	/// <summary>
+	/// Bounded lock-free queue of transmission-ready AKM frames.
+	/// Each slot carries a sequence number telling producers and consumers whose turn it is, so enqueue and dequeue
+	/// take a single compare-exchange and never block; a full queue is reported to the producer instead.
+	/// </summary>
+	public sealed class AkmFrameQueue
+	{
+		private struct Slot
+		{
+			public long Sequence;
+			public byte[] Frame;
+			public long Timestamp;
+			public long Order;
+		}
+
+		private readonly Slot[] _slots;
+		private readonly long _mask;
+		private long _enqueuePosition;
+		private long _dequeuePosition;
+
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="capacity">Maximum number of queued frames, rounded up to a power of two</param>
+		public AkmFrameQueue(int capacity)
+		{
+			if (capacity <= 0 || capacity > (1 << 30))
+			{
+				throw new ArgumentOutOfRangeException(nameof(capacity));
+			}
+
+			var size = 1;
+			while (size < capacity)
+				size <<= 1;
+
+			_slots = new Slot[size];
+			_mask = size - 1;
+			for (int i = 0; i < size; i++)
+			{
+				_slots[i].Sequence = i;
+			}
+		}
+
+		/// <summary>
+		/// Maximum number of queued frames
+		/// </summary>
+		public int Capacity => _slots.Length;
+
+		/// <summary>
+		/// Approximate number of queued frames
+		/// </summary>
+		public int Count
+		{
+			get
+			{
+				var count = Volatile.Read(ref _enqueuePosition) - Volatile.Read(ref _dequeuePosition);
+				return (int)Math.Max(0, Math.Min(count, _slots.Length));
+			}
+		}
+
+		/// <summary>
+		/// Returns true if no frames are queued
+		/// </summary>
+		public bool IsEmpty => Count == 0;
+
+		/// <summary>
+		/// Adds a frame at the end of the queue
+		/// </summary>
+		/// <param name="frame">Frame transmission data</param>
+		/// <returns>False if the queue is full</returns>
+		public bool TryEnqueue(byte[] frame)
+		{
+			return TryEnqueue(frame, 0);
+		}
+
+		/// <summary>
+		/// Adds a frame at the end of the queue along with an order number the consumer can read with TryPeekOrder
+		/// </summary>
+		/// <param name="frame">Frame transmission data</param>
+		/// <param name="order">Order number of the frame</param>
+		/// <returns>False if the queue is full</returns>
+		public bool TryEnqueue(byte[] frame, long order)
+		{
+			var position = Volatile.Read(ref _enqueuePosition);
+			while (true)
+			{
+				ref var slot = ref _slots[position & _mask];
+				var difference = Volatile.Read(ref slot.Sequence) - position;
+
+				if (difference == 0)
+				{
+					if (Interlocked.CompareExchange(ref _enqueuePosition, position + 1, position) == position)
+					{
+						slot.Frame = frame;
+						slot.Timestamp = Stopwatch.GetTimestamp();
+						slot.Order = order;
+						Volatile.Write(ref slot.Sequence, position + 1);
+						return true;
+					}
+				}
+				else if (difference < 0)
+				{
+					return false;
+				}
+				position = Volatile.Read(ref _enqueuePosition);
+			}
+		}
+
+		/// <summary>
+		/// Takes the frame from the beginning of the queue
+		/// </summary>
+		/// <param name="frame">Frame transmission data</param>
+		/// <returns>False if the queue is empty</returns>
+		public bool TryDequeue(out byte[] frame)
+		{
+			return TryDequeue(out frame, out _);
+		}
+
+		/// <summary>
+		/// Takes the frame from the beginning of the queue along with the time it was queued
+		/// </summary>
+		/// <param name="frame">Frame transmission data</param>
+		/// <param name="timestamp">Stopwatch timestamp of the enqueue</param>
+		/// <returns>False if the queue is empty</returns>
+		public bool TryDequeue(out byte[] frame, out long timestamp)
+		{
+			var position = Volatile.Read(ref _dequeuePosition);
+			while (true)
+			{
+				ref var slot = ref _slots[position & _mask];
+				var difference = Volatile.Read(ref slot.Sequence) - (position + 1);
+
+				if (difference == 0)
+				{
+					if (Interlocked.CompareExchange(ref _dequeuePosition, position + 1, position) == position)
+					{
+						frame = slot.Frame;
+						timestamp = slot.Timestamp;
+						slot.Frame = null;
+						Volatile.Write(ref slot.Sequence, position + _mask + 1);
+						return true;
+					}
+				}
+				else if (difference < 0)
+				{
+					frame = null;
+					timestamp = 0;
+					return false;
+				}
+				position = Volatile.Read(ref _dequeuePosition);
+			}
+		}
+
+		/// <summary>
+		/// Returns the order number of the frame at the beginning of the queue, without taking it.
+		/// Only valid for a single consumer, another consumer may take the frame in the meantime.
+		/// </summary>
+		/// <param name="order">Order number given to TryEnqueue</param>
+		/// <returns>False if the queue is empty</returns>
+		public bool TryPeekOrder(out long order)
+		{
+			var position = Volatile.Read(ref _dequeuePosition);
+			ref var slot = ref _slots[position & _mask];
+
+			if (Volatile.Read(ref slot.Sequence) != position + 1)
+			{
+				order = 0;
+				return false;
+			}
+			order = slot.Order;
+			return true;
+		}
+	}
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using System;
+using System.Buffers.Binary;
+
+namespace AKMLogic
+{
+	/// <summary>
+	/// Dependency-free LZ77 block codec in the LZ4 block format.
+	/// A block is a series of sequences, each a token (literal count and match length nibbles), the literals,
+	/// a 2-byte match offset and length extensions; the last sequence has literals only. Matches are found through
+	/// a hash table of 4-byte prefixes, one per thread, so compressing allocates nothing.
+	/// </summary>
+	public static class AkmLz
+	{
+		private const int MIN_MATCH = 4;
+		private const int HASH_LOG = 12;
+		private const int MAX_OFFSET = 65535;
+		// The last literals of a block and the shortest input worth searching, as the LZ4 format requires
+		private const int LAST_LITERALS = 5;
+		private const int MF_LIMIT = 12;
+		private const int RUN_MASK = 15;
+		// Every 64 bytes without a match the search steps one byte further, so incompressible input is skipped fast
+		private const int SKIP_TRIGGER = 6;
+
+		[ThreadStatic]
+		private static int[]? _hashTable;
+
+		/// <summary>
+		/// Largest compressed size of length bytes of input
+		/// </summary>
+		/// <param name="length">Input length</param>
+		/// <returns>Size of a buffer always large enough for Compress</returns>
+		public static int MaxCompressedLength(int length)
+		{
+			return length + length / 255 + 16;
+		}
+
+		/// <summary>
+		/// Compresses source into one block
+		/// </summary>
+		/// <param name="source">Data to compress</param>
+		/// <param name="destination">Buffer for the block</param>
+		/// <returns>Block length, -1 if destination is too small</returns>
+		public static int Compress(ReadOnlySpan<byte> source, Span<byte> destination)
+		{
+			var table = _hashTable ??= new int[1 << HASH_LOG];
+			// Positions are stored plus one, zero is an empty entry
+			Array.Clear(table, 0, table.Length);
+
+			int anchor = 0;
+			int output = 0;
+			if (source.Length >= MF_LIMIT + 1)
+			{
+				int matchLimit = source.Length - LAST_LITERALS;
+				int searchLimit = source.Length - MF_LIMIT;
+				int position = 0;
+				while (position < searchLimit)
+				{
+					var sequence = BinaryPrimitives.ReadUInt32LittleEndian(source.Slice(position));
+					var hash = Hash(sequence);
+					var candidate = table[hash] - 1;
+					table[hash] = position + 1;
+					if (candidate < 0 || position - candidate > MAX_OFFSET
+						|| BinaryPrimitives.ReadUInt32LittleEndian(source.Slice(candidate)) != sequence)
+					{
+						position += 1 + ((position - anchor) >> SKIP_TRIGGER);
+						continue;
+					}
+
+					while (position > anchor && candidate > 0 && source[position - 1] == source[candidate - 1])
+					{
+						position--;
+						candidate--;
+					}
+					var length = MIN_MATCH;
+					while (position + length < matchLimit && source[position + length] == source[candidate + length])
+						length++;
+
+					output = WriteSequence(source.Slice(anchor, position - anchor), position - candidate, length - MIN_MATCH, destination, output);
+					if (output < 0)
+						return -1;
+
+					position += length;
+					anchor = position;
+					if (position < searchLimit)
+						table[Hash(BinaryPrimitives.ReadUInt32LittleEndian(source.Slice(position - 2)))] = position - 2 + 1;
+				}
+			}
+			return WriteSequence(source.Slice(anchor), 0, -1, destination, output);
+		}
+
+		/// <summary>
+		/// Decompresses one block
+		/// </summary>
+		/// <param name="source">Block</param>
+		/// <param name="destination">Buffer for the data</param>
+		/// <returns>Data length, -1 if the block is malformed or destination is too small</returns>
+		public static int Decompress(ReadOnlySpan<byte> source, Span<byte> destination)
+		{
+			int input = 0;
+			int output = 0;
+			while (input < source.Length)
+			{
+				int token = source[input++];
+				var literals = token >> 4;
+				if (literals == RUN_MASK && !ReadLength(source, ref input, ref literals, destination.Length - output))
+					return -1;
+				if (literals > source.Length - input || literals > destination.Length - output)
+					return -1;
+				source.Slice(input, literals).CopyTo(destination.Slice(output));
+				input += literals;
+				output += literals;
+				if (input == source.Length)
+					break;
+
+				if (source.Length - input < 2)
+					return -1;
+				int offset = BinaryPrimitives.ReadUInt16LittleEndian(source.Slice(input));
+				input += 2;
+				if (offset == 0 || offset > output)
+					return -1;
+				var length = token & RUN_MASK;
+				if (length == RUN_MASK && !ReadLength(source, ref input, ref length, destination.Length - output))
+					return -1;
+				length += MIN_MATCH;
+				if (length > destination.Length - output)
+					return -1;
+				if (offset >= length)
+				{
+					destination.Slice(output - offset, length).CopyTo(destination.Slice(output));
+				}
+				else
+				{
+					// Overlapping matches repeat the last offset bytes
+					for (int i = 0; i < length; i++)
+						destination[output + i] = destination[output - offset + i];
+				}
+				output += length;
+			}
+			return output;
+		}
+
+		private static int Hash(uint sequence)
+		{
+			return (int)((sequence * 2654435761u) >> (32 - HASH_LOG));
+		}
+
+		// A match length of -1 writes the literals only, the end of a block
+		private static int WriteSequence(ReadOnlySpan<byte> literals, int offset, int matchLength, Span<byte> destination, int output)
+		{
+			var needed = 1 + literals.Length + literals.Length / 255 + 1 + (matchLength < 0 ? 0 : 2 + matchLength / 255 + 1);
+			if (output < 0 || needed > destination.Length - output)
+				return -1;
+
+			var tokenPosition = output++;
+			var token = Math.Min(literals.Length, RUN_MASK) << 4;
+			if (literals.Length >= RUN_MASK)
+				output = WriteLength(literals.Length - RUN_MASK, destination, output);
+			literals.CopyTo(destination.Slice(output));
+			output += literals.Length;
+
+			if (matchLength >= 0)
+			{
+				BinaryPrimitives.WriteUInt16LittleEndian(destination.Slice(output), (ushort)offset);
+				output += 2;
+				token |= Math.Min(matchLength, RUN_MASK);
+				if (matchLength >= RUN_MASK)
+					output = WriteLength(matchLength - RUN_MASK, destination, output);
+			}
+			destination[tokenPosition] = (byte)token;
+			return output;
+		}
+
+		private static int WriteLength(int length, Span<byte> destination, int output)
+		{
+			while (length >= 255)
+			{
+				destination[output++] = 255;
+				length -= 255;
+			}
+			destination[output++] = (byte)length;
+			return output;
+		}
+
+		// A length past the remaining output cannot be satisfied, stopping there also keeps the sum from overflowing
+		private static bool ReadLength(ReadOnlySpan<byte> source, ref int input, ref int length, int limit)
+		{
+			byte value;
+			do
+			{
+				if (input >= source.Length)
+					return false;
+				value = source[input++];
+				if (value > limit - length)
+					return false;
+				length += value;
+			}
+			while (value == 255);
+			return true;
+		}
+	}
+}
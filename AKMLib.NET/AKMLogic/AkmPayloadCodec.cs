@@ -0,0 +1,240 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Struct;
+using System;
+using System.Buffers.Binary;
+using System.IO;
+
+namespace AKMLogic
+{
+	/// <summary>
+	/// Position of a frame in a chunked stream
+	/// </summary>
+	public readonly struct AkmPayloadChunk
+	{
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="streamId">Stream identifier, unique per sender</param>
+		/// <param name="index">Chunk number, starting at 0</param>
+		/// <param name="isFinal">True on the last chunk of the stream</param>
+		public AkmPayloadChunk(uint streamId, uint index, bool isFinal)
+		{
+			StreamId = streamId;
+			Index = index;
+			IsFinal = isFinal;
+		}
+
+		/// <summary>
+		/// Stream identifier, unique per sender
+		/// </summary>
+		public uint StreamId { get; }
+		/// <summary>
+		/// Chunk number, starting at 0
+		/// </summary>
+		public uint Index { get; }
+		/// <summary>
+		/// True on the last chunk of the stream
+		/// </summary>
+		public bool IsFinal { get; }
+	}
+
+	/// <summary>
+	/// Payload stage applied to frame content before it is encrypted and after it is decrypted.
+	/// With AkmAppConfig.CompressPayloads or AkmAppConfig.ChunkedPayloads set, content starts with a flags byte.
+	/// FlagChunk is followed by the 32-bit little endian stream identifier and chunk number; then FlagCompressed is
+	/// followed by the 32-bit little endian raw length and one AkmLz block, otherwise the payload follows as it was.
+	/// Payloads below the threshold, or which do not get smaller, are sent uncompressed.
+	/// The chunk header is inside the encrypted and hashed part of the frame, so every chunk is authenticated
+	/// together with its place in the stream. Chunks are compressed one by one, so a stream sent by Sender.SendStream
+	/// is compressed holding one chunk at a time.
+	/// </summary>
+	public static class AkmPayloadCodec
+	{
+		/// <summary>
+		/// Content flag marking a compressed payload
+		/// </summary>
+		public const byte FlagCompressed = 0x01;
+		/// <summary>
+		/// Content flag marking a chunk of a stream
+		/// </summary>
+		public const byte FlagChunk = 0x02;
+		/// <summary>
+		/// Content flag marking the last chunk of a stream
+		/// </summary>
+		public const byte FlagFinalChunk = 0x04;
+		/// <summary>
+		/// Smallest payload compressed when AkmAppConfig.CompressionThreshold is 0
+		/// </summary>
+		public const int DefaultThreshold = 256;
+		/// <summary>
+		/// Largest payload of a chunk when AkmAppConfig.StreamChunkSize is 0
+		/// </summary>
+		public const int DefaultChunkSize = 64 * 1024;
+
+		private const byte KNOWN_FLAGS = FlagCompressed | FlagChunk | FlagFinalChunk;
+		private const int CHUNK_HEADER_SIZE = 8;
+		private const int RAW_LENGTH_SIZE = 4;
+
+		/// <summary>
+		/// Returns true if frame content of the relationship starts with the flags byte
+		/// </summary>
+		/// <param name="appCfg">Relationship configuration</param>
+		public static bool HasHeader(AkmAppConfig appCfg)
+		{
+			return appCfg.CompressPayloads || appCfg.ChunkedPayloads;
+		}
+
+		/// <summary>
+		/// Largest payload of a chunk in the relationship
+		/// </summary>
+		/// <param name="appCfg">Relationship configuration</param>
+		public static int ChunkSize(AkmAppConfig appCfg)
+		{
+			return appCfg.StreamChunkSize > 0 ? appCfg.StreamChunkSize : DefaultChunkSize;
+		}
+
+		/// <summary>
+		/// Prepares payload to be put in a frame
+		/// </summary>
+		/// <param name="payload">Data that needs to be sent</param>
+		/// <param name="appCfg">Configuration of the relationship the frame is sent in</param>
+		/// <returns>Frame content</returns>
+		public static byte[] Encode(byte[] payload, AkmAppConfig appCfg)
+		{
+			if (!HasHeader(appCfg))
+				return payload;
+			return Encode(payload, appCfg, 0, 0, 0);
+		}
+
+		/// <summary>
+		/// Prepares a chunk of a stream to be put in a frame
+		/// </summary>
+		/// <param name="data">Chunk payload, at most ChunkSize bytes</param>
+		/// <param name="chunk">Position of the chunk in its stream</param>
+		/// <param name="appCfg">Configuration of the relationship the frame is sent in, with ChunkedPayloads set</param>
+		/// <returns>Frame content</returns>
+		public static byte[] EncodeChunk(ReadOnlySpan<byte> data, AkmPayloadChunk chunk, AkmAppConfig appCfg)
+		{
+			if (!appCfg.ChunkedPayloads)
+				throw new InvalidOperationException($"Relationship #{appCfg.RelationshipId} does not use chunked payloads");
+			var flags = (byte)(FlagChunk | (chunk.IsFinal ? FlagFinalChunk : 0));
+			return Encode(data, appCfg, flags, chunk.StreamId, chunk.Index);
+		}
+
+		/// <summary>
+		/// Recovers the payload from frame content
+		/// </summary>
+		/// <param name="content">Decrypted frame content</param>
+		/// <param name="appCfg">Configuration of the relationship the frame came in</param>
+		/// <returns>Data that was sent</returns>
+		/// <exception cref="InvalidDataException">Content is not in the format Encode produces</exception>
+		public static byte[] Decode(byte[] content, AkmAppConfig appCfg)
+		{
+			return Decode(content, appCfg, out _);
+		}
+
+		/// <summary>
+		/// Recovers the payload, or a chunk of a stream, from frame content
+		/// </summary>
+		/// <param name="content">Decrypted frame content</param>
+		/// <param name="appCfg">Configuration of the relationship the frame came in</param>
+		/// <param name="chunk">Position of the chunk in its stream, null if the frame carries a whole payload</param>
+		/// <returns>Data that was sent</returns>
+		/// <exception cref="InvalidDataException">Content is not in the format Encode produces</exception>
+		public static byte[] Decode(byte[] content, AkmAppConfig appCfg, out AkmPayloadChunk? chunk)
+		{
+			chunk = null;
+			if (!HasHeader(appCfg))
+				return content;
+			return Decode(content.AsSpan(), appCfg, out chunk);
+		}
+
+		/// <summary>
+		/// Recovers the payload, or a chunk of a stream, from frame content still in the frame buffer
+		/// </summary>
+		/// <param name="content">Decrypted frame content</param>
+		/// <param name="appCfg">Configuration of the relationship the frame came in</param>
+		/// <param name="chunk">Position of the chunk in its stream, null if the frame carries a whole payload</param>
+		/// <returns>Data that was sent</returns>
+		/// <exception cref="InvalidDataException">Content is not in the format Encode produces</exception>
+		public static byte[] Decode(ReadOnlySpan<byte> content, AkmAppConfig appCfg, out AkmPayloadChunk? chunk)
+		{
+			chunk = null;
+			if (!HasHeader(appCfg))
+				return content.ToArray();
+			if (content.Length == 0)
+				throw new InvalidDataException("Frame content is missing its payload flags");
+
+			var flags = content[0];
+			if ((flags & ~KNOWN_FLAGS) != 0 || (flags & (FlagChunk | FlagFinalChunk)) == FlagFinalChunk)
+				throw new InvalidDataException($"Unsupported payload flags {flags:X2}");
+
+			var body = content.Slice(1);
+			if ((flags & FlagChunk) != 0)
+			{
+				if (body.Length < CHUNK_HEADER_SIZE)
+					throw new InvalidDataException("Truncated chunk header");
+				chunk = new AkmPayloadChunk(BinaryPrimitives.ReadUInt32LittleEndian(body),
+					BinaryPrimitives.ReadUInt32LittleEndian(body.Slice(4)),
+					(flags & FlagFinalChunk) != 0);
+				body = body.Slice(CHUNK_HEADER_SIZE);
+			}
+			if ((flags & FlagCompressed) == 0)
+				return body.ToArray();
+			if (body.Length < RAW_LENGTH_SIZE)
+				throw new InvalidDataException("Truncated compressed payload");
+
+			var rawLength = BinaryPrimitives.ReadUInt32LittleEndian(body);
+			var block = body.Slice(RAW_LENGTH_SIZE);
+			// No block expands more than 255 times, which bounds what a forged length can make us allocate
+			if (rawLength > (ulong)block.Length * 255 + 16)
+				throw new InvalidDataException($"Compressed payload claims {rawLength} bytes");
+
+			var payload = new byte[rawLength];
+			if (AkmLz.Decompress(block, payload) != rawLength)
+				throw new InvalidDataException("Malformed compressed payload");
+			return payload;
+		}
+
+		private static byte[] Encode(ReadOnlySpan<byte> payload, AkmAppConfig appCfg, byte flags, uint streamId, uint index)
+		{
+			var headerSize = 1 + ((flags & FlagChunk) != 0 ? CHUNK_HEADER_SIZE : 0);
+			byte[]? content = null;
+			var length = payload.Length;
+
+			var threshold = appCfg.CompressionThreshold > 0 ? appCfg.CompressionThreshold : DefaultThreshold;
+			if (appCfg.CompressPayloads && payload.Length >= threshold)
+			{
+				var compressed = new byte[headerSize + RAW_LENGTH_SIZE + AkmLz.MaxCompressedLength(payload.Length)];
+				var compressedLength = AkmLz.Compress(payload, compressed.AsSpan(headerSize + RAW_LENGTH_SIZE));
+				if (compressedLength >= 0 && RAW_LENGTH_SIZE + compressedLength < payload.Length)
+				{
+					flags |= FlagCompressed;
+					BinaryPrimitives.WriteUInt32LittleEndian(compressed.AsSpan(headerSize), (uint)payload.Length);
+					length = RAW_LENGTH_SIZE + compressedLength;
+					content = compressed;
+				}
+			}
+			if (content == null)
+			{
+				content = new byte[headerSize + payload.Length];
+				payload.CopyTo(content.AsSpan(headerSize));
+			}
+			else
+			{
+				Array.Resize(ref content, headerSize + length);
+			}
+
+			content[0] = flags;
+			if ((flags & FlagChunk) != 0)
+			{
+				BinaryPrimitives.WriteUInt32LittleEndian(content.AsSpan(1), streamId);
+				BinaryPrimitives.WriteUInt32LittleEndian(content.AsSpan(5), index);
+			}
+			return content;
+		}
+	}
+}
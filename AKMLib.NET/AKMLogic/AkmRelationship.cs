@@ -16,7 +16,7 @@ namespace AKMLogic
 	/// <summary>
 	/// Main processing class
 	/// </summary>
-	public class AkmRelationship : IDisposable
+	public unsafe class AkmRelationship : IDisposable
 	{
 		/// <summary>
 		/// Assumed key count
@@ -26,6 +26,8 @@ namespace AKMLogic
 		/// PDV structure length
 		/// </summary>
 		public const int PDV_Size = 128;
+		//source address lengths are stored in a byte
+		private const int MAX_ADDRESS_SIZE = 256;
 
 		private IntPtr _relationship = IntPtr.Zero;
 		private readonly IKeyFactory _keyFactory;
@@ -150,7 +152,11 @@ namespace AKMLogic
 		private AkmStatus Init(ref AkmConfiguration config)
 		{
 			AkmProcessCtx ctx = PrepareProcessCtx();
-			AkmStatus status = ICLibCalls.AKMInit(ref ctx, ref config);
+			AkmStatus status;
+			fixed (AkmConfiguration* pConfig = &config)
+			{
+				status = AkmNative.AKMInit(&ctx, pConfig);
+			}
 			_relationship = ctx.relationship;
 
 			if (status == AkmStatus.Success)
@@ -167,7 +173,7 @@ namespace AKMLogic
 
 		private void Free()
 		{
-			ICLibCalls.AKMFree(_relationship);
+			AkmNative.AKMFree(_relationship);
 			_relationship = IntPtr.Zero;
 		}
 
@@ -188,24 +194,20 @@ namespace AKMLogic
 			}
 		}
 
+		/// <summary>
+		/// Runs the state machine and executes its commands. Nothing is allocated on the way: the context is fixed by the
+		/// callers, which keep it on the stack, and the source address is copied to a stack buffer.
+		/// </summary>
 		private AkmStatus GenericProcessInternal(ref AkmProcessCtx ctx, IEncryptedFrame encFrame, ref IDecryptedFrame decFrame)
 		{
 			IsConfigurationUpdated = false;
-			byte[] srcAddr = decFrame?.GetSourceAddressAsByteArray();
-			GCHandle? hSrcAddr = null;
-			ctx.srcAddr = IntPtr.Zero;
-			if (srcAddr != null)
-			{
-				hSrcAddr = GCHandle.Alloc(srcAddr, GCHandleType.Pinned);
-				ctx.srcAddr = hSrcAddr.Value.AddrOfPinnedObject();
-			}
+			byte* srcAddr = stackalloc byte[MAX_ADDRESS_SIZE];
+			ctx.srcAddr = SourceAddress(decFrame, srcAddr);
 			while (true)
 			{
-				ICLibCalls.AKMProcess(ref ctx);
-				if (hSrcAddr.HasValue && ctx.srcAddr == IntPtr.Zero)
+				fixed (AkmProcessCtx* pCtx = &ctx)
 				{
-					hSrcAddr.Value.Free();
-					hSrcAddr = null;
+					AkmNative.AKMProcess(pCtx);
 				}
 #if DEBUG
 				//_logger.LogDebug($"AKM OpCode: {ctx.cmd.opcode}");
@@ -238,17 +240,11 @@ namespace AKMLogic
 						_decKeyIdx = ctx.cmd.p2;
 						break;
 					case AkmCmdOpCode.RetryDec:
+						//the frame decrypted with the wrong key is dropped, its buffer can be reused for the retry
+						(decFrame as IDisposable)?.Dispose();
 						decFrame = encFrame?.Decrypt(_keys[ctx.cmd.p1]);
 						ctx.akmEvent = decFrame != null ? decFrame.FrameEvent : AkmEvent.CannotDecrypt;
-						srcAddr = decFrame?.GetSourceAddressAsByteArray();
-						hSrcAddr?.Free();
-						hSrcAddr = null;
-						ctx.srcAddr = IntPtr.Zero;
-						if (srcAddr != null)
-						{
-							hSrcAddr = GCHandle.Alloc(srcAddr, GCHandleType.Pinned);
-							ctx.srcAddr = hSrcAddr.Value.AddrOfPinnedObject();
-						}
+						ctx.srcAddr = SourceAddress(decFrame, srcAddr);
 						break;
 					case AkmCmdOpCode.SetTimer:
 						SetTimer(Marshal.ReadInt64(ctx.cmd.data));
@@ -261,6 +257,13 @@ namespace AKMLogic
 
 		}
 
+		private static IntPtr SourceAddress(IDecryptedFrame decFrame, byte* buffer)
+		{
+			if (decFrame == null)
+				return IntPtr.Zero;
+			return decFrame.CopySourceAddress(new Span<byte>(buffer, MAX_ADDRESS_SIZE)) > 0 ? (IntPtr)buffer : IntPtr.Zero;
+		}
+
 		private void SetTimer(long t)
 		{
 			_timer.Stop();
@@ -395,6 +398,8 @@ namespace AKMLogic
 			{
 				_timer?.Dispose();
 				_timer = null;
+				//AES instances keyed with the keys of this relationship are cached by the threads that used them
+				AkmCrypto.ClearKeyCache();
 			}
 			Free();
 		}
@@ -421,29 +426,24 @@ namespace AKMLogic
 		/// <param name="selfNodeAddr">byte array with own node address</param>
 		internal AkmConfigParams GetCurrentAKMConfig(out byte[] pdv, out byte[] nodeAddresses, out byte[] selfNodeAddr)
 		{
-			AkmConfigParams akmConfigParams;
 			lock (_procLock)
 			{
+				//the buffers are sized by the node count, which is only known from the parameters; a call without
+				//buffers copies just those
 				var akmConfig = new AkmConfiguration();
-				ICLibCalls.AKMGetConfig(_relationship, ref akmConfig);
-				int addrListLen = akmConfig.cfgParams.N * akmConfig.cfgParams.SRNA;
-				akmConfigParams = akmConfig.cfgParams;
+				AkmNative.AKMGetConfig(_relationship, &akmConfig);
 				pdv = new byte[PDV_Size];
-				nodeAddresses = new byte[addrListLen];
+				nodeAddresses = new byte[akmConfig.cfgParams.N * akmConfig.cfgParams.SRNA];
 				selfNodeAddr = new byte[akmConfig.cfgParams.SRNA];
-				GCHandle hPdv = GCHandle.Alloc(pdv, GCHandleType.Pinned);
-				GCHandle hNodeAddresses = GCHandle.Alloc(nodeAddresses, GCHandleType.Pinned);
-				GCHandle hSelfNodeAddr = GCHandle.Alloc(selfNodeAddr, GCHandleType.Pinned);
-				akmConfig.pdv = hPdv.AddrOfPinnedObject();
-				akmConfig.nodeAddresses = hNodeAddresses.AddrOfPinnedObject();
-				akmConfig.selfNodeAddress = hSelfNodeAddr.AddrOfPinnedObject();
-				ICLibCalls.AKMGetConfig(_relationship, ref akmConfig);
-				hPdv.Free();
-				hNodeAddresses.Free();
-				hSelfNodeAddr.Free();
+				fixed (byte* pPdv = pdv, pNodeAddresses = nodeAddresses, pSelfNodeAddr = selfNodeAddr)
+				{
+					akmConfig.pdv = (IntPtr)pPdv;
+					akmConfig.nodeAddresses = (IntPtr)pNodeAddresses;
+					akmConfig.selfNodeAddress = (IntPtr)pSelfNodeAddr;
+					AkmNative.AKMGetConfig(_relationship, &akmConfig);
+				}
+				return akmConfig.cfgParams;
 			}
-
-			return akmConfigParams;
 		}
 	}
 }
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Enum;
+using System;
+using System.Diagnostics;
+using System.Threading;
+
+namespace AKMLogic
+{
+	/// <summary>
+	/// Send path lanes
+	/// </summary>
+	public enum AkmSendLane
+	{
+		/// <summary>
+		/// Session establishment frames (SEI, SEC, SEF)
+		/// </summary>
+		Control = 0,
+		/// <summary>
+		/// All other frames
+		/// </summary>
+		Data = 1
+	}
+
+	/// <summary>
+	/// Counters of frames taken from a send lane
+	/// </summary>
+	public sealed class AkmSendLaneStatistics
+	{
+		private long _frames;
+		private long _bytes;
+		private long _totalDelayTicks;
+		private long _maxDelayTicks;
+
+		/// <summary>
+		/// Number of frames taken from the lane
+		/// </summary>
+		public long Frames => Volatile.Read(ref _frames);
+
+		/// <summary>
+		/// Number of bytes taken from the lane
+		/// </summary>
+		public long Bytes => Volatile.Read(ref _bytes);
+
+		/// <summary>
+		/// Average time frames spent in the lane
+		/// </summary>
+		public TimeSpan AverageQueueDelay
+		{
+			get
+			{
+				var frames = Frames;
+				return frames == 0 ? TimeSpan.Zero : ToTimeSpan(Volatile.Read(ref _totalDelayTicks) / frames);
+			}
+		}
+
+		/// <summary>
+		/// Longest time a frame spent in the lane
+		/// </summary>
+		public TimeSpan MaxQueueDelay => ToTimeSpan(Volatile.Read(ref _maxDelayTicks));
+
+		internal void Record(int size, long delayTicks)
+		{
+			Volatile.Write(ref _frames, _frames + 1);
+			Volatile.Write(ref _bytes, _bytes + size);
+			Volatile.Write(ref _totalDelayTicks, _totalDelayTicks + delayTicks);
+			if (delayTicks > _maxDelayTicks)
+				Volatile.Write(ref _maxDelayTicks, delayTicks);
+		}
+
+		private static TimeSpan ToTimeSpan(long stopwatchTicks)
+		{
+			return TimeSpan.FromTicks(stopwatchTicks * TimeSpan.TicksPerSecond / Stopwatch.Frequency);
+		}
+	}
+
+	/// <summary>
+	/// Outgoing frames split into a control lane for session establishment frames and a data lane for the rest.
+	/// Each lane has its own capacity, so a full data lane does not refuse establishment frames, and its own queue
+	/// delay statistics. Frames leave in the order they were queued across both lanes: data frames ahead of an
+	/// establishment frame are encrypted with the key it replaces, the peer could not decrypt them once it got
+	/// the establishment frame first.
+	/// Any number of producers, a single consumer.
+	/// </summary>
+	public sealed class AkmSendLanes
+	{
+		private readonly AkmFrameQueue _control;
+		private readonly AkmFrameQueue _data;
+		private long _order;
+
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="dataCapacity">Maximum number of queued data frames</param>
+		/// <param name="controlCapacity">Maximum number of queued control frames</param>
+		public AkmSendLanes(int dataCapacity, int controlCapacity)
+		{
+			_data = new AkmFrameQueue(dataCapacity);
+			_control = new AkmFrameQueue(controlCapacity);
+		}
+
+		/// <summary>
+		/// Statistics of the control lane
+		/// </summary>
+		public AkmSendLaneStatistics ControlStatistics { get; } = new AkmSendLaneStatistics();
+
+		/// <summary>
+		/// Statistics of the data lane
+		/// </summary>
+		public AkmSendLaneStatistics DataStatistics { get; } = new AkmSendLaneStatistics();
+
+		/// <summary>
+		/// Approximate number of queued frames in both lanes
+		/// </summary>
+		public int Count => _control.Count + _data.Count;
+
+		/// <summary>
+		/// Approximate number of frames queued in given lane
+		/// </summary>
+		/// <param name="lane">Send lane</param>
+		public int CountOf(AkmSendLane lane)
+		{
+			return Queue(lane).Count;
+		}
+
+		/// <summary>
+		/// Returns true if no frames are queued
+		/// </summary>
+		public bool IsEmpty => _control.IsEmpty && _data.IsEmpty;
+
+		/// <summary>
+		/// Returns true if given lane cannot take more frames
+		/// </summary>
+		/// <param name="lane">Send lane</param>
+		public bool IsFull(AkmSendLane lane)
+		{
+			var queue = Queue(lane);
+			return queue.Count >= queue.Capacity;
+		}
+
+		/// <summary>
+		/// Returns the lane for a frame carrying given AKM Event
+		/// </summary>
+		/// <param name="akmEvent">AKM Event set on the frame</param>
+		public static AkmSendLane LaneOf(AkmEvent akmEvent)
+		{
+			switch (akmEvent)
+			{
+				case AkmEvent.RecvSEI:
+				case AkmEvent.RecvSEC:
+				case AkmEvent.RecvSEF:
+					return AkmSendLane.Control;
+				default:
+					return AkmSendLane.Data;
+			}
+		}
+
+		/// <summary>
+		/// Adds a frame at the end of given lane
+		/// </summary>
+		/// <param name="frame">Frame transmission data</param>
+		/// <param name="lane">Send lane</param>
+		/// <returns>False if the lane is full</returns>
+		public bool TryEnqueue(byte[] frame, AkmSendLane lane)
+		{
+			return Queue(lane).TryEnqueue(frame, Interlocked.Increment(ref _order));
+		}
+
+		/// <summary>
+		/// Takes the next frame to send
+		/// </summary>
+		/// <param name="frame">Frame transmission data</param>
+		/// <returns>False if both lanes are empty</returns>
+		public bool TryDequeue(out byte[] frame)
+		{
+			var controlPending = _control.TryPeekOrder(out var controlOrder);
+			var dataPending = _data.TryPeekOrder(out var dataOrder);
+
+			if (controlPending && (!dataPending || controlOrder < dataOrder))
+				return TryDequeue(_control, ControlStatistics, out frame);
+			if (dataPending)
+				return TryDequeue(_data, DataStatistics, out frame);
+
+			frame = null;
+			return false;
+		}
+
+		private AkmFrameQueue Queue(AkmSendLane lane)
+		{
+			return lane == AkmSendLane.Control ? _control : _data;
+		}
+
+		private static bool TryDequeue(AkmFrameQueue queue, AkmSendLaneStatistics statistics, out byte[] frame)
+		{
+			if (!queue.TryDequeue(out frame, out var timestamp))
+				return false;
+
+			statistics.Record(frame.Length, Stopwatch.GetTimestamp() - timestamp);
+			return true;
+		}
+	}
+}
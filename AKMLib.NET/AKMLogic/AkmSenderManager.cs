@@ -19,6 +19,7 @@ namespace AKMLogic
 	{
 		private static readonly object _lockSenders = new object();
 		private static readonly Dictionary<short, Dictionary<short, Sender>> _senders = new Dictionary<short, Dictionary<short, Sender>>();
+		private static readonly Dictionary<Socket, AkmConnection> _connections = new Dictionary<Socket, AkmConnection>();
 		private static ICryptography defaultCryptography;
 
 		/// <summary>
@@ -100,7 +101,8 @@ namespace AKMLogic
 		}
 
 		/// <summary>
-		/// Add new sender object to specific Relationship 
+		/// Add new sender object to specific Relationship. Senders given the same socket share a single connection,
+		/// whatever relationship they belong to.
 		/// </summary>
 		/// <param name="relatioshipId">Relationship identifier</param>
 		/// <param name="senderAddress">Numeric value for target node</param>
@@ -108,17 +110,39 @@ namespace AKMLogic
 		/// <param name="logger">ILogger implementation</param>
 		public static void AddSender(short relatioshipId, short senderAddress, Socket socket, ILogger logger)
 		{
-			if (!_senders.ContainsKey(relatioshipId))
-				_senders.Add(relatioshipId, new Dictionary<short, Sender>());
-			if (!_senders[relatioshipId].ContainsKey(senderAddress))
+			lock (_lockSenders)
 			{
-				var s = new Sender(relatioshipId);
-				s.SetLogger(logger);
-				s.SetSocket(socket);
-				s.SetCryptography(defaultCryptography);
-				_senders[relatioshipId].Add(senderAddress, s);
+				if (!_senders.ContainsKey(relatioshipId))
+					_senders.Add(relatioshipId, new Dictionary<short, Sender>());
+				if (!_senders[relatioshipId].ContainsKey(senderAddress))
+				{
+					var s = new Sender(relatioshipId);
+					s.SetLogger(logger);
+					s.SetCryptography(defaultCryptography);
+					s.SetConnection(GetConnection(relatioshipId, socket, logger));
+					_senders[relatioshipId].Add(senderAddress, s);
+				}
 			}
 		}
 
+		/// <summary>
+		/// Returns the connection shared by all senders using given socket, creating it if needed
+		/// </summary>
+		private static AkmConnection GetConnection(short relationshipId, Socket socket, ILogger logger)
+		{
+			if (_connections.TryGetValue(socket, out var connection) && connection.IsRunning)
+				return connection;
+
+			foreach (var closed in _connections.Where(c => !c.Value.IsRunning).Select(c => c.Key).ToList())
+			{
+				_connections.Remove(closed);
+			}
+
+			var latencyBudget = AkmSetup.AkmAppCfg.TryGetValue(relationshipId, out var appCfg) ? appCfg.SendLatencyBudget : 0;
+			connection = new AkmConnection(socket, logger, latencyBudget);
+			_connections[socket] = connection;
+			return connection;
+		}
+
 	}
 }
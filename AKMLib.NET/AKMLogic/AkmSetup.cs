@@ -7,7 +7,6 @@ using AKMCommon.Struct;
 using AKMInterface;
 using Microsoft.Extensions.Configuration;
 using Microsoft.Extensions.Logging;
-using Newtonsoft.Json;
 using System;
 using System.Collections.Generic;
 using System.Diagnostics;
@@ -26,6 +25,7 @@ namespace AKMLogic
 		private static IDictionary<int, AkmAppConfig> _akmAppConfigs;
 		private static IDictionary<int, AkmConfiguration> _akmConfigs;
 		private static IDictionary<int, AkmRelationship> _akmRelationships;
+		private static AkmConfigJournal _akmConfigJournal;
 
 		/// <summary>
 		/// Determines if configuration values should be taken only from config file
@@ -33,14 +33,12 @@ namespace AKMLogic
 		public static bool ForceFileConfig { get; set; }
 
 		/// <summary>
-		/// Returns environment variable name for storing current configuration based on relationshipId and self address value
+		/// Returns default path of the journal storing current configuration
 		/// </summary>
-		/// <param name="relationshipId">RelationshipId value</param>
-		/// <param name="selfAddress">Self Node Address value</param>
 		/// <returns></returns>
-		private static string EnvVariableName(short relationshipId, short selfAddress)
+		private static string DefaultJournalPath()
 		{
-			return $"AKMConfig_{Process.GetCurrentProcess().ProcessName}_{relationshipId}_{selfAddress}";
+			return Path.Combine(Directory.GetCurrentDirectory(), $"AKMConfig_{Process.GetCurrentProcess().ProcessName}.journal");
 		}
 
 		/// <summary>
@@ -108,17 +106,19 @@ namespace AKMLogic
 			IConfigurationRoot configuration = builder.Build();
 
 			var checkPool = int.Parse(configuration.GetSection("AkmCheckPool")?.Value ?? "-1");
+			var journalPath = configuration.GetSection("AkmConfigJournal")?.Value ?? DefaultJournalPath();
 			var configSection = configuration.GetSection("AkmAppConfigs");
 			AkmAppConfig[] configs = configSection.Get<AkmAppConfig[]>();
 
+			_akmConfigJournal?.Dispose();
+			_akmConfigJournal = new AkmConfigJournal(journalPath);
+
 			foreach (var cfg in configs)
 			{
 				if (!_akmAppConfigs.ContainsKey(cfg.RelationshipId))
 				{
 					_akmAppConfigs.Add(cfg.RelationshipId, cfg);
-
-					if (!TryLoadConfigFromEnvironment(cfg.RelationshipId, cfg.SelfAddressValue))
-						SaveConfigAsEnvVariable(cfg.RelationshipId, cfg.SelfAddressValue);
+					TryLoadConfigFromJournal(cfg);
 				}
 				else
 					throw new AkmError(AKMCommon.Enum.AkmStatus.FatalError);
@@ -164,12 +164,12 @@ namespace AKMLogic
 				cfgParams = new AkmConfigParams()
 			};
 
-			byte[] selfAddress = BitConverter.GetBytes(appCfg.SelfAddressValue);
+			byte[] selfAddress = BitConverter.GetBytes((short)appCfg.SelfAddressValue);
 			byte[] expandedNodes = new byte[appCfg.NodesAddresses.Length * sizeof(short)];
 
 			for (int i = 0; i < appCfg.NodesAddresses.Length; i++)
 			{
-				Array.Copy(BitConverter.GetBytes(appCfg.NodesAddresses[i]), 0, expandedNodes, i * (sizeof(short)), sizeof(short));
+				Array.Copy(BitConverter.GetBytes((short)appCfg.NodesAddresses[i]), 0, expandedNodes, i * (sizeof(short)), sizeof(short));
 			}
 
 			//I know it looks bad, but for now we need to make sure PDV is the same across nodes and eventuall generation method is unknown
@@ -260,21 +260,29 @@ namespace AKMLogic
 				var configParams = relationship.GetCurrentAKMConfig(out currentPdv, out currentNodes, out selfAddress);
 				var akmKeys = relationship.GetKeys();
 
-				//for dynamic relationships you may wish to store current nodes and self address as well
 				akmAppConfig.AkmConfigParameters = configParams;
 				akmAppConfig.PDV = currentPdv;
+				akmAppConfig.NodesAddresses = NodeAddressValues(currentNodes, configParams.SRNA);
 				akmAppConfig.InitialKeys = new AkmConfigKeyString[akmKeys.Length];
 
+				var keys = new byte[akmKeys.Length][];
 				for (int i = 0; i < akmAppConfig.InitialKeys.Length; i++)
 				{
 					akmAppConfig.InitialKeys[i] = new AkmConfigKeyString { InitialKey = akmKeys[i].KeyAsBase64String };
+					keys[i] = (byte[])akmKeys[i].KeyAsBytes.Clone();
 				}
 
-				var jsonString = JsonConvert.SerializeObject(AkmAppCfg);
-
-				Environment.SetEnvironmentVariable(EnvVariableName(relationshipId, akmAppConfig.SelfAddressValue), jsonString, EnvironmentVariableTarget.User);
-
-				Logger.LogDebug("Saved all AKM app config as env variable");
+				//only the changed relationship is appended, persistence cost does not depend on the number of relationships
+				_akmConfigJournal.Append(new AkmConfigJournalEntry
+				{
+					RelationshipId = relationshipId,
+					SelfAddressValue = akmAppConfig.SelfAddressValue,
+					ConfigParams = configParams,
+					NodeAddresses = currentNodes,
+					Keys = keys
+				});
+
+				Logger.LogDebug($"Journaled AKM config of Relationship #{relationshipId}");
 			}
 			else
 			{
@@ -282,28 +290,41 @@ namespace AKMLogic
 			}
 		}
 
-		internal static void SaveConfigAsEnvVariable(short relationshipId, short selfAddressId)
-		{
-			var jsonString = JsonConvert.SerializeObject(AkmAppCfg);
-			Environment.SetEnvironmentVariable(EnvVariableName(relationshipId, selfAddressId), jsonString, EnvironmentVariableTarget.User);
-			Logger.LogDebug("Saved all AKM app config as env variable");
-		}
-
-		private static bool TryLoadConfigFromEnvironment(short relationshipId, short selfAddressId)
+		private static bool TryLoadConfigFromJournal(AkmAppConfig cfg)
 		{
 			if (ForceFileConfig)
 				return false;
 
-			var result = false;
-			string configJson = Environment.GetEnvironmentVariable(EnvVariableName(relationshipId, selfAddressId), EnvironmentVariableTarget.User);
-			if (!string.IsNullOrEmpty(configJson))
+			var result = _akmConfigJournal.Entries.TryGetValue(cfg.RelationshipId, out var entry) && entry.SelfAddressValue == cfg.SelfAddressValue;
+			if (result)
 			{
-				_akmAppConfigs = JsonConvert.DeserializeObject<IDictionary<int, AkmAppConfig>>(configJson);
-				result = true;
+				cfg.AkmConfigParameters = entry.ConfigParams;
+				cfg.NodesAddresses = NodeAddressValues(entry.NodeAddresses, entry.ConfigParams.SRNA);
+				cfg.InitialKeys = new AkmConfigKeyString[entry.Keys.Length];
+
+				for (int i = 0; i < cfg.InitialKeys.Length; i++)
+				{
+					cfg.InitialKeys[i] = new AkmConfigKeyString { InitialKey = Convert.ToBase64String(entry.Keys[i]) };
+				}
 			}
-			Logger.LogDebug($"Env config load result:{result}");
+			Logger?.LogDebug($"Journal config load result for Relationship #{cfg.RelationshipId}:{result}");
 			return result;
+		}
 
+		/// <summary>
+		/// Converts node addresses returned by AKM library (little endian, SRNA bytes each) to config file address values
+		/// </summary>
+		private static byte[] NodeAddressValues(byte[] nodeAddresses, int srna)
+		{
+			if (srna == 0)
+				return Array.Empty<byte>();
+
+			var values = new byte[nodeAddresses.Length / srna];
+			for (int i = 0; i < values.Length; i++)
+			{
+				values[i] = nodeAddresses[i * srna];
+			}
+			return values;
 		}
 
 		private static bool IsConfigValid(IDictionary<int, AkmAppConfig> configs, int checkPool)
@@ -0,0 +1,678 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using System;
+using System.Buffers;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Net.Sockets;
+using System.Runtime.InteropServices;
+using System.Threading;
+
+namespace AKMLogic
+{
+	/// <summary>
+	/// Shared-memory channel to akmd for nodes on the same host, the client side of libakmc/daemon/akmd_shm.h.
+	/// A memfd segment holds one single-producer single-consumer ring of records per direction, and each ring has an
+	/// eventfd per side to wake it; akmd hands the descriptors over its Unix socket (-c). Every record is one frame
+	/// in the transmission format, the bytes of AkmEncryptedFrame.GetTransmissionData, so frames cross between the
+	/// processes without a system call unless a side went to sleep. Linux only; one thread may send and one receive.
+	/// </summary>
+	public sealed unsafe class AkmShmChannel : IDisposable
+	{
+		/// <summary>
+		/// Ring size akmd uses unless configured otherwise
+		/// </summary>
+		public const int DefaultRingSize = 4 * 1024 * 1024;
+
+		private const int FDS_NUM = 5;
+		private const int MEMFD = 0;
+		private const int TO_DAEMON_DATA = 1;
+		private const int TO_DAEMON_SPACE = 2;
+		private const int TO_CLIENT_DATA = 3;
+		private const int TO_CLIENT_SPACE = 4;
+		//both ring headers share the first page, the rings follow it
+		private const int HEADERS_SIZE = 4096;
+		//struct AKMDRingHeader, every field on a cache line of its own
+		private const int HEAD = 0;
+		private const int TAIL = 64;
+		private const int CONSUMER_WAITING = 128;
+		private const int PRODUCER_WAITING = 192;
+		private const int SIZE = 256;
+		private const int HEADER_SIZE = 320;
+		//each record starts with its size, 32 bits padded to keep records 8-byte aligned
+		private const int RECORD_PREFIX = 8;
+		private const uint RECORD_WRAP = uint.MaxValue;
+
+		private struct Ring
+		{
+			public byte* Header;
+			public byte* Data;
+			public ulong Size;
+			//the side's own position, and its last view of the other side's
+			public ulong Own;
+			public ulong Other;
+			public int DataFd;
+			public int SpaceFd;
+			public bool Corrupt;
+		}
+
+		private readonly int[] _fds;
+		private readonly Socket? _socket;
+		private byte* _base;
+		private readonly ulong _mapSize;
+		//records are consumed from _in and produced to _out
+		private Ring _in;
+		private Ring _out;
+
+		private AkmShmChannel(int[] fds, byte* mapped, ulong mapSize, bool daemon, Socket? socket)
+		{
+			_fds = fds;
+			_base = mapped;
+			_mapSize = mapSize;
+			_socket = socket;
+
+			var toDaemon = mapped;
+			var toClient = mapped + HEADER_SIZE;
+			var toDaemonData = mapped + HEADERS_SIZE;
+			var toClientData = toDaemonData + *(ulong*)(toDaemon + SIZE);
+			if (daemon)
+			{
+				_in = NewRing(toDaemon, toDaemonData, fds[TO_DAEMON_DATA], fds[TO_DAEMON_SPACE], false);
+				_out = NewRing(toClient, toClientData, fds[TO_CLIENT_DATA], fds[TO_CLIENT_SPACE], true);
+			}
+			else
+			{
+				_in = NewRing(toClient, toClientData, fds[TO_CLIENT_DATA], fds[TO_CLIENT_SPACE], false);
+				_out = NewRing(toDaemon, toDaemonData, fds[TO_DAEMON_DATA], fds[TO_DAEMON_SPACE], true);
+			}
+		}
+
+		/// <summary>
+		/// Descriptors of the channel in the order akmd hands them over: memfd, then data and space eventfds of the
+		/// ring to the daemon and of the ring to the client
+		/// </summary>
+		public IReadOnlyList<int> Descriptors => _fds;
+
+		/// <summary>
+		/// Largest frame the channel carries
+		/// </summary>
+		public int MaxFrameSize => (int)Math.Min(_out.Size - RECORD_PREFIX, int.MaxValue);
+
+		/// <summary>
+		/// Connects to the Unix socket of akmd and attaches to the channel it creates; the socket stays open for the
+		/// life of the channel, closing it ends the channel on the daemon side
+		/// </summary>
+		/// <param name="path">Path of the Unix socket akmd listens on</param>
+		/// <returns>Client side of the channel</returns>
+		public static AkmShmChannel Connect(string path)
+		{
+			CheckPlatform();
+			var socket = new Socket(AddressFamily.Unix, SocketType.Seqpacket, ProtocolType.Unspecified);
+			var fds = new int[FDS_NUM];
+			var received = 0;
+			try
+			{
+				socket.Connect(new UnixDomainSocketEndPoint(path));
+				received = ReceiveFds((int)socket.Handle, fds);
+				if (received != FDS_NUM)
+				{
+					throw new InvalidDataException($"akmd handed over {received} descriptors instead of {FDS_NUM}");
+				}
+				return Attach(fds, socket);
+			}
+			catch
+			{
+				socket.Dispose();
+				throw;
+			}
+			finally
+			{
+				//Attach works on duplicates
+				for (int i = 0; i < received; i++)
+				{
+					close(fds[i]);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Daemon side of a new channel, as akmd creates them; the other side attaches to its Descriptors
+		/// </summary>
+		/// <param name="ringSize">Size of each ring, a power of two of at least 4096 bytes</param>
+		/// <returns>Daemon side of the channel</returns>
+		public static AkmShmChannel Create(int ringSize = DefaultRingSize)
+		{
+			CheckPlatform();
+			if (ringSize < HEADERS_SIZE || (ringSize & (ringSize - 1)) != 0)
+			{
+				throw new ArgumentOutOfRangeException(nameof(ringSize));
+			}
+
+			var fds = new int[FDS_NUM];
+			for (int i = 0; i < FDS_NUM; i++)
+			{
+				fds[i] = -1;
+			}
+			var mapSize = (ulong)HEADERS_SIZE + 2 * (ulong)ringSize;
+			byte* mapped = null;
+			try
+			{
+				fds[MEMFD] = memfd_create("akmd-channel", MFD_CLOEXEC);
+				for (int i = MEMFD + 1; i < FDS_NUM; i++)
+				{
+					fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				}
+				foreach (var fd in fds)
+				{
+					if (fd < 0)
+						throw LastError("Cannot create channel descriptors");
+				}
+				if (ftruncate(fds[MEMFD], (long)mapSize) != 0)
+					throw LastError("Cannot size channel memory");
+				mapped = Map(fds[MEMFD], mapSize);
+			}
+			catch
+			{
+				CloseAll(fds);
+				throw;
+			}
+
+			//a new memfd reads as zeros, the positions and flags start that way
+			*(ulong*)(mapped + SIZE) = (ulong)ringSize;
+			*(ulong*)(mapped + HEADER_SIZE + SIZE) = (ulong)ringSize;
+			var channel = new AkmShmChannel(fds, mapped, mapSize, true, null);
+			//the daemon waits for the first record like for any later one
+			channel.ConsumerSleep();
+			return channel;
+		}
+
+		/// <summary>
+		/// Client side of a channel created elsewhere
+		/// </summary>
+		/// <param name="descriptors">Descriptors of the channel in the order of Descriptors, duplicated so the caller
+		/// keeps its own</param>
+		/// <returns>Client side of the channel</returns>
+		public static AkmShmChannel Attach(IReadOnlyList<int> descriptors)
+		{
+			CheckPlatform();
+			if (descriptors == null || descriptors.Count != FDS_NUM)
+			{
+				throw new ArgumentException($"A channel has {FDS_NUM} descriptors", nameof(descriptors));
+			}
+			return Attach(descriptors, null);
+		}
+
+		private static AkmShmChannel Attach(IReadOnlyList<int> descriptors, Socket? socket)
+		{
+			var fds = new int[FDS_NUM];
+			for (int i = 0; i < FDS_NUM; i++)
+			{
+				fds[i] = -1;
+			}
+			try
+			{
+				for (int i = 0; i < FDS_NUM; i++)
+				{
+					fds[i] = fcntl(descriptors[i], F_DUPFD_CLOEXEC, 0);
+					if (fds[i] < 0)
+						throw LastError("Cannot duplicate channel descriptors");
+				}
+
+				var size = lseek(fds[MEMFD], 0, SEEK_END);
+				if (size <= HEADERS_SIZE)
+					throw new InvalidDataException($"Channel memory of {size} bytes");
+				var mapSize = (ulong)size;
+				var mapped = Map(fds[MEMFD], mapSize);
+
+				//the segment comes from the other process, its ring sizes must match what was mapped
+				var ringSize = *(ulong*)(mapped + SIZE);
+				if (ringSize == 0 || (ringSize & (ringSize - 1)) != 0 || *(ulong*)(mapped + HEADER_SIZE + SIZE) != ringSize
+					|| HEADERS_SIZE + 2 * ringSize != mapSize)
+				{
+					munmap(mapped, (UIntPtr)mapSize);
+					throw new InvalidDataException("Channel memory does not hold two rings of one size");
+				}
+				return new AkmShmChannel(fds, mapped, mapSize, false, socket);
+			}
+			catch
+			{
+				CloseAll(fds);
+				throw;
+			}
+		}
+
+		/// <summary>
+		/// Puts a frame on the channel if there is room for it now
+		/// </summary>
+		/// <param name="frame">Frame in the transmission format</param>
+		/// <returns>False if the ring is too full for the frame</returns>
+		public bool TrySend(ReadOnlySpan<byte> frame)
+		{
+			CheckNotDisposed();
+			if (frame.Length == 0 || frame.Length > MaxFrameSize)
+			{
+				throw new ArgumentOutOfRangeException(nameof(frame), $"Frame of {frame.Length} bytes, the channel carries 1 to {MaxFrameSize}");
+			}
+
+			var record = Reserve(ref _out, frame.Length);
+			if (record == null)
+				return false;
+			frame.CopyTo(new Span<byte>(record, frame.Length));
+			Commit(ref _out, frame.Length);
+			Wake(_out.Header + CONSUMER_WAITING, _out.DataFd);
+			return true;
+		}
+
+		/// <summary>
+		/// Puts a frame on the channel, waiting for room
+		/// </summary>
+		/// <param name="frame">Frame in the transmission format</param>
+		/// <param name="timeoutMs">Longest wait in milliseconds, -1 for no limit</param>
+		/// <returns>False if there was no room before the timeout</returns>
+		public bool Send(ReadOnlySpan<byte> frame, int timeoutMs = Timeout.Infinite)
+		{
+			var deadline = Deadline(timeoutMs);
+			while (!TrySend(frame))
+			{
+				if (!ProducerSleep(frame.Length))
+					continue;
+				if (!WaitFd(_out.SpaceFd, Remaining(deadline, timeoutMs)))
+					return false;
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// Takes the next frame off the channel if there is one
+		/// </summary>
+		/// <param name="frame">Frame in the transmission format, rented from ArrayPool&lt;byte&gt;.Shared</param>
+		/// <param name="frameLength">Length of the frame, the rented array may be longer</param>
+		/// <returns>False if no frame is waiting</returns>
+		public bool TryReceive(out byte[] frame, out int frameLength)
+		{
+			CheckNotDisposed();
+			frame = null;
+			frameLength = 0;
+
+			var record = Peek(ref _in, out var size);
+			if (record == null)
+			{
+				if (_in.Corrupt)
+					throw new InvalidDataException("The channel ring was corrupted by the other side");
+				return false;
+			}
+
+			frame = ArrayPool<byte>.Shared.Rent(size);
+			frameLength = size;
+			new ReadOnlySpan<byte>(record, size).CopyTo(frame);
+			Consume(ref _in, size);
+			Wake(_in.Header + PRODUCER_WAITING, _in.SpaceFd);
+			return true;
+		}
+
+		/// <summary>
+		/// Takes the next frame off the channel, waiting for one
+		/// </summary>
+		/// <param name="frame">Frame in the transmission format, rented from ArrayPool&lt;byte&gt;.Shared</param>
+		/// <param name="frameLength">Length of the frame, the rented array may be longer</param>
+		/// <param name="timeoutMs">Longest wait in milliseconds, -1 for no limit</param>
+		/// <returns>False if no frame came before the timeout</returns>
+		public bool Receive(out byte[] frame, out int frameLength, int timeoutMs = Timeout.Infinite)
+		{
+			var deadline = Deadline(timeoutMs);
+			while (!TryReceive(out frame, out frameLength))
+			{
+				if (!ConsumerSleep())
+					continue;
+				if (!WaitFd(_in.DataFd, Remaining(deadline, timeoutMs)))
+					return false;
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// Unmaps the channel and closes its descriptors, and its socket to akmd
+		/// </summary>
+		public void Dispose()
+		{
+			if (_base == null)
+				return;
+			munmap(_base, (UIntPtr)_mapSize);
+			_base = null;
+			CloseAll(_fds);
+			_socket?.Dispose();
+		}
+
+		private static Ring NewRing(byte* header, byte* data, int dataFd, int spaceFd, bool producer)
+		{
+			return new Ring
+			{
+				Header = header,
+				Data = data,
+				Size = *(ulong*)(header + SIZE),
+				Own = Volatile.Read(ref *(ulong*)(header + (producer ? HEAD : TAIL))),
+				Other = Volatile.Read(ref *(ulong*)(header + (producer ? TAIL : HEAD))),
+				DataFd = dataFd,
+				SpaceFd = spaceFd
+			};
+		}
+
+		private static ulong RecordSize(int size)
+		{
+			return (RECORD_PREFIX + (ulong)size + 7) & ~7UL;
+		}
+
+		//bytes a record takes at the producer position, with the end of the ring skipped if it does not fit
+		private static bool HasRoom(ref Ring ring, int size)
+		{
+			var record = RecordSize(size);
+			if (record > ring.Size)
+				return false;
+			var left = ring.Size - (ring.Own & (ring.Size - 1));
+			var needed = left < record ? left + record : record;
+			if (ring.Own - ring.Other + needed <= ring.Size)
+				return true;
+			ring.Other = Volatile.Read(ref *(ulong*)(ring.Header + TAIL));
+			return ring.Own - ring.Other + needed <= ring.Size;
+		}
+
+		private static byte* Reserve(ref Ring ring, int size)
+		{
+			if (!HasRoom(ref ring, size))
+				return null;
+			var offset = ring.Own & (ring.Size - 1);
+			if (ring.Size - offset < RecordSize(size))
+			{
+				//published with the record, the consumer never sees the marker alone
+				*(uint*)(ring.Data + offset) = RECORD_WRAP;
+				ring.Own += ring.Size - offset;
+				offset = 0;
+			}
+			return ring.Data + offset + RECORD_PREFIX;
+		}
+
+		private static void Commit(ref Ring ring, int size)
+		{
+			*(uint*)(ring.Data + (ring.Own & (ring.Size - 1))) = (uint)size;
+			ring.Own += RecordSize(size);
+			Volatile.Write(ref *(ulong*)(ring.Header + HEAD), ring.Own);
+		}
+
+		//the head and the records come from the other process, nothing it wrote may take the consumer out of the ring
+		private static byte* Peek(ref Ring ring, out int size)
+		{
+			size = 0;
+			for (;;)
+			{
+				if (ring.Corrupt)
+					return null;
+				if (ring.Own == ring.Other)
+				{
+					ring.Other = Volatile.Read(ref *(ulong*)(ring.Header + HEAD));
+					if (ring.Own == ring.Other)
+						return null;
+				}
+				var published = ring.Other - ring.Own;
+				var offset = ring.Own & (ring.Size - 1);
+				if (published > ring.Size)
+				{
+					ring.Corrupt = true;
+					continue;
+				}
+				var prefix = *(uint*)(ring.Data + offset);
+				if (prefix == RECORD_WRAP)
+				{
+					//the marker is published with the record after it
+					if (ring.Size - offset >= published)
+						ring.Corrupt = true;
+					else
+						ring.Own += ring.Size - offset;
+					continue;
+				}
+				if (RECORD_PREFIX + (ulong)prefix > ring.Size - offset || prefix > int.MaxValue || RecordSize((int)prefix) > published)
+				{
+					ring.Corrupt = true;
+					continue;
+				}
+				size = (int)prefix;
+				return ring.Data + offset + RECORD_PREFIX;
+			}
+		}
+
+		private static void Consume(ref Ring ring, int size)
+		{
+			ring.Own += RecordSize(size);
+			Volatile.Write(ref *(ulong*)(ring.Header + TAIL), ring.Own);
+		}
+
+		//the flag is cleared by whoever sees it set, so a sleeper is written to once
+		private static void Wake(byte* waiting, int fd)
+		{
+			Interlocked.MemoryBarrier();
+			if (Volatile.Read(ref *(int*)waiting) != 0 && Interlocked.Exchange(ref *(int*)waiting, 0) != 0)
+			{
+				ulong one = 1;
+				write(fd, &one, (UIntPtr)sizeof(ulong));
+			}
+		}
+
+		//false if room appeared meanwhile, otherwise the consumer wakes the producer through the space eventfd
+		private bool ProducerSleep(int size)
+		{
+			Interlocked.Exchange(ref *(int*)(_out.Header + PRODUCER_WAITING), 1);
+			if (HasRoom(ref _out, size))
+			{
+				Interlocked.Exchange(ref *(int*)(_out.Header + PRODUCER_WAITING), 0);
+				return false;
+			}
+			return true;
+		}
+
+		//false if a record arrived meanwhile, otherwise the producer wakes the consumer through the data eventfd
+		private bool ConsumerSleep()
+		{
+			Interlocked.Exchange(ref *(int*)(_in.Header + CONSUMER_WAITING), 1);
+			_in.Other = Volatile.Read(ref *(ulong*)(_in.Header + HEAD));
+			if (_in.Own != _in.Other)
+			{
+				Interlocked.Exchange(ref *(int*)(_in.Header + CONSUMER_WAITING), 0);
+				return false;
+			}
+			return true;
+		}
+
+		private static bool WaitFd(int fd, int timeoutMs)
+		{
+			var pfd = new PollFd { Fd = fd, Events = POLLIN };
+			int n;
+			do
+				n = poll(&pfd, (UIntPtr)1, timeoutMs);
+			while (n < 0 && Marshal.GetLastWin32Error() == EINTR);
+			if (n <= 0)
+				return false;
+			ulong count;
+			read(fd, &count, (UIntPtr)sizeof(ulong));
+			return true;
+		}
+
+		private static long Deadline(int timeoutMs)
+		{
+			return timeoutMs < 0 ? long.MaxValue : Stopwatch.GetTimestamp() + timeoutMs * Stopwatch.Frequency / 1000;
+		}
+
+		private static int Remaining(long deadline, int timeoutMs)
+		{
+			if (timeoutMs < 0)
+				return Timeout.Infinite;
+			var ticks = deadline - Stopwatch.GetTimestamp();
+			return ticks <= 0 ? 0 : (int)Math.Min(ticks * 1000 / Stopwatch.Frequency + 1, int.MaxValue);
+		}
+
+		private static byte* Map(int fd, ulong size)
+		{
+			var mapped = mmap(null, (UIntPtr)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (mapped == MAP_FAILED)
+				throw LastError("Cannot map channel memory");
+			return (byte*)mapped;
+		}
+
+		//the descriptors come with a one byte version, as AKMDShmSendFds sends them
+		private static int ReceiveFds(int socketFd, int[] fds)
+		{
+			byte version = 0;
+			var iov = new IoVec { Base = &version, Len = (UIntPtr)1 };
+			byte* control = stackalloc byte[CMSG_HEADER + 8 * FDS_NUM];
+			var msg = new MsgHdr { Iov = &iov, IovLen = (UIntPtr)1, Control = control, ControlLen = (UIntPtr)(CMSG_HEADER + 8 * FDS_NUM) };
+			long n;
+			do
+				n = (long)recvmsg(socketFd, &msg, MSG_CMSG_CLOEXEC);
+			while (n < 0 && Marshal.GetLastWin32Error() == EINTR);
+			if (n < 0)
+				throw LastError("Cannot receive the channel from akmd");
+
+			var received = 0;
+			var cmsg = (CmsgHdr*)control;
+			if ((ulong)msg.ControlLen >= (ulong)CMSG_HEADER && cmsg->Level == SOL_SOCKET && cmsg->Type == SCM_RIGHTS)
+			{
+				var data = (int*)(control + CMSG_HEADER);
+				var count = (int)(((ulong)cmsg->Len - CMSG_HEADER) / sizeof(int));
+				for (int i = 0; i < count; i++)
+				{
+					if (received < fds.Length)
+						fds[received++] = data[i];
+					else
+						close(data[i]);
+				}
+			}
+			if (n != 1 || version != 1)
+			{
+				for (int i = 0; i < received; i++)
+				{
+					close(fds[i]);
+				}
+				throw new InvalidDataException($"akmd sent channel version {version}, 1 is understood");
+			}
+			return received;
+		}
+
+		private static void CloseAll(int[] fds)
+		{
+			for (int i = 0; i < fds.Length; i++)
+			{
+				if (fds[i] >= 0)
+					close(fds[i]);
+				fds[i] = -1;
+			}
+		}
+
+		private void CheckNotDisposed()
+		{
+			if (_base == null)
+				throw new ObjectDisposedException(nameof(AkmShmChannel));
+		}
+
+		private static void CheckPlatform()
+		{
+			if (!RuntimeInformation.IsOSPlatform(OSPlatform.Linux) || IntPtr.Size != 8)
+				throw new PlatformNotSupportedException("Shared-memory channels need 64-bit Linux");
+		}
+
+		private static IOException LastError(string message)
+		{
+			return new IOException($"{message}, errno {Marshal.GetLastWin32Error()}");
+		}
+
+		//64-bit Linux definitions from the C headers
+		private const int MFD_CLOEXEC = 0x1;
+		private const int EFD_NONBLOCK = 0x800;
+		private const int EFD_CLOEXEC = 0x80000;
+		private const int F_DUPFD_CLOEXEC = 1030;
+		private const int SEEK_END = 2;
+		private const int PROT_READ = 0x1;
+		private const int PROT_WRITE = 0x2;
+		private const int MAP_SHARED = 0x1;
+		private static readonly void* MAP_FAILED = (void*)-1;
+		private const short POLLIN = 0x1;
+		private const int EINTR = 4;
+		private const int MSG_CMSG_CLOEXEC = 0x40000000;
+		private const int SOL_SOCKET = 1;
+		private const int SCM_RIGHTS = 1;
+		private const int CMSG_HEADER = 16;
+
+		[StructLayout(LayoutKind.Sequential)]
+		private struct IoVec
+		{
+			public void* Base;
+			public UIntPtr Len;
+		}
+
+		[StructLayout(LayoutKind.Sequential)]
+		private struct MsgHdr
+		{
+			public void* Name;
+			public int NameLen;
+			public IoVec* Iov;
+			public UIntPtr IovLen;
+			public void* Control;
+			public UIntPtr ControlLen;
+			public int Flags;
+		}
+
+		[StructLayout(LayoutKind.Sequential)]
+		private struct CmsgHdr
+		{
+			public UIntPtr Len;
+			public int Level;
+			public int Type;
+		}
+
+		[StructLayout(LayoutKind.Sequential)]
+		private struct PollFd
+		{
+			public int Fd;
+			public short Events;
+			public short REvents;
+		}
+
+		private const string LIBC = "libc";
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern int memfd_create(string name, int flags);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern int eventfd(uint initval, int flags);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern int ftruncate(int fd, long length);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern long lseek(int fd, long offset, int whence);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern int fcntl(int fd, int cmd, int arg);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern void* mmap(void* addr, UIntPtr length, int prot, int flags, int fd, long offset);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern int munmap(void* addr, UIntPtr length);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern IntPtr recvmsg(int sockfd, MsgHdr* msg, int flags);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern int poll(PollFd* fds, UIntPtr nfds, int timeout);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern IntPtr read(int fd, void* buf, UIntPtr count);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern IntPtr write(int fd, void* buf, UIntPtr count);
+
+		[DllImport(LIBC, SetLastError = true)]
+		private static extern int close(int fd);
+	}
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+
+namespace AKMLogic
+{
+	/// <summary>
+	/// Keeps the chunk order of the streams being received.
+	/// Chunks are handed on as they arrive, so a stream that breaks off has already delivered its leading chunks:
+	/// every broken stream is reported once through the callback and its later chunks are dropped silently.
+	/// A stream breaks off on a chunk out of sequence, or when it gets no chunk for the idle timeout; idle streams are
+	/// found as chunks arrive and, when the tracker is full, the least recently seen stream makes room for a new one.
+	/// Not thread safe, the Receiver only touches it from its pipe reader.
+	/// </summary>
+	public sealed class AkmStreamTracker
+	{
+		private sealed class StreamState
+		{
+			public uint Next;
+			public long LastSeen;
+			public bool Dropped;
+		}
+
+		private readonly Dictionary<(short RelationshipId, short SrcAddr, uint StreamId), StreamState> _streams = new Dictionary<(short, short, uint), StreamState>();
+		private readonly List<(short RelationshipId, short SrcAddr, uint StreamId)> _idle = new List<(short, short, uint)>();
+		private readonly int _capacity;
+		private readonly long _idleTimeoutTicks;
+		private readonly Action<(short RelationshipId, short SrcAddr, uint StreamId), uint, string> _dropped;
+		private long _nextSweep;
+
+		/// <summary>
+		/// Constructor
+		/// </summary>
+		/// <param name="capacity">Maximum number of streams tracked at once</param>
+		/// <param name="idleTimeout">Time without a chunk after which a stream is dropped</param>
+		/// <param name="dropped">Called once per dropped stream with the number of chunks it delivered and the reason</param>
+		public AkmStreamTracker(int capacity, TimeSpan idleTimeout, Action<(short RelationshipId, short SrcAddr, uint StreamId), uint, string> dropped)
+		{
+			if (capacity <= 0)
+			{
+				throw new ArgumentOutOfRangeException(nameof(capacity));
+			}
+
+			_capacity = capacity;
+			_idleTimeoutTicks = idleTimeout.Ticks * Stopwatch.Frequency / TimeSpan.TicksPerSecond;
+			_dropped = dropped ?? throw new ArgumentNullException(nameof(dropped));
+		}
+
+		/// <summary>
+		/// Number of streams tracked, dropped ones still waiting for their final chunk included
+		/// </summary>
+		public int Count => _streams.Count;
+
+		/// <summary>
+		/// Checks that a chunk is the next one of its stream
+		/// </summary>
+		/// <param name="relationshipId">Relationship the chunk was received in</param>
+		/// <param name="srcAddr">Node that sent the chunk</param>
+		/// <param name="chunk">Position of the chunk in its stream</param>
+		/// <param name="timestamp">Stopwatch timestamp of the arrival</param>
+		/// <returns>True if the chunk is to be delivered</returns>
+		public bool Accept(short relationshipId, short srcAddr, AkmPayloadChunk chunk, long timestamp)
+		{
+			if (timestamp - _nextSweep >= 0)
+			{
+				DropIdle(timestamp);
+				_nextSweep = timestamp + _idleTimeoutTicks;
+			}
+
+			var key = (relationshipId, srcAddr, chunk.StreamId);
+			if (!_streams.TryGetValue(key, out var stream))
+			{
+				if (_streams.Count >= _capacity)
+					DropLeastRecent();
+
+				stream = new StreamState();
+				_streams.Add(key, stream);
+			}
+			stream.LastSeen = timestamp;
+
+			if (!stream.Dropped && chunk.Index != stream.Next)
+			{
+				stream.Dropped = true;
+				_dropped(key, stream.Next, $"chunk {chunk.Index} out of sequence, expected {stream.Next}");
+			}
+
+			if (stream.Dropped)
+			{
+				if (chunk.IsFinal)
+					_streams.Remove(key);
+				return false;
+			}
+
+			if (chunk.IsFinal)
+				_streams.Remove(key);
+			else
+				stream.Next++;
+			return true;
+		}
+
+		/// <summary>
+		/// Drops the streams which got no chunk for the idle timeout
+		/// </summary>
+		/// <param name="timestamp">Stopwatch timestamp of now</param>
+		public void DropIdle(long timestamp)
+		{
+			foreach (var entry in _streams)
+			{
+				if (timestamp - entry.Value.LastSeen >= _idleTimeoutTicks)
+					_idle.Add(entry.Key);
+			}
+
+			foreach (var key in _idle)
+			{
+				Drop(key, "idle");
+			}
+			_idle.Clear();
+		}
+
+		private void DropLeastRecent()
+		{
+			var oldest = default((short, short, uint));
+			var oldestSeen = long.MaxValue;
+			foreach (var entry in _streams)
+			{
+				if (entry.Value.LastSeen < oldestSeen)
+				{
+					oldest = entry.Key;
+					oldestSeen = entry.Value.LastSeen;
+				}
+			}
+			Drop(oldest, "too many open streams");
+		}
+
+		private void Drop((short RelationshipId, short SrcAddr, uint StreamId) key, string reason)
+		{
+			var stream = _streams[key];
+			_streams.Remove(key);
+			//a stream already dropped was reported when it was
+			if (!stream.Dropped)
+				_dropped(key, stream.Next, reason);
+		}
+	}
+}
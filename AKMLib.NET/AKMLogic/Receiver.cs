@@ -6,27 +6,37 @@ using AKMCommon.Struct;
 using AKMInterface;
 using Microsoft.Extensions.Logging;
 using System;
-using System.Collections.Generic;
+using System.Buffers;
+using System.Diagnostics;
 using System.IO;
-using System.Linq;
+using System.IO.Pipelines;
 using System.Net.Sockets;
 using System.Threading;
+using System.Threading.Tasks;
 
 namespace AKMLogic
 {
 	/// <summary>
-	/// Provides functionality for receiving AKM Frames over network stream and extracts transmitted data 
+	/// Provides functionality for receiving AKM Frames over network stream and extracts transmitted data.
+	/// Receiving is asynchronous: socket reads fill a pipe of pooled buffers and frames are deframed in place,
+	/// so connections do not hold a thread while idle.
 	/// </summary>
 	public sealed class Receiver
 	{
-		private const int BUFFER_SIZE = 1024;
-		private readonly NetworkStream _stream;
-		private Thread _thread;
+		private const int BUFFER_SIZE = 4096;
+		private const int RELATIONSHIP_ID_SIZE = 2;
+		private const int FRAME_HEADER_SIZE = RELATIONSHIP_ID_SIZE + sizeof(long); //RelationshipId and data size
+		private const long MAX_FRAME_SIZE = 16 * 1024 * 1024;
+		private const int MAX_OPEN_STREAMS = 1024;
+		private static readonly TimeSpan STREAM_IDLE_TIMEOUT = TimeSpan.FromMinutes(1);
 		private readonly ILogger _logger;
 		private readonly ICryptography _crypto;
 		private AkmRelationship _akmRelationship;
-		private readonly CancellationToken? _cancellationToken;
+		private readonly CancellationToken _cancellationToken;
 		private readonly Socket _socket;
+		private Task _receiveTask;
+		//chunk order of the streams being received, only touched by the pipe reader
+		private readonly AkmStreamTracker _streams;
 
 		/// <summary>
 		/// Node Number in Relationship
@@ -38,6 +48,18 @@ namespace AKMLogic
 		/// </summary>
 		public event EventHandler<AkmDataReceivedEventArgs> DataReceived;
 
+		/// <summary>
+		/// This event will be fired when a stream breaks off after some of its chunks were delivered: a chunk came out of
+		/// sequence, or none came for a while. FrameData is null and ChunkIndex is the number of chunks delivered;
+		/// the rest of the stream is dropped.
+		/// </summary>
+		public event EventHandler<AkmDataReceivedEventArgs> StreamAborted;
+
+		/// <summary>
+		/// Task completing when the connection is closed or receiving is cancelled
+		/// </summary>
+		public Task Completion => _receiveTask ?? Task.CompletedTask;
+
 		/// <summary>
 		/// Simplified contructor that uses default ICryptography implementation provided by AKMCrypto class.
 		/// </summary>
@@ -48,10 +70,10 @@ namespace AKMLogic
 		public Receiver(Socket socket, CancellationToken token, ILogger logger, ICryptography cryptography)
 		{
 			_socket = socket;
-			_stream = new NetworkStream(socket);
 			_logger = logger;
 			_crypto = cryptography;
 			_cancellationToken = token;
+			_streams = new AkmStreamTracker(MAX_OPEN_STREAMS, STREAM_IDLE_TIMEOUT, StreamDropped);
 		}
 
 		/// <summary>
@@ -66,15 +88,11 @@ namespace AKMLogic
 		}
 
 		/// <summary>
-		/// Start new thread responsible for checking network stream for new data and processing it
+		/// Starts receiving and processing data from the socket
 		/// </summary>
 		public void StartReceiving()
 		{
-			if (_stream != null)
-			{
-				_thread = new Thread(Run);
-				_thread.Start(_cancellationToken);
-			}
+			StartReceiving(_cancellationToken);
 		}
 		/// <summary>
 		/// Starts the receiver process with option to pass CancelationToken
@@ -82,141 +100,239 @@ namespace AKMLogic
 		/// <param name="token"></param>
 		public void StartReceiving(CancellationToken token)
 		{
-			if (_stream != null)
+			if (_socket != null && _receiveTask == null)
 			{
-				_thread = new Thread(Run);
-				_thread.Start(token);
+				_receiveTask = Task.Run(() => RunAsync(token));
 			}
 		}
 
-		private bool IsConnectionAlive()
+		private async Task RunAsync(CancellationToken token)
 		{
-			if (_socket != null)
+			var pipe = new Pipe(new PipeOptions(
+				pauseWriterThreshold: MAX_FRAME_SIZE + FRAME_HEADER_SIZE + BUFFER_SIZE,
+				resumeWriterThreshold: MAX_FRAME_SIZE / 2,
+				minimumSegmentSize: BUFFER_SIZE,
+				useSynchronizationContext: false));
+
+			using (var cts = CancellationTokenSource.CreateLinkedTokenSource(token))
 			{
-				var socketError = _socket.Poll(1, SelectMode.SelectError);
-				return !socketError;
+				try
+				{
+					await Task.WhenAll(FillPipeAsync(pipe.Writer, cts.Token), ReadPipeAsync(pipe.Reader, cts)).ConfigureAwait(false);
+				}
+				catch (Exception ex)
+				{
+					_logger.LogError($"General Error in Receiver: {ex.Message}");
+				}
 			}
-			return false;
 		}
 
+		private async Task FillPipeAsync(PipeWriter writer, CancellationToken token)
+		{
+			try
+			{
+				while (true)
+				{
+					var memory = writer.GetMemory(BUFFER_SIZE);
+					var readBytes = await _socket.ReceiveAsync(memory, SocketFlags.None, token).ConfigureAwait(false);
+					if (readBytes == 0)
+						break;
+
+					writer.Advance(readBytes);
+
+					var result = await writer.FlushAsync(token).ConfigureAwait(false);
+					if (result.IsCompleted || result.IsCanceled)
+						break;
+				}
+			}
+			catch (OperationCanceledException)
+			{
+			}
+			catch (SocketException ex)
+			{
+				_logger.LogError($"IO Error in Receiver: {ex.Message}");
+			}
+			catch (ObjectDisposedException ex)
+			{
+				_logger.LogError($"IO Error in Receiver: {ex.Message}");
+			}
+			finally
+			{
+				writer.Complete();
+			}
+		}
 
-		private void Run(object token)
+		private async Task ReadPipeAsync(PipeReader reader, CancellationTokenSource cts)
 		{
-			var frameCounter = 0;
-			CancellationToken? ct = (CancellationToken)token;
 			try
 			{
-				byte[] inputBuffer = new byte[BUFFER_SIZE];
-				var frame = new List<byte>();
-				int readbytes = 0;
-				long dataCollected = 0;
-				while (!(ct?.IsCancellationRequested ?? false) && IsConnectionAlive())
+				while (true)
 				{
-					try
-					{
+					var result = await reader.ReadAsync(cts.Token).ConfigureAwait(false);
+					var buffer = result.Buffer;
 
-						readbytes = 0;
-						dataCollected = 0;
-						while (!((ct?.IsCancellationRequested ?? false) || _stream.DataAvailable))
+					while (TryReadFrame(ref buffer, out var relationshipId, out var frame, out var frameLength))
+					{
+						if (frame == null)
+							continue;
+						try
 						{
-							Thread.Sleep(5);
+							Dispatch(frame, frameLength, relationshipId);
 						}
-						if (ct?.IsCancellationRequested ?? false)
-							break;
-
-						//let's try to get the frame size first - 2 bytes for RelationshipId and 8 bytes for ulong with data size
-						var header = new byte[10];
-						short relationShipId = 0;
-						long dataSize = 0;
-						var size = _stream.Read(header, 0, 10);
-						int bufferReadSize = 0;
-						relationShipId = BitConverter.ToInt16(header.Take(2).ToArray());
-						dataSize = BitConverter.ToInt64(header.TakeLast(8).ToArray());
-						_akmRelationship = AkmSetup.AkmRelationships[relationShipId];
-						short _SrcAddr = 0;
-						short _TrgAddr = 0;
-						AKMCommon.Enum.AkmEvent _AkmEvent;
-
-						frame.AddRange(header.Take(2));
-
-						while (dataCollected < dataSize)
+						finally
 						{
-							bufferReadSize = (int)Math.Min((dataSize - dataCollected), BUFFER_SIZE);
-
-							if ((readbytes = _socket.Receive(inputBuffer, 0, bufferReadSize, SocketFlags.None)) > 0)
-							{
-								frame.AddRange(inputBuffer.Take(readbytes));
-								dataCollected += Convert.ToInt64(readbytes);
-
-								if (dataCollected == dataSize)
-								{
-									frameCounter++;
-									//_logger.LogDebug("Data Received event fired");
-									DataReceived(null, new AkmDataReceivedEventArgs
-									{
-										FrameData = ExtractContentFromAkmFrame(frame.ToArray(), relationShipId, out _SrcAddr, out _TrgAddr, out _AkmEvent),
-										RelationshipId = relationShipId,
-										SrcAddr = _SrcAddr,
-										TrgAddr = _TrgAddr,
-										AkmEvent = _AkmEvent
-									});
-									frame.Clear();
-								}
-
-								Array.Clear(inputBuffer, 0, BUFFER_SIZE);
-							}
-							else //wait for the rest of the data to appear in the stream
-							{
-								Thread.Sleep(5);
-							}
+							ArrayPool<byte>.Shared.Return(frame);
 						}
 					}
-					catch (IOException ex)
-					{
-						_logger.LogError($"IO Error in Receiver: {ex.Message}");
-						if (_stream != null)
-						{
-							_stream.Close();
-						}
 
-					}
+					//everything received so far was examined, next read waits for more data
+					reader.AdvanceTo(buffer.Start, buffer.End);
+
+					if (result.IsCompleted || result.IsCanceled)
+						break;
 				}
 			}
-			catch (Exception ex)
+			catch (OperationCanceledException)
 			{
-				_logger.LogError($"General Error in Receiver: {ex.Message}");
 			}
 			finally
 			{
-				if (_stream != null)
-					_stream.Close();
+				reader.Complete();
+				//stops the socket reads as well when frames cannot be processed anymore
+				cts.Cancel();
 			}
 		}
 
-		private byte[] ExtractContentFromAkmFrame(byte[] akmFrame, short relationshipId, out short SrcAddr, out short TrgAddr, out AKMCommon.Enum.AkmEvent FrameEvent)
+		private static bool TryReadFrame(ref ReadOnlySequence<byte> buffer, out short relationshipId, out byte[] frame, out int frameLength)
 		{
+			relationshipId = 0;
+			frame = null;
+			frameLength = 0;
+
+			if (buffer.Length < FRAME_HEADER_SIZE)
+				return false;
+
+			Span<byte> header = stackalloc byte[FRAME_HEADER_SIZE];
+			buffer.Slice(0, FRAME_HEADER_SIZE).CopyTo(header);
+			relationshipId = BitConverter.ToInt16(header);
+			var dataSize = BitConverter.ToInt64(header.Slice(RELATIONSHIP_ID_SIZE));
+
+			if (dataSize < 0 || dataSize > MAX_FRAME_SIZE)
+				throw new InvalidDataException($"Invalid AKM Frame size {dataSize}.");
+
+			if (buffer.Length < FRAME_HEADER_SIZE + dataSize)
+				return false;
+
+			if (dataSize > 0)
+			{
+				//the only copy of the frame, straight from the pooled segments into a pooled array lent to AkmEncryptedFrame
+				frameLength = RELATIONSHIP_ID_SIZE + (int)dataSize;
+				frame = ArrayPool<byte>.Shared.Rent(frameLength);
+				header.Slice(0, RELATIONSHIP_ID_SIZE).CopyTo(frame);
+				buffer.Slice(FRAME_HEADER_SIZE, dataSize).CopyTo(frame.AsSpan(RELATIONSHIP_ID_SIZE));
+			}
+
+			buffer = buffer.Slice(FRAME_HEADER_SIZE + dataSize);
+			return true;
+		}
+
+		private void Dispatch(byte[] frame, int frameLength, short relationshipId)
+		{
+			//the connection carries other relationships too, a frame none of ours can take is skipped, not fatal
+			if (!AkmSetup.AkmRelationships.ContainsKey(relationshipId))
+			{
+				_logger.LogError($"Frame of {frameLength} bytes for unknown Relationship #{relationshipId} dropped");
+				return;
+			}
+
+			short _SrcAddr = 0;
+			short _TrgAddr = 0;
+			AKMCommon.Enum.AkmEvent _AkmEvent;
+
+			var frameData = ExtractContentFromAkmFrame(frame, frameLength, relationshipId, out _SrcAddr, out _TrgAddr, out _AkmEvent, out var chunk);
+			if (chunk.HasValue && !_streams.Accept(relationshipId, _SrcAddr, chunk.Value, Stopwatch.GetTimestamp()))
+				return;
+
+			try
+			{
+				DataReceived?.Invoke(null, new AkmDataReceivedEventArgs
+				{
+					FrameData = frameData,
+					RelationshipId = relationshipId,
+					SrcAddr = _SrcAddr,
+					TrgAddr = _TrgAddr,
+					AkmEvent = _AkmEvent,
+					StreamId = chunk?.StreamId,
+					ChunkIndex = chunk?.Index ?? 0,
+					IsFinalChunk = chunk?.IsFinal ?? false
+				});
+			}
+			catch (Exception ex)
+			{
+				//a failing handler loses its frame, the connection keeps reading for the other relationships
+				_logger.LogError($"Error in DataReceived handler for Relationship #{relationshipId}: {ex.Message}");
+			}
+		}
+
+		private void StreamDropped((short RelationshipId, short SrcAddr, uint StreamId) stream, uint chunksDelivered, string reason)
+		{
+			_logger.LogError($"Stream {stream.StreamId} from node {stream.SrcAddr} in Relationship #{stream.RelationshipId} dropped after {chunksDelivered} chunks: {reason}");
+			if (chunksDelivered == 0)
+				return;
+
+			try
+			{
+				StreamAborted?.Invoke(null, new AkmDataReceivedEventArgs
+				{
+					RelationshipId = stream.RelationshipId,
+					SrcAddr = stream.SrcAddr,
+					StreamId = stream.StreamId,
+					ChunkIndex = chunksDelivered
+				});
+			}
+			catch (Exception ex)
+			{
+				_logger.LogError($"Error in StreamAborted handler for Relationship #{stream.RelationshipId}: {ex.Message}");
+			}
+		}
+
+		private byte[] ExtractContentFromAkmFrame(byte[] akmFrame, int frameLength, short relationshipId, out short SrcAddr, out short TrgAddr, out AKMCommon.Enum.AkmEvent FrameEvent, out AkmPayloadChunk? chunk)
+		{
+			chunk = null;
 			SrcAddr = 0;
 			TrgAddr = 0;
 			FrameEvent = AKMCommon.Enum.AkmEvent.None;
+			IDecryptedFrame decFrame = null;
 			try
 			{
-				var encFrame = new AkmEncryptedFrame(_crypto, _logger, akmFrame, 1);
+				var encFrame = new AkmEncryptedFrame(_crypto, _logger, akmFrame, frameLength, 1);
 				_akmRelationship = AkmSetup.AkmRelationships[relationshipId];
 
-				var akmStatus = _akmRelationship.ProcessFrame(encFrame, out IDecryptedFrame decFrame);
+				var akmStatus = _akmRelationship.ProcessFrame(encFrame, out decFrame);
 				//_logger.LogDebug($"Frame processing status: {akmStatus} ");
 				if (_akmRelationship.IsConfigurationUpdated)
 					AkmSetup.UpdateAkmConfiguration(relationshipId);
 				SrcAddr = decFrame.GetSourceAddressAsShort();
 				TrgAddr = decFrame.GetTargetAddressAsShort();
 				FrameEvent = decFrame.FrameEvent;
-				return decFrame?.GetContentBytes();
+				if (!AkmSetup.AkmAppCfg.TryGetValue(relationshipId, out var appCfg))
+					return decFrame.GetContentBytes();
+				//decoded straight from the frame buffer, the payload is the only copy made
+				if (decFrame is AkmDecryptedFrame pooledFrame)
+					return AkmPayloadCodec.Decode(pooledFrame.ContentSpan, appCfg, out chunk);
+				return AkmPayloadCodec.Decode(decFrame.GetContentBytes(), appCfg, out chunk);
 			}
 			catch (Exception ex)
 			{
 				_logger.LogError("Error in AKM Frame Receive Processing: " + ex.Message);
+				chunk = null;
 				return null;
 			}
+			finally
+			{
+				//content is copied out, the frame buffer goes back for the next frame
+				(decFrame as IDisposable)?.Dispose();
+			}
 		}
 	}
 }
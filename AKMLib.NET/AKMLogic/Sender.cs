@@ -6,31 +6,35 @@ using AKMCommon.Enum;
 using AKMInterface;
 using Microsoft.Extensions.Logging;
 using System;
-using System.Collections.Generic;
-using System.Linq;
+using System.IO;
 using System.Net.Sockets;
 using System.Threading;
 
 namespace AKMLogic
 {
 	/// <summary>
-	/// Provides functionality for sending data on specified network stream using AKM Frames
+	/// Provides functionality for sending data of a single relationship using AKM Frames.
+	/// Frames are queued without locking and written by the AkmConnection the Sender is attached to, which may be
+	/// shared with Senders of other relationships.
 	/// </summary>
 	public sealed class Sender
 	{
-		private const int BUFFER_SIZE = 1024;
+		private const int DEF_QUEUE_CAPACITY = 1024;
+		private const int CONTROL_QUEUE_CAPACITY = 256;
+		//chunks of a stream queued at a time, which bounds the memory a stream holds whatever its length
+		private const int STREAM_WINDOW = 4;
+		private const int STREAM_WAIT_MS = 100;
 
-		private NetworkStream _stream;
-		private readonly Thread _thread;
-		private IList<byte[]> _dataBuffer;
-		private readonly object _locker = new object();
+		private AkmConnection _connection;
+		private readonly AkmSendLanes _lanes;
+		private readonly int _latencyBudget;
 		private CancellationToken _cancellationToken;
 		private ILogger _logger;
 		private ICryptography _crypto;
 		private readonly short _relationshipId;
 		private AkmRelationship _akmRelationship;
-
-		private Socket _socket;
+		private readonly ManualResetEventSlim _framesSent = new ManualResetEventSlim(false);
+		private int _nextStreamId;
 
 		/// <summary>
 		/// Determine if all required components are provided and defined for proper work
@@ -39,7 +43,7 @@ namespace AKMLogic
 		{
 			get
 			{
-				return (_stream != null) && (_logger != null) && (_crypto != null);
+				return (_connection != null) && (_logger != null) && (_crypto != null);
 			}
 		}
 
@@ -48,9 +52,36 @@ namespace AKMLogic
 		/// </summary>
 		public bool IsActive
 		{
-			get { return _thread != null && _thread.IsAlive && IsConnectionAlive; }
+			get { return _connection != null && _connection.IsActive; }
 		}
 
+		/// <summary>
+		/// Connection the frames are sent over
+		/// </summary>
+		public AkmConnection Connection => _connection;
+
+		/// <summary>
+		/// Number of frames waiting to be sent
+		/// </summary>
+		public int PendingFrames => _lanes.Count;
+
+		/// <summary>
+		/// Returns value indicating if the data send queue is full and new data frames are rejected
+		/// </summary>
+		public bool IsBackPressured => _lanes.IsFull(AkmSendLane.Data);
+
+		/// <summary>
+		/// Queueing statistics of session establishment frames
+		/// </summary>
+		public AkmSendLaneStatistics ControlLaneStatistics => _lanes.ControlStatistics;
+
+		/// <summary>
+		/// Queueing statistics of data frames
+		/// </summary>
+		public AkmSendLaneStatistics DataLaneStatistics => _lanes.DataStatistics;
+
+		internal AkmSendLanes Lanes => _lanes;
+
 		private AkmRelationship AkmRelationship
 		{
 			get
@@ -66,20 +97,38 @@ namespace AKMLogic
 		internal Sender(short relationshipId)
 		{
 			_relationshipId = relationshipId;
-			_dataBuffer = new List<byte[]>(1);
+
+			var queueCapacity = DEF_QUEUE_CAPACITY;
+			if (AkmSetup.AkmAppCfg.TryGetValue(relationshipId, out var appCfg))
+			{
+				if (appCfg.SendQueueCapacity > 0)
+					queueCapacity = appCfg.SendQueueCapacity;
+				_latencyBudget = appCfg.SendLatencyBudget;
+			}
+			_lanes = new AkmSendLanes(queueCapacity, CONTROL_QUEUE_CAPACITY);
 			_crypto = new AkmCrypto();
-			_thread = new Thread(Run);
-			_thread.Start();
 		}
 
 		/// <summary>
-		/// Sets Socket object for network communication
+		/// Sets Socket object for network communication, the Sender gets a connection of its own
 		/// </summary>
 		/// <param name="socket"></param>
 		public void SetSocket(Socket socket)
 		{
-			_socket = socket;
-			_stream = new NetworkStream(socket);
+			SetConnection(new AkmConnection(socket, _logger, _latencyBudget));
+		}
+
+		/// <summary>
+		/// Attaches the Sender to a connection, possibly shared with other relationships
+		/// </summary>
+		/// <param name="connection">Connection to the peer</param>
+		public void SetConnection(AkmConnection connection)
+		{
+			_connection?.Unregister(this);
+			_connection = connection;
+			_connection.SetCancellationToken(_cancellationToken);
+			_connection.Register(this);
+			_connection.Signal();
 		}
 
 		/// <summary>
@@ -103,36 +152,25 @@ namespace AKMLogic
 		internal void SetCanellationToken(CancellationToken token)
 		{
 			_cancellationToken = token;
+			_connection?.SetCancellationToken(token);
 		}
 
-		private bool IsConnectionAlive
-		{
-			get
-			{
-				if (_socket != null)
-				{
-					var socketWriteable = _socket.Poll(1, SelectMode.SelectWrite);
-					var socketError = _socket.Poll(1, SelectMode.SelectError);
-
-					return socketWriteable && !socketError;
-				}
-				return false;
-			}
-		}
-
-		public void SendData(byte[] data, short targetAddress, short sourceAddres, AkmEvent AKMEvent)
+		/// <summary>
+		/// Starts data transmission process with given source address and AKM Event
+		/// </summary>
+		/// <param name="data">Byte array with data that needs to be sent</param>
+		/// <param name="targetAddress">Target address value</param>
+		/// <param name="sourceAddres">Source address value</param>
+		/// <param name="AKMEvent">AKM Event value that needs to be set on AKM Frame</param>
+		/// <returns>False if the frame was not queued because the sender is not running or its queue is full</returns>
+		public bool SendData(byte[] data, short targetAddress, short sourceAddres, AkmEvent AKMEvent)
 		{
-			if (_thread != null && _thread.IsAlive)
+			if (_connection != null && _connection.IsRunning)
 			{
 				var frame = PrepareFrame(data, BitConverter.GetBytes(targetAddress), BitConverter.GetBytes(sourceAddres));
-				var encFrame = AkmRelationship.PrepareFrameWithEvent(frame, AKMEvent);
-				encFrame.SetFrameLength();
-
-				lock (_locker)
-				{
-					_dataBuffer.Add(encFrame.GetTransmissionData());
-				}
+				return Enqueue(frame, AkmRelationship.PrepareFrameWithEvent(frame, AKMEvent));
 			}
+			return false;
 		}
 
 		/// <summary>
@@ -141,85 +179,116 @@ namespace AKMLogic
 		/// <param name="data">Byte array with data that needs to be sent</param>
 		/// <param name="targetAddress">Target address value</param>
 		/// <param name="forcedAkmEvent">Optional AKM Event value that needs to be set on AKM Frame</param>
-		
-		public void SendData(byte[] data, short targetAddress, AkmEvent? forcedAkmEvent = null)
+		/// <returns>False if the frame was not queued because the sender is not running or its queue is full</returns>
+		public bool SendData(byte[] data, short targetAddress, AkmEvent? forcedAkmEvent = null)
 		{
-			if (_thread != null && _thread.IsAlive)
+			if (_connection != null && _connection.IsRunning)
 			{
 				var frame = PrepareFrame(data, BitConverter.GetBytes(targetAddress));
-				var encFrame = AkmRelationship.PrepareFrame(frame, forcedAkmEvent);
-				encFrame.SetFrameLength();
-
-				lock (_locker)
-				{
-					_dataBuffer.Add(encFrame.GetTransmissionData());
-				}
+				return Enqueue(frame, AkmRelationship.PrepareFrame(frame, forcedAkmEvent));
 			}
+			return false;
+		}
+
+		/// <summary>
+		/// Sends a payload of any length as a stream of chunk frames, each encrypted and authenticated on its own.
+		/// The payload is read one chunk at a time and no more than a few chunks are queued at once, so the memory
+		/// held is bounded by AkmAppConfig.StreamChunkSize, not by the payload length. The receiver delivers every
+		/// chunk as soon as it is decrypted. Requires AkmAppConfig.ChunkedPayloads on all nodes of the relationship.
+		/// </summary>
+		/// <param name="payload">Stream with data that needs to be sent, read to its end</param>
+		/// <param name="targetAddress">Target address value</param>
+		/// <param name="token">Token for cancelling the transmission</param>
+		/// <returns>False if the sender stopped before the whole payload was queued</returns>
+		/// <exception cref="OperationCanceledException">Token was cancelled while waiting for chunks to be sent</exception>
+		public bool SendStream(Stream payload, short targetAddress, CancellationToken token = default)
+		{
+			var appCfg = AkmSetup.AkmAppCfg[_relationshipId];
+			if (!appCfg.ChunkedPayloads)
+				throw new InvalidOperationException($"Relationship #{_relationshipId} does not use chunked payloads");
+
+			var buffer = new byte[AkmPayloadCodec.ChunkSize(appCfg)];
+			var streamId = (uint)Interlocked.Increment(ref _nextStreamId);
+			var targetAddr = BitConverter.GetBytes(targetAddress);
+			var sourceAddr = BitConverter.GetBytes((short)appCfg.SelfAddressValue);
+
+			for (uint index = 0; ; index++)
+			{
+				var length = ReadChunk(payload, buffer);
+				//a payload ending on a chunk boundary is closed by an empty final chunk
+				var isFinal = length < buffer.Length;
+				var content = AkmPayloadCodec.EncodeChunk(buffer.AsSpan(0, length), new AkmPayloadChunk(streamId, index, isFinal), appCfg);
 
+				if (!WaitForStreamWindow(token))
+					return false;
+				var frame = BuildFrame(content, targetAddr, sourceAddr);
+				if (!Enqueue(frame, AkmRelationship.PrepareFrame(frame)))
+					return false;
+
+				if (isFinal)
+					return true;
+			}
 		}
+
 		/// <summary>
-		/// Starts sedner thread
+		/// Wakes up streams waiting for their chunks to be sent
 		/// </summary>
-		private void Run()
+		internal void SignalSent()
+		{
+			if (!_framesSent.IsSet)
+				_framesSent.Set();
+		}
+
+		private bool WaitForStreamWindow(CancellationToken token)
 		{
-			while (!_cancellationToken.IsCancellationRequested)
+			while (true)
 			{
-				var chunkStart = 0;
-				int chunkLength;
+				if (_connection == null || !_connection.IsRunning)
+					return false;
+				//reset before checking the queue so frames sent in between still wake us up
+				_framesSent.Reset();
+				if (_lanes.Count < STREAM_WINDOW)
+					return true;
+				_framesSent.Wait(STREAM_WAIT_MS, token);
+			}
+		}
 
-				while ((_dataBuffer.Count) == 0 && !_cancellationToken.IsCancellationRequested)
-				{
-					Thread.Sleep(5);
-				}
-				if (_cancellationToken.IsCancellationRequested)
+		private static int ReadChunk(Stream payload, byte[] buffer)
+		{
+			var length = 0;
+			while (length < buffer.Length)
+			{
+				var read = payload.Read(buffer, length, buffer.Length - length);
+				if (read == 0)
 					break;
+				length += read;
+			}
+			return length;
+		}
 
-				if (IsConnectionAlive && _stream != null && _stream.CanWrite)
-				{
-					lock (_locker)
-					{
-						byte[] data = _dataBuffer.FirstOrDefault();
-						try
-						{
-							while (chunkStart < data.Length)
-							{
-								chunkLength = Math.Min(BUFFER_SIZE, data.Length - chunkStart);
-								_socket.Send(data.AsSpan(chunkStart, chunkLength).ToArray());
-
-								chunkStart += chunkLength;
-							}
-						}
-						catch (SocketException sockEx)
-						{
-							_logger.LogError($"Unable to connect to remote address. {sockEx}");
-							return;
-						}
-						catch (System.IO.IOException ioEx)
-						{
-							_logger.LogError($"Unable to connect to remote address. {ioEx}");
-							return;
-						}
-						finally
-						{
-							_dataBuffer.Remove(data);
-							data = null;
-						}
-					}
-				}
-				else
-				{
-					_logger.LogError("Unable to connect to remote address. Sender process will now close.");
-					_stream.Dispose();
-					if (_socket.Connected)
-					{
-						_socket.Shutdown(SocketShutdown.Both);
-						_socket.Disconnect(true);
-					}
-					_socket.Dispose();
-					return;
+		/// <summary>
+		/// Queues an encrypted frame, handing its decrypted frame back for reuse by the next one
+		/// </summary>
+		private bool Enqueue(AkmDecryptedFrame frame, IEncryptedFrame encFrame)
+		{
+			encFrame.SetFrameLength();
+			var lane = AkmSendLanes.LaneOf(frame.FrameEvent);
+			var transmissionData = encFrame.GetTransmissionData();
+			frame.Dispose();
 
-				}
+			return Enqueue(transmissionData, lane);
+		}
+
+		private bool Enqueue(byte[] transmissionData, AkmSendLane lane)
+		{
+			if (!_lanes.TryEnqueue(transmissionData, lane))
+			{
+				_logger?.LogWarning($"{lane} send queue of Relationship #{_relationshipId} is full, frame dropped");
+				return false;
 			}
+
+			_connection.Signal();
+			return true;
 		}
 
 		/// <summary>
@@ -228,24 +297,26 @@ namespace AKMLogic
 		/// <param name="content">Byte array with data that needs to be sent</param>
 		/// <param name="targetAddress">byte array with destination address value</param>
 		/// <returns></returns>
-		private IDecryptedFrame PrepareFrame(byte[] content, byte[] targetAddress)
+		private AkmDecryptedFrame PrepareFrame(byte[] content, byte[] targetAddress)
 		{
-			var sourceAddr = BitConverter.GetBytes(AkmSetup.AkmAppCfg[_relationshipId].SelfAddressValue);
+			var sourceAddr = BitConverter.GetBytes((short)AkmSetup.AkmAppCfg[_relationshipId].SelfAddressValue);
 			return PrepareFrame(content, targetAddress, sourceAddr);
 		}
 
-		private IDecryptedFrame PrepareFrame(byte[] content, byte[] targetAddress, byte[] sourceAddress)
+		private AkmDecryptedFrame PrepareFrame(byte[] content, byte[] targetAddress, byte[] sourceAddress)
 		{
-			var decFrame = new AkmDecryptedFrame(_crypto, _logger, 1);
-
-			var messageFrame = new byte[content.Length + 5];
-
-			Array.Copy(sourceAddress, 0, messageFrame, 0, sourceAddress.Length);
-			Array.Copy(targetAddress, 0, messageFrame, sourceAddress.Length, targetAddress.Length);
+			if (AkmSetup.AkmAppCfg.TryGetValue(_relationshipId, out var appCfg))
+				content = AkmPayloadCodec.Encode(content, appCfg);
+			return BuildFrame(content, targetAddress, sourceAddress);
+		}
 
-			Array.Copy(content, 0, messageFrame, 5, content.Length);
+		private AkmDecryptedFrame BuildFrame(byte[] content, byte[] targetAddress, byte[] sourceAddress)
+		{
+			var decFrame = AkmDecryptedFrame.Rent(_crypto, _logger, 1);
 
-			decFrame.SetData(messageFrame);
+			decFrame.SetContent(content);
+			decFrame.SetSourceAddress(sourceAddress);
+			decFrame.SetTargetAddress(targetAddress);
 			return decFrame;
 		}
 	}
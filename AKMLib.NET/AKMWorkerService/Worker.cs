@@ -83,13 +83,10 @@ namespace AKMWorkerService
 				if (thr.IsAlive)
 					thr.Join(1000);
 			}
-			foreach (var rel in _relationshipPools)
+			foreach (var cli in _relationshipPools.SelectMany(rel => rel.RelationshipNodesClients.Values).Distinct())
 			{
-				foreach (var cli in rel.RelationshipNodesClients.Values)
-				{
-					cli.Close();
-					cli.Dispose();
-				}
+				cli.Close();
+				cli.Dispose();
 			}
 			return base.StopAsync(cancellationToken);
 		}
@@ -99,13 +96,14 @@ namespace AKMWorkerService
 		{
 			_logger.LogInformation("AKM Worker service running at: {time}", DateTimeOffset.Now);
 			ct = cancellationToken;
-			foreach (var akmAppConfig in AkmSetup.AkmAppCfg.Values)
+			//relationships configured on the same endpoint share the connections accepted there
+			foreach (var endpointConfigs in AkmSetup.AkmAppCfg.Values.GroupBy(c => (c.IPAddress, c.CommunicationPort)))
 			{
 				Thread thread = new Thread(StartListeningServer);
 				_workerThreads.Add(thread);
 
-				_logger.LogDebug($"Starting new Relationship listening thread. { akmAppConfig.RelationshipId}");
-				thread.Start(akmAppConfig);
+				_logger.LogDebug($"Starting new listening thread for Relationships {string.Join(", ", endpointConfigs.Select(c => c.RelationshipId))}");
+				thread.Start(endpointConfigs.ToArray());
 			}
 
 			while (!cancellationToken.IsCancellationRequested)
@@ -116,9 +114,10 @@ namespace AKMWorkerService
 			await this.StopAsync(cancellationToken);
 		}
 
-		private void StartListeningServer(object akmAppConfig)
+		private void StartListeningServer(object akmAppConfigs)
 		{
-			cfg = akmAppConfig as AkmAppConfig;
+			var configs = akmAppConfigs as AkmAppConfig[];
+			cfg = configs[0];
 			if (!IPAddress.TryParse(cfg.IPAddress, out IPAddress ipAddr))
 				ipAddr = IPAddress.Loopback;
 
@@ -128,23 +127,38 @@ namespace AKMWorkerService
 			while (Thread.CurrentThread.ThreadState != ThreadState.StopRequested && !ct.IsCancellationRequested)
 			{
 				TcpClient _client = server.AcceptTcpClient();
-				var akmPool = _relationshipPools.FirstOrDefault(x => x.RelationshipID == cfg.RelationshipId);
-				if (akmPool == null)
+				//frames go out in batches already, Nagle would only hold back the last one of a batch for the peer's ACK
+				_client.NoDelay = true;
+				short firstNodeNumber = 0;
+
+				foreach (var relCfg in configs)
 				{
-					akmPool = new AkmRelationshipPool { NodesCount = cfg.NodesAddresses.Length, RelationshipID = cfg.RelationshipId };
-					_relationshipPools.Add(akmPool);
-				}
+					AkmRelationshipPool akmPool;
+					lock (_relationshipPools)
+					{
+						akmPool = _relationshipPools.FirstOrDefault(x => x.RelationshipID == relCfg.RelationshipId);
+						if (akmPool == null)
+						{
+							akmPool = new AkmRelationshipPool { NodesCount = relCfg.NodesAddresses.Length, RelationshipID = relCfg.RelationshipId };
+							_relationshipPools.Add(akmPool);
+						}
+					}
 
-				var nodeNumber = GetNewNodeNumber(cfg.RelationshipId);
-				akmPool.RelationshipNodesClients.Add(nodeNumber, _client);
+					var nodeNumber = GetNewNodeNumber(relCfg.RelationshipId);
+					if (firstNodeNumber == 0)
+						firstNodeNumber = nodeNumber;
+					akmPool.RelationshipNodesClients.Add(nodeNumber, _client);
+
+					//all senders get the same socket and so share one connection and one writer thread
+					AkmSenderManager.AddSender(relCfg.RelationshipId, nodeNumber, _client.Client, _logger);
+				}
 
-				_logger.LogDebug("Got a connection");
+				_logger.LogDebug($"Got a connection carrying {configs.Length} Relationships");
 
+				//frames of every relationship arrive on the connection, each is dispatched by its RelationshipId
 				var receiver = new Receiver(_client.Client, ct, _logger);
 				receiver.DataReceived += OnDataReceived;
-				receiver.NodeNumber = nodeNumber;
-				
-				AkmSenderManager.AddSender(cfg.RelationshipId, nodeNumber, _client.Client, _logger);
+				receiver.NodeNumber = firstNodeNumber;
 
 				receiver.StartReceiving(ct);
 
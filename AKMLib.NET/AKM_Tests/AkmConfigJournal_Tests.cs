@@ -0,0 +1,118 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Struct;
+using AKMLogic;
+using NUnit.Framework;
+using System.IO;
+
+namespace AKM_Tests
+{
+	public class AkmConfigJournal_Tests
+	{
+		private string _path;
+
+		[SetUp]
+		public void Setup()
+		{
+			_path = Path.Combine(Path.GetTempPath(), $"akm_journal_{TestContext.CurrentContext.Test.Name}.journal");
+			File.Delete(_path);
+		}
+
+		[TearDown]
+		public void TearDown()
+		{
+			File.Delete(_path);
+		}
+
+		private static AkmConfigJournalEntry CreateEntry(short relationshipId, uint seed)
+		{
+			return new AkmConfigJournalEntry
+			{
+				RelationshipId = relationshipId,
+				SelfAddressValue = 1,
+				ConfigParams = new AkmConfigParams { SK = 4, SRNA = 2, N = 2, CSS = seed, NSS = seed + 1, EFSS = 7, NNRT = 1000 },
+				NodeAddresses = new byte[] { 1, 0, 2, 0 },
+				Keys = new[] { new byte[] { 1, 2, 3, (byte)seed }, new byte[] { 5, 6, 7, 8 } }
+			};
+		}
+
+		[Test]
+		public void AkmConfigJournalReplaysLatestEntries()
+		{
+			using (var journal = new AkmConfigJournal(_path))
+			{
+				journal.Append(CreateEntry(1, 10));
+				journal.Append(CreateEntry(2, 20));
+				journal.Append(CreateEntry(1, 11));
+			}
+
+			using (var journal = new AkmConfigJournal(_path))
+			{
+				Assert.AreEqual(2, journal.Entries.Count);
+				Assert.AreEqual(11, journal.Entries[1].ConfigParams.CSS);
+				Assert.AreEqual(12, journal.Entries[1].ConfigParams.NSS);
+				Assert.AreEqual(1000, journal.Entries[1].ConfigParams.NNRT);
+				Assert.AreEqual(20, journal.Entries[2].ConfigParams.CSS);
+				Assert.AreEqual(new byte[] { 1, 0, 2, 0 }, journal.Entries[2].NodeAddresses);
+				Assert.AreEqual(new byte[] { 1, 2, 3, 11 }, journal.Entries[1].Keys[0]);
+				Assert.AreEqual(new byte[] { 5, 6, 7, 8 }, journal.Entries[1].Keys[1]);
+			}
+		}
+
+		[Test]
+		public void AkmConfigJournalIgnoresTornRecord()
+		{
+			long lastRecordEnd;
+			using (var journal = new AkmConfigJournal(_path))
+			{
+				journal.Append(CreateEntry(1, 10));
+				journal.Append(CreateEntry(1, 11));
+				lastRecordEnd = journal.Length;
+			}
+
+			using (var stream = new FileStream(_path, FileMode.Open))
+			{
+				stream.Position = lastRecordEnd - 1;
+				stream.WriteByte(0xFF);
+			}
+
+			using (var journal = new AkmConfigJournal(_path))
+			{
+				Assert.AreEqual(10, journal.Entries[1].ConfigParams.CSS);
+
+				journal.Append(CreateEntry(1, 12));
+			}
+
+			using (var journal = new AkmConfigJournal(_path))
+			{
+				Assert.AreEqual(12, journal.Entries[1].ConfigParams.CSS);
+			}
+		}
+
+		[Test]
+		public void AkmConfigJournalCompacts()
+		{
+			using (var journal = new AkmConfigJournal(_path, 4096))
+			{
+				for (uint i = 0; i < 1000; i++)
+				{
+					journal.Append(CreateEntry((short)(i % 3), i));
+				}
+				Assert.Less(journal.Length, 4096);
+
+				journal.Compact();
+				Assert.AreEqual(3, journal.Entries.Count);
+			}
+
+			using (var journal = new AkmConfigJournal(_path, 4096))
+			{
+				Assert.AreEqual(3, journal.Entries.Count);
+				Assert.AreEqual(999, journal.Entries[0].ConfigParams.CSS);
+				Assert.AreEqual(997, journal.Entries[1].ConfigParams.CSS);
+				Assert.AreEqual(998, journal.Entries[2].ConfigParams.CSS);
+			}
+		}
+	}
+}
@@ -51,5 +51,19 @@ namespace AKM_Tests
 			Assert.AreEqual(message, decryptedMessage);
 			Assert.AreEqual(messageBytes.Length, decryptedBytes.Length);
 		}
+
+		[Test]
+		public void AkmCryptoKeyCacheCanBeCleared()
+		{
+			using var akmCrypto = new AkmCrypto();
+			var messageBytes = Encoding.UTF8.GetBytes("Clear Text Message");
+			var encryptedBytes = akmCrypto.Encrypt(messageBytes, AES_KEY_BYTES);
+
+			AkmCrypto.ClearKeyCache();
+
+			//a cleared key is cached again on its next use
+			Assert.AreEqual(messageBytes, akmCrypto.Decrypt(akmCrypto.Encrypt(messageBytes, AES_KEY_BYTES), AES_KEY_BYTES));
+			Assert.AreEqual(messageBytes, akmCrypto.Decrypt(encryptedBytes, AES_KEY_BYTES));
+		}
 	}
 }
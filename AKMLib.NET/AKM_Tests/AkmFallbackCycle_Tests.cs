@@ -0,0 +1,171 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Enum;
+using AKMCommon.Struct;
+using AKMInterface;
+using AKMLogic;
+using Microsoft.Extensions.Logging.Abstractions;
+using NUnit.Framework;
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Runtime.InteropServices;
+using System.Threading;
+
+namespace AKM_Tests
+{
+	/// <summary>
+	/// Two nodes of one relationship wired back to back, going through fallback establishing again and again: the
+	/// SEI of every rekey the peer starts is lost, so the peer times out and falls back
+	/// </summary>
+	public class AkmFallbackCycle_Tests
+	{
+		private const int KEY_SIZE = 32;
+		private const long NSET = 10;
+		private const long NO_TIMEOUT = 1000000000;
+		private const int CYCLES = 6;
+		private const int ESTABLISH_ROUNDS = 16;
+		private static readonly byte[] NodeAddresses = { 1, 0, 5, 0 };
+		private const short LOCAL = 1;
+		private const short PEER = 5;
+
+		private readonly List<IntPtr> _unmanaged = new List<IntPtr>();
+		private readonly AkmCrypto _crypto = new AkmCrypto();
+
+		[TearDown]
+		public void TearDown()
+		{
+			foreach (var ptr in _unmanaged)
+				Marshal.FreeHGlobal(ptr);
+			_unmanaged.Clear();
+		}
+
+		[Test]
+		public void AkmFallbackCyclesKeepNodesInStep()
+		{
+			RunFallbackCycles(0x1111);
+		}
+
+		/// <summary>
+		/// With all seeds zero the fallback keys regenerated by the first cycles repeat the session keys, so the
+		/// fallback SEI of a later cycle decrypts with the local node's session key: the local node takes it for a
+		/// normal SEI and regenerates its keys the normal way while the peer does the fallback way. The keys of the
+		/// nodes differ from the third cycle on, and a few cycles later the nodes cannot establish again.
+		/// </summary>
+		[Test]
+		[Ignore("Known issue: consecutive fallback cycles diverge the keys when all seeds are zero")]
+		public void AkmFallbackCyclesKeepNodesInStepWithZeroSeeds()
+		{
+			RunFallbackCycles(0);
+		}
+
+		private void RunFallbackCycles(uint seed)
+		{
+			using var local = CreateNode(LOCAL, seed);
+			using var peer = CreateNode(PEER, seed);
+			Assert.IsTrue(Establish(local, peer), "not established");
+
+			for (int cycle = 0; cycle < CYCLES; cycle++)
+			{
+				Send(peer, LOCAL, AkmEvent.LocalSEI);
+				Thread.Sleep(TimeSpan.FromMilliseconds(NSET + 1));
+				Receive(peer, Send(local, PEER));
+				Receive(local, Send(peer, LOCAL));
+
+				Assert.IsTrue(Establish(local, peer), $"not established again after fallback cycle {cycle}");
+				var localKeys = local.GetKeys();
+				var peerKeys = peer.GetKeys();
+				for (int k = 0; k < AkmRelationship.KEY_COUNT; k++)
+				{
+					CollectionAssert.AreEqual(peerKeys[k].KeyAsBytes, localKeys[k].KeyAsBytes, $"key {k} differs after fallback cycle {cycle}");
+				}
+			}
+		}
+
+		private IEncryptedFrame Send(AkmRelationship sender, short target, AkmEvent? forcedAkmEvent = null)
+		{
+			return Send(sender, target, out _, forcedAkmEvent);
+		}
+
+		private IEncryptedFrame Send(AkmRelationship sender, short target, out AkmEvent sentEvent, AkmEvent? forcedAkmEvent = null)
+		{
+			using var frame = AkmDecryptedFrame.Rent(_crypto, NullLogger.Instance, 1);
+			frame.SetContent(Array.Empty<byte>());
+			frame.SetSourceAddress(target == PEER ? LOCAL : PEER);
+			frame.SetTargetAddress(target);
+			var encFrame = sender.PrepareFrame(frame, forcedAkmEvent);
+			sentEvent = frame.FrameEvent;
+			return encFrame;
+		}
+
+		private static void Receive(AkmRelationship receiver, IEncryptedFrame encFrame)
+		{
+			receiver.ProcessFrame(encFrame, out var decFrame);
+			(decFrame as IDisposable)?.Dispose();
+		}
+
+		//frames each way until both nodes have sent RecvSE in two rounds in a row
+		private bool Establish(AkmRelationship local, AkmRelationship peer)
+		{
+			var settled = 0;
+			for (int round = 0; round < ESTABLISH_ROUNDS && settled < 2; round++)
+			{
+				Receive(peer, Send(local, PEER, out var localEvent));
+				Receive(local, Send(peer, LOCAL, out var peerEvent));
+				settled = localEvent == AkmEvent.RecvSE && peerEvent == AkmEvent.RecvSE ? settled + 1 : 0;
+			}
+			return settled == 2;
+		}
+
+		private AkmRelationship CreateNode(short selfAddress, uint seed)
+		{
+			var pdv = new byte[AkmRelationship.PDV_Size];
+			for (int i = 0; i < pdv.Length; i++)
+				pdv[i] = (byte)(i * 7 + 3);
+
+			var config = new AkmConfiguration
+			{
+				cfgParams = new AkmConfigParams
+				{
+					SK = KEY_SIZE,
+					SRNA = 2,
+					N = 2,
+					CSS = seed,
+					NSS = seed * 2,
+					FSS = seed * 3,
+					NFSS = seed * 4,
+					SFSS = seed * 5,
+					NSFSS = seed * 6,
+					EFSS = seed * 7,
+					NNRT = NO_TIMEOUT,
+					NSET = NSET,
+					FBSET = NO_TIMEOUT,
+					FSSET = NO_TIMEOUT
+				},
+				pdv = Unmanaged(pdv),
+				nodeAddresses = Unmanaged(NodeAddresses),
+				selfNodeAddress = Unmanaged(BitConverter.GetBytes(selfAddress))
+			};
+
+			//both nodes start from the same shared keys
+			var keys = new IKey[AkmRelationship.KEY_COUNT];
+			for (int k = 0; k < keys.Length; k++)
+			{
+				var key = new AkmKey(KEY_SIZE);
+				key.SetKey(Enumerable.Range(0, KEY_SIZE).Select(i => (byte)(k * 31 + i)).ToArray());
+				keys[k] = key;
+			}
+			return new AkmRelationship(NullLogger.Instance, new AkmCLibCall(), new AkmKeyFactory(), keys, ref config);
+		}
+
+		private IntPtr Unmanaged(byte[] data)
+		{
+			var ptr = Marshal.AllocHGlobal(data.Length);
+			Marshal.Copy(data, 0, ptr, data.Length);
+			_unmanaged.Add(ptr);
+			return ptr;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMLogic;
+using NUnit.Framework;
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace AKM_Tests
+{
+	public class AkmFrameQueue_Tests
+	{
+		[Test]
+		public void AkmFrameQueueKeepsOrderAndBound()
+		{
+			var queue = new AkmFrameQueue(3);
+			Assert.AreEqual(4, queue.Capacity);
+
+			for (byte i = 0; i < 4; i++)
+			{
+				Assert.IsTrue(queue.TryEnqueue(new byte[] { i }));
+			}
+			Assert.IsFalse(queue.TryEnqueue(new byte[] { 4 }));
+			Assert.AreEqual(4, queue.Count);
+
+			for (byte i = 0; i < 4; i++)
+			{
+				Assert.IsTrue(queue.TryDequeue(out var frame));
+				Assert.AreEqual(i, frame[0]);
+			}
+			Assert.IsFalse(queue.TryDequeue(out _));
+			Assert.IsTrue(queue.IsEmpty);
+			Assert.IsTrue(queue.TryEnqueue(new byte[] { 5 }));
+		}
+
+		[Test]
+		public void AkmFrameQueueConcurrentProducers()
+		{
+			const int producers = 4;
+			const int framesPerProducer = 10000;
+			var queue = new AkmFrameQueue(64);
+			var next = new int[producers];
+
+			var tasks = new List<Task>();
+			for (int p = 0; p < producers; p++)
+			{
+				var producer = p;
+				tasks.Add(Task.Run(() =>
+				{
+					for (int i = 0; i < framesPerProducer; i++)
+					{
+						var frame = new byte[8];
+						BitConverter.GetBytes(producer).CopyTo(frame, 0);
+						BitConverter.GetBytes(i).CopyTo(frame, 4);
+						while (!queue.TryEnqueue(frame))
+						{
+							Thread.Yield();
+						}
+					}
+				}));
+			}
+
+			var received = 0;
+			while (received < producers * framesPerProducer)
+			{
+				if (queue.TryDequeue(out var frame))
+				{
+					var producer = BitConverter.ToInt32(frame, 0);
+					Assert.AreEqual(next[producer]++, BitConverter.ToInt32(frame, 4));
+					received++;
+				}
+			}
+
+			Task.WaitAll(tasks.ToArray());
+			Assert.IsTrue(queue.IsEmpty);
+		}
+	}
+}
@@ -208,5 +208,65 @@ namespace AKM_Tests
 
 		}
 
+		[Test]
+		public void AkmCryptoEncryptionUsesFreshIV()
+		{
+			var crypto = new AkmCrypto();
+			var message = Encoding.UTF8.GetBytes("Test Content Message of more than a single block");
+
+			//frames of the former format, the encryption of a zero block in front, are still read
+			var legacy = Encrypt(message, _keyBytes);
+			Assert.AreEqual(message, crypto.Decrypt(legacy, _keyBytes));
+
+			var encrypted = new byte[crypto.GetEncryptedLength(message.Length)];
+			Assert.AreEqual(legacy.Length, crypto.Encrypt(message, _keyBytes, encrypted));
+			Assert.AreEqual(message, Decrypt(encrypted, _keyBytes));
+
+			//equal data encrypted again does not give the same frame
+			var again = crypto.Encrypt(message, _keyBytes);
+			Assert.AreEqual(encrypted.Length, again.Length);
+			Assert.AreNotEqual(encrypted.AsSpan(0, 16).ToArray(), again.AsSpan(0, 16).ToArray());
+			Assert.AreNotEqual(encrypted, again);
+
+			var decrypted = new byte[encrypted.Length];
+			var length = crypto.Decrypt(again, _keyBytes, decrypted);
+			Assert.AreEqual(message, decrypted.AsSpan(0, length).ToArray());
+		}
+
+		[Test]
+		public void PooledFramesSurviveTransmission()
+		{
+			var crypto = new AkmCrypto();
+			var key = new AkmKey();
+			_keyBytes.CopyTo(key.KeyAsBytes, 0);
+			var content = Encoding.UTF8.GetBytes("Test Content Message");
+
+			for (int i = 0; i < 3; i++)
+			{
+				var df = AkmDecryptedFrame.Rent(crypto, _mockLogger.Object, 1);
+				df.SetContent(content);
+				df.SetSourceAddress(5);
+				df.SetTargetAddress(1);
+				df.SetFrameEvent(AkmEvent.RecvSE);
+				var ef = df.Encrypt(key);
+				df.Dispose();
+
+				ef.SetFrameLength();
+				var wire = ef.GetTransmissionData();
+				Assert.AreEqual(wire.Length - 10, BitConverter.ToInt64(wire, 2));
+
+				var received = new byte[wire.Length + 16];
+				wire.AsSpan(0, 2).CopyTo(received);
+				wire.AsSpan(10).CopyTo(received.AsSpan(2));
+				var decrypted = new AkmEncryptedFrame(crypto, _mockLogger.Object, received, wire.Length - 8, 1).Decrypt(key);
+
+				Assert.IsNotNull(decrypted);
+				Assert.AreEqual(content, decrypted.GetContentBytes());
+				Assert.AreEqual(5, decrypted.GetSourceAddressAsShort());
+				Assert.AreEqual(AkmEvent.RecvSE, decrypted.FrameEvent);
+				((IDisposable)decrypted).Dispose();
+			}
+		}
+
 	}
 }
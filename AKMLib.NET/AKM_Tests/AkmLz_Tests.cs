@@ -0,0 +1,154 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Struct;
+using AKMLogic;
+using NUnit.Framework;
+using System;
+using System.IO;
+using System.Text;
+
+namespace AKM_Tests
+{
+	public class AkmLz_Tests
+	{
+		private static byte[] Telemetry(int records)
+		{
+			var sb = new StringBuilder("[");
+			for (int i = 0; i < records; i++)
+			{
+				sb.Append($"{{\"deviceId\":\"sensor-{i % 50:D4}\",\"timestamp\":{1700000000 + i},\"temperature\":{20 + i % 7}.{i % 100:D2},\"status\":\"OK\"}},");
+			}
+			sb.Append(']');
+			return Encoding.UTF8.GetBytes(sb.ToString());
+		}
+
+		private static byte[] RandomBytes(int length)
+		{
+			var data = new byte[length];
+			new Random(7).NextBytes(data);
+			return data;
+		}
+
+		private static byte[] RoundTrip(byte[] data)
+		{
+			var block = new byte[AkmLz.MaxCompressedLength(data.Length)];
+			var length = AkmLz.Compress(data, block);
+			Assert.Greater(length, 0);
+
+			var result = new byte[data.Length];
+			Assert.AreEqual(data.Length, AkmLz.Decompress(block.AsSpan(0, length), result));
+			return result;
+		}
+
+		[Test]
+		public void AkmLzRoundTrips()
+		{
+			var telemetry = Telemetry(200);
+			CollectionAssert.AreEqual(telemetry, RoundTrip(telemetry));
+			CollectionAssert.AreEqual(new byte[10000], RoundTrip(new byte[10000]));
+			CollectionAssert.AreEqual(RandomBytes(16384), RoundTrip(RandomBytes(16384)));
+			for (int length = 0; length < 40; length++)
+			{
+				var data = Telemetry(1).AsSpan(0, length).ToArray();
+				CollectionAssert.AreEqual(data, RoundTrip(data));
+			}
+		}
+
+		[Test]
+		public void AkmLzRoundTripsBlocksOverEightMiB()
+		{
+			// Length extensions of these blocks add up past 2^23, up to the largest frame the Receiver accepts
+			var length = 9 * 1024 * 1024;
+			CollectionAssert.AreEqual(new byte[length], RoundTrip(new byte[length]));
+			var random = RandomBytes(length);
+			CollectionAssert.AreEqual(random, RoundTrip(random));
+		}
+
+		[Test]
+		public void AkmLzCompressesRepetitiveData()
+		{
+			var telemetry = Telemetry(200);
+			var block = new byte[AkmLz.MaxCompressedLength(telemetry.Length)];
+			Assert.Less(AkmLz.Compress(telemetry, block), telemetry.Length / 3);
+			Assert.AreEqual(-1, AkmLz.Compress(telemetry, new byte[16]));
+		}
+
+		[Test]
+		public void AkmLzRejectsMalformedBlocks()
+		{
+			var output = new byte[64];
+			// Match before the start of the data
+			Assert.AreEqual(-1, AkmLz.Decompress(new byte[] { 0x10, 0x41, 0x02, 0x00 }, output));
+			// Zero offset
+			Assert.AreEqual(-1, AkmLz.Decompress(new byte[] { 0x10, 0x41, 0x00, 0x00 }, output));
+			// Literals past the end of the block
+			Assert.AreEqual(-1, AkmLz.Decompress(new byte[] { 0x50, 0x41 }, output));
+			// Unterminated length
+			Assert.AreEqual(-1, AkmLz.Decompress(new byte[] { 0xF0, 0xFF, 0xFF }, output));
+			// Output too small
+			Assert.AreEqual(-1, AkmLz.Decompress(new byte[] { 0x1F, 0x41, 0x01, 0x00, 0x40 }, output));
+		}
+
+		[Test]
+		public void AkmPayloadCodecRoundTrips()
+		{
+			var appCfg = new AkmAppConfig { CompressPayloads = true };
+			var telemetry = Telemetry(50);
+			var content = AkmPayloadCodec.Encode(telemetry, appCfg);
+			Assert.AreEqual(AkmPayloadCodec.FlagCompressed, content[0]);
+			Assert.Less(content.Length, telemetry.Length);
+			CollectionAssert.AreEqual(telemetry, AkmPayloadCodec.Decode(content, appCfg));
+
+			var random = RandomBytes(1024);
+			content = AkmPayloadCodec.Encode(random, appCfg);
+			Assert.AreEqual(0, content[0]);
+			Assert.AreEqual(random.Length + 1, content.Length);
+			CollectionAssert.AreEqual(random, AkmPayloadCodec.Decode(content, appCfg));
+
+			var small = new byte[AkmPayloadCodec.DefaultThreshold - 1];
+			content = AkmPayloadCodec.Encode(small, appCfg);
+			Assert.AreEqual(0, content[0]);
+			CollectionAssert.AreEqual(small, AkmPayloadCodec.Decode(content, appCfg));
+
+			var disabled = new AkmAppConfig();
+			Assert.AreSame(telemetry, AkmPayloadCodec.Encode(telemetry, disabled));
+			Assert.AreSame(telemetry, AkmPayloadCodec.Decode(telemetry, disabled));
+		}
+
+		[Test]
+		public void AkmPayloadCodecCarriesChunks()
+		{
+			var appCfg = new AkmAppConfig { ChunkedPayloads = true, CompressPayloads = true };
+			var telemetry = Telemetry(50);
+			var content = AkmPayloadCodec.EncodeChunk(telemetry, new AkmPayloadChunk(7, 3, false), appCfg);
+			Assert.AreEqual(AkmPayloadCodec.FlagChunk | AkmPayloadCodec.FlagCompressed, content[0]);
+			CollectionAssert.AreEqual(telemetry, AkmPayloadCodec.Decode(content, appCfg, out var chunk));
+			Assert.AreEqual(7u, chunk.Value.StreamId);
+			Assert.AreEqual(3u, chunk.Value.Index);
+			Assert.IsFalse(chunk.Value.IsFinal);
+
+			content = AkmPayloadCodec.EncodeChunk(ReadOnlySpan<byte>.Empty, new AkmPayloadChunk(7, 4, true), appCfg);
+			Assert.AreEqual(0, AkmPayloadCodec.Decode(content, appCfg, out chunk).Length);
+			Assert.IsTrue(chunk.Value.IsFinal);
+
+			content = AkmPayloadCodec.Encode(telemetry, new AkmAppConfig { ChunkedPayloads = true });
+			CollectionAssert.AreEqual(telemetry, AkmPayloadCodec.Decode(content, appCfg, out chunk));
+			Assert.IsFalse(chunk.HasValue);
+
+			Assert.Throws<InvalidOperationException>(() => AkmPayloadCodec.EncodeChunk(telemetry, new AkmPayloadChunk(1, 0, true), new AkmAppConfig()));
+			Assert.Throws<InvalidDataException>(() => AkmPayloadCodec.Decode(new byte[] { AkmPayloadCodec.FlagFinalChunk }, appCfg));
+		}
+
+		[Test]
+		public void AkmPayloadCodecRejectsMalformedContent()
+		{
+			var appCfg = new AkmAppConfig { CompressPayloads = true };
+			Assert.Throws<InvalidDataException>(() => AkmPayloadCodec.Decode(new byte[0], appCfg));
+			Assert.Throws<InvalidDataException>(() => AkmPayloadCodec.Decode(new byte[] { 0x02, 0x41 }, appCfg));
+			Assert.Throws<InvalidDataException>(() => AkmPayloadCodec.Decode(new byte[] { 0x01, 0xFF, 0xFF, 0xFF, 0x7F, 0x10, 0x41 }, appCfg));
+			Assert.Throws<InvalidDataException>(() => AkmPayloadCodec.Decode(new byte[] { 0x01, 0x02, 0x00, 0x00, 0x00, 0x10, 0x41 }, appCfg));
+		}
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Enum;
+using AKMLogic;
+using NUnit.Framework;
+
+namespace AKM_Tests
+{
+	public class AkmSendLanes_Tests
+	{
+		[Test]
+		public void AkmSendLanesSelectsLaneByEvent()
+		{
+			Assert.AreEqual(AkmSendLane.Control, AkmSendLanes.LaneOf(AkmEvent.RecvSEI));
+			Assert.AreEqual(AkmSendLane.Control, AkmSendLanes.LaneOf(AkmEvent.RecvSEC));
+			Assert.AreEqual(AkmSendLane.Control, AkmSendLanes.LaneOf(AkmEvent.RecvSEF));
+			Assert.AreEqual(AkmSendLane.Data, AkmSendLanes.LaneOf(AkmEvent.RecvSE));
+			Assert.AreEqual(AkmSendLane.Data, AkmSendLanes.LaneOf(AkmEvent.None));
+		}
+
+		[Test]
+		public void AkmSendLanesKeepQueueOrderAcrossLanes()
+		{
+			var lanes = new AkmSendLanes(16, 16);
+
+			for (byte i = 0; i < 3; i++)
+			{
+				Assert.IsTrue(lanes.TryEnqueue(new byte[] { i }, AkmSendLane.Data));
+			}
+			Assert.IsTrue(lanes.TryEnqueue(new byte[] { 3 }, AkmSendLane.Control));
+			Assert.IsTrue(lanes.TryEnqueue(new byte[] { 4 }, AkmSendLane.Data));
+			Assert.IsTrue(lanes.TryEnqueue(new byte[] { 5 }, AkmSendLane.Control));
+
+			var order = new byte[6];
+			for (int i = 0; i < order.Length; i++)
+			{
+				Assert.IsTrue(lanes.TryDequeue(out var frame));
+				order[i] = frame[0];
+			}
+
+			Assert.AreEqual(new byte[] { 0, 1, 2, 3, 4, 5 }, order);
+			Assert.AreEqual(2, lanes.ControlStatistics.Frames);
+			Assert.AreEqual(4, lanes.DataStatistics.Frames);
+			Assert.IsFalse(lanes.TryDequeue(out _));
+			Assert.IsTrue(lanes.IsEmpty);
+		}
+
+		[Test]
+		public void AkmSendLanesTakeControlFramesWhenDataLaneIsFull()
+		{
+			var lanes = new AkmSendLanes(4, 4);
+
+			for (int i = 0; i < 4; i++)
+			{
+				Assert.IsTrue(lanes.TryEnqueue(new byte[] { 0 }, AkmSendLane.Data));
+			}
+			Assert.IsTrue(lanes.IsFull(AkmSendLane.Data));
+			Assert.IsFalse(lanes.TryEnqueue(new byte[] { 0 }, AkmSendLane.Data));
+			Assert.IsTrue(lanes.TryEnqueue(new byte[] { 1 }, AkmSendLane.Control));
+
+			Assert.AreEqual(5, lanes.Count);
+			Assert.AreEqual(1, lanes.CountOf(AkmSendLane.Control));
+		}
+	}
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMLogic;
+using NUnit.Framework;
+using System;
+using System.Buffers;
+using System.Runtime.InteropServices;
+using System.Threading.Tasks;
+
+namespace AKM_Tests
+{
+	public class AkmShmChannel_Tests
+	{
+		[SetUp]
+		public void Setup()
+		{
+			if (!RuntimeInformation.IsOSPlatform(OSPlatform.Linux))
+				Assert.Ignore("Shared-memory channels are Linux only");
+		}
+
+		private static byte[] Frame(int i)
+		{
+			var frame = new byte[1 + i * 7 % 700];
+			for (int j = 0; j < frame.Length; j++)
+			{
+				frame[j] = (byte)(i + j);
+			}
+			return frame;
+		}
+
+		private static void ReceiveAll(AkmShmChannel channel, int num)
+		{
+			for (int i = 0; i < num; i++)
+			{
+				Assert.IsTrue(channel.Receive(out var frame, out var frameLength, 5000));
+				CollectionAssert.AreEqual(Frame(i), frame.AsSpan(0, frameLength).ToArray());
+				ArrayPool<byte>.Shared.Return(frame);
+			}
+		}
+
+		[Test]
+		public void AkmShmChannelCarriesFramesBothWays()
+		{
+			// Rings far smaller than the traffic, so both wrap and both sides wait for room and for frames
+			using var daemon = AkmShmChannel.Create(4096);
+			using var client = AkmShmChannel.Attach(daemon.Descriptors);
+			const int num = 2000;
+
+			var toDaemon = Task.Run(() => ReceiveAll(daemon, num));
+			var toClient = Task.Run(() => ReceiveAll(client, num));
+			var fromDaemon = Task.Run(() =>
+			{
+				for (int i = 0; i < num; i++)
+				{
+					Assert.IsTrue(daemon.Send(Frame(i), 5000));
+				}
+			});
+			for (int i = 0; i < num; i++)
+			{
+				Assert.IsTrue(client.Send(Frame(i), 5000));
+			}
+			Assert.IsTrue(Task.WaitAll(new[] { toDaemon, toClient, fromDaemon }, 10000));
+			Assert.IsFalse(client.TryReceive(out _, out _));
+		}
+
+		[Test]
+		public void AkmShmChannelReportsFullRing()
+		{
+			using var daemon = AkmShmChannel.Create(4096);
+			using var client = AkmShmChannel.Attach(daemon.Descriptors);
+			Assert.AreEqual(4096 - 8, client.MaxFrameSize);
+			Assert.Throws<ArgumentOutOfRangeException>(() => client.TrySend(new byte[client.MaxFrameSize + 1]));
+
+			var frame = new byte[1000];
+			var sent = 0;
+			while (client.TrySend(frame))
+				sent++;
+			Assert.AreEqual(4, sent);
+			Assert.IsFalse(client.Send(frame, 10));
+
+			Assert.IsTrue(daemon.TryReceive(out var received, out var receivedLength));
+			Assert.AreEqual(1000, receivedLength);
+			ArrayPool<byte>.Shared.Return(received);
+			Assert.IsTrue(client.TrySend(frame));
+		}
+	}
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMLogic;
+using NUnit.Framework;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+
+namespace AKM_Tests
+{
+	public class AkmStreamTracker_Tests
+	{
+		private static readonly long Second = Stopwatch.Frequency;
+
+		[Test]
+		public void AkmStreamTrackerReportsBrokenStreamOnce()
+		{
+			var dropped = new List<(uint StreamId, uint Delivered)>();
+			var tracker = new AkmStreamTracker(4, TimeSpan.FromSeconds(60), (stream, delivered, reason) => dropped.Add((stream.StreamId, delivered)));
+
+			Assert.IsTrue(tracker.Accept(1, 2, new AkmPayloadChunk(7, 0, false), 0));
+			Assert.IsTrue(tracker.Accept(1, 2, new AkmPayloadChunk(7, 1, false), 0));
+			Assert.IsFalse(tracker.Accept(1, 2, new AkmPayloadChunk(7, 3, false), 0));
+			Assert.IsFalse(tracker.Accept(1, 2, new AkmPayloadChunk(7, 4, false), 0));
+			Assert.IsFalse(tracker.Accept(1, 2, new AkmPayloadChunk(7, 5, true), 0));
+			CollectionAssert.AreEqual(new[] { (7u, 2u) }, dropped);
+			Assert.AreEqual(0, tracker.Count);
+
+			//the same identifier from another node is another stream
+			Assert.IsTrue(tracker.Accept(1, 3, new AkmPayloadChunk(7, 0, false), 0));
+			Assert.IsTrue(tracker.Accept(1, 3, new AkmPayloadChunk(7, 1, true), 0));
+			Assert.AreEqual(0, tracker.Count);
+			Assert.AreEqual(1, dropped.Count);
+		}
+
+		[Test]
+		public void AkmStreamTrackerDropsIdleStreams()
+		{
+			var dropped = new List<(uint StreamId, uint Delivered)>();
+			var tracker = new AkmStreamTracker(4, TimeSpan.FromSeconds(60), (stream, delivered, reason) => dropped.Add((stream.StreamId, delivered)));
+
+			Assert.IsTrue(tracker.Accept(1, 2, new AkmPayloadChunk(1, 0, false), 0));
+			Assert.IsTrue(tracker.Accept(1, 2, new AkmPayloadChunk(2, 0, false), 30 * Second));
+			Assert.IsTrue(tracker.Accept(1, 2, new AkmPayloadChunk(3, 0, false), 61 * Second));
+			CollectionAssert.AreEqual(new[] { (1u, 1u) }, dropped);
+			Assert.AreEqual(2, tracker.Count);
+
+			tracker.DropIdle(200 * Second);
+			Assert.AreEqual(0, tracker.Count);
+			Assert.AreEqual(3, dropped.Count);
+		}
+
+		[Test]
+		public void AkmStreamTrackerMakesRoomForNewStreams()
+		{
+			var dropped = new List<(uint StreamId, uint Delivered)>();
+			var tracker = new AkmStreamTracker(4, TimeSpan.FromSeconds(60), (stream, delivered, reason) => dropped.Add((stream.StreamId, delivered)));
+
+			//abandoned streams, none idle long enough yet
+			for (uint i = 0; i < 4; i++)
+			{
+				Assert.IsTrue(tracker.Accept(1, 2, new AkmPayloadChunk(i, 0, false), i * Second));
+			}
+			Assert.IsTrue(tracker.Accept(1, 2, new AkmPayloadChunk(0, 1, false), 5 * Second));
+
+			//the least recently seen stream goes, new streams are never refused
+			for (uint i = 4; i < 20; i++)
+			{
+				Assert.IsTrue(tracker.Accept(1, 2, new AkmPayloadChunk(i, 0, false), 6 * Second));
+				Assert.AreEqual(4, tracker.Count);
+			}
+			Assert.AreEqual((1u, 1u), dropped[0]);
+			Assert.AreEqual(16, dropped.Count);
+		}
+	}
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+namespace AkmAutomatedTestClient
+{
+	/// <summary>
+	/// Latency histogram in microseconds with log-linear buckets: values below 64 are exact and every power of two
+	/// above is split into 32 buckets, so a percentile is within about 3% of the recorded value. Recording is lock
+	/// free and may happen on several threads at once.
+	/// </summary>
+	public sealed class LatencyHistogram
+	{
+		private const int SUB_BUCKET_BITS = 5;
+		private const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+		private const int MAX_VALUE_BITS = 40;
+		private const long MAX_VALUE = (1L << MAX_VALUE_BITS) - 1;
+		private const int BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+		private readonly long[] _counts = new long[BUCKET_COUNT];
+		private long _count;
+		private long _sum;
+		private long _min = long.MaxValue;
+		private long _max;
+
+		/// <summary>
+		/// Number of recorded values
+		/// </summary>
+		public long Count => Interlocked.Read(ref _count);
+
+		/// <summary>
+		/// Records a single value
+		/// </summary>
+		/// <param name="microseconds">Latency in microseconds</param>
+		public void Record(long microseconds)
+		{
+			Record(microseconds, 1);
+		}
+
+		/// <summary>
+		/// Adds values of a report made from another histogram
+		/// </summary>
+		/// <param name="report">Latency report with buckets</param>
+		public void Merge(LatencyReport report)
+		{
+			if (report.Count == 0)
+				return;
+
+			foreach (var bucket in report.Buckets)
+			{
+				Interlocked.Add(ref _counts[IndexOf(Math.Clamp(bucket.UpToUs, 0, MAX_VALUE))], bucket.Count);
+			}
+			Interlocked.Add(ref _count, report.Count);
+			Interlocked.Add(ref _sum, (long)Math.Round(report.MeanUs * report.Count));
+			UpdateMin(report.MinUs);
+			UpdateMax(report.MaxUs);
+		}
+
+		/// <summary>
+		/// Returns the value below which given percentage of recorded values fall
+		/// </summary>
+		/// <param name="percentile">Percentile, between 0 and 100</param>
+		/// <returns>Upper bound of the bucket the percentile falls in, 0 when nothing was recorded</returns>
+		public long Percentile(double percentile)
+		{
+			var count = Count;
+			if (count == 0)
+				return 0;
+
+			var rank = Math.Max(1, (long)Math.Ceiling(percentile / 100 * count));
+			long seen = 0;
+			for (int i = 0; i < _counts.Length; i++)
+			{
+				seen += Interlocked.Read(ref _counts[i]);
+				if (seen >= rank)
+					return Math.Min(UpperBoundOf(i), Interlocked.Read(ref _max));
+			}
+			return Interlocked.Read(ref _max);
+		}
+
+		/// <summary>
+		/// Summary of the recorded values with the non empty buckets, so reports can be merged again
+		/// </summary>
+		public LatencyReport ToReport()
+		{
+			var count = Count;
+			var report = new LatencyReport
+			{
+				Count = count,
+				MinUs = count > 0 ? Interlocked.Read(ref _min) : 0,
+				MaxUs = Interlocked.Read(ref _max),
+				MeanUs = count > 0 ? (double)Interlocked.Read(ref _sum) / count : 0,
+				P50Us = Percentile(50),
+				P90Us = Percentile(90),
+				P99Us = Percentile(99),
+				P999Us = Percentile(99.9)
+			};
+
+			for (int i = 0; i < _counts.Length; i++)
+			{
+				var bucketCount = Interlocked.Read(ref _counts[i]);
+				if (bucketCount > 0)
+					report.Buckets.Add(new LatencyBucket { UpToUs = UpperBoundOf(i), Count = bucketCount });
+			}
+			return report;
+		}
+
+		private void Record(long microseconds, long count)
+		{
+			var value = Math.Clamp(microseconds, 0, MAX_VALUE);
+			Interlocked.Add(ref _counts[IndexOf(value)], count);
+			Interlocked.Add(ref _count, count);
+			Interlocked.Add(ref _sum, value * count);
+			UpdateMin(value);
+			UpdateMax(value);
+		}
+
+		private void UpdateMin(long value)
+		{
+			var current = Interlocked.Read(ref _min);
+			while (value < current)
+			{
+				var seen = Interlocked.CompareExchange(ref _min, value, current);
+				if (seen == current)
+					break;
+				current = seen;
+			}
+		}
+
+		private void UpdateMax(long value)
+		{
+			var current = Interlocked.Read(ref _max);
+			while (value > current)
+			{
+				var seen = Interlocked.CompareExchange(ref _max, value, current);
+				if (seen == current)
+					break;
+				current = seen;
+			}
+		}
+
+		private static int IndexOf(long value)
+		{
+			if (value < 2 * SUB_BUCKETS)
+				return (int)value;
+
+			var shift = 63 - (int)ulong.LeadingZeroCount((ulong)value) - SUB_BUCKET_BITS;
+			return (shift + 1) * SUB_BUCKETS + (int)(value >> shift) - SUB_BUCKETS;
+		}
+
+		private static long UpperBoundOf(int index)
+		{
+			if (index < 2 * SUB_BUCKETS)
+				return index;
+
+			var shift = index / SUB_BUCKETS - 1;
+			var subBucket = index % SUB_BUCKETS + SUB_BUCKETS;
+			return ((long)(subBucket + 1) << shift) - 1;
+		}
+	}
+}
@@ -0,0 +1,384 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Struct;
+using AKMLogic;
+using Microsoft.Extensions.Configuration;
+using Microsoft.Extensions.Logging;
+using System.Diagnostics;
+using System.Net;
+using System.Net.Sockets;
+using System.Reflection;
+
+namespace AkmAutomatedTestClient
+{
+	/// <summary>
+	/// Drives AKMWorkerService instances on loopback with test frames and measures how they cope. Every relationship
+	/// is loaded by every peer, peers other than the first run as child processes of the client since a process
+	/// holds a single node of each relationship. The worker service echoes every frame, the time from a frame being
+	/// due until its echo arrives is the end-to-end latency. Each peer writes its streams to a report, the first one
+	/// merges them into the final report.
+	/// </summary>
+	internal sealed class LoadGenerator
+	{
+		/// <summary>
+		/// Command line switch starting the load generator
+		/// </summary>
+		public const string LOAD_ARG = "--load";
+		private const string PEER_ARG = "--load-peer";
+		private const string REPORT_ARG = "--load-report";
+		private const int CONNECT_RETRY_MS = 500;
+		private const int ECHO_WAIT_MS = 10;
+		private const int SPIN_THRESHOLD_MS = 2;
+		private const int PEER_EXIT_MARGIN_SECONDS = 30;
+
+		private readonly LoadTestSettings _settings;
+		private readonly ILogger _logger;
+		private readonly int _peerIndex;
+		private readonly string _reportPath;
+		private readonly Random _rng;
+		private readonly ManualResetEventSlim _echoed = new ManualResetEventSlim(false);
+		private readonly Dictionary<short, LoadStream> _streams = new Dictionary<short, LoadStream>();
+		private readonly List<Socket> _sockets = new List<Socket>();
+
+		/// <param name="settings">Load generation settings</param>
+		/// <param name="logger">ILogger implementation</param>
+		/// <param name="args">Command line arguments, telling which peer this process is</param>
+		public LoadGenerator(LoadTestSettings settings, ILogger logger, string[] args)
+		{
+			_settings = settings;
+			_logger = logger;
+			_peerIndex = Math.Max(0, PeerIndex(args));
+			var reportArg = Array.IndexOf(args, REPORT_ARG);
+			_reportPath = reportArg >= 0 && reportArg + 1 < args.Length ? args[reportArg + 1] : settings.ReportPath;
+			_rng = new Random(settings.Seed + _peerIndex);
+		}
+
+		private int PeerCount => Math.Max(1, _settings.PeerAddresses?.Length ?? 0);
+
+		/// <summary>
+		/// Returns the index of the peer this process runs as
+		/// </summary>
+		/// <param name="args">Command line arguments</param>
+		/// <returns>0 for the client started with --load, -1 if the load generator was not asked for</returns>
+		public static int PeerIndex(string[] args)
+		{
+			var peerArg = Array.IndexOf(args, PEER_ARG);
+			if (peerArg >= 0 && peerArg + 1 < args.Length && int.TryParse(args[peerArg + 1], out var peerIndex))
+				return peerIndex;
+			return args.Contains(LOAD_ARG) ? 0 : -1;
+		}
+
+		/// <summary>
+		/// Gives this process the node address of its peer in every relationship and a config journal of its own.
+		/// AkmSetup reads environment variables over appsettings.json, so this has to run before it loads.
+		/// </summary>
+		/// <param name="configuration">Client configuration</param>
+		public void ApplyPeerConfig(IConfiguration configuration)
+		{
+			var peerAddresses = _settings.PeerAddresses ?? Array.Empty<byte>();
+			if (_peerIndex < peerAddresses.Length)
+			{
+				foreach (var relationship in configuration.GetSection("AkmAppConfigs").GetChildren())
+				{
+					Environment.SetEnvironmentVariable($"AkmAppConfigs__{relationship.Key}__SelfAddressValue", peerAddresses[_peerIndex].ToString());
+				}
+			}
+
+			if (_peerIndex > 0)
+			{
+				var journal = Path.Combine(Directory.GetCurrentDirectory(), $"AKMConfig_{Process.GetCurrentProcess().ProcessName}_peer{_peerIndex}.journal");
+				Environment.SetEnvironmentVariable("AkmConfigJournal", journal);
+			}
+		}
+
+		/// <summary>
+		/// Runs the load, writes the report and, on the first peer, merges the reports of the other peers into it
+		/// </summary>
+		/// <param name="token">Token stopping the load early, the report is still written</param>
+		/// <returns>Process exit code</returns>
+		public int Run(CancellationToken token)
+		{
+			if (_settings.Mode == LoadMode.OpenLoop && _settings.FramesPerSecond <= 0)
+			{
+				_logger.LogError("Open loop load needs FramesPerSecond above 0.");
+				return 1;
+			}
+
+			var peers = _peerIndex == 0 ? StartPeers() : new List<(Process Process, string ReportPath)>();
+			try
+			{
+				if (!Connect(token))
+				{
+					_logger.LogError("Cannot connect to the AKM Worker Service.");
+					return 1;
+				}
+
+				var runStart = Stopwatch.GetTimestamp();
+				var measureFrom = runStart + _settings.WarmupSeconds * Stopwatch.Frequency;
+				var runEnd = measureFrom + _settings.DurationSeconds * Stopwatch.Frequency;
+				CreateStreams(runStart, measureFrom);
+
+				_logger.LogInformation($"Peer {_peerIndex}: {_settings.Mode} load on {_streams.Count} relationships for {_settings.WarmupSeconds}+{_settings.DurationSeconds} s");
+				Drive(runEnd, token);
+				Drain();
+
+				var measuredSeconds = Math.Max(0, (double)(Math.Min(Stopwatch.GetTimestamp(), runEnd) - measureFrom) / Stopwatch.Frequency);
+				var streams = _streams.Values.Select(s => s.ToReport()).ToList();
+
+				if (_peerIndex > 0)
+				{
+					LoadReport.Create(_settings.Mode, 1, measuredSeconds, streams).WriteTo(_reportPath);
+					return 0;
+				}
+
+				var reportingPeers = 1;
+				foreach (var peer in peers)
+				{
+					var peerReport = WaitForPeer(peer.Process, peer.ReportPath);
+					if (peerReport == null)
+						continue;
+					reportingPeers++;
+					streams.AddRange(peerReport.Streams);
+					measuredSeconds = Math.Max(measuredSeconds, peerReport.MeasuredSeconds);
+				}
+
+				var report = LoadReport.Create(_settings.Mode, reportingPeers, measuredSeconds, streams);
+				report.WriteTo(_reportPath);
+				_logger.LogInformation($"Echoed {report.FramesPerSecond:F0} frames/s, latency p50 {report.Latency.P50Us} us, p99 {report.Latency.P99Us} us, p99.9 {report.Latency.P999Us} us, " +
+					$"rejected {report.FramesRejected}, lost {report.FramesLost}. Report written to {Path.GetFullPath(_reportPath)}");
+				return reportingPeers == PeerCount ? 0 : 1;
+			}
+			finally
+			{
+				foreach (var socket in _sockets)
+				{
+					//a shutdown ends the pending receive with 0 bytes, closing alone makes the Receiver log an IO error
+					try
+					{
+						socket.Shutdown(SocketShutdown.Both);
+					}
+					catch (SocketException)
+					{
+					}
+					catch (ObjectDisposedException)
+					{
+					}
+					socket.Close();
+				}
+				foreach (var peer in peers)
+				{
+					if (!peer.Process.HasExited)
+						peer.Process.Kill();
+					peer.Process.Dispose();
+				}
+			}
+		}
+
+		private List<(Process Process, string ReportPath)> StartPeers()
+		{
+			var peers = new List<(Process, string)>();
+			var entryAssembly = Assembly.GetEntryAssembly()!.Location;
+			var host = Environment.ProcessPath!;
+
+			for (int peerIndex = 1; peerIndex < PeerCount; peerIndex++)
+			{
+				var reportPath = Path.Combine(Path.GetTempPath(), $"akmLoadPeer{peerIndex}_{Environment.ProcessId}.json");
+				var startInfo = new ProcessStartInfo(host) { UseShellExecute = false, WorkingDirectory = Directory.GetCurrentDirectory() };
+				//started through the dotnet host the assembly has to be passed on
+				if (!string.Equals(Path.GetFileNameWithoutExtension(host), Path.GetFileNameWithoutExtension(entryAssembly), StringComparison.OrdinalIgnoreCase))
+					startInfo.ArgumentList.Add(entryAssembly);
+				startInfo.ArgumentList.Add(PEER_ARG);
+				startInfo.ArgumentList.Add(peerIndex.ToString());
+				startInfo.ArgumentList.Add(REPORT_ARG);
+				startInfo.ArgumentList.Add(reportPath);
+
+				var process = Process.Start(startInfo);
+				if (process == null)
+				{
+					_logger.LogError($"Cannot start load peer {peerIndex}");
+					continue;
+				}
+				peers.Add((process, reportPath));
+			}
+			return peers;
+		}
+
+		private LoadReport? WaitForPeer(Process process, string reportPath)
+		{
+			var timeout = _settings.ConnectTimeoutSeconds + _settings.WarmupSeconds + _settings.DurationSeconds + _settings.DrainSeconds + PEER_EXIT_MARGIN_SECONDS;
+			if (!process.WaitForExit(timeout * 1000) || process.ExitCode != 0 || !File.Exists(reportPath))
+			{
+				_logger.LogError($"Load peer process {process.Id} did not finish with a report, its streams are missing from the report");
+				return null;
+			}
+
+			var report = LoadReport.ReadFrom(reportPath);
+			File.Delete(reportPath);
+			return report;
+		}
+
+		/// <summary>
+		/// Connects once to every worker service endpoint, relationships sharing an endpoint share the connection
+		/// </summary>
+		private bool Connect(CancellationToken token)
+		{
+			var deadline = DateTime.UtcNow.AddSeconds(_settings.ConnectTimeoutSeconds);
+			foreach (var endpointConfigs in LoadedRelationships().GroupBy(c => c.CommunicationPort))
+			{
+				var endpoint = new IPEndPoint(IPAddress.Loopback, endpointConfigs.Key);
+				var socket = new Socket(SocketType.Stream, ProtocolType.Tcp) { NoDelay = true };
+				while (!socket.Connected)
+				{
+					try
+					{
+						socket.Connect(endpoint);
+					}
+					catch (SocketException ex)
+					{
+						if (DateTime.UtcNow > deadline || token.IsCancellationRequested)
+						{
+							_logger.LogError($"Error while connecting to {endpoint}: {ex.Message}");
+							socket.Dispose();
+							return false;
+						}
+						Thread.Sleep(CONNECT_RETRY_MS);
+					}
+				}
+				_sockets.Add(socket);
+
+				foreach (var relCfg in endpointConfigs)
+				{
+					AkmSenderManager.AddSender(relCfg.RelationshipId, relCfg.SelfAddressValue, socket, _logger);
+				}
+
+				var receiver = new Receiver(socket, token, _logger);
+				receiver.DataReceived += Receiver_DataReceived;
+				receiver.StartReceiving();
+			}
+			return true;
+		}
+
+		private void CreateStreams(long runStart, long measureFrom)
+		{
+			var rekeyInterval = _settings.RekeyIntervalSeconds * Stopwatch.Frequency;
+			var peerAddresses = _settings.PeerAddresses ?? Array.Empty<byte>();
+			foreach (var relCfg in LoadedRelationships())
+			{
+				var target = _settings.TargetAddress;
+				if (target == 0)
+					target = relCfg.NodesAddresses.FirstOrDefault(a => a != relCfg.SelfAddressValue && !peerAddresses.Contains(a));
+
+				var sender = AkmSenderManager.GetRelationshipSenders(relCfg.RelationshipId)[relCfg.SelfAddressValue];
+				_streams.Add(relCfg.RelationshipId, new LoadStream(relCfg.RelationshipId, relCfg.SelfAddressValue, target, sender, runStart, measureFrom, rekeyInterval));
+			}
+		}
+
+		private IEnumerable<AkmAppConfig> LoadedRelationships()
+		{
+			var configs = AkmSetup.AkmAppCfg.Values;
+			return _settings.RelationshipCount > 0 ? configs.Take(_settings.RelationshipCount) : configs;
+		}
+
+		/// <summary>
+		/// Sends frames until the end of the run, expiring the ones left without echo as it goes
+		/// </summary>
+		private void Drive(long runEnd, CancellationToken token)
+		{
+			var interval = _settings.FramesPerSecond > 0 ? Stopwatch.Frequency / _settings.FramesPerSecond : 0;
+			var responseTimeout = _settings.ResponseTimeoutMs * Stopwatch.Frequency / 1000;
+
+			long now;
+			while ((now = Stopwatch.GetTimestamp()) < runEnd && !token.IsCancellationRequested)
+			{
+				var nextDue = runEnd;
+				_echoed.Reset();
+				foreach (var stream in _streams.Values)
+				{
+					if (!stream.Sender.IsActive)
+						continue;
+
+					if (_settings.Mode == LoadMode.OpenLoop)
+					{
+						//frames that could not be sent on time go out back to back, still measured from when they were due
+						while (stream.NextDue <= now)
+						{
+							stream.Send(NextPayloadSize(), stream.NextDue);
+							stream.NextDue += interval;
+						}
+						nextDue = Math.Min(nextDue, stream.NextDue);
+					}
+					else
+					{
+						while (stream.InFlight < _settings.Concurrency && stream.Send(NextPayloadSize(), now))
+						{
+							now = Stopwatch.GetTimestamp();
+						}
+					}
+					stream.Expire(now - responseTimeout);
+				}
+
+				if (_settings.Mode == LoadMode.ClosedLoop)
+				{
+					_echoed.Wait(ECHO_WAIT_MS);
+				}
+				else
+				{
+					var waitMs = (nextDue - Stopwatch.GetTimestamp()) * 1000 / Stopwatch.Frequency;
+					if (waitMs > SPIN_THRESHOLD_MS)
+						Thread.Sleep((int)Math.Min(waitMs - 1, ECHO_WAIT_MS));
+					else
+						Thread.SpinWait(20);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Waits for the echoes of frames still in flight, those that do not come are counted as lost
+		/// </summary>
+		private void Drain()
+		{
+			var deadline = Stopwatch.GetTimestamp() + _settings.DrainSeconds * Stopwatch.Frequency;
+			while (_streams.Values.Any(s => s.InFlight > 0) && Stopwatch.GetTimestamp() < deadline)
+			{
+				_echoed.Reset();
+				_echoed.Wait(ECHO_WAIT_MS);
+			}
+			foreach (var stream in _streams.Values)
+			{
+				stream.Expire(long.MaxValue);
+			}
+		}
+
+		private int NextPayloadSize()
+		{
+			switch (_settings.PayloadSizeDistribution)
+			{
+				case PayloadSizeDistribution.Uniform:
+					return _rng.Next(_settings.MinPayloadSize, _settings.MaxPayloadSize + 1);
+				case PayloadSizeDistribution.Exponential:
+					var mean = Math.Max(1, _settings.MeanPayloadSize - _settings.MinPayloadSize);
+					var size = _settings.MinPayloadSize - mean * Math.Log(1 - _rng.NextDouble());
+					return (int)Math.Min(size, _settings.MaxPayloadSize);
+				default:
+					return _settings.MinPayloadSize;
+			}
+		}
+
+		private void Receiver_DataReceived(object? sender, AkmDataReceivedEventArgs e)
+		{
+			var receivedAt = Stopwatch.GetTimestamp();
+			if ((e.FrameData?.Length ?? 0) < sizeof(int) || !_streams.TryGetValue(e.RelationshipId, out var stream))
+				return;
+
+			//the worker service sends every frame back to its source, and on to its target on behalf of the source;
+			//the first is the echo, the second one and frames of other peers are skipped
+			if (e.TrgAddr != stream.PeerAddress || e.SrcAddr == stream.PeerAddress)
+				return;
+
+			stream.Echoed(BitConverter.ToInt32(e.FrameData.AsSpan(0, sizeof(int))), e.FrameData!.Length, e.AkmEvent, receivedAt);
+			_echoed.Set();
+		}
+	}
+}
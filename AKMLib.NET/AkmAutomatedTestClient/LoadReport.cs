@@ -0,0 +1,345 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using System.Text.Json;
+using System.Text.Json.Serialization;
+
+namespace AkmAutomatedTestClient
+{
+	/// <summary>
+	/// Result of a load run, written as JSON. Totals are computed from the streams, so the reports of all peers are
+	/// merged by putting their streams together.
+	/// </summary>
+	public class LoadReport
+	{
+		private static readonly JsonSerializerOptions JsonOptions = new JsonSerializerOptions
+		{
+			WriteIndented = true,
+			Converters = { new JsonStringEnumConverter() }
+		};
+
+		/// <summary>
+		/// Pacing of the run
+		/// </summary>
+		public LoadMode Mode { get; set; }
+		/// <summary>
+		/// Client processes that took part
+		/// </summary>
+		public int Peers { get; set; }
+		/// <summary>
+		/// Relationships loaded by every peer
+		/// </summary>
+		public int Relationships { get; set; }
+		/// <summary>
+		/// Measured time, warm-up excluded
+		/// </summary>
+		public double MeasuredSeconds { get; set; }
+
+		/// <summary>
+		/// Frames queued for sending
+		/// </summary>
+		public long FramesSent { get; set; }
+		/// <summary>
+		/// Payload bytes queued for sending
+		/// </summary>
+		public long BytesSent { get; set; }
+		/// <summary>
+		/// Frames echoed back by the worker service
+		/// </summary>
+		public long FramesEchoed { get; set; }
+		/// <summary>
+		/// Frames not queued because the send queue was full
+		/// </summary>
+		public long FramesRejected { get; set; }
+		/// <summary>
+		/// Frames without echo within the response timeout
+		/// </summary>
+		public long FramesLost { get; set; }
+		/// <summary>
+		/// Echoes received after their frame was counted as lost
+		/// </summary>
+		public long LateEchoes { get; set; }
+		/// <summary>
+		/// LocalSEI rekeys forced
+		/// </summary>
+		public long Rekeys { get; set; }
+
+		/// <summary>
+		/// Frames echoed per second
+		/// </summary>
+		public double FramesPerSecond { get; set; }
+		/// <summary>
+		/// Payload bytes echoed per second
+		/// </summary>
+		public double BytesPerSecond { get; set; }
+
+		/// <summary>
+		/// End-to-end latency, from the time a frame was due to be sent until its echo was received
+		/// </summary>
+		public LatencyReport Latency { get; set; } = new LatencyReport();
+		/// <summary>
+		/// Session establishments at start-up and after forced rekeys
+		/// </summary>
+		public EstablishmentSummary Establishment { get; set; } = new EstablishmentSummary();
+
+		/// <summary>
+		/// Every relationship of every peer
+		/// </summary>
+		public List<LoadStreamReport> Streams { get; set; } = new List<LoadStreamReport>();
+
+		/// <summary>
+		/// Creates a report with totals of given streams
+		/// </summary>
+		/// <param name="mode">Pacing of the run</param>
+		/// <param name="peers">Client processes that took part</param>
+		/// <param name="measuredSeconds">Measured time of the longest peer</param>
+		/// <param name="streams">Streams of all peers</param>
+		public static LoadReport Create(LoadMode mode, int peers, double measuredSeconds, IEnumerable<LoadStreamReport> streams)
+		{
+			var report = new LoadReport { Mode = mode, Peers = peers, MeasuredSeconds = measuredSeconds };
+			report.Streams.AddRange(streams.OrderBy(s => s.RelationshipId).ThenBy(s => s.PeerAddress));
+			report.Relationships = report.Streams.Select(s => s.RelationshipId).Distinct().Count();
+
+			var latency = new LatencyHistogram();
+			var establishments = new List<double>();
+			long bytesEchoed = 0;
+			foreach (var stream in report.Streams)
+			{
+				report.FramesSent += stream.FramesSent;
+				report.BytesSent += stream.BytesSent;
+				report.FramesEchoed += stream.FramesEchoed;
+				report.FramesRejected += stream.FramesRejected;
+				report.FramesLost += stream.FramesLost;
+				report.LateEchoes += stream.LateEchoes;
+				report.Rekeys += stream.Rekeys;
+				report.Establishment.Unfinished += stream.UnfinishedEstablishments;
+				bytesEchoed += stream.BytesEchoed;
+
+				latency.Merge(stream.Latency);
+				establishments.AddRange(stream.Establishments.Select(e => e.DurationMs));
+			}
+
+			if (measuredSeconds > 0)
+			{
+				report.FramesPerSecond = report.FramesEchoed / measuredSeconds;
+				report.BytesPerSecond = bytesEchoed / measuredSeconds;
+			}
+			report.Latency = latency.ToReport();
+			report.Establishment.Summarize(establishments);
+			return report;
+		}
+
+		/// <summary>
+		/// Reads a report written by WriteTo
+		/// </summary>
+		/// <param name="path">Report file</param>
+		public static LoadReport ReadFrom(string path)
+		{
+			return JsonSerializer.Deserialize<LoadReport>(File.ReadAllText(path), JsonOptions)
+				?? throw new InvalidDataException($"Empty load report {path}");
+		}
+
+		/// <summary>
+		/// Writes the report as indented JSON
+		/// </summary>
+		/// <param name="path">Report file, overwritten</param>
+		public void WriteTo(string path)
+		{
+			File.WriteAllText(path, JsonSerializer.Serialize(this, JsonOptions));
+		}
+	}
+
+	/// <summary>
+	/// Load of a single relationship sent by a single peer
+	/// </summary>
+	public class LoadStreamReport
+	{
+		/// <summary>
+		/// Relationship the frames were sent in
+		/// </summary>
+		public short RelationshipId { get; set; }
+		/// <summary>
+		/// Node address of the peer
+		/// </summary>
+		public short PeerAddress { get; set; }
+		/// <summary>
+		/// Frames queued for sending
+		/// </summary>
+		public long FramesSent { get; set; }
+		/// <summary>
+		/// Payload bytes queued for sending
+		/// </summary>
+		public long BytesSent { get; set; }
+		/// <summary>
+		/// Frames echoed back
+		/// </summary>
+		public long FramesEchoed { get; set; }
+		/// <summary>
+		/// Payload bytes of the frames echoed back
+		/// </summary>
+		public long BytesEchoed { get; set; }
+		/// <summary>
+		/// Frames not queued because the send queue was full
+		/// </summary>
+		public long FramesRejected { get; set; }
+		/// <summary>
+		/// Frames without echo within the response timeout
+		/// </summary>
+		public long FramesLost { get; set; }
+		/// <summary>
+		/// Echoes received after their frame was counted as lost
+		/// </summary>
+		public long LateEchoes { get; set; }
+		/// <summary>
+		/// LocalSEI rekeys forced
+		/// </summary>
+		public long Rekeys { get; set; }
+		/// <summary>
+		/// Average time data frames waited in the send queue
+		/// </summary>
+		public double AverageQueueDelayMs { get; set; }
+		/// <summary>
+		/// Longest time a data frame waited in the send queue
+		/// </summary>
+		public double MaxQueueDelayMs { get; set; }
+		/// <summary>
+		/// End-to-end latency of the stream
+		/// </summary>
+		public LatencyReport Latency { get; set; } = new LatencyReport();
+		/// <summary>
+		/// Completed session establishments
+		/// </summary>
+		public List<EstablishmentRecord> Establishments { get; set; } = new List<EstablishmentRecord>();
+		/// <summary>
+		/// Establishments still running when the run ended
+		/// </summary>
+		public int UnfinishedEstablishments { get; set; }
+	}
+
+	/// <summary>
+	/// Latency percentiles in microseconds, with the histogram buckets they were computed from
+	/// </summary>
+	public class LatencyReport
+	{
+		/// <summary>
+		/// Number of measured frames
+		/// </summary>
+		public long Count { get; set; }
+		/// <summary>
+		/// Lowest latency
+		/// </summary>
+		public long MinUs { get; set; }
+		/// <summary>
+		/// Mean latency
+		/// </summary>
+		public double MeanUs { get; set; }
+		/// <summary>
+		/// Median latency
+		/// </summary>
+		public long P50Us { get; set; }
+		/// <summary>
+		/// 90th percentile
+		/// </summary>
+		public long P90Us { get; set; }
+		/// <summary>
+		/// 99th percentile
+		/// </summary>
+		public long P99Us { get; set; }
+		/// <summary>
+		/// 99.9th percentile
+		/// </summary>
+		public long P999Us { get; set; }
+		/// <summary>
+		/// Highest latency
+		/// </summary>
+		public long MaxUs { get; set; }
+		/// <summary>
+		/// Non empty histogram buckets
+		/// </summary>
+		public List<LatencyBucket> Buckets { get; set; } = new List<LatencyBucket>();
+	}
+
+	/// <summary>
+	/// Histogram bucket
+	/// </summary>
+	public class LatencyBucket
+	{
+		/// <summary>
+		/// Highest latency in the bucket, in microseconds
+		/// </summary>
+		public long UpToUs { get; set; }
+		/// <summary>
+		/// Number of frames in the bucket
+		/// </summary>
+		public long Count { get; set; }
+	}
+
+	/// <summary>
+	/// Single session establishment
+	/// </summary>
+	public class EstablishmentRecord
+	{
+		/// <summary>
+		/// Start-up or a forced rekey
+		/// </summary>
+		public string Reason { get; set; } = string.Empty;
+		/// <summary>
+		/// Time from the start of the run until the establishment began
+		/// </summary>
+		public double StartSeconds { get; set; }
+		/// <summary>
+		/// Time until the worker service answered with RecvSE again
+		/// </summary>
+		public double DurationMs { get; set; }
+	}
+
+	/// <summary>
+	/// Establishment durations of all streams
+	/// </summary>
+	public class EstablishmentSummary
+	{
+		/// <summary>
+		/// Completed establishments
+		/// </summary>
+		public int Count { get; set; }
+		/// <summary>
+		/// Establishments still running when the run ended
+		/// </summary>
+		public int Unfinished { get; set; }
+		/// <summary>
+		/// Shortest establishment
+		/// </summary>
+		public double MinMs { get; set; }
+		/// <summary>
+		/// Mean establishment duration
+		/// </summary>
+		public double MeanMs { get; set; }
+		/// <summary>
+		/// Median establishment duration
+		/// </summary>
+		public double P50Ms { get; set; }
+		/// <summary>
+		/// 99th percentile
+		/// </summary>
+		public double P99Ms { get; set; }
+		/// <summary>
+		/// Longest establishment
+		/// </summary>
+		public double MaxMs { get; set; }
+
+		internal void Summarize(List<double> durations)
+		{
+			Count = durations.Count;
+			if (Count == 0)
+				return;
+
+			durations.Sort();
+			MinMs = durations[0];
+			MaxMs = durations[^1];
+			MeanMs = durations.Average();
+			P50Ms = durations[Math.Max(0, (int)Math.Ceiling(0.5 * Count) - 1)];
+			P99Ms = durations[Math.Max(0, (int)Math.Ceiling(0.99 * Count) - 1)];
+		}
+	}
+}
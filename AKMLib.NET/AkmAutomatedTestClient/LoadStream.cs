@@ -0,0 +1,244 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+using AKMCommon.Enum;
+using AKMLogic;
+using System.Diagnostics;
+
+namespace AkmAutomatedTestClient
+{
+	/// <summary>
+	/// Frames a peer sends in a single relationship and the echoes it gets back. Frames are numbered from 1 as the
+	/// worker service expects, and the time each was due is kept until its echo arrives. Frames are sent from the
+	/// load generator thread, echoes are processed on receiver threads.
+	/// </summary>
+	internal sealed class LoadStream
+	{
+		private const int IN_FLIGHT_CAPACITY = 1 << 16;
+		private const int IN_FLIGHT_MASK = IN_FLIGHT_CAPACITY - 1;
+
+		//time each frame in flight was due, 0 for free slots
+		private readonly long[] _dueAt = new long[IN_FLIGHT_CAPACITY];
+		private readonly long _runStart;
+		private readonly long _measureFrom;
+		private readonly long _rekeyInterval;
+		private readonly object _lockEstablishment = new object();
+		private readonly List<EstablishmentRecord> _establishments = new List<EstablishmentRecord>();
+
+		private int _frameNumber;
+		private int _oldestInFlight = 1;
+		private int _inFlight;
+		private long _framesSent;
+		private long _bytesSent;
+		private long _framesEchoed;
+		private long _bytesEchoed;
+		private long _framesRejected;
+		private long _framesLost;
+		private long _lateEchoes;
+		private long _rekeys;
+
+		//establishment in progress, finished by the first RecvSE echo of a frame sent after it began
+		private long _establishingSince;
+		private int _establishingAfter;
+		private string _establishingReason = string.Empty;
+
+		public short RelationshipId { get; }
+		public byte PeerAddress { get; }
+		public short TargetAddress { get; }
+		public Sender Sender { get; }
+		public LatencyHistogram Latency { get; } = new LatencyHistogram();
+
+		/// <summary>
+		/// Time the next frame is due in open loop mode
+		/// </summary>
+		public long NextDue { get; set; }
+
+		/// <summary>
+		/// Frames sent and neither echoed nor counted as lost
+		/// </summary>
+		public int InFlight => Volatile.Read(ref _inFlight);
+
+		/// <param name="relationshipId">Relationship the frames are sent in</param>
+		/// <param name="peerAddress">Node address of the peer</param>
+		/// <param name="targetAddress">Address the frames are sent to</param>
+		/// <param name="sender">Sender of the relationship</param>
+		/// <param name="runStart">Stopwatch timestamp of the run start, when the session starts being established</param>
+		/// <param name="measureFrom">Stopwatch timestamp of the warm-up end, frames due before are not counted</param>
+		/// <param name="rekeyInterval">Stopwatch ticks between forced rekeys, 0 for none</param>
+		public LoadStream(short relationshipId, byte peerAddress, short targetAddress, Sender sender, long runStart, long measureFrom, long rekeyInterval)
+		{
+			RelationshipId = relationshipId;
+			PeerAddress = peerAddress;
+			TargetAddress = targetAddress;
+			Sender = sender;
+			NextDue = runStart;
+			_runStart = runStart;
+			_measureFrom = measureFrom;
+			_rekeyInterval = rekeyInterval;
+			_establishingSince = runStart;
+			_establishingReason = "Startup";
+		}
+
+		/// <summary>
+		/// Sends the next frame, forcing LocalSEI on it when a rekey is due
+		/// </summary>
+		/// <param name="payloadSize">Payload size in bytes</param>
+		/// <param name="dueAt">Time the frame was due, latency is measured from it</param>
+		/// <returns>False if the send queue did not take the frame</returns>
+		public bool Send(int payloadSize, long dueAt)
+		{
+			var frameNumber = _frameNumber + 1;
+			var headerLength = Program.MessageHeaderLength(frameNumber);
+			var message = Program.BuildMessage(frameNumber, Math.Max(0, payloadSize - headerLength));
+			var rekey = _rekeyInterval > 0 && dueAt - _runStart >= _rekeyInterval * (_rekeys + 1);
+			var isMeasured = dueAt >= _measureFrom;
+
+			//a frame still in flight in the slot is one the ring went all the way around, it is not coming back
+			if (Interlocked.Exchange(ref _dueAt[frameNumber & IN_FLIGHT_MASK], dueAt) != 0)
+				Expired(isMeasured);
+
+			if (!Sender.SendData(message, TargetAddress, rekey ? AkmEvent.LocalSEI : null))
+			{
+				//not sent, the number is used by the next frame so the worker sees no gap
+				Volatile.Write(ref _dueAt[frameNumber & IN_FLIGHT_MASK], 0);
+				if (isMeasured)
+					Interlocked.Increment(ref _framesRejected);
+				return false;
+			}
+
+			_frameNumber = frameNumber;
+			Interlocked.Increment(ref _inFlight);
+			if (isMeasured)
+			{
+				Interlocked.Increment(ref _framesSent);
+				Interlocked.Add(ref _bytesSent, message.Length);
+			}
+			if (rekey)
+			{
+				_rekeys++;
+				BeginEstablishment("Rekey", Stopwatch.GetTimestamp(), frameNumber);
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// Matches an echo with the frame it answers
+		/// </summary>
+		/// <param name="frameNumber">Frame number carried by the echo</param>
+		/// <param name="length">Echoed payload length</param>
+		/// <param name="akmEvent">AKM Event of the echo frame</param>
+		/// <param name="receivedAt">Stopwatch timestamp of the echo</param>
+		public void Echoed(int frameNumber, int length, AkmEvent akmEvent, long receivedAt)
+		{
+			var dueAt = Interlocked.Exchange(ref _dueAt[frameNumber & IN_FLIGHT_MASK], 0);
+			if (dueAt == 0)
+			{
+				Interlocked.Increment(ref _lateEchoes);
+			}
+			else
+			{
+				Interlocked.Decrement(ref _inFlight);
+				if (dueAt >= _measureFrom)
+				{
+					Interlocked.Increment(ref _framesEchoed);
+					Interlocked.Add(ref _bytesEchoed, length);
+					Latency.Record((receivedAt - dueAt) * 1000000 / Stopwatch.Frequency);
+				}
+			}
+
+			if (akmEvent == AkmEvent.RecvSE)
+				EndEstablishment(frameNumber, receivedAt);
+		}
+
+		/// <summary>
+		/// Counts frames due before given time and still without echo as lost, called by the sending thread only
+		/// </summary>
+		/// <param name="dueBefore">Stopwatch timestamp, long.MaxValue expires all frames in flight</param>
+		public void Expire(long dueBefore)
+		{
+			while (_oldestInFlight <= _frameNumber)
+			{
+				ref var slot = ref _dueAt[_oldestInFlight & IN_FLIGHT_MASK];
+				var dueAt = Volatile.Read(ref slot);
+				if (dueAt != 0)
+				{
+					if (dueAt >= dueBefore)
+						break;
+					if (Interlocked.CompareExchange(ref slot, 0, dueAt) == dueAt)
+						Expired(dueAt >= _measureFrom);
+				}
+				_oldestInFlight++;
+			}
+		}
+
+		/// <summary>
+		/// Returns the stream report
+		/// </summary>
+		public LoadStreamReport ToReport()
+		{
+			var dataLane = Sender.DataLaneStatistics;
+			var report = new LoadStreamReport
+			{
+				RelationshipId = RelationshipId,
+				PeerAddress = PeerAddress,
+				FramesSent = Interlocked.Read(ref _framesSent),
+				BytesSent = Interlocked.Read(ref _bytesSent),
+				FramesEchoed = Interlocked.Read(ref _framesEchoed),
+				BytesEchoed = Interlocked.Read(ref _bytesEchoed),
+				FramesRejected = Interlocked.Read(ref _framesRejected),
+				FramesLost = Interlocked.Read(ref _framesLost),
+				LateEchoes = Interlocked.Read(ref _lateEchoes),
+				Rekeys = _rekeys,
+				AverageQueueDelayMs = dataLane.AverageQueueDelay.TotalMilliseconds,
+				MaxQueueDelayMs = dataLane.MaxQueueDelay.TotalMilliseconds,
+				Latency = Latency.ToReport()
+			};
+
+			lock (_lockEstablishment)
+			{
+				report.Establishments.AddRange(_establishments);
+				report.UnfinishedEstablishments = _establishingSince != 0 ? 1 : 0;
+			}
+			return report;
+		}
+
+		private void Expired(bool isMeasured)
+		{
+			Interlocked.Decrement(ref _inFlight);
+			if (isMeasured)
+				Interlocked.Increment(ref _framesLost);
+		}
+
+		private void BeginEstablishment(string reason, long now, int afterFrame)
+		{
+			lock (_lockEstablishment)
+			{
+				//a rekey forced while still establishing extends the establishment in progress
+				if (_establishingSince == 0)
+				{
+					_establishingSince = now;
+					_establishingReason = reason;
+				}
+				_establishingAfter = afterFrame;
+			}
+		}
+
+		private void EndEstablishment(int frameNumber, long now)
+		{
+			lock (_lockEstablishment)
+			{
+				if (_establishingSince == 0 || frameNumber <= _establishingAfter)
+					return;
+
+				_establishments.Add(new EstablishmentRecord
+				{
+					Reason = _establishingReason,
+					StartSeconds = (double)(_establishingSince - _runStart) / Stopwatch.Frequency,
+					DurationMs = (double)(now - _establishingSince) * 1000 / Stopwatch.Frequency
+				});
+				_establishingSince = 0;
+			}
+		}
+	}
+}
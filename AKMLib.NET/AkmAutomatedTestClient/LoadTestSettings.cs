@@ -0,0 +1,128 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+namespace AkmAutomatedTestClient
+{
+	/// <summary>
+	/// How the load generator paces the frames it sends
+	/// </summary>
+	public enum LoadMode
+	{
+		/// <summary>
+		/// Frames are sent at a fixed rate whether or not earlier ones were answered, latency is measured from the
+		/// time a frame was due so a stalled node shows up in the tail
+		/// </summary>
+		OpenLoop,
+		/// <summary>
+		/// A fixed number of frames is kept waiting for their echo, a new one is sent as soon as one is answered
+		/// </summary>
+		ClosedLoop
+	}
+
+	/// <summary>
+	/// Distribution payload sizes are drawn from
+	/// </summary>
+	public enum PayloadSizeDistribution
+	{
+		/// <summary>
+		/// Every payload is MinPayloadSize bytes
+		/// </summary>
+		Fixed,
+		/// <summary>
+		/// Uniform between MinPayloadSize and MaxPayloadSize
+		/// </summary>
+		Uniform,
+		/// <summary>
+		/// Exponential with MeanPayloadSize mean, starting at MinPayloadSize and cut at MaxPayloadSize
+		/// </summary>
+		Exponential
+	}
+
+	/// <summary>
+	/// Load generation settings, read from the LoadTestSettings section of appsettings.json
+	/// </summary>
+	public class LoadTestSettings
+	{
+		/// <summary>
+		/// Runs the load generator instead of the functional test, same as starting the client with --load
+		/// </summary>
+		public bool Enabled { get; set; }
+		/// <summary>
+		/// Open or closed loop pacing
+		/// </summary>
+		public LoadMode Mode { get; set; } = LoadMode.OpenLoop;
+		/// <summary>
+		/// Frames sent per second on every relationship by every peer in open loop mode
+		/// </summary>
+		public int FramesPerSecond { get; set; } = 100;
+		/// <summary>
+		/// Frames waiting for their echo on every relationship of every peer in closed loop mode
+		/// </summary>
+		public int Concurrency { get; set; } = 1;
+
+		/// <summary>
+		/// Number of relationships loaded, taken in appsettings.json order, 0 loads all of them
+		/// </summary>
+		public int RelationshipCount { get; set; }
+		/// <summary>
+		/// Node address of every peer, each peer is a separate client process and takes this address in all
+		/// relationships. Empty runs a single peer with the configured SelfAddressValue.
+		/// </summary>
+		public byte[] PeerAddresses { get; set; } = Array.Empty<byte>();
+		/// <summary>
+		/// Address frames are sent to, 0 selects the first node address of the relationship that is not a peer
+		/// </summary>
+		public short TargetAddress { get; set; }
+
+		/// <summary>
+		/// Distribution of payload sizes
+		/// </summary>
+		public PayloadSizeDistribution PayloadSizeDistribution { get; set; } = PayloadSizeDistribution.Fixed;
+		/// <summary>
+		/// Smallest payload in bytes, payloads never get shorter than the frame number and sample message header
+		/// </summary>
+		public int MinPayloadSize { get; set; } = 64;
+		/// <summary>
+		/// Largest payload in bytes
+		/// </summary>
+		public int MaxPayloadSize { get; set; } = 1024;
+		/// <summary>
+		/// Mean payload size in bytes of the exponential distribution
+		/// </summary>
+		public int MeanPayloadSize { get; set; } = 256;
+
+		/// <summary>
+		/// Length of the measurement in seconds
+		/// </summary>
+		public int DurationSeconds { get; set; } = 30;
+		/// <summary>
+		/// Seconds of load before the measurement starts, frames sent in that time are not counted
+		/// </summary>
+		public int WarmupSeconds { get; set; } = 5;
+		/// <summary>
+		/// Seconds to wait for outstanding echoes once sending stopped
+		/// </summary>
+		public int DrainSeconds { get; set; } = 5;
+		/// <summary>
+		/// Time after which a frame without echo is counted as lost
+		/// </summary>
+		public int ResponseTimeoutMs { get; set; } = 5000;
+		/// <summary>
+		/// Interval in seconds of the LocalSEI rekeys forced on every relationship, 0 disables them
+		/// </summary>
+		public int RekeyIntervalSeconds { get; set; }
+		/// <summary>
+		/// Time to keep trying to connect to the worker service
+		/// </summary>
+		public int ConnectTimeoutSeconds { get; set; } = 30;
+		/// <summary>
+		/// Seed of payload sizes, peers add their index to it
+		/// </summary>
+		public int Seed { get; set; } = 1;
+		/// <summary>
+		/// File the JSON report is written to
+		/// </summary>
+		public string ReportPath { get; set; } = "akmLoadReport.json";
+	}
+}
@@ -38,12 +38,14 @@ namespace AkmAutomatedTestClient
 		static void Main(string[] args)
 		{
 			CancellationTokenSource cts = new CancellationTokenSource();
+			var loadPeer = LoadGenerator.PeerIndex(args);
+			var logName = loadPeer > 0 ? $"akmLoadPeer{loadPeer}Log" : "akmAutomatedTestClientLog";
 
 			Log.Logger = new LoggerConfiguration()
 				.MinimumLevel.Debug()
 				.MinimumLevel.Override("Microsoft", LogEventLevel.Warning)
 				.Enrich.FromLogContext()
-				.WriteTo.File($"C:\\akmLog\\akmAutomatedTestClientLog{DateTime.Today:yyyy_MM_dd}.txt")
+				.WriteTo.File($"C:\\akmLog\\{logName}{DateTime.Today:yyyy_MM_dd}.txt")
 				.WriteTo.Console(outputTemplate: "[{Timestamp:HH:mm:ss} {Level:u3}] {Message:lj}{NewLine}{Exception}")
 				.CreateLogger();
 
@@ -69,6 +71,24 @@ namespace AkmAutomatedTestClient
 			AkmSetup.Logger = _logger;
 			AkmSetup.ForceFileConfig = testSettings.AlwaysUseFileConfig;
 
+			var loadSettings = configuration.GetSection("LoadTestSettings").Get<LoadTestSettings>();
+			if (loadPeer >= 0 || (loadSettings?.Enabled ?? false))
+			{
+				var loadGenerator = new LoadGenerator(loadSettings ?? new LoadTestSettings(), _logger, args);
+				loadGenerator.ApplyPeerConfig(configuration);
+
+				//stopping early still writes the report of what was measured
+				Console.CancelKeyPress += delegate (object sender, ConsoleCancelEventArgs e)
+				{
+					e.Cancel = true;
+					cts.Cancel();
+				};
+
+				Environment.ExitCode = loadGenerator.Run(cts.Token);
+				Log.CloseAndFlush();
+				return;
+			}
+
 			var akmConfig = AkmSetup.AkmAppCfg.FirstOrDefault().Value;
 			if (akmConfig == null)
 			{
@@ -117,23 +137,8 @@ namespace AkmAutomatedTestClient
 			while (!cts.Token.IsCancellationRequested && isConnected)
 			{
 				var message = $"Sample message number {++frameCount}";
-				var textBytes = new List<byte>();
-				textBytes.AddRange(BitConverter.GetBytes(frameCount));
-				textBytes.AddRange(Encoding.UTF8.GetBytes(message));
-				byte[] messageBytes = textBytes.ToArray();
-
-				if (testSettings.UseRandomDataSize)
-				{
-					var addedSize = rng.Next(testSettings.MinDataPackageSize, testSettings.MaxDataPackageSize);
-					Array.Resize<byte>(ref messageBytes, messageBytes.Length + addedSize);
-					var extraPackage = new byte[addedSize];
-					var frameCounterBytes = BitConverter.GetBytes(frameCount);
-					for (int i = 0; i < addedSize - 4; i += 4)
-					{
-						Array.Copy(frameCounterBytes, 0, extraPackage, i, 4);
-					}
-					Array.Copy(extraPackage, 0, messageBytes, messageBytes.Length - addedSize, addedSize);
-				}
+				var addedSize = testSettings.UseRandomDataSize ? rng.Next(testSettings.MinDataPackageSize, testSettings.MaxDataPackageSize) : 0;
+				byte[] messageBytes = BuildMessage(frameCount, addedSize);
 
 				if (!sender.IsActive) //check
 				{
@@ -180,6 +185,42 @@ namespace AkmAutomatedTestClient
 			socket.Dispose();
 		}
 
+		/// <summary>
+		/// Builds a test frame payload: frame number, sample message text and an extra data package filled with the
+		/// frame number, as the worker service checks it
+		/// </summary>
+		/// <param name="frameCount">Frame number</param>
+		/// <param name="addedSize">Size of the extra data package</param>
+		internal static byte[] BuildMessage(int frameCount, int addedSize)
+		{
+			var textBytes = new List<byte>();
+			textBytes.AddRange(BitConverter.GetBytes(frameCount));
+			textBytes.AddRange(Encoding.UTF8.GetBytes($"Sample message number {frameCount}"));
+			byte[] messageBytes = textBytes.ToArray();
+
+			if (addedSize > 0)
+			{
+				Array.Resize<byte>(ref messageBytes, messageBytes.Length + addedSize);
+				var extraPackage = new byte[addedSize];
+				var frameCounterBytes = BitConverter.GetBytes(frameCount);
+				for (int i = 0; i < addedSize - 4; i += 4)
+				{
+					Array.Copy(frameCounterBytes, 0, extraPackage, i, 4);
+				}
+				Array.Copy(extraPackage, 0, messageBytes, messageBytes.Length - addedSize, addedSize);
+			}
+			return messageBytes;
+		}
+
+		/// <summary>
+		/// Length of the payload BuildMessage returns without extra data package
+		/// </summary>
+		/// <param name="frameCount">Frame number</param>
+		internal static int MessageHeaderLength(int frameCount)
+		{
+			return sizeof(int) + Encoding.UTF8.GetByteCount($"Sample message number {frameCount}");
+		}
+
 		private static bool ConnectToService(CancellationTokenSource cts, out Socket socket)
 		{
 			bool isConnected = false;
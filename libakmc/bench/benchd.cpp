@@ -0,0 +1,474 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#include <akmd.h>
+#include <akmd_udp.h>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+const uint16_t ringNodes[] = { 1, 5 };
+const uint16_t clientAddress = 1;
+const uint16_t daemonAddress = 5;
+const uint16_t firstId = 1;
+const uint32_t relationshipNum = 50000;
+// Relationships the client talks on, spread over the whole range
+const uint32_t activeNum = 256;
+
+const char* const defaultKeys[AKMD_KEYS_NUM] = {
+	"6v9y$B&E)H+MbQeThWmZq4t7w!z%C*F-",
+	"z$C&F)H@McQfTjWnZr4u7x!A%D*G-KaN",
+	"6v9y$B&E)H+MbQeMhWmZq4t7w!z%C*Fo",
+	"z$C&F)H@McQfTjWaZr4u7x!A%D*G-Kat",
+};
+
+// Relationships the establishment benches start sessions on, none of them active
+const uint32_t establishNum = 5000;
+
+// How the client reaches akmd
+enum Transport
+{
+	TransportTcp,
+	TransportUdp,
+	TransportShm,
+};
+
+struct Client
+{
+	AKMDNode node;
+	int fd;
+	std::vector<uint8_t> out;
+	std::vector<uint8_t> in;
+	std::vector<uint8_t> plain;
+	size_t inPos, inSize;
+	// The same frames as datagrams, one sendmmsg and recvmmsg batch at a time
+	int udpFd;
+	AKMDDatagramBatch udpOut, udpIn;
+	unsigned udpQueued, udpMessage, udpReceived;
+	size_t udpPos;
+	// Or as records of a shared-memory channel
+	int shmFd;
+	AKMDShmChannel channel;
+};
+
+typedef bool(*bench_func)(Client* client, long iterations, size_t contentSize, Transport transport);
+
+bool bench_round_trip(Client* client, long iterations, size_t contentSize, Transport transport);
+bool bench_pipelined(Client* client, long iterations, size_t contentSize, Transport transport);
+bool bench_establish(Client* client, long iterations, size_t contentSize, Transport transport);
+
+struct Bench
+{
+	const char* name;
+	bench_func func;
+	long iterations;
+	size_t contentSize;
+	Transport transport;
+};
+
+Bench benches[] =
+{
+	{ "round_trip_64", bench_round_trip, 20000, 64, TransportTcp },
+	{ "round_trip_1024", bench_round_trip, 20000, 1024, TransportTcp },
+	{ "pipelined_64", bench_pipelined, 200000, 64, TransportTcp },
+	{ "pipelined_1024", bench_pipelined, 100000, 1024, TransportTcp },
+	{ "udp_round_trip_64", bench_round_trip, 20000, 64, TransportUdp },
+	{ "udp_round_trip_1024", bench_round_trip, 20000, 1024, TransportUdp },
+	{ "udp_pipelined_64", bench_pipelined, 200000, 64, TransportUdp },
+	{ "udp_pipelined_1024", bench_pipelined, 100000, 1024, TransportUdp },
+	{ "shm_round_trip_64", bench_round_trip, 20000, 64, TransportShm },
+	{ "shm_round_trip_1024", bench_round_trip, 20000, 1024, TransportShm },
+	{ "shm_pipelined_64", bench_pipelined, 200000, 64, TransportShm },
+	{ "shm_pipelined_1024", bench_pipelined, 100000, 1024, TransportShm },
+	{ "establish_tcp", bench_establish, 2000, 0, TransportTcp },
+	{ "establish_udp", bench_establish, 2000, 0, TransportUdp },
+	{ "establish_shm", bench_establish, 2000, 0, TransportShm },
+	{ nullptr, nullptr, 0, 0, TransportTcp },
+};
+
+static void makeConfig(AKMConfiguration* config, AKMParameterDataVector* pdv, const uint16_t* self)
+{
+	for (int i = 0; i < AKM_PARAMETER_DATA_VECTOR_SIZE; ++i)
+		pdv->data[i] = (uint8_t)i;
+	*config = AKMConfiguration();
+	config->params.SK = AES256_KEY_SIZE;
+	config->params.SRNA = sizeof(ringNodes[0]);
+	config->params.N = sizeof(ringNodes) / sizeof(ringNodes[0]);
+	config->params.NNRT = 1000000000;
+	config->params.NSET = 1000000000;
+	config->params.FBSET = 1000000000;
+	config->params.FSSET = 1000000000;
+	config->pdv = pdv;
+	config->nodeAddresses = ringNodes;
+	config->selfNodeAddress = self;
+}
+
+static inline AKMDRelationship* activeRelationship(Client* client, long i)
+{
+	return client->node.relationships + (size_t)(i % activeNum) * (relationshipNum / activeNum);
+}
+
+// Appends a frame to the output buffer, datagram batch or channel ring
+static bool queueFrame(Client* client, AKMDRelationship* rel, const uint8_t* content, size_t contentSize, Transport transport)
+{
+	const size_t size = AKMDFrameSealedSize(contentSize);
+	uint8_t* out;
+	if (transport == TransportUdp)
+	{
+		if (!(out = AKMDBatchAdd(&client->udpOut, nullptr, size)))
+			return false;
+		client->udpQueued++;
+	}
+	else if (transport == TransportShm)
+	{
+		while (!(out = AKMDRingReserve(&client->channel.out, size)))
+		{
+			AKMDRingWakeConsumer(&client->channel.out);
+			if (AKMDRingProducerSleep(&client->channel.out, size) && !AKMDShmWait(client->channel.out.spaceFd, 1000))
+				return false;
+		}
+		if (AKMDNodeSeal(&client->node, rel, &daemonAddress, (AKMEvent)rel->sendEvent, content, contentSize, out) == 0)
+			return false;
+		AKMDRingCommit(&client->channel.out, size);
+		return true;
+	}
+	else
+	{
+		const size_t offset = client->out.size();
+		client->out.resize(offset + size);
+		out = client->out.data() + offset;
+	}
+	return AKMDNodeSeal(&client->node, rel, &daemonAddress, (AKMEvent)rel->sendEvent, content, contentSize, out) > 0;
+}
+
+static bool flushFrames(Client* client, Transport transport)
+{
+	if (transport == TransportUdp)
+	{
+		const unsigned queued = client->udpQueued;
+		client->udpQueued = 0;
+		return AKMDBatchSend(&client->udpOut, client->udpFd, nullptr, nullptr) == (int)queued;
+	}
+	if (transport == TransportShm)
+	{
+		// One wakeup for the records queued since the last
+		AKMDRingWakeConsumer(&client->channel.out);
+		return true;
+	}
+	const uint8_t* data = client->out.data();
+	size_t size = client->out.size();
+	while (size > 0)
+	{
+		const ssize_t n = send(client->fd, data, size, MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		data += n;
+		size -= (size_t)n;
+	}
+	client->out.clear();
+	return true;
+}
+
+static bool openFrame(Client* client, const uint8_t* header, uint64_t dataSize)
+{
+	AKMDRelationship* rel = AKMDNodeFind(&client->node, (uint16_t)(header[0] | header[1] << 8));
+	if (!rel)
+		return false;
+	if (client->plain.size() < dataSize + AKMD_ADDRESS_SIZE)
+		client->plain.resize(dataSize + AKMD_ADDRESS_SIZE);
+	AKMFrame plain;
+	AKMDNodeReceive(&client->node, rel, header + AKMD_HEADER_SIZE, dataSize, client->plain.data(), 0, &plain);
+	return plain.size > 0;
+}
+
+// Takes the next frame of the last recvmmsg batch, a datagram or a GRO segment, receiving a new batch when done
+static bool receiveDatagram(Client* client)
+{
+	for (;;)
+	{
+		if (client->udpMessage < client->udpReceived)
+		{
+			const uint8_t* data;
+			size_t size, segmentSize;
+			const sockaddr_in* peer;
+			AKMDBatchReceived(&client->udpIn, client->udpMessage, &data, &size, &segmentSize, &peer);
+			if (client->udpPos < size)
+			{
+				const size_t frameSize = std::min(segmentSize, size - client->udpPos);
+				const uint8_t* frame = data + client->udpPos;
+				client->udpPos += frameSize;
+				return frameSize >= AKMD_HEADER_SIZE && openFrame(client, frame, frameSize - AKMD_HEADER_SIZE);
+			}
+			client->udpMessage++;
+			client->udpPos = 0;
+			continue;
+		}
+		// A lost datagram ends the bench at the receive timeout instead of hanging it
+		const int n = AKMDBatchReceive(&client->udpIn, client->udpFd, true);
+		if (n <= 0)
+			return false;
+		client->udpReceived = (unsigned)n;
+		client->udpMessage = 0;
+		client->udpPos = 0;
+	}
+}
+
+// Takes the next record of the channel, sleeping until the daemon publishes one if there is none
+static bool receiveRecord(Client* client)
+{
+	AKMDRing* ring = &client->channel.in;
+	size_t size;
+	const uint8_t* record;
+	while (!(record = AKMDRingPeek(ring, &size)))
+	{
+		if (AKMDRingConsumerSleep(ring) && !AKMDShmWait(ring->dataFd, 1000))
+			return false;
+	}
+	const bool ok = size >= AKMD_HEADER_SIZE && openFrame(client, record, size - AKMD_HEADER_SIZE);
+	AKMDRingConsume(ring, size);
+	AKMDRingWakeProducer(ring);
+	return ok;
+}
+
+// Receives and processes one frame, false if the connection broke or the frame did not decrypt
+static bool receiveFrame(Client* client, Transport transport)
+{
+	if (transport == TransportUdp)
+		return receiveDatagram(client);
+	if (transport == TransportShm)
+		return receiveRecord(client);
+	for (;;)
+	{
+		const size_t available = client->inSize - client->inPos;
+		if (available >= AKMD_HEADER_SIZE)
+		{
+			const uint8_t* header = client->in.data() + client->inPos;
+			uint64_t dataSize = 0;
+			for (int i = 7; i >= 0; --i)
+				dataSize = dataSize << 8 | header[2 + i];
+			if (available >= AKMD_HEADER_SIZE + dataSize)
+			{
+				client->inPos += AKMD_HEADER_SIZE + dataSize;
+				return openFrame(client, header, dataSize);
+			}
+		}
+		if (client->inPos > 0)
+		{
+			std::copy(client->in.begin() + client->inPos, client->in.begin() + client->inSize, client->in.begin());
+			client->inSize -= client->inPos;
+			client->inPos = 0;
+		}
+		const ssize_t n = recv(client->fd, client->in.data() + client->inSize, client->in.size() - client->inSize, 0);
+		if (n <= 0)
+			return false;
+		client->inSize += (size_t)n;
+	}
+}
+
+// Session establishment started by the client, with the frames AKM takes to set the new keys
+static bool establish(Client* client, AKMDRelationship* rel, Transport transport)
+{
+	AKMDNodeLocalSEI(&client->node, rel, 0);
+	for (int round = 0; round < 4; ++round)
+	{
+		if (!queueFrame(client, rel, nullptr, 0, transport) || !flushFrames(client, transport) || !receiveFrame(client, transport))
+			return false;
+	}
+	return true;
+}
+
+// Sequential request and reply, the latency of a frame through akmd
+bool bench_round_trip(Client* client, long iterations, size_t contentSize, Transport transport)
+{
+	std::vector<uint8_t> content(contentSize, 0x5a);
+	std::vector<double> samples;
+	samples.reserve((size_t)iterations);
+	const auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < iterations; ++i)
+	{
+		const auto sent = std::chrono::steady_clock::now();
+		if (!queueFrame(client, activeRelationship(client, i), content.data(), content.size(), transport) || !flushFrames(client, transport)
+				|| !receiveFrame(client, transport))
+			return false;
+		samples.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sent).count());
+	}
+	const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	std::sort(samples.begin(), samples.end());
+	std::cout << iterations << " round trips, " << iterations / (ns / 1e9) << " frames/s, p50 "
+		<< samples[samples.size() / 2] / 1000 << " us, p99 " << samples[samples.size() * 99 / 100] / 1000 << " us" << std::endl;
+	return true;
+}
+
+// Windows of frames written at once, throughput with the daemon batching its replies
+bool bench_pipelined(Client* client, long iterations, size_t contentSize, Transport transport)
+{
+	// A datagram window is one sendmmsg batch
+	const long window = transport == TransportUdp ? AKMD_UDP_BATCH : 128;
+	std::vector<uint8_t> content(contentSize, 0x5a);
+	const auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < iterations; i += window)
+	{
+		const long batch = std::min(window, iterations - i);
+		for (long j = 0; j < batch; ++j)
+		{
+			if (!queueFrame(client, activeRelationship(client, i + j), content.data(), content.size(), transport))
+				return false;
+		}
+		if (!flushFrames(client, transport))
+			return false;
+		for (long j = 0; j < batch; ++j)
+		{
+			if (!receiveFrame(client, transport))
+				return false;
+		}
+	}
+	const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	const double frameBytes = (double)AKMDFrameSealedSize(contentSize);
+	std::cout << iterations << " frames, " << iterations / (ns / 1e9) << " frames/s, "
+		<< 2 * iterations * frameBytes / ns * 1e3 << " MB/s both ways, " << ns / iterations << " ns/frame" << std::endl;
+	return true;
+}
+
+// Sessions set up one relationship after another, each on one not used before
+bool bench_establish(Client* client, long iterations, size_t contentSize, Transport transport)
+{
+	(void)contentSize;
+	// Each transport takes relationships off the active ones and the other transports'
+	const uint32_t stride = relationshipNum / establishNum;
+	const auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < iterations; ++i)
+	{
+		AKMDRelationship* rel = client->node.relationships + (size_t)(i % establishNum) * stride + 1 + transport;
+		if (!establish(client, rel, transport))
+			return false;
+	}
+	const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	std::cout << iterations << " sessions, " << iterations / (ns / 1e9) << " sessions/s, " << ns / iterations / 1000 << " us/session" << std::endl;
+	return true;
+}
+
+static int connectTo(uint16_t port, int type = SOCK_STREAM)
+{
+	const int fd = socket(AF_INET, type, 0);
+	sockaddr_in addr = sockaddr_in();
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	const int one = 1;
+	if (type == SOCK_STREAM)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	else
+	{
+		const timeval timeout = { 1, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		const int bufferSize = 4 * 1024 * 1024;
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+	}
+	return fd;
+}
+
+int main(int argc, char** argv)
+{
+	const double scale = argc > 1 ? std::atof(argv[1]) : 1.0;
+	AKMConfiguration daemonConfig, clientConfig;
+	AKMParameterDataVector daemonPdv, clientPdv;
+	makeConfig(&daemonConfig, &daemonPdv, &daemonAddress);
+	makeConfig(&clientConfig, &clientPdv, &clientAddress);
+	AKMDConfig config = AKMDConfig();
+	config.address = "127.0.0.1";
+	config.firstRelationshipId = firstId;
+	config.relationshipNum = relationshipNum;
+	config.akm = &daemonConfig;
+	for (int i = 0; i < AKMD_KEYS_NUM; ++i)
+		config.keys[i] = (const uint8_t*)defaultKeys[i];
+	config.echo = true;
+	config.udp = true;
+	config.udpOffload = true;
+	config.udpMtu = AKMD_UDP_DEFAULT_MTU;
+	const std::string shmPath = "/tmp/akm_benchd." + std::to_string(getpid()) + ".sock";
+	config.shmPath = shmPath.c_str();
+
+	const auto created = std::chrono::steady_clock::now();
+	AKMDaemon* daemon;
+	if (AKMDCreate(&daemon, &config) != AKMStSuccess)
+	{
+		std::cout << "cannot create akmd" << std::endl;
+		return 1;
+	}
+	std::cout << "akmd: " << relationshipNum << " relationships created in "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - created).count() << " ms" << std::endl;
+	std::thread reactor([daemon] { AKMDRun(daemon); });
+
+	Client client = Client();
+	client.in.resize(1024 * 1024);
+	client.fd = client.udpFd = client.shmFd = -1;
+	int status = 0;
+	if (AKMDNodeInit(&client.node, &clientConfig, (const uint8_t* const*)defaultKeys, firstId, relationshipNum, 0) != AKMStSuccess
+			|| (client.fd = connectTo(AKMDGetPort(daemon))) < 0 || (client.udpFd = connectTo(AKMDGetPort(daemon), SOCK_DGRAM)) < 0
+			|| AKMDBatchInit(&client.udpOut, AKMD_UDP_BATCH, AKMD_UDP_BATCH * 64 * 1024) != AKMStSuccess
+			|| AKMDBatchInit(&client.udpIn, AKMD_UDP_BATCH, AKMD_UDP_BATCH * 64 * 1024) != AKMStSuccess
+			|| (client.shmFd = AKMDShmConnect(shmPath.c_str(), &client.channel)) < 0)
+	{
+		std::cout << "cannot connect to akmd" << std::endl;
+		status = 1;
+	}
+	else
+	{
+		client.udpOut.gso = AKMDUdpEnableGso(client.udpFd);
+		AKMDUdpEnableGro(client.udpFd);
+	}
+	// Establish sessions on the relationships in use, so the benches run with the negotiated keys
+	for (uint32_t i = 0; status == 0 && i < activeNum; ++i)
+	{
+		if (!establish(&client, activeRelationship(&client, i), TransportTcp))
+			status = 1;
+	}
+	for (int i = 0; status == 0 && benches[i].name; ++i)
+	{
+		std::cout << benches[i].name << ": ";
+		if (!benches[i].func(&client, (long)(benches[i].iterations * scale) + 1, benches[i].contentSize, benches[i].transport))
+		{
+			std::cout << "failed" << std::endl;
+			status = 1;
+		}
+	}
+
+	if (client.fd >= 0)
+		close(client.fd);
+	if (client.udpFd >= 0)
+		close(client.udpFd);
+	AKMDBatchFree(&client.udpOut);
+	AKMDBatchFree(&client.udpIn);
+	if (client.shmFd >= 0)
+	{
+		close(client.shmFd);
+		AKMDShmClose(&client.channel);
+	}
+	AKMDStop(daemon);
+	reactor.join();
+	AKMDStats stats;
+	AKMDGetStats(daemon, &stats);
+	std::cout << "akmd: " << stats.framesIn << " frames in, " << stats.framesOut << " frames out, "
+		<< stats.node.keysSet << " keys set, " << stats.node.cannotDecrypt << " undecryptable" << std::endl;
+	std::cout << "akmd: " << stats.datagramsIn << " datagrams in, " << stats.datagramsOut << " datagrams out in "
+		<< stats.datagramBatches << " recvmmsg and sendmmsg batches" << std::endl;
+	AKMDFree(daemon);
+	AKMDNodeFree(&client.node);
+	return status;
+}
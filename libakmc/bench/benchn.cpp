@@ -0,0 +1,412 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#include <akm.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+const uint16_t nodeAddresses[] = { 3, 5, 7, 9 };
+const uint16_t selfAddress[] = { 9 };
+
+struct BenchResult
+{
+	long events;
+	long steps;
+	// Optional: bytes produced, and the time of the measured part if not the whole bench
+	long bytes;
+	double ns;
+};
+
+typedef BenchResult(*bench_func)(AKMRelationship* relationship, long iterations);
+
+BenchResult bench_established_recv_se(AKMRelationship* relationship, long iterations);
+BenchResult bench_rekey_cycle(AKMRelationship* relationship, long iterations);
+BenchResult bench_established_retry_dec(AKMRelationship* relationship, long iterations);
+BenchResult bench_create_init(AKMRelationship* relationship, long iterations);
+BenchResult bench_create_from_template(AKMRelationship* relationship, long iterations);
+BenchResult bench_churn_malloc(AKMRelationship* relationship, long iterations);
+BenchResult bench_churn_pool(AKMRelationship* relationship, long iterations);
+BenchResult bench_replica_rekey_cycle(AKMRelationship* relationship, long iterations);
+BenchResult bench_replica_apply(AKMRelationship* relationship, long iterations);
+
+struct Bench
+{
+	const char* name;
+	bench_func func;
+	long iterations;
+	// The allocator can be changed only while no relationship exists, such benches get none
+	bool setsAllocator;
+};
+
+Bench benches[] =
+{
+	{ "established_recv_se", bench_established_recv_se, 2000000 },
+	{ "rekey_cycle", bench_rekey_cycle, 20000 },
+	{ "established_retry_dec", bench_established_retry_dec, 1000000 },
+	{ "create_init", bench_create_init, 200000 },
+	{ "create_from_template", bench_create_from_template, 200000 },
+	{ "churn_malloc", bench_churn_malloc, 400000, true },
+	{ "churn_pool", bench_churn_pool, 400000, true },
+	{ "replica_rekey_cycle", bench_replica_rekey_cycle, 20000 },
+	{ "replica_apply", bench_replica_apply, 20000 },
+	{ nullptr, nullptr, 0 },
+};
+
+static void makeConfig(AKMConfiguration* config, AKMParameterDataVector* pdv)
+{
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<> dist(0, 255);
+	for (int i = 0; i < AKM_PARAMETER_DATA_VECTOR_SIZE; ++i)
+		pdv->data[i] = dist(gen);
+	*config = AKMConfiguration();
+	config->nodeAddresses = nodeAddresses;
+	config->selfNodeAddress = selfAddress;
+	config->pdv = pdv;
+	config->params.SK = 16;
+	config->params.SRNA = sizeof(selfAddress);
+	config->params.N = sizeof(nodeAddresses) / config->params.SRNA;
+	config->params.NNRT = 1000000000;
+	config->params.NSET = 1000000000;
+	config->params.FBSET = 1000000000;
+	config->params.FSSET = 1000000000;
+}
+
+// Runs the initialization yielded after AKMInit or AKMInitFromTemplate
+static AKMStatus runInit(AKMProcessCtx* ctx, AKMStatus status, BenchResult* result)
+{
+	if (status != AKMStSuccess)
+		return status;
+	do
+	{
+		AKMProcess(ctx);
+		result->steps++;
+	}
+	while (ctx->cmd.opcode != AKMCmdOpReturn);
+	result->events++;
+	return (AKMStatus)ctx->cmd.p1;
+}
+
+AKMRelationship* makeRelationship()
+{
+	AKMProcessCtx ctx = { 0 };
+	AKMConfiguration config;
+	AKMParameterDataVector pdv;
+	makeConfig(&config, &pdv);
+	BenchResult result = { 0, 0 };
+	const AKMStatus status = runInit(&ctx, AKMInit(&ctx, &config), &result);
+	if (status != AKMStSuccess)
+	{
+		AKMFree(ctx.relationship);
+		ctx.relationship = NULL;
+	}
+	return ctx.relationship;
+}
+
+// Feeds one event and runs the relationship until it returns, yielded commands are ignored
+static inline void feed(AKMProcessCtx* ctx, AKMEvent akmEvent, const void* srcAddr, BenchResult* result)
+{
+	ctx->akmEvent = akmEvent;
+	ctx->srcAddr = srcAddr;
+	do
+	{
+		AKMProcess(ctx);
+		result->steps++;
+	}
+	while (ctx->cmd.opcode != AKMCmdOpReturn);
+	result->events++;
+}
+
+static void feedRound(AKMProcessCtx* ctx, AKMEvent akmEvent, BenchResult* result)
+{
+	for (int i = 0; i < 3; ++i)
+		feed(ctx, akmEvent, nodeAddresses + i, result);
+}
+
+int main(int argc, char** argv)
+{
+	const double scale = argc > 1 ? std::atof(argv[1]) : 1.0;
+	for (int i = 0; benches[i].name; ++i)
+	{
+		AKMRelationship* relationship = benches[i].setsAllocator ? nullptr : makeRelationship();
+		if (!relationship && !benches[i].setsAllocator)
+		{
+			std::cout << benches[i].name << ": cannot create relationship" << std::endl;
+			return 1;
+		}
+		const long iterations = (long)(benches[i].iterations * scale) + 1;
+		const auto start = std::chrono::steady_clock::now();
+		const BenchResult result = benches[i].func(relationship, iterations);
+		double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		if (result.ns > 0)
+			ns = result.ns;
+		std::cout << benches[i].name << ": " << result.events << " events, "
+			<< ns / result.events << " ns/event, " << ns / result.steps << " ns/step";
+		if (result.bytes > 0)
+			std::cout << ", " << (double)result.bytes / result.events << " bytes/event";
+		std::cout << std::endl;
+		AKMFree(relationship);
+	}
+	return 0;
+}
+
+BenchResult bench_established_recv_se(AKMRelationship* relationship, long iterations)
+{
+	BenchResult result = { 0, 0 };
+	AKMProcessCtx ctx = { 0 };
+	ctx.relationship = relationship;
+	feedRound(&ctx, AKMEvRecvSEI, &result);
+	feedRound(&ctx, AKMEvRecvSEC, &result);
+	feedRound(&ctx, AKMEvRecvSEF, &result);
+	feedRound(&ctx, AKMEvRecvSE, &result);
+	result = BenchResult{ 0, 0 };
+	for (long i = 0; i < iterations; ++i)
+		feed(&ctx, AKMEvRecvSE, nodeAddresses + i % 3, &result);
+	return result;
+}
+
+// Every frame fails to decrypt with the current key and is decrypted on the retry
+BenchResult bench_established_retry_dec(AKMRelationship* relationship, long iterations)
+{
+	BenchResult result = { 0, 0 };
+	AKMProcessCtx ctx = { 0 };
+	ctx.relationship = relationship;
+	feedRound(&ctx, AKMEvRecvSEI, &result);
+	feedRound(&ctx, AKMEvRecvSEC, &result);
+	feedRound(&ctx, AKMEvRecvSEF, &result);
+	feedRound(&ctx, AKMEvRecvSE, &result);
+	result = BenchResult{ 0, 0 };
+	for (long i = 0; i < iterations; ++i)
+	{
+		ctx.akmEvent = AKMEvCannotDecrypt;
+		ctx.srcAddr = NULL;
+		AKMProcess(&ctx);
+		result.steps++;
+		feed(&ctx, AKMEvRecvSE, nodeAddresses + i % 3, &result);
+	}
+	return result;
+}
+
+BenchResult bench_rekey_cycle(AKMRelationship* relationship, long iterations)
+{
+	BenchResult result = { 0, 0 };
+	AKMProcessCtx ctx = { 0 };
+	ctx.relationship = relationship;
+	for (long i = 0; i < iterations; ++i)
+	{
+		feedRound(&ctx, AKMEvRecvSEI, &result);
+		feedRound(&ctx, AKMEvRecvSEC, &result);
+		feedRound(&ctx, AKMEvRecvSEF, &result);
+		feedRound(&ctx, AKMEvRecvSE, &result);
+	}
+	return result;
+}
+
+// Relationships are kept alive in batches, as when a large number of them is instantiated at startup
+static const long createBatchSize = 4096;
+
+BenchResult bench_create_init(AKMRelationship* relationship, long iterations)
+{
+	(void)relationship;
+	BenchResult result = { 0, 0 };
+	AKMConfiguration config;
+	AKMParameterDataVector pdv;
+	makeConfig(&config, &pdv);
+	std::vector<AKMRelationship*> batch;
+	batch.reserve(createBatchSize);
+	for (long i = 0; i < iterations; ++i)
+	{
+		AKMProcessCtx ctx = { 0 };
+		runInit(&ctx, AKMInit(&ctx, &config), &result);
+		batch.push_back(ctx.relationship);
+		if ((long)batch.size() == createBatchSize || i + 1 == iterations)
+		{
+			for (AKMRelationship* r : batch)
+				AKMFree(r);
+			batch.clear();
+		}
+	}
+	return result;
+}
+
+BenchResult bench_create_from_template(AKMRelationship* relationship, long iterations)
+{
+	(void)relationship;
+	BenchResult result = { 0, 0 };
+	AKMConfiguration config;
+	AKMParameterDataVector pdv;
+	makeConfig(&config, &pdv);
+	AKMTemplate* tmpl = NULL;
+	if (AKMTemplateCreate(&tmpl, &config) != AKMStSuccess)
+		return result;
+	std::vector<AKMRelationship*> batch;
+	batch.reserve(createBatchSize);
+	for (long i = 0; i < iterations; ++i)
+	{
+		AKMProcessCtx ctx = { 0 };
+		runInit(&ctx, AKMInitFromTemplate(&ctx, tmpl, NULL), &result);
+		batch.push_back(ctx.relationship);
+		if ((long)batch.size() == createBatchSize || i + 1 == iterations)
+		{
+			for (AKMRelationship* r : batch)
+				AKMFree(r);
+			batch.clear();
+		}
+	}
+	AKMTemplateRelease(tmpl);
+	return result;
+}
+
+// Every thread keeps a window of live relationships, creating a new one and freeing the oldest per iteration
+static BenchResult churn(const AKMAllocator* allocator, long iterations)
+{
+	const unsigned threadsNum = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+	const long window = 64;
+	std::vector<BenchResult> results(threadsNum, BenchResult{ 0, 0 });
+	std::vector<std::thread> threads;
+	if (AKMSetAllocator(allocator) != AKMStSuccess)
+	{
+		std::cout << "churn: cannot set allocator while relationships exist" << std::endl;
+		std::exit(1);
+	}
+	for (unsigned t = 0; t < threadsNum; ++t)
+	{
+		threads.emplace_back([&results, t, iterations, threadsNum, window]()
+		{
+			AKMConfiguration config;
+			AKMParameterDataVector pdv;
+			makeConfig(&config, &pdv);
+			std::vector<AKMRelationship*> live(window, nullptr);
+			for (long i = 0; i < iterations / threadsNum; ++i)
+			{
+				AKMProcessCtx ctx = { 0 };
+				runInit(&ctx, AKMInit(&ctx, &config), &results[t]);
+				AKMRelationship*& slot = live[i % window];
+				AKMFree(slot);
+				slot = ctx.relationship;
+			}
+			for (AKMRelationship* r : live)
+				AKMFree(r);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	AKMSetAllocator(NULL);
+	BenchResult result = { 0, 0 };
+	for (const BenchResult& r : results)
+	{
+		result.events += r.events;
+		result.steps += r.steps;
+	}
+	return result;
+}
+
+BenchResult bench_churn_malloc(AKMRelationship* relationship, long iterations)
+{
+	(void)relationship;
+	return churn(NULL, iterations);
+}
+
+BenchResult bench_churn_pool(AKMRelationship* relationship, long iterations)
+{
+	(void)relationship;
+	return churn(AKMPoolAllocator(), iterations);
+}
+
+// Replica of a relationship created by makeRelationship(), brought up to date with a first full delta
+static AKMRelationship* makeReplica(AKMRelationship* primary)
+{
+	AKMProcessCtx ctx = { 0 };
+	AKMConfiguration config;
+	AKMParameterDataVector pdv;
+	makeConfig(&config, &pdv);
+	if (AKMInit(&ctx, &config) != AKMStSuccess)
+		return NULL;
+	uint8_t delta[1024];
+	size_t size = 0;
+	if (AKMGetDelta(primary, 0, delta, sizeof(delta), &size) != AKMStSuccess || AKMApplyDelta(ctx.relationship, delta, size) != AKMStSuccess)
+	{
+		AKMFree(ctx.relationship);
+		return NULL;
+	}
+	return ctx.relationship;
+}
+
+// Rekeying with a delta taken and applied to the replica after every event, compare with rekey_cycle
+BenchResult bench_replica_rekey_cycle(AKMRelationship* relationship, long iterations)
+{
+	BenchResult result = { 0, 0 };
+	AKMRelationship* replica = makeReplica(relationship);
+	if (!replica)
+		return result;
+	AKMProcessCtx ctx = { 0 };
+	ctx.relationship = relationship;
+	const AKMEvent events[] = { AKMEvRecvSEI, AKMEvRecvSEC, AKMEvRecvSEF, AKMEvRecvSE };
+	uint8_t delta[1024];
+	for (long i = 0; i < iterations; ++i)
+	{
+		for (AKMEvent akmEvent : events)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				feed(&ctx, akmEvent, nodeAddresses + j, &result);
+				size_t size = 0;
+				AKMGetDelta(relationship, 100, delta, sizeof(delta), &size);
+				AKMApplyDelta(replica, delta, size);
+				result.bytes += (long)size;
+			}
+		}
+	}
+	AKMFree(replica);
+	return result;
+}
+
+// Only the AKMApplyDelta calls are timed, the deltas of a rekeying are recorded first
+BenchResult bench_replica_apply(AKMRelationship* relationship, long iterations)
+{
+	BenchResult result = { 0, 0 };
+	AKMRelationship* replica = makeReplica(relationship);
+	if (!replica)
+		return result;
+	AKMProcessCtx ctx = { 0 };
+	ctx.relationship = relationship;
+	const AKMEvent events[] = { AKMEvRecvSEI, AKMEvRecvSEC, AKMEvRecvSEF, AKMEvRecvSE };
+	std::vector<uint8_t> log;
+	std::vector<size_t> sizes;
+	uint8_t delta[1024];
+	BenchResult unused = { 0, 0 };
+	for (AKMEvent akmEvent : events)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			feed(&ctx, akmEvent, nodeAddresses + j, &unused);
+			size_t size = 0;
+			AKMGetDelta(relationship, 100, delta, sizeof(delta), &size);
+			log.insert(log.end(), delta, delta + size);
+			sizes.push_back(size);
+		}
+	}
+	// Replaying the same round keeps the replica cycling through the same states
+	const auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < iterations; ++i)
+	{
+		size_t offset = 0;
+		for (size_t size : sizes)
+		{
+			AKMApplyDelta(replica, log.data() + offset, size);
+			offset += size;
+			result.events++;
+			result.steps++;
+			result.bytes += (long)size;
+		}
+	}
+	result.ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	AKMFree(replica);
+	return result;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#ifndef INC_AES_H_
+#define INC_AES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AES_BLOCK_SIZE 16
+#define AES256_KEY_SIZE (256 / 8)
+#define AES256_ROUNDS 14
+#define AES256_SCHEDULE_WORDS (4 * (AES256_ROUNDS + 1))
+
+struct AES256_Context {
+	uint32_t roundKeys[AES256_SCHEDULE_WORDS];
+};
+
+typedef struct AES256_Context AES256_Ctx;
+
+void AES256_init(AES256_Ctx* c, const uint8_t key[AES256_KEY_SIZE]);
+void AES256_encrypt_block(const AES256_Ctx* c, const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]);
+void AES256_decrypt_block(const AES256_Ctx* c, const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]);
+
+// CBC with PKCS#7 padding, as System.Security.Cryptography does by default. Encryption may be done in place,
+// out gets AES256_cbc_size(len) bytes.
+static inline size_t AES256_cbc_size(size_t len) {
+	return (len / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE;
+}
+
+size_t AES256_cbc_encrypt(const AES256_Ctx* c, const uint8_t iv[AES_BLOCK_SIZE], const uint8_t* in, size_t len, uint8_t* out);
+
+// Returns the plaintext size, or SIZE_MAX if len is not a multiple of the block size or the padding is invalid
+size_t AES256_cbc_decrypt(const AES256_Ctx* c, const uint8_t iv[AES_BLOCK_SIZE], const uint8_t* in, size_t len, uint8_t* out);
+
+#endif /* INC_AES_H_ */
@@ -0,0 +1,845 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "akmd.h"
+#include "akmd_udp.h"
+#include "endianness.h"
+#include "utilities.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define AKMD_EVENTS_NUM 256
+#define AKMD_READ_CHUNK (64 * 1024)
+#define AKMD_MAX_PENDING (64 * 1024 * 1024)
+#define AKMD_NO_DEADLINE INT64_MIN
+// Room for a GRO message of up to 64 KiB in every receive slot
+#define AKMD_UDP_SLOT (64 * 1024)
+// Records handled on a channel between wakeups of the peer
+#define AKMD_SHM_BATCH 64
+
+struct AKMDConnection
+{
+	int fd;
+	// Never reused, so a relationship can name its connection after the connection is gone
+	uint64_t id;
+	struct sockaddr_in peer;
+	// Set on connections of the Unix socket, whose frames go through the channel
+	struct AKMDShmChannel* shm;
+	uint8_t* rbuf;
+	size_t rsize, rcap;
+	uint8_t* wbuf;
+	size_t wpos, wsize, wcap;
+	struct AKMDConnection* next;
+};
+
+struct AKMDaemon
+{
+	struct AKMDNode node;
+	int epollFd, listenFd, timerFd, stopFd, udpFd, shmListenFd;
+	uint16_t port;
+	char* shmPath;
+	size_t shmRingSize;
+	bool echo;
+	size_t udpPayload;
+	struct AKMDDatagramBatch udpIn, udpOut;
+	// Per relationship, the id of the TCP connection its last frame came over, replies too large for a datagram
+	// go there
+	uint64_t* streamOf;
+	uint64_t lastConnectionId;
+	akm_time_t armedDeadline;
+	akm_time_t now;
+	struct AKMDConnection* connections;
+	struct AKMDConnection* closed;
+	uint8_t* plain;
+	size_t plainCap;
+	struct AKMDStats stats;
+};
+
+static akm_time_t monotonicMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (akm_time_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool reserve(uint8_t** buffer, size_t* capacity, size_t size)
+{
+	if (size <= *capacity)
+		return true;
+	size_t newCapacity = *capacity ? *capacity : AKMD_READ_CHUNK;
+	while (newCapacity < size)
+		newCapacity *= 2;
+	uint8_t* newBuffer = (uint8_t*)realloc(*buffer, newCapacity);
+	if (!newBuffer)
+		return false;
+	*buffer = newBuffer;
+	*capacity = newCapacity;
+	return true;
+}
+
+static bool watch(struct AKMDaemon* daemon, int fd, uint32_t events, void* ptr)
+{
+	struct epoll_event ev = { 0 };
+	ev.events = events;
+	ev.data.ptr = ptr;
+	return epoll_ctl(daemon->epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+// Connections are freed after the batch of events they may still appear in
+static void closeConnection(struct AKMDaemon* daemon, struct AKMDConnection* conn)
+{
+	if (conn->fd < 0)
+		return;
+	// The peer still holds the eventfds, they would stay in the epoll set past the connection
+	if (conn->shm)
+	{
+		epoll_ctl(daemon->epollFd, EPOLL_CTL_DEL, conn->shm->in.dataFd, NULL);
+		epoll_ctl(daemon->epollFd, EPOLL_CTL_DEL, conn->shm->out.spaceFd, NULL);
+	}
+	close(conn->fd);
+	conn->fd = -1;
+	for (struct AKMDConnection** p = &daemon->connections; *p; p = &(*p)->next)
+	{
+		if (*p == conn)
+		{
+			*p = conn->next;
+			break;
+		}
+	}
+	conn->next = daemon->closed;
+	daemon->closed = conn;
+}
+
+static void freeConnections(struct AKMDConnection* conn)
+{
+	while (conn)
+	{
+		struct AKMDConnection* next = conn->next;
+		if (conn->fd >= 0)
+			close(conn->fd);
+		if (conn->shm)
+		{
+			AKMDShmClose(conn->shm);
+			free(conn->shm);
+		}
+		free(conn->rbuf);
+		free(conn->wbuf);
+		free(conn);
+		conn = next;
+	}
+}
+
+static void flush(struct AKMDaemon* daemon, struct AKMDConnection* conn)
+{
+	while (conn->wpos < conn->wsize)
+	{
+		const ssize_t n = send(conn->fd, conn->wbuf + conn->wpos, conn->wsize - conn->wpos, MSG_NOSIGNAL);
+		if (n > 0)
+		{
+			conn->wpos += (size_t)n;
+			daemon->stats.bytesOut += (uint64_t)n;
+		}
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		else
+		{
+			closeConnection(daemon, conn);
+			return;
+		}
+	}
+	conn->wpos = conn->wsize = 0;
+}
+
+// Room for size bytes at the end of the pending writes, NULL if the peer is too far behind
+static uint8_t* reserveWrite(struct AKMDConnection* conn, size_t size)
+{
+	if (conn->wsize - conn->wpos + size > AKMD_MAX_PENDING)
+		return NULL;
+	if (conn->wpos > 0 && conn->wcap - conn->wsize < size)
+	{
+		memmove(conn->wbuf, conn->wbuf + conn->wpos, conn->wsize - conn->wpos);
+		conn->wsize -= conn->wpos;
+		conn->wpos = 0;
+	}
+	if (!reserve(&conn->wbuf, &conn->wcap, conn->wsize + size))
+		return NULL;
+	return conn->wbuf + conn->wsize;
+}
+
+static void echo(struct AKMDaemon* daemon, struct AKMDConnection* conn, struct AKMDRelationship* rel, const struct AKMFrameSpan* source, const struct AKMFrameSpan* content)
+{
+	uint8_t* out = reserveWrite(conn, AKMDFrameSealedSize(content->size));
+	if (!out)
+	{
+		daemon->stats.framesDropped++;
+		return;
+	}
+	const size_t sealed = AKMDNodeSeal(&daemon->node, rel, source->data, (enum AKMEvent)rel->sendEvent, content->data, content->size, out);
+	if (sealed == 0)
+	{
+		daemon->stats.framesDropped++;
+		return;
+	}
+	conn->wsize += sealed;
+	daemon->stats.framesOut++;
+}
+
+// The TCP connection of a datagram peer: the one the relationship's frames came over if it is from the peer's
+// host, otherwise one from the peer's very address and port; a host may run many clients, so no other will do
+static struct AKMDConnection* findConnection(struct AKMDaemon* daemon, const struct sockaddr_in* peer, const struct AKMDRelationship* rel)
+{
+	const uint64_t stream = daemon->streamOf[rel - daemon->node.relationships];
+	struct AKMDConnection* samePort = NULL;
+	for (struct AKMDConnection* conn = daemon->connections; conn; conn = conn->next)
+	{
+		if (conn->shm || conn->peer.sin_addr.s_addr != peer->sin_addr.s_addr)
+			continue;
+		if (conn->id == stream)
+			return conn;
+		if (conn->peer.sin_port == peer->sin_port)
+			samePort = conn;
+	}
+	return samePort;
+}
+
+// Sends a sealed frame to a datagram peer over its TCP connection
+static void sendOverStream(struct AKMDaemon* daemon, const struct sockaddr_in* peer, const struct AKMDRelationship* rel, const uint8_t* frame, size_t size)
+{
+	struct AKMDConnection* conn = findConnection(daemon, peer, rel);
+	uint8_t* out = conn ? reserveWrite(conn, size) : NULL;
+	if (!out)
+	{
+		daemon->stats.framesDropped++;
+		return;
+	}
+	memcpy(out, frame, size);
+	conn->wsize += size;
+	daemon->stats.streamFallbacks++;
+	flush(daemon, conn);
+}
+
+// A datagram holds one sealed frame, header included, so a datagram the path refused goes over TCP as it is
+static void datagramRefused(void* context, const struct sockaddr_in* peer, const uint8_t* data, size_t size)
+{
+	struct AKMDaemon* daemon = (struct AKMDaemon*)context;
+	struct AKMDRelationship* rel = AKMDNodeFind(&daemon->node, read_le16(data));
+	if (!rel)
+	{
+		daemon->stats.framesDropped++;
+		return;
+	}
+	sendOverStream(daemon, peer, rel, data, size);
+}
+
+static void sendDatagrams(struct AKMDaemon* daemon)
+{
+	if (daemon->udpOut.num == 0)
+		return;
+	const int sent = AKMDBatchSend(&daemon->udpOut, daemon->udpFd, datagramRefused, daemon);
+	daemon->stats.datagramBatches++;
+	daemon->stats.datagramsOut += (uint64_t)sent;
+}
+
+static void echoDatagram(struct AKMDaemon* daemon, const struct sockaddr_in* peer, struct AKMDRelationship* rel, const struct AKMFrameSpan* source, const struct AKMFrameSpan* content)
+{
+	const size_t size = AKMDFrameSealedSize(content->size);
+	if (size > daemon->udpPayload)
+	{
+		// Fragmented datagrams are lost whole on any lost fragment, the peer's TCP connection carries the reply
+		struct AKMDConnection* conn = findConnection(daemon, peer, rel);
+		if (!conn)
+		{
+			daemon->stats.framesDropped++;
+			return;
+		}
+		echo(daemon, conn, rel, source, content);
+		daemon->stats.streamFallbacks++;
+		flush(daemon, conn);
+		return;
+	}
+	// A slot taken in the batch goes out, so the key is checked before
+	if (!rel->keys[rel->encKeyIdx].present)
+	{
+		daemon->stats.framesDropped++;
+		return;
+	}
+	uint8_t* out = AKMDBatchAdd(&daemon->udpOut, peer, size);
+	if (!out)
+	{
+		sendDatagrams(daemon);
+		out = AKMDBatchAdd(&daemon->udpOut, peer, size);
+		if (!out)
+		{
+			daemon->stats.framesDropped++;
+			return;
+		}
+	}
+	AKMDNodeSeal(&daemon->node, rel, source->data, (enum AKMEvent)rel->sendEvent, content->data, content->size, out);
+	daemon->stats.framesOut++;
+}
+
+static void echoChannel(struct AKMDaemon* daemon, struct AKMDShmChannel* shm, struct AKMDRelationship* rel, const struct AKMFrameSpan* source, const struct AKMFrameSpan* content)
+{
+	const size_t size = AKMDFrameSealedSize(content->size);
+	uint8_t* out = AKMDRingReserve(&shm->out, size);
+	if (!out || AKMDNodeSeal(&daemon->node, rel, source->data, (enum AKMEvent)rel->sendEvent, content->data, content->size, out) == 0)
+	{
+		daemon->stats.framesDropped++;
+		return;
+	}
+	AKMDRingCommit(&shm->out, size);
+	daemon->stats.framesOut++;
+}
+
+// Frames come from conn, or as datagrams from peer
+static bool handleFrame(struct AKMDaemon* daemon, struct AKMDConnection* conn, const struct sockaddr_in* peer, uint16_t relationshipId, const uint8_t* data, size_t dataSize)
+{
+	daemon->stats.framesIn++;
+	struct AKMDRelationship* rel = AKMDNodeFind(&daemon->node, relationshipId);
+	if (!rel)
+	{
+		daemon->stats.unknownRelationship++;
+		return true;
+	}
+	if (conn && !conn->shm && daemon->streamOf)
+		daemon->streamOf[rel - daemon->node.relationships] = conn->id;
+	if (!reserve(&daemon->plain, &daemon->plainCap, dataSize - AES_BLOCK_SIZE + AKMD_ADDRESS_SIZE))
+		return false;
+	struct AKMFrame plain;
+	AKMDNodeReceive(&daemon->node, rel, data, dataSize, daemon->plain, daemon->now, &plain);
+	if (daemon->echo && plain.size > 0)
+	{
+		struct AKMFrameSpan source, content;
+		AKMFrameGetField(&plain, AKMFfSourceAddress, &source);
+		AKMFrameGetField(&plain, AKMFfPayload, &content);
+		if (conn && conn->shm)
+			echoChannel(daemon, conn->shm, rel, &source, &content);
+		else if (conn)
+			echo(daemon, conn, rel, &source, &content);
+		else
+			echoDatagram(daemon, peer, rel, &source, &content);
+	}
+	return true;
+}
+
+// Handles the complete frames in the read buffer, false if the stream is not in the transmission format
+static bool deframe(struct AKMDaemon* daemon, struct AKMDConnection* conn)
+{
+	size_t pos = 0;
+	bool ok = true;
+	while (conn->rsize - pos >= AKMD_HEADER_SIZE)
+	{
+		const uint8_t* header = conn->rbuf + pos;
+		const uint64_t dataSize = read_le64(header + 2);
+		if (dataSize < AKMD_MIN_DATA_SIZE || dataSize > AKMD_MAX_DATA_SIZE || dataSize % AES_BLOCK_SIZE != 0)
+		{
+			daemon->stats.malformed++;
+			ok = false;
+			break;
+		}
+		if (conn->rsize - pos - AKMD_HEADER_SIZE < dataSize)
+			break;
+		if (!handleFrame(daemon, conn, NULL, read_le16(header), header + AKMD_HEADER_SIZE, (size_t)dataSize))
+		{
+			ok = false;
+			break;
+		}
+		pos += AKMD_HEADER_SIZE + (size_t)dataSize;
+	}
+	if (pos > 0)
+	{
+		memmove(conn->rbuf, conn->rbuf + pos, conn->rsize - pos);
+		conn->rsize -= pos;
+	}
+	return ok;
+}
+
+static void readConnection(struct AKMDaemon* daemon, struct AKMDConnection* conn)
+{
+	for (;;)
+	{
+		if (!reserve(&conn->rbuf, &conn->rcap, conn->rsize + AKMD_READ_CHUNK))
+		{
+			closeConnection(daemon, conn);
+			return;
+		}
+		const ssize_t n = recv(conn->fd, conn->rbuf + conn->rsize, conn->rcap - conn->rsize, 0);
+		if (n > 0)
+		{
+			conn->rsize += (size_t)n;
+			daemon->stats.bytesIn += (uint64_t)n;
+			if (!deframe(daemon, conn))
+			{
+				closeConnection(daemon, conn);
+				return;
+			}
+		}
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+		{
+			// The peer may have only shut down its side, it still gets the replies already due
+			if (n == 0)
+				flush(daemon, conn);
+			closeConnection(daemon, conn);
+			return;
+		}
+	}
+	// Replies to everything read in this round go out in one write
+	flush(daemon, conn);
+}
+
+// Each datagram, each segment of a GRO message and each channel record is one whole frame; anything else is
+// dropped alone, false then
+static bool handleRecord(struct AKMDaemon* daemon, struct AKMDConnection* conn, const struct sockaddr_in* peer, const uint8_t* record, size_t size)
+{
+	if (size < AKMD_HEADER_SIZE)
+	{
+		daemon->stats.malformed++;
+		return false;
+	}
+	const uint64_t dataSize = read_le64(record + 2);
+	if (dataSize != size - AKMD_HEADER_SIZE || dataSize < AKMD_MIN_DATA_SIZE || dataSize > AKMD_MAX_DATA_SIZE || dataSize % AES_BLOCK_SIZE != 0)
+	{
+		daemon->stats.malformed++;
+		return false;
+	}
+	handleFrame(daemon, conn, peer, read_le16(record), record + AKMD_HEADER_SIZE, (size_t)dataSize);
+	return true;
+}
+
+static void readDatagrams(struct AKMDaemon* daemon)
+{
+	int n;
+	do
+	{
+		n = AKMDBatchReceive(&daemon->udpIn, daemon->udpFd, false);
+		if (n <= 0)
+			break;
+		daemon->stats.datagramBatches++;
+		for (int i = 0; i < n; ++i)
+		{
+			const uint8_t* data;
+			size_t size, segmentSize;
+			const struct sockaddr_in* peer;
+			AKMDBatchReceived(&daemon->udpIn, (unsigned)i, &data, &size, &segmentSize, &peer);
+			daemon->stats.bytesIn += size;
+			for (size_t pos = 0; pos < size; pos += segmentSize)
+			{
+				if (handleRecord(daemon, NULL, peer, data + pos, size - pos < segmentSize ? size - pos : segmentSize))
+					daemon->stats.datagramsIn++;
+			}
+		}
+	}
+	// Whatever arrives after a short batch raises a new edge
+	while ((unsigned)n == daemon->udpIn.capacity);
+	// Replies to everything read in this round go out in as few sendmmsg calls as the batch allows
+	sendDatagrams(daemon);
+}
+
+static void acceptConnections(struct AKMDaemon* daemon)
+{
+	for (;;)
+	{
+		struct sockaddr_in peer;
+		socklen_t peerLen = sizeof(peer);
+		const int fd = accept4(daemon->listenFd, (struct sockaddr*)&peer, &peerLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return;
+		}
+		const int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		struct AKMDConnection* conn = (struct AKMDConnection*)calloc(1, sizeof(*conn));
+		if (!conn)
+		{
+			close(fd);
+			continue;
+		}
+		conn->fd = fd;
+		conn->id = ++daemon->lastConnectionId;
+		conn->peer = peer;
+		if (!watch(daemon, fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, conn))
+		{
+			close(fd);
+			free(conn);
+			continue;
+		}
+		conn->next = daemon->connections;
+		daemon->connections = conn;
+		daemon->stats.connections++;
+	}
+}
+
+// Drains the records of a channel until its ring is empty or the replies wait for room
+static void serveChannel(struct AKMDaemon* daemon, struct AKMDConnection* conn, uint32_t events)
+{
+	if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+	{
+		closeConnection(daemon, conn);
+		return;
+	}
+	struct AKMDShmChannel* shm = conn->shm;
+	// The rings tell what there is to do, the wakeups are only reset
+	uint64_t count;
+	while (read(shm->in.dataFd, &count, sizeof(count)) > 0)
+		;
+	while (read(shm->out.spaceFd, &count, sizeof(count)) > 0)
+		;
+	unsigned handled = 0;
+	for (;;)
+	{
+		size_t size;
+		const uint8_t* record = AKMDRingPeek(&shm->in, &size);
+		if (!record)
+		{
+			// The client broke the ring, nothing more can be read from it
+			if (shm->in.corrupt)
+			{
+				daemon->stats.malformed++;
+				closeConnection(daemon, conn);
+				return;
+			}
+			if (AKMDRingConsumerSleep(&shm->in))
+				break;
+			continue;
+		}
+		// A reply is the size of the frame it answers, it waits for room instead of being dropped
+		if (daemon->echo && size <= AKMDRingMaxRecord(&shm->out) && !AKMDRingHasRoom(&shm->out, size))
+		{
+			AKMDRingWakeConsumer(&shm->out);
+			if (AKMDRingProducerSleep(&shm->out, size))
+				break;
+			continue;
+		}
+		daemon->stats.bytesIn += size;
+		handleRecord(daemon, conn, NULL, record, size);
+		AKMDRingConsume(&shm->in, size);
+		if (++handled % AKMD_SHM_BATCH == 0)
+		{
+			AKMDRingWakeConsumer(&shm->out);
+			AKMDRingWakeProducer(&shm->in);
+		}
+	}
+	AKMDRingWakeConsumer(&shm->out);
+	AKMDRingWakeProducer(&shm->in);
+}
+
+// Every connection of the Unix socket gets a channel of its own, it lasts until the peer closes the socket
+static void acceptChannels(struct AKMDaemon* daemon)
+{
+	for (;;)
+	{
+		const int fd = accept4(daemon->shmListenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return;
+		}
+		struct AKMDConnection* conn = (struct AKMDConnection*)calloc(1, sizeof(*conn));
+		struct AKMDShmChannel* shm = (struct AKMDShmChannel*)malloc(sizeof(*shm));
+		if (!conn || !shm || AKMDShmCreate(shm, daemon->shmRingSize) != AKMStSuccess)
+		{
+			close(fd);
+			free(conn);
+			free(shm);
+			continue;
+		}
+		conn->fd = fd;
+		conn->shm = shm;
+		if (!watch(daemon, fd, EPOLLRDHUP | EPOLLET, conn))
+		{
+			freeConnections(conn);
+			continue;
+		}
+		if (!watch(daemon, shm->in.dataFd, EPOLLIN | EPOLLET, conn) || !watch(daemon, shm->out.spaceFd, EPOLLIN | EPOLLET, conn)
+				|| !AKMDShmSendFds(fd, shm))
+		{
+			conn->next = daemon->connections;
+			daemon->connections = conn;
+			closeConnection(daemon, conn);
+			continue;
+		}
+		conn->next = daemon->connections;
+		daemon->connections = conn;
+		daemon->stats.channels++;
+	}
+}
+
+// A single timerfd follows the earliest deadline of all relationships
+static void armTimer(struct AKMDaemon* daemon)
+{
+	akm_time_t deadline;
+	if (!AKMDNodeNextDeadline(&daemon->node, &deadline))
+		deadline = AKMD_NO_DEADLINE;
+	if (deadline == daemon->armedDeadline)
+		return;
+	struct itimerspec spec = { 0 };
+	if (deadline != AKMD_NO_DEADLINE)
+	{
+		// A zero expiration would disarm the timer, a deadline already passed fires at once
+		const akm_time_t expiration = deadline > 0 ? deadline : 1;
+		spec.it_value.tv_sec = expiration / 1000;
+		spec.it_value.tv_nsec = (long)(expiration % 1000) * 1000000 + 1;
+	}
+	timerfd_settime(daemon->timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+	daemon->armedDeadline = deadline;
+}
+
+static int listenOn(const struct AKMDConfig* config, uint16_t* port)
+{
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(config->port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (config->address && inet_pton(AF_INET, config->address, &addr.sin_addr) != 1)
+		return -1;
+	const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	const int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	socklen_t len = sizeof(addr);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0
+			|| getsockname(fd, (struct sockaddr*)&addr, &len) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	*port = ntohs(addr.sin_port);
+	return fd;
+}
+
+static int bindDatagram(const struct AKMDConfig* config, uint16_t port)
+{
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (config->address && inet_pton(AF_INET, config->address, &addr.sin_addr) != 1)
+		return -1;
+	const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	// Datagrams past the path MTU fail instead of going out fragmented
+	const int discover = IP_PMTUDISC_DO;
+	setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &discover, sizeof(discover));
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Opens the UDP side on the port TCP got
+static bool openDatagrams(struct AKMDaemon* d, const struct AKMDConfig* config)
+{
+	const uint16_t mtu = config->udpMtu ? config->udpMtu : AKMD_UDP_DEFAULT_MTU;
+	if (mtu <= AKMD_UDP_HEADERS_SIZE + AKMD_HEADER_SIZE + AKMD_MIN_DATA_SIZE)
+		return false;
+	d->udpPayload = mtu - AKMD_UDP_HEADERS_SIZE < AKMD_UDP_MAX_PAYLOAD ? mtu - AKMD_UDP_HEADERS_SIZE : AKMD_UDP_MAX_PAYLOAD;
+	d->streamOf = (uint64_t*)calloc(d->node.relationshipNum, sizeof(*d->streamOf));
+	d->udpFd = bindDatagram(config, d->port);
+	if ((!d->streamOf && d->node.relationshipNum > 0) || d->udpFd < 0 || AKMDBatchInit(&d->udpIn, AKMD_UDP_BATCH, AKMD_UDP_BATCH * AKMD_UDP_SLOT) != AKMStSuccess
+			|| AKMDBatchInit(&d->udpOut, AKMD_UDP_BATCH, AKMD_UDP_BATCH * AKMD_UDP_SLOT) != AKMStSuccess)
+		return false;
+	if (config->udpOffload)
+	{
+		d->udpOut.gso = AKMDUdpEnableGso(d->udpFd);
+		AKMDUdpEnableGro(d->udpFd);
+	}
+	return watch(d, d->udpFd, EPOLLIN | EPOLLET, &d->udpFd);
+}
+
+static int listenChannels(const char* path)
+{
+	struct sockaddr_un addr = { 0 };
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	strcpy(addr.sun_path, path);
+	const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	unlink(path);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Opens the Unix socket peers get their channels on
+static bool openChannels(struct AKMDaemon* d, const struct AKMDConfig* config)
+{
+	d->shmRingSize = config->shmRingSize ? config->shmRingSize : AKMD_SHM_DEFAULT_RING;
+	d->shmListenFd = listenChannels(config->shmPath);
+	if (d->shmListenFd < 0)
+		return false;
+	d->shmPath = strdup(config->shmPath);
+	return d->shmPath && watch(d, d->shmListenFd, EPOLLIN | EPOLLET, &d->shmListenFd);
+}
+
+enum AKMStatus AKMDCreate(struct AKMDaemon** daemon, const struct AKMDConfig* config)
+{
+	*daemon = NULL;
+	struct AKMDaemon* d = (struct AKMDaemon*)calloc(1, sizeof(*d));
+	if (!d)
+		return AKMStNoMemory;
+	d->epollFd = d->listenFd = d->timerFd = d->stopFd = d->udpFd = d->shmListenFd = -1;
+	d->armedDeadline = AKMD_NO_DEADLINE;
+	d->echo = config->echo;
+	enum AKMStatus status = AKMDNodeInit(&d->node, config->akm, config->keys, config->firstRelationshipId, config->relationshipNum, monotonicMs());
+	if (status != AKMStSuccess)
+	{
+		free(d);
+		return status;
+	}
+	d->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	d->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	d->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	d->listenFd = listenOn(config, &d->port);
+	if (d->epollFd < 0 || d->timerFd < 0 || d->stopFd < 0 || d->listenFd < 0
+			|| !watch(d, d->listenFd, EPOLLIN | EPOLLET, &d->listenFd)
+			|| !watch(d, d->timerFd, EPOLLIN | EPOLLET, &d->timerFd)
+			|| !watch(d, d->stopFd, EPOLLIN | EPOLLET, &d->stopFd)
+			|| (config->udp && !openDatagrams(d, config))
+			|| (config->shmPath && !openChannels(d, config)))
+	{
+		AKMDFree(d);
+		return AKMStFatalError;
+	}
+	*daemon = d;
+	return AKMStSuccess;
+}
+
+enum AKMStatus AKMDRun(struct AKMDaemon* daemon)
+{
+	struct epoll_event events[AKMD_EVENTS_NUM];
+	daemon->now = monotonicMs();
+	armTimer(daemon);
+	for (;;)
+	{
+		const int n = epoll_wait(daemon->epollFd, events, AKMD_EVENTS_NUM, -1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return AKMStFatalError;
+		}
+		daemon->now = monotonicMs();
+		bool stop = false;
+		for (int i = 0; i < n; ++i)
+		{
+			void* ptr = events[i].data.ptr;
+			uint64_t count;
+			if (ptr == &daemon->stopFd)
+				stop = true;
+			else if (ptr == &daemon->listenFd)
+				acceptConnections(daemon);
+			else if (ptr == &daemon->udpFd)
+				readDatagrams(daemon);
+			else if (ptr == &daemon->shmListenFd)
+				acceptChannels(daemon);
+			else if (ptr == &daemon->timerFd)
+			{
+				while (read(daemon->timerFd, &count, sizeof(count)) == sizeof(count))
+					;
+				daemon->armedDeadline = AKMD_NO_DEADLINE;
+				AKMDNodeExpire(&daemon->node, daemon->now);
+			}
+			else
+			{
+				struct AKMDConnection* conn = (struct AKMDConnection*)ptr;
+				if (conn->shm)
+				{
+					if (conn->fd >= 0)
+						serveChannel(daemon, conn, events[i].events);
+				}
+				else
+				{
+					if (conn->fd >= 0 && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+						readConnection(daemon, conn);
+					if (conn->fd >= 0 && (events[i].events & EPOLLOUT))
+						flush(daemon, conn);
+				}
+			}
+		}
+		freeConnections(daemon->closed);
+		daemon->closed = NULL;
+		if (stop)
+			return AKMStSuccess;
+		armTimer(daemon);
+	}
+}
+
+void AKMDStop(struct AKMDaemon* daemon)
+{
+	const uint64_t one = 1;
+	ssize_t written = write(daemon->stopFd, &one, sizeof(one));
+	(void)written;
+}
+
+void AKMDFree(struct AKMDaemon* daemon)
+{
+	if (!daemon)
+		return;
+	freeConnections(daemon->connections);
+	freeConnections(daemon->closed);
+	if (daemon->listenFd >= 0)
+		close(daemon->listenFd);
+	if (daemon->timerFd >= 0)
+		close(daemon->timerFd);
+	if (daemon->stopFd >= 0)
+		close(daemon->stopFd);
+	if (daemon->udpFd >= 0)
+		close(daemon->udpFd);
+	if (daemon->shmListenFd >= 0)
+		close(daemon->shmListenFd);
+	if (daemon->shmPath)
+		unlink(daemon->shmPath);
+	free(daemon->shmPath);
+	AKMDBatchFree(&daemon->udpIn);
+	AKMDBatchFree(&daemon->udpOut);
+	free(daemon->streamOf);
+	if (daemon->epollFd >= 0)
+		close(daemon->epollFd);
+	AKMDNodeFree(&daemon->node);
+	free(daemon->plain);
+	free(daemon);
+}
+
+uint16_t AKMDGetPort(const struct AKMDaemon* daemon)
+{
+	return daemon->port;
+}
+
+void AKMDGetStats(const struct AKMDaemon* daemon, struct AKMDStats* stats)
+{
+	*stats = daemon->stats;
+	stats->node = daemon->node.stats;
+}
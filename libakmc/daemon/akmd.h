@@ -0,0 +1,82 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#ifndef INC_AKMD_H_
+#define INC_AKMD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "akmd_node.h"
+#include "akmd_shm.h"
+
+struct AKMDConfig
+{
+	// IPv4 address to listen on, NULL for any; port 0 picks a free port, see AKMDGetPort
+	const char* address;
+	uint16_t port;
+	// Relationships firstRelationshipId .. firstRelationshipId + relationshipNum - 1, all created from akm
+	uint16_t firstRelationshipId;
+	uint32_t relationshipNum;
+	const struct AKMConfiguration* akm;
+	const uint8_t* keys[AKMD_KEYS_NUM];
+	// Answer every frame that decrypts with a frame carrying the same content back to its source
+	bool echo;
+	// Also take one frame per datagram on the UDP port of the same number; replies larger than fit in udpMtu
+	// (0 for AKMD_UDP_DEFAULT_MTU), or than the path lets through, go over the TCP connection the relationship's
+	// frames came over or one from the datagram's address and port, and are dropped without one; udpOffload
+	// enables GSO and GRO
+	bool udp;
+	bool udpOffload;
+	uint16_t udpMtu;
+	// Unix socket, NULL for none, on which co-located peers get a shared-memory channel with rings of shmRingSize
+	// bytes (0 for AKMD_SHM_DEFAULT_RING), see AKMDShmConnect
+	const char* shmPath;
+	uint32_t shmRingSize;
+};
+
+struct AKMDStats
+{
+	uint64_t connections;
+	uint64_t framesIn;
+	uint64_t framesOut;
+	uint64_t framesDropped;
+	uint64_t bytesIn;
+	uint64_t bytesOut;
+	uint64_t unknownRelationship;
+	uint64_t malformed;
+	uint64_t datagramsIn;
+	uint64_t datagramsOut;
+	// recvmmsg and sendmmsg batches
+	uint64_t datagramBatches;
+	// Replies too large for a datagram that went over TCP instead
+	uint64_t streamFallbacks;
+	uint64_t channels;
+	struct AKMDNodeStats node;
+};
+
+struct AKMDaemon;
+
+enum AKMStatus AKMDCreate(struct AKMDaemon** daemon, const struct AKMDConfig* config);
+
+// Runs the reactor on the calling thread until AKMDStop
+enum AKMStatus AKMDRun(struct AKMDaemon* daemon);
+
+// Callable from any thread and from signal handlers
+void AKMDStop(struct AKMDaemon* daemon);
+
+void AKMDFree(struct AKMDaemon* daemon);
+
+uint16_t AKMDGetPort(const struct AKMDaemon* daemon);
+
+// Consistent only on the reactor thread or after AKMDRun returned
+void AKMDGetStats(const struct AKMDaemon* daemon, struct AKMDStats* stats);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INC_AKMD_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#include "akmd_frame.h"
+#include "endianness.h"
+#include "utilities.h"
+#include <string.h>
+
+void AKMDFramePlainLayout(struct AKMFrameLayout* layout)
+{
+	struct AKMFrameSchema schema = { 0 };
+	schema.relationshipIdLength = 2;
+	schema.sourceAddressIndex = 2;
+	schema.sourceAddressLength = AKMD_ADDRESS_SIZE;
+	schema.targetAddressIndex = 4;
+	schema.targetAddressLength = AKMD_ADDRESS_SIZE;
+	schema.akmEventIndex = 6;
+	schema.akmEventLength = 1;
+	schema.dataStartIndex = AKMD_PLAIN_HEADER_SIZE;
+	schema.tagLength = SHA256_DIGEST_SIZE;
+	AKMFrameLayoutCompile(layout, &schema);
+}
+
+size_t AKMDFrameSeal(struct AKMFrame* plain, const AES256_Ctx* key, const uint8_t iv[AES_BLOCK_SIZE], uint8_t* out)
+{
+	const uint16_t relationshipId = read_le16(plain->buffer);
+	struct AKMFrameSpan tag;
+	AKMFrameGetField(plain, AKMFfTag, &tag);
+	SHA256_calc(plain->buffer, plain->size - tag.size, tag.data);
+
+	uint8_t* data = out + AKMD_HEADER_SIZE;
+	const size_t dataSize = AES_BLOCK_SIZE + AES256_cbc_encrypt(key, iv, plain->buffer + AKMD_ADDRESS_SIZE, plain->size - AKMD_ADDRESS_SIZE, data + AES_BLOCK_SIZE);
+	memcpy(data, iv, AES_BLOCK_SIZE);
+	write_le16(out, relationshipId);
+	write_le64(out + 2, dataSize);
+	return AKMD_HEADER_SIZE + dataSize;
+}
+
+enum AKMStatus AKMDFrameOpen(struct AKMFrame* plain, const struct AKMFrameLayout* layout, const AES256_Ctx* key, uint16_t relationshipId, const uint8_t* data, size_t dataSize, uint8_t* buffer)
+{
+	if (unlikely(dataSize < AKMD_MIN_DATA_SIZE))
+		return AKMStFatalError;
+	const size_t size = AES256_cbc_decrypt(key, data, data + AES_BLOCK_SIZE, dataSize - AES_BLOCK_SIZE, buffer + AKMD_ADDRESS_SIZE);
+	if (size == SIZE_MAX)
+		return AKMStFatalError;
+	write_le16(buffer, relationshipId);
+	if (AKMFrameParse(plain, layout, buffer, AKMD_ADDRESS_SIZE + size) != AKMStSuccess)
+		return AKMStFatalError;
+	struct AKMFrameSpan tag;
+	AKMFrameGetField(plain, AKMFfTag, &tag);
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	SHA256_calc(plain->buffer, plain->size - tag.size, digest);
+	return memcmp(digest, tag.data, SHA256_DIGEST_SIZE) == 0 ? AKMStSuccess : AKMStFatalError;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#ifndef INC_AKMD_FRAME_H_
+#define INC_AKMD_FRAME_H_
+
+#include "akm.h"
+#include "aes.h"
+#include "sha256.h"
+
+// Transmission format of AKMLib.NET: Relationship Id (2) | Data Size (8) | Data, where Data is
+// IV (16) | AES-256-CBC of Source (2) | Target (2) | Event (1) | Content | SHA-256 of everything before it
+// with the Relationship Id prepended. Plain frames are kept in that hashed form, Relationship Id first,
+// so the frame layout engine describes them and the hash covers one contiguous span.
+#define AKMD_HEADER_SIZE 10
+#define AKMD_ADDRESS_SIZE 2
+#define AKMD_PLAIN_HEADER_SIZE 7
+#define AKMD_MIN_DATA_SIZE (2 * AES_BLOCK_SIZE)
+#define AKMD_MAX_DATA_SIZE (16 * 1024 * 1024)
+
+void AKMDFramePlainLayout(struct AKMFrameLayout* layout);
+
+// Size of a plain frame and of the transmission data of a frame with contentSize bytes of content
+static inline size_t AKMDFramePlainSize(size_t contentSize)
+{
+	return AKMD_PLAIN_HEADER_SIZE + contentSize + SHA256_DIGEST_SIZE;
+}
+
+static inline size_t AKMDFrameSealedSize(size_t contentSize)
+{
+	return AKMD_HEADER_SIZE + AES_BLOCK_SIZE + AES256_cbc_size(AKMDFramePlainSize(contentSize) - AKMD_ADDRESS_SIZE);
+}
+
+// Hashes the plain frame and writes its transmission data, AKMDFrameSealedSize bytes, to out; the plain frame
+// may lie at out + AKMD_HEADER_SIZE + AES_BLOCK_SIZE - AKMD_ADDRESS_SIZE to be sealed in place
+size_t AKMDFrameSeal(struct AKMFrame* plain, const AES256_Ctx* key, const uint8_t iv[AES_BLOCK_SIZE], uint8_t* out);
+
+// Decrypts Data of a received frame into buffer, which takes dataSize - AES_BLOCK_SIZE + AKMD_ADDRESS_SIZE
+// bytes, and checks its hash; AKMStFatalError if the frame does not decrypt with the key
+enum AKMStatus AKMDFrameOpen(struct AKMFrame* plain, const struct AKMFrameLayout* layout, const AES256_Ctx* key, uint16_t relationshipId, const uint8_t* data, size_t dataSize, uint8_t* buffer);
+
+#endif /* INC_AKMD_FRAME_H_ */
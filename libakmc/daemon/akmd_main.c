@@ -0,0 +1,173 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#include "akmd.h"
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define AKMD_MAX_NODES 256
+
+// Defaults of AKMLib.NET (AkmSetup), so akmd talks to an unconfigured AKMWorkerService
+static const char* const defaultKeys[AKMD_KEYS_NUM] = {
+	"6v9y$B&E)H+MbQeThWmZq4t7w!z%C*F-",
+	"z$C&F)H@McQfTjWnZr4u7x!A%D*G-KaN",
+	"6v9y$B&E)H+MbQeMhWmZq4t7w!z%C*Fo",
+	"z$C&F)H@McQfTjWaZr4u7x!A%D*G-Kat",
+};
+
+static struct AKMDaemon* runningDaemon;
+
+static void onSignal(int signum)
+{
+	(void)signum;
+	if (runningDaemon)
+		AKMDStop(runningDaemon);
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr,
+		"Usage: %s [-a address] [-p port] [-i first id] [-n relationships] [-s self] [-r ring] [-e] [-u] [-m mtu] [-o] [-c path]\n"
+		"  -a  IPv4 address to listen on (any)\n"
+		"  -p  TCP port (5000)\n"
+		"  -i  first Relationship Id (1)\n"
+		"  -n  number of relationships (1)\n"
+		"  -s  self node address (5)\n"
+		"  -r  comma separated node addresses of the ring (1,5)\n"
+		"  -e  echo the content of received frames back to their source\n"
+		"  -u  also take frames as UDP datagrams on the same port\n"
+		"  -m  path MTU of UDP replies, larger ones go over TCP (1500)\n"
+		"  -o  use UDP segmentation and receive offloads\n"
+		"  -c  Unix socket giving co-located peers shared-memory channels\n",
+		name);
+}
+
+static int parseNodes(const char* list, uint16_t* nodes)
+{
+	int num = 0;
+	char* end;
+	for (const char* p = list; *p && num < AKMD_MAX_NODES; p = *end ? end + 1 : end)
+	{
+		const unsigned long value = strtoul(p, &end, 0);
+		if (end == p || value > UINT16_MAX || (*end && *end != ','))
+			return -1;
+		nodes[num++] = (uint16_t)value;
+	}
+	return num;
+}
+
+int main(int argc, char** argv)
+{
+	uint16_t nodes[AKMD_MAX_NODES] = { 1, 5 };
+	int nodeNum = 2;
+	uint16_t self = 5;
+	struct AKMDConfig config = { 0 };
+	config.port = 5000;
+	config.firstRelationshipId = 1;
+	config.relationshipNum = 1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "a:p:i:n:s:r:eum:oc:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'a':
+			config.address = optarg;
+			break;
+		case 'p':
+			config.port = (uint16_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			config.firstRelationshipId = (uint16_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			config.relationshipNum = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			self = (uint16_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			nodeNum = parseNodes(optarg, nodes);
+			if (nodeNum < 1)
+			{
+				usage(argv[0]);
+				return 2;
+			}
+			break;
+		case 'e':
+			config.echo = true;
+			break;
+		case 'u':
+			config.udp = true;
+			break;
+		case 'm':
+			config.udpMtu = (uint16_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			config.udpOffload = true;
+			break;
+		case 'c':
+			config.shmPath = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	struct AKMParameterDataVector pdv;
+	for (int i = 0; i < AKM_PARAMETER_DATA_VECTOR_SIZE; ++i)
+		pdv.data[i] = (uint8_t)i;
+	struct AKMConfiguration akm = { 0 };
+	akm.params.SK = AES256_KEY_SIZE;
+	akm.params.SRNA = sizeof(self);
+	akm.params.N = (uint16_t)nodeNum;
+	akm.params.NNRT = 1000000000;
+	akm.params.NSET = 1000000000;
+	akm.params.FBSET = 1000000000;
+	akm.params.FSSET = 1000000000;
+	akm.pdv = &pdv;
+	akm.nodeAddresses = nodes;
+	akm.selfNodeAddress = &self;
+	config.akm = &akm;
+	for (int i = 0; i < AKMD_KEYS_NUM; ++i)
+		config.keys[i] = (const uint8_t*)defaultKeys[i];
+
+	struct AKMDaemon* daemon;
+	const enum AKMStatus status = AKMDCreate(&daemon, &config);
+	if (status != AKMStSuccess)
+	{
+		fprintf(stderr, "akmd: cannot start (status %d)\n", (int)status);
+		return 1;
+	}
+	runningDaemon = daemon;
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	fprintf(stderr, "akmd: %" PRIu32 " relationships from #%u on port %u%s\n",
+		config.relationshipNum, (unsigned)config.firstRelationshipId, (unsigned)AKMDGetPort(daemon), config.udp ? " (TCP and UDP)" : "");
+
+	const enum AKMStatus result = AKMDRun(daemon);
+	runningDaemon = NULL;
+	struct AKMDStats stats;
+	AKMDGetStats(daemon, &stats);
+	fprintf(stderr, "akmd: %" PRIu64 " connections, %" PRIu64 " frames in, %" PRIu64 " frames out, %" PRIu64 " dropped, "
+		"%" PRIu64 " undecryptable, %" PRIu64 " unknown relationship, %" PRIu64 " malformed\n",
+		stats.connections, stats.framesIn, stats.framesOut, stats.framesDropped,
+		stats.node.cannotDecrypt, stats.unknownRelationship, stats.malformed);
+	if (config.udp)
+		fprintf(stderr, "akmd: %" PRIu64 " datagrams in, %" PRIu64 " datagrams out in %" PRIu64 " batches, %" PRIu64 " replies over TCP\n",
+			stats.datagramsIn, stats.datagramsOut, stats.datagramBatches, stats.streamFallbacks);
+	if (config.shmPath)
+		fprintf(stderr, "akmd: %" PRIu64 " shared-memory channels\n", stats.channels);
+	AKMDFree(daemon);
+	return result == AKMStSuccess ? 0 : 1;
+}
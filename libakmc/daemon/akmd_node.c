@@ -0,0 +1,280 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#include "akmd_node.h"
+#include "endianness.h"
+#include "utilities.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+static inline bool timerBefore(const struct AKMDNode* node, uint32_t a, uint32_t b)
+{
+	return node->relationships[a].deadline < node->relationships[b].deadline;
+}
+
+static inline void timerPlace(struct AKMDNode* node, uint32_t pos, uint32_t index)
+{
+	node->timers[pos] = index;
+	node->relationships[index].timerIndex = pos;
+}
+
+static void timerSiftUp(struct AKMDNode* node, uint32_t pos)
+{
+	const uint32_t index = node->timers[pos];
+	while (pos > 0)
+	{
+		const uint32_t parent = (pos - 1) / 2;
+		if (!timerBefore(node, index, node->timers[parent]))
+			break;
+		timerPlace(node, pos, node->timers[parent]);
+		pos = parent;
+	}
+	timerPlace(node, pos, index);
+}
+
+static void timerSiftDown(struct AKMDNode* node, uint32_t pos)
+{
+	const uint32_t index = node->timers[pos];
+	for (;;)
+	{
+		uint32_t child = 2 * pos + 1;
+		if (child >= node->timerNum)
+			break;
+		if (child + 1 < node->timerNum && timerBefore(node, node->timers[child + 1], node->timers[child]))
+			++child;
+		if (!timerBefore(node, node->timers[child], index))
+			break;
+		timerPlace(node, pos, node->timers[child]);
+		pos = child;
+	}
+	timerPlace(node, pos, index);
+}
+
+static void resetTimer(struct AKMDNode* node, struct AKMDRelationship* rel)
+{
+	const uint32_t pos = rel->timerIndex;
+	if (pos == AKMD_NO_TIMER)
+		return;
+	rel->timerIndex = AKMD_NO_TIMER;
+	const uint32_t last = node->timers[--node->timerNum];
+	if (pos == node->timerNum)
+		return;
+	timerPlace(node, pos, last);
+	timerSiftDown(node, pos);
+	timerSiftUp(node, node->relationships[last].timerIndex);
+}
+
+static void setTimer(struct AKMDNode* node, struct AKMDRelationship* rel, akm_time_t deadline)
+{
+	resetTimer(node, rel);
+	rel->deadline = deadline;
+	node->timers[node->timerNum] = (uint32_t)(rel - node->relationships);
+	timerSiftUp(node, node->timerNum++);
+}
+
+static bool openFrame(struct AKMDNode* node, struct AKMDRelationship* rel, int keyIdx, const uint8_t* data, size_t dataSize, uint8_t* buffer, struct AKMFrame* plain)
+{
+	plain->size = 0;
+	if ((unsigned)keyIdx >= AKMD_KEYS_NUM || !rel->keys[keyIdx].present || !data)
+		return false;
+	if (AKMDFrameOpen(plain, &node->plainLayout, &rel->keys[keyIdx].aes, rel->id, data, dataSize, buffer) != AKMStSuccess)
+	{
+		plain->size = 0;
+		return false;
+	}
+	return true;
+}
+
+static inline void setFrameEvent(struct AKMProcessCtx* ctx, const struct AKMFrame* plain)
+{
+	if (plain->size > 0)
+	{
+		struct AKMFrameSpan span;
+		AKMFrameGetField(plain, AKMFfSourceAddress, &span);
+		ctx->akmEvent = AKMFrameGetEvent(plain);
+		ctx->srcAddr = span.data;
+	}
+	else
+	{
+		ctx->akmEvent = AKMEvCannotDecrypt;
+		ctx->srcAddr = NULL;
+	}
+}
+
+// Runs the relationship until it returns, carrying out the commands it yields the way AkmRelationship does
+static enum AKMStatus process(struct AKMDNode* node, struct AKMDRelationship* rel, struct AKMProcessCtx* ctx, const uint8_t* data, size_t dataSize, uint8_t* buffer, struct AKMFrame* plain)
+{
+	node->stats.processed++;
+	for (;;)
+	{
+		AKMProcess(ctx);
+		switch (ctx->cmd.opcode)
+		{
+		case AKMCmdOpReturn:
+			return (enum AKMStatus)ctx->cmd.p1;
+		case AKMCmdOpSetSendEvent:
+			rel->sendEvent = (int8_t)(ctx->cmd.p1 ? ctx->cmd.p2 : AKMEvNone);
+			break;
+		case AKMCmdOpSetKey:
+			AES256_init(&rel->keys[ctx->cmd.p1].aes, (const uint8_t*)ctx->cmd.data);
+			rel->keys[ctx->cmd.p1].present = true;
+			node->stats.keysSet++;
+			break;
+		case AKMCmdOpResetKey:
+			rel->keys[ctx->cmd.p1].present = false;
+			break;
+		case AKMCmdOpMoveKey:
+			rel->keys[ctx->cmd.p1] = rel->keys[ctx->cmd.p2];
+			rel->keys[ctx->cmd.p2].present = false;
+			break;
+		case AKMCmdOpUseKeys:
+			rel->encKeyIdx = (uint8_t)ctx->cmd.p1;
+			rel->decKeyIdx = (uint8_t)ctx->cmd.p2;
+			break;
+		case AKMCmdOpRetryDec:
+			node->stats.retries++;
+			openFrame(node, rel, ctx->cmd.p1, data, dataSize, buffer, plain);
+			setFrameEvent(ctx, plain);
+			break;
+		case AKMCmdOpSetTimer:
+			setTimer(node, rel, *(const akm_time_t*)ctx->cmd.data);
+			break;
+		case AKMCmdOpResetTimer:
+			resetTimer(node, rel);
+			break;
+		}
+	}
+}
+
+enum AKMStatus AKMDNodeInit(struct AKMDNode* node, const struct AKMConfiguration* config, const uint8_t* const keys[AKMD_KEYS_NUM], uint16_t firstId, uint32_t relationshipNum, akm_time_t time_ms)
+{
+	memset(node, 0, sizeof(*node));
+	if (config->params.SK != AES256_KEY_SIZE || config->params.SRNA > AKMD_ADDRESS_SIZE
+			|| !config->selfNodeAddress || relationshipNum > UINT16_MAX + 1u)
+		return AKMStFatalError;
+	uint8_t ivKey[AES256_KEY_SIZE];
+	if (getrandom(ivKey, sizeof(ivKey), 0) != (ssize_t)sizeof(ivKey))
+		return AKMStFatalError;
+	AES256_init(&node->ivKey, ivKey);
+	AKMDFramePlainLayout(&node->plainLayout);
+	memcpy(node->selfAddress, config->selfNodeAddress, config->params.SRNA);
+	node->firstId = firstId;
+
+	enum AKMStatus status = AKMTemplateCreate(&node->tmpl, config);
+	if (status != AKMStSuccess)
+		return status;
+	node->relationships = (struct AKMDRelationship*)calloc(relationshipNum, sizeof(*node->relationships));
+	node->timers = (uint32_t*)calloc(relationshipNum, sizeof(*node->timers));
+	if (!node->relationships || !node->timers)
+	{
+		AKMDNodeFree(node);
+		return AKMStNoMemory;
+	}
+	for (uint32_t i = 0; i < relationshipNum; ++i)
+	{
+		struct AKMDRelationship* rel = node->relationships + i;
+		rel->id = (uint16_t)(firstId + i);
+		rel->timerIndex = AKMD_NO_TIMER;
+		rel->sendEvent = AKMEvNone;
+		for (int k = 0; k < AKMD_KEYS_NUM; ++k)
+		{
+			rel->keys[k].present = keys[k] != NULL;
+			if (keys[k])
+				AES256_init(&rel->keys[k].aes, keys[k]);
+		}
+		struct AKMProcessCtx ctx = { 0 };
+		ctx.time_ms = time_ms;
+		status = AKMInitFromTemplate(&ctx, node->tmpl, NULL);
+		rel->relationship = ctx.relationship;
+		node->relationshipNum = i + 1;
+		if (status == AKMStSuccess)
+			status = process(node, rel, &ctx, NULL, 0, NULL, NULL);
+		if (status != AKMStSuccess)
+		{
+			AKMDNodeFree(node);
+			return status;
+		}
+	}
+	node->stats.processed = 0;
+	return AKMStSuccess;
+}
+
+void AKMDNodeFree(struct AKMDNode* node)
+{
+	for (uint32_t i = 0; i < node->relationshipNum; ++i)
+		AKMFree(node->relationships[i].relationship);
+	free(node->relationships);
+	free(node->timers);
+	if (node->tmpl)
+		AKMTemplateRelease(node->tmpl);
+	memset(node, 0, sizeof(*node));
+}
+
+enum AKMStatus AKMDNodeReceive(struct AKMDNode* node, struct AKMDRelationship* rel, const uint8_t* data, size_t dataSize, uint8_t* buffer, akm_time_t time_ms, struct AKMFrame* plain)
+{
+	struct AKMProcessCtx ctx = { 0 };
+	ctx.relationship = rel->relationship;
+	ctx.time_ms = time_ms;
+	openFrame(node, rel, rel->decKeyIdx, data, dataSize, buffer, plain);
+	setFrameEvent(&ctx, plain);
+	const enum AKMStatus status = process(node, rel, &ctx, data, dataSize, buffer, plain);
+	if (plain->size == 0)
+		node->stats.cannotDecrypt++;
+	return status;
+}
+
+enum AKMStatus AKMDNodeLocalSEI(struct AKMDNode* node, struct AKMDRelationship* rel, akm_time_t time_ms)
+{
+	struct AKMProcessCtx ctx = { 0 };
+	ctx.relationship = rel->relationship;
+	ctx.akmEvent = AKMEvLocalSEI;
+	ctx.time_ms = time_ms;
+	return process(node, rel, &ctx, NULL, 0, NULL, NULL);
+}
+
+uint32_t AKMDNodeExpire(struct AKMDNode* node, akm_time_t time_ms)
+{
+	uint32_t expired = 0;
+	while (node->timerNum > 0)
+	{
+		struct AKMDRelationship* rel = node->relationships + node->timers[0];
+		if (rel->deadline > time_ms)
+			break;
+		resetTimer(node, rel);
+		struct AKMProcessCtx ctx = { 0 };
+		ctx.relationship = rel->relationship;
+		ctx.akmEvent = AKMEvTimeOut;
+		ctx.time_ms = time_ms;
+		process(node, rel, &ctx, NULL, 0, NULL, NULL);
+		node->stats.timeouts++;
+		++expired;
+	}
+	return expired;
+}
+
+size_t AKMDNodeSeal(struct AKMDNode* node, struct AKMDRelationship* rel, const void* targetAddress, enum AKMEvent akmEvent, const void* content, size_t contentSize, uint8_t* out)
+{
+	const struct AKMDKeySlot* key = rel->keys + rel->encKeyIdx;
+	if (!key->present)
+		return 0;
+	// The plain frame is built where its ciphertext goes, so it is sealed in place
+	uint8_t* buffer = out + AKMD_HEADER_SIZE + AES_BLOCK_SIZE - AKMD_ADDRESS_SIZE;
+	struct AKMFrame plain;
+	AKMFrameBuild(&plain, &node->plainLayout, buffer, AKMDFramePlainSize(contentSize), contentSize);
+	AKMFrameSetUInt(&plain, AKMFfRelationshipId, rel->id);
+	AKMFrameSetField(&plain, AKMFfSourceAddress, node->selfAddress, AKMD_ADDRESS_SIZE);
+	AKMFrameSetField(&plain, AKMFfTargetAddress, targetAddress, AKMD_ADDRESS_SIZE);
+	AKMFrameSetEvent(&plain, akmEvent);
+	struct AKMFrameSpan payload;
+	AKMFrameGetField(&plain, AKMFfPayload, &payload);
+	if (contentSize > 0)
+		memmove(payload.data, content, contentSize);
+
+	uint8_t iv[AES_BLOCK_SIZE] = { 0 };
+	write_le64(iv, ++node->ivCounter);
+	AES256_encrypt_block(&node->ivKey, iv, iv);
+	return AKMDFrameSeal(&plain, &key->aes, iv, out);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#ifndef INC_AKMD_NODE_H_
+#define INC_AKMD_NODE_H_
+
+#include "akmd_frame.h"
+#include <stdbool.h>
+
+#define AKMD_KEYS_NUM 4
+#define AKMD_NO_TIMER UINT32_MAX
+
+struct AKMDKeySlot
+{
+	bool present;
+	AES256_Ctx aes;
+};
+
+// Host side of a relationship: what AKMLib.NET keeps in AkmRelationship, with the keys expanded once when set
+struct AKMDRelationship
+{
+	struct AKMRelationship* relationship;
+	akm_time_t deadline;
+	uint32_t timerIndex;
+	uint16_t id;
+	int8_t sendEvent;
+	uint8_t encKeyIdx, decKeyIdx;
+	struct AKMDKeySlot keys[AKMD_KEYS_NUM];
+};
+
+struct AKMDNodeStats
+{
+	uint64_t processed;
+	uint64_t cannotDecrypt;
+	uint64_t retries;
+	uint64_t keysSet;
+	uint64_t timeouts;
+};
+
+// Relationships with consecutive ids created from one template, with their timers in a min-heap so a single
+// timer of the host serves all of them
+struct AKMDNode
+{
+	struct AKMTemplate* tmpl;
+	struct AKMFrameLayout plainLayout;
+	struct AKMDRelationship* relationships;
+	uint32_t* timers;
+	uint32_t timerNum;
+	uint32_t relationshipNum;
+	uint16_t firstId;
+	uint8_t selfAddress[AKMD_ADDRESS_SIZE];
+	AES256_Ctx ivKey;
+	uint64_t ivCounter;
+	struct AKMDNodeStats stats;
+};
+
+// SK must be AES256_KEY_SIZE and SRNA at most AKMD_ADDRESS_SIZE; keys are the initial keys (SK bytes each,
+// NULL for an empty slot) every relationship starts with
+enum AKMStatus AKMDNodeInit(struct AKMDNode* node, const struct AKMConfiguration* config, const uint8_t* const keys[AKMD_KEYS_NUM], uint16_t firstId, uint32_t relationshipNum, akm_time_t time_ms);
+
+void AKMDNodeFree(struct AKMDNode* node);
+
+static inline struct AKMDRelationship* AKMDNodeFind(struct AKMDNode* node, uint16_t id)
+{
+	const uint16_t index = (uint16_t)(id - node->firstId);
+	return index < node->relationshipNum ? node->relationships + index : NULL;
+}
+
+// Decrypts Data of a received frame into buffer (see AKMDFrameOpen) and processes its event; plain gets size 0
+// if the frame did not decrypt with any key the relationship tried
+enum AKMStatus AKMDNodeReceive(struct AKMDNode* node, struct AKMDRelationship* rel, const uint8_t* data, size_t dataSize, uint8_t* buffer, akm_time_t time_ms, struct AKMFrame* plain);
+
+enum AKMStatus AKMDNodeLocalSEI(struct AKMDNode* node, struct AKMDRelationship* rel, akm_time_t time_ms);
+
+// Processes the timeouts of all relationships whose timer expired by time_ms, returns their number
+uint32_t AKMDNodeExpire(struct AKMDNode* node, akm_time_t time_ms);
+
+static inline bool AKMDNodeNextDeadline(const struct AKMDNode* node, akm_time_t* deadline)
+{
+	if (node->timerNum == 0)
+		return false;
+	*deadline = node->relationships[node->timers[0]].deadline;
+	return true;
+}
+
+// Writes the transmission data of a frame, AKMDFrameSealedSize(contentSize) bytes, to out using the current
+// encryption key; returns 0 if the relationship has no such key
+size_t AKMDNodeSeal(struct AKMDNode* node, struct AKMDRelationship* rel, const void* targetAddress, enum AKMEvent akmEvent, const void* content, size_t contentSize, uint8_t* out);
+
+#endif /* INC_AKMD_NODE_H_ */
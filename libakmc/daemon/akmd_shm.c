@@ -0,0 +1,389 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "akmd_shm.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define AKMD_CACHE_LINE 64
+// Both ring headers share the first page, the rings follow it
+#define AKMD_SHM_HEADERS_SIZE 4096
+// Record size marking the rest of the ring unused, the next record starts at its beginning
+#define AKMD_RECORD_WRAP UINT32_MAX
+
+// Each position and flag on its own cache line, so the two processes do not share lines they write
+struct AKMDRingHeader
+{
+	_Alignas(AKMD_CACHE_LINE) _Atomic uint64_t head;
+	_Alignas(AKMD_CACHE_LINE) _Atomic uint64_t tail;
+	_Alignas(AKMD_CACHE_LINE) _Atomic uint32_t consumerWaiting;
+	_Alignas(AKMD_CACHE_LINE) _Atomic uint32_t producerWaiting;
+	_Alignas(AKMD_CACHE_LINE) uint64_t size;
+};
+
+enum
+{
+	AKMD_SHM_MEMFD,
+	AKMD_SHM_TO_DAEMON_DATA,
+	AKMD_SHM_TO_DAEMON_SPACE,
+	AKMD_SHM_TO_CLIENT_DATA,
+	AKMD_SHM_TO_CLIENT_SPACE,
+};
+
+static inline uint64_t recordSize(size_t size)
+{
+	return (AKMD_RECORD_PREFIX + (uint64_t)size + 7) & ~(uint64_t)7;
+}
+
+static void initRing(struct AKMDRing* ring, struct AKMDRingHeader* header, uint8_t* data, int dataFd, int spaceFd, bool producer)
+{
+	ring->header = header;
+	ring->data = data;
+	ring->size = header->size;
+	ring->own = atomic_load_explicit(producer ? &header->head : &header->tail, memory_order_acquire);
+	ring->other = atomic_load_explicit(producer ? &header->tail : &header->head, memory_order_acquire);
+	ring->dataFd = dataFd;
+	ring->spaceFd = spaceFd;
+}
+
+static void initRings(struct AKMDShmChannel* channel, bool daemon)
+{
+	struct AKMDRingHeader* toDaemon = (struct AKMDRingHeader*)channel->base;
+	struct AKMDRingHeader* toClient = toDaemon + 1;
+	uint8_t* toDaemonData = (uint8_t*)channel->base + AKMD_SHM_HEADERS_SIZE;
+	uint8_t* toClientData = toDaemonData + toDaemon->size;
+	const int* fds = channel->fds;
+	if (daemon)
+	{
+		initRing(&channel->in, toDaemon, toDaemonData, fds[AKMD_SHM_TO_DAEMON_DATA], fds[AKMD_SHM_TO_DAEMON_SPACE], false);
+		initRing(&channel->out, toClient, toClientData, fds[AKMD_SHM_TO_CLIENT_DATA], fds[AKMD_SHM_TO_CLIENT_SPACE], true);
+	}
+	else
+	{
+		initRing(&channel->in, toClient, toClientData, fds[AKMD_SHM_TO_CLIENT_DATA], fds[AKMD_SHM_TO_CLIENT_SPACE], false);
+		initRing(&channel->out, toDaemon, toDaemonData, fds[AKMD_SHM_TO_DAEMON_DATA], fds[AKMD_SHM_TO_DAEMON_SPACE], true);
+	}
+}
+
+enum AKMStatus AKMDShmCreate(struct AKMDShmChannel* channel, size_t ringSize)
+{
+	memset(channel, 0, sizeof(*channel));
+	for (int i = 0; i < AKMD_SHM_FDS; ++i)
+		channel->fds[i] = -1;
+	if (ringSize < AKMD_SHM_HEADERS_SIZE || (ringSize & (ringSize - 1)) != 0)
+		return AKMStFatalError;
+	channel->mapSize = AKMD_SHM_HEADERS_SIZE + 2 * ringSize;
+	channel->fds[AKMD_SHM_MEMFD] = memfd_create("akmd-channel", MFD_CLOEXEC);
+	for (int i = AKMD_SHM_MEMFD + 1; i < AKMD_SHM_FDS; ++i)
+		channel->fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	for (int i = 0; i < AKMD_SHM_FDS; ++i)
+	{
+		if (channel->fds[i] < 0)
+		{
+			AKMDShmClose(channel);
+			return AKMStFatalError;
+		}
+	}
+	if (ftruncate(channel->fds[AKMD_SHM_MEMFD], (off_t)channel->mapSize) != 0
+			|| (channel->base = mmap(NULL, channel->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, channel->fds[AKMD_SHM_MEMFD], 0)) == MAP_FAILED)
+	{
+		channel->base = NULL;
+		AKMDShmClose(channel);
+		return AKMStNoMemory;
+	}
+	// A new memfd reads as zeros, the positions and flags start that way
+	struct AKMDRingHeader* headers = (struct AKMDRingHeader*)channel->base;
+	headers[0].size = headers[1].size = ringSize;
+	initRings(channel, true);
+	// The daemon waits for the first record like for any later one
+	AKMDRingConsumerSleep(&channel->in);
+	return AKMStSuccess;
+}
+
+enum AKMStatus AKMDShmAttach(struct AKMDShmChannel* channel, const int fds[AKMD_SHM_FDS])
+{
+	memset(channel, 0, sizeof(*channel));
+	memcpy(channel->fds, fds, sizeof(channel->fds));
+	struct stat st;
+	if (fstat(fds[AKMD_SHM_MEMFD], &st) != 0 || st.st_size <= AKMD_SHM_HEADERS_SIZE)
+	{
+		AKMDShmClose(channel);
+		return AKMStFatalError;
+	}
+	channel->mapSize = (size_t)st.st_size;
+	channel->base = mmap(NULL, channel->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fds[AKMD_SHM_MEMFD], 0);
+	if (channel->base == MAP_FAILED)
+	{
+		channel->base = NULL;
+		AKMDShmClose(channel);
+		return AKMStNoMemory;
+	}
+	const struct AKMDRingHeader* headers = (const struct AKMDRingHeader*)channel->base;
+	const uint64_t ringSize = headers[0].size;
+	if (ringSize == 0 || (ringSize & (ringSize - 1)) != 0 || headers[1].size != ringSize
+			|| AKMD_SHM_HEADERS_SIZE + 2 * ringSize != channel->mapSize)
+	{
+		AKMDShmClose(channel);
+		return AKMStFatalError;
+	}
+	initRings(channel, false);
+	return AKMStSuccess;
+}
+
+void AKMDShmClose(struct AKMDShmChannel* channel)
+{
+	if (channel->base)
+		munmap(channel->base, channel->mapSize);
+	for (int i = 0; i < AKMD_SHM_FDS; ++i)
+	{
+		if (channel->fds[i] >= 0)
+			close(channel->fds[i]);
+	}
+	memset(channel, 0, sizeof(*channel));
+	for (int i = 0; i < AKMD_SHM_FDS; ++i)
+		channel->fds[i] = -1;
+}
+
+bool AKMDShmSendFds(int socketFd, const struct AKMDShmChannel* channel)
+{
+	union
+	{
+		char buffer[CMSG_SPACE(sizeof(channel->fds))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	uint8_t version = 1;
+	struct iovec iov = { &version, sizeof(version) };
+	struct msghdr msg = { 0 };
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(channel->fds));
+	memcpy(CMSG_DATA(cmsg), channel->fds, sizeof(channel->fds));
+	return sendmsg(socketFd, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(version);
+}
+
+int AKMDShmConnect(const char* path, struct AKMDShmChannel* channel)
+{
+	struct sockaddr_un addr = { 0 };
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	strcpy(addr.sun_path, path);
+	const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	union
+	{
+		char buffer[CMSG_SPACE(sizeof(int) * AKMD_SHM_FDS)];
+		struct cmsghdr align;
+	} control;
+	uint8_t version;
+	struct iovec iov = { &version, sizeof(version) };
+	struct msghdr msg = { 0 };
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	ssize_t n;
+	do
+		n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	while (n < 0 && errno == EINTR);
+	struct cmsghdr* cmsg = n == (ssize_t)sizeof(version) ? CMSG_FIRSTHDR(&msg) : NULL;
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+			|| cmsg->cmsg_len != CMSG_LEN(sizeof(int) * AKMD_SHM_FDS) || version != 1)
+	{
+		if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		{
+			const int* fds = (const int*)CMSG_DATA(cmsg);
+			for (size_t i = 0; i < (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int); ++i)
+				close(fds[i]);
+		}
+		close(fd);
+		return -1;
+	}
+	int fds[AKMD_SHM_FDS];
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	if (AKMDShmAttach(channel, fds) != AKMStSuccess)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Bytes a record of size bytes takes at the producer position, with the end of the ring skipped if it does not fit
+static inline uint64_t spaceNeeded(const struct AKMDRing* ring, size_t size)
+{
+	const uint64_t record = recordSize(size);
+	const uint64_t left = ring->size - (ring->own & (ring->size - 1));
+	return left < record ? left + record : record;
+}
+
+bool AKMDRingHasRoom(struct AKMDRing* ring, size_t size)
+{
+	if (recordSize(size) > ring->size)
+		return false;
+	const uint64_t needed = spaceNeeded(ring, size);
+	if (ring->own - ring->other + needed <= ring->size)
+		return true;
+	ring->other = atomic_load_explicit(&ring->header->tail, memory_order_acquire);
+	return ring->own - ring->other + needed <= ring->size;
+}
+
+size_t AKMDRingMaxRecord(const struct AKMDRing* ring)
+{
+	return (size_t)ring->size - AKMD_RECORD_PREFIX;
+}
+
+uint8_t* AKMDRingReserve(struct AKMDRing* ring, size_t size)
+{
+	if (!AKMDRingHasRoom(ring, size))
+		return NULL;
+	uint64_t offset = ring->own & (ring->size - 1);
+	if (ring->size - offset < recordSize(size))
+	{
+		// Published with the record, the consumer never sees the marker alone
+		const uint32_t wrap = AKMD_RECORD_WRAP;
+		memcpy(ring->data + offset, &wrap, sizeof(wrap));
+		ring->own += ring->size - offset;
+		offset = 0;
+	}
+	return ring->data + offset + AKMD_RECORD_PREFIX;
+}
+
+void AKMDRingCommit(struct AKMDRing* ring, size_t size)
+{
+	const uint32_t prefix = (uint32_t)size;
+	memcpy(ring->data + (ring->own & (ring->size - 1)), &prefix, sizeof(prefix));
+	ring->own += recordSize(size);
+	atomic_store_explicit(&ring->header->head, ring->own, memory_order_release);
+}
+
+// The flag is cleared by whoever sees it set, so a sleeper is written to once
+static inline void wake(_Atomic uint32_t* waiting, int fd)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(waiting, memory_order_relaxed) && atomic_exchange(waiting, 0))
+	{
+		const uint64_t one = 1;
+		ssize_t written = write(fd, &one, sizeof(one));
+		(void)written;
+	}
+}
+
+void AKMDRingWakeConsumer(struct AKMDRing* ring)
+{
+	wake(&ring->header->consumerWaiting, ring->dataFd);
+}
+
+bool AKMDRingProducerSleep(struct AKMDRing* ring, size_t size)
+{
+	atomic_store(&ring->header->producerWaiting, 1);
+	if (AKMDRingHasRoom(ring, size))
+	{
+		atomic_store(&ring->header->producerWaiting, 0);
+		return false;
+	}
+	return true;
+}
+
+// The head and the records come from the producer's process, nothing it wrote may take the consumer out of the ring
+const uint8_t* AKMDRingPeek(struct AKMDRing* ring, size_t* size)
+{
+	for (;;)
+	{
+		if (ring->corrupt)
+			return NULL;
+		if (ring->own == ring->other)
+		{
+			ring->other = atomic_load_explicit(&ring->header->head, memory_order_acquire);
+			if (ring->own == ring->other)
+				return NULL;
+		}
+		const uint64_t published = ring->other - ring->own;
+		const uint64_t offset = ring->own & (ring->size - 1);
+		if (published > ring->size)
+		{
+			ring->corrupt = true;
+			continue;
+		}
+		uint32_t prefix;
+		memcpy(&prefix, ring->data + offset, sizeof(prefix));
+		if (prefix == AKMD_RECORD_WRAP)
+		{
+			// The marker is published with the record after it
+			if (ring->size - offset >= published)
+				ring->corrupt = true;
+			else
+				ring->own += ring->size - offset;
+			continue;
+		}
+		if (AKMD_RECORD_PREFIX + (uint64_t)prefix > ring->size - offset || recordSize(prefix) > published)
+		{
+			ring->corrupt = true;
+			continue;
+		}
+		*size = prefix;
+		return ring->data + offset + AKMD_RECORD_PREFIX;
+	}
+}
+
+void AKMDRingConsume(struct AKMDRing* ring, size_t size)
+{
+	ring->own += recordSize(size);
+	atomic_store_explicit(&ring->header->tail, ring->own, memory_order_release);
+}
+
+void AKMDRingWakeProducer(struct AKMDRing* ring)
+{
+	wake(&ring->header->producerWaiting, ring->spaceFd);
+}
+
+bool AKMDRingConsumerSleep(struct AKMDRing* ring)
+{
+	atomic_store(&ring->header->consumerWaiting, 1);
+	ring->other = atomic_load(&ring->header->head);
+	if (ring->own != ring->other)
+	{
+		atomic_store(&ring->header->consumerWaiting, 0);
+		return false;
+	}
+	return true;
+}
+
+bool AKMDShmWait(int fd, int timeoutMs)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	int n;
+	do
+		n = poll(&pfd, 1, timeoutMs);
+	while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return false;
+	uint64_t count;
+	ssize_t got = read(fd, &count, sizeof(count));
+	(void)got;
+	return true;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#ifndef INC_AKMD_SHM_H_
+#define INC_AKMD_SHM_H_
+
+#include "akm.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+// A channel is a memfd segment with one ring per direction and an eventfd per ring and side, handed over a
+// Unix socket as memfd, client-to-daemon data and space, daemon-to-client data and space
+#define AKMD_SHM_FDS 5
+#define AKMD_SHM_DEFAULT_RING (4 * 1024 * 1024)
+// Each record starts with its size, 32 bits padded to keep records 8-byte aligned
+#define AKMD_RECORD_PREFIX 8
+
+struct AKMDRingHeader;
+
+// One side of a single-producer single-consumer ring of records, each one frame in the transmission format.
+// Records are contiguous in the segment, so frames are sealed into and opened from it in place.
+struct AKMDRing
+{
+	struct AKMDRingHeader* header;
+	uint8_t* data;
+	uint64_t size;
+	// The side's own position, and its last view of the other side's
+	uint64_t own, other;
+	// Wakes the consumer when data arrives, and the producer when space is freed
+	int dataFd, spaceFd;
+	// Set by the consumer when the positions or a record size written by the other process do not fit the ring,
+	// nothing more is read from it
+	bool corrupt;
+};
+
+struct AKMDShmChannel
+{
+	void* base;
+	size_t mapSize;
+	int fds[AKMD_SHM_FDS];
+	// Records are consumed from in and produced to out
+	struct AKMDRing in, out;
+};
+
+// Daemon side of a new channel with rings of ringSize bytes, a power of two
+enum AKMStatus AKMDShmCreate(struct AKMDShmChannel* channel, size_t ringSize);
+
+// Client side of a channel created by the daemon, takes ownership of fds
+enum AKMStatus AKMDShmAttach(struct AKMDShmChannel* channel, const int fds[AKMD_SHM_FDS]);
+
+void AKMDShmClose(struct AKMDShmChannel* channel);
+
+// Passes the descriptors of a channel over a connected Unix socket
+bool AKMDShmSendFds(int socketFd, const struct AKMDShmChannel* channel);
+
+// Connects to the Unix socket of akmd at path and attaches to the channel it creates, returns the socket, which
+// is kept open for the life of the channel, or -1
+int AKMDShmConnect(const char* path, struct AKMDShmChannel* channel);
+
+// Producer: room for a record of size bytes, NULL if the ring is too full for it now
+uint8_t* AKMDRingReserve(struct AKMDRing* ring, size_t size);
+bool AKMDRingHasRoom(struct AKMDRing* ring, size_t size);
+// Largest record the ring ever has room for
+size_t AKMDRingMaxRecord(const struct AKMDRing* ring);
+// Publishes the record last reserved, size at most what was reserved
+void AKMDRingCommit(struct AKMDRing* ring, size_t size);
+// Wakes the consumer if it went to sleep; published records batch under one wakeup
+void AKMDRingWakeConsumer(struct AKMDRing* ring);
+// False if room for size bytes appeared meanwhile, otherwise the producer is woken through spaceFd
+bool AKMDRingProducerSleep(struct AKMDRing* ring, size_t size);
+
+// Consumer: the next record, NULL if there is none or the ring turned out corrupt
+const uint8_t* AKMDRingPeek(struct AKMDRing* ring, size_t* size);
+// Frees the record last peeked
+void AKMDRingConsume(struct AKMDRing* ring, size_t size);
+void AKMDRingWakeProducer(struct AKMDRing* ring);
+// False if a record arrived meanwhile, otherwise the consumer is woken through dataFd
+bool AKMDRingConsumerSleep(struct AKMDRing* ring);
+
+// Blocks on a wakeup eventfd for up to timeoutMs (-1 for ever), false on timeout
+bool AKMDShmWait(int fd, int timeoutMs);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INC_AKMD_SHM_H_ */
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "akmd_udp.h"
+#include <errno.h>
+#include <netinet/udp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define AKMD_UDP_CONTROL_SIZE CMSG_SPACE(sizeof(int))
+
+enum AKMStatus AKMDBatchInit(struct AKMDDatagramBatch* batch, unsigned capacity, size_t bufferSize)
+{
+	memset(batch, 0, sizeof(*batch));
+	batch->capacity = capacity;
+	batch->bufferSize = bufferSize;
+	batch->msgs = (struct mmsghdr*)calloc(capacity, sizeof(*batch->msgs));
+	batch->iovs = (struct iovec*)calloc(capacity, sizeof(*batch->iovs));
+	batch->addrs = (struct sockaddr_in*)calloc(capacity, sizeof(*batch->addrs));
+	batch->control = (uint8_t*)calloc(capacity, AKMD_UDP_CONTROL_SIZE);
+	batch->segmentSizes = (uint16_t*)calloc(capacity, sizeof(*batch->segmentSizes));
+	batch->buffer = (uint8_t*)malloc(bufferSize);
+	if (!batch->msgs || !batch->iovs || !batch->addrs || !batch->control || !batch->segmentSizes || !batch->buffer)
+	{
+		AKMDBatchFree(batch);
+		return AKMStNoMemory;
+	}
+	return AKMStSuccess;
+}
+
+void AKMDBatchFree(struct AKMDDatagramBatch* batch)
+{
+	free(batch->msgs);
+	free(batch->iovs);
+	free(batch->addrs);
+	free(batch->control);
+	free(batch->segmentSizes);
+	free(batch->buffer);
+	memset(batch, 0, sizeof(*batch));
+}
+
+bool AKMDUdpEnableGso(int fd)
+{
+	// Probing with segment size 0 leaves sends unsegmented unless a message asks for it
+	const int size = 0;
+	return setsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &size, sizeof(size)) == 0;
+}
+
+bool AKMDUdpEnableGro(int fd)
+{
+	const int one = 1;
+	return setsockopt(fd, IPPROTO_UDP, UDP_GRO, &one, sizeof(one)) == 0;
+}
+
+static inline bool samePeer(const struct sockaddr_in* a, const struct sockaddr_in* b)
+{
+	if (!b)
+		return a->sin_family == 0;
+	return a->sin_family == b->sin_family && a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+}
+
+uint8_t* AKMDBatchAdd(struct AKMDDatagramBatch* batch, const struct sockaddr_in* peer, size_t size)
+{
+	if (size == 0 || size > AKMD_UDP_MAX_PAYLOAD || batch->used + size > batch->bufferSize)
+		return NULL;
+	uint8_t* data = batch->buffer + batch->used;
+	if (batch->gso && batch->num > 0)
+	{
+		// GSO splits a message into segments of its first datagram's size, only the last one may be shorter
+		const unsigned last = batch->num - 1;
+		struct iovec* iov = batch->iovs + last;
+		const size_t segmentSize = batch->segmentSizes[last];
+		if (size <= segmentSize && iov->iov_len % segmentSize == 0 && iov->iov_len / segmentSize < AKMD_UDP_MAX_SEGMENTS
+				&& iov->iov_len + size <= AKMD_UDP_MAX_PAYLOAD && samePeer(batch->addrs + last, peer))
+		{
+			iov->iov_len += size;
+			batch->used += size;
+			return data;
+		}
+	}
+	if (batch->num == batch->capacity)
+		return NULL;
+	const unsigned i = batch->num++;
+	batch->iovs[i].iov_base = data;
+	batch->iovs[i].iov_len = size;
+	batch->segmentSizes[i] = (uint16_t)size;
+	if (peer)
+		batch->addrs[i] = *peer;
+	else
+		memset(batch->addrs + i, 0, sizeof(batch->addrs[i]));
+	batch->used += size;
+	return data;
+}
+
+int AKMDBatchSend(struct AKMDDatagramBatch* batch, int fd, AKMDDatagramRefused refused, void* context)
+{
+	for (unsigned i = 0; i < batch->num; ++i)
+	{
+		struct msghdr* hdr = &batch->msgs[i].msg_hdr;
+		memset(hdr, 0, sizeof(*hdr));
+		if (batch->addrs[i].sin_family != 0)
+		{
+			hdr->msg_name = batch->addrs + i;
+			hdr->msg_namelen = sizeof(batch->addrs[i]);
+		}
+		hdr->msg_iov = batch->iovs + i;
+		hdr->msg_iovlen = 1;
+		if (batch->iovs[i].iov_len > batch->segmentSizes[i])
+		{
+			hdr->msg_control = batch->control + i * AKMD_UDP_CONTROL_SIZE;
+			hdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+			struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+			cmsg->cmsg_level = IPPROTO_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			memcpy(CMSG_DATA(cmsg), batch->segmentSizes + i, sizeof(uint16_t));
+		}
+	}
+	int datagrams = 0;
+	unsigned sent = 0;
+	while (sent < batch->num)
+	{
+		const int n = sendmmsg(fd, batch->msgs + sent, batch->num - sent, 0);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			// The first message was refused, the others may still go
+			if (errno == EMSGSIZE && refused)
+			{
+				const struct iovec* iov = batch->iovs + sent;
+				const struct sockaddr_in* peer = batch->addrs[sent].sin_family != 0 ? batch->addrs + sent : NULL;
+				const size_t segmentSize = batch->segmentSizes[sent];
+				for (size_t pos = 0; pos < iov->iov_len; pos += segmentSize)
+				{
+					const size_t size = iov->iov_len - pos < segmentSize ? iov->iov_len - pos : segmentSize;
+					refused(context, peer, (const uint8_t*)iov->iov_base + pos, size);
+				}
+			}
+			++sent;
+			continue;
+		}
+		for (int i = 0; i < n; ++i)
+		{
+			const size_t segmentSize = batch->segmentSizes[sent + i];
+			datagrams += (int)((batch->iovs[sent + i].iov_len + segmentSize - 1) / segmentSize);
+		}
+		sent += (unsigned)n;
+	}
+	batch->num = 0;
+	batch->used = 0;
+	return datagrams;
+}
+
+int AKMDBatchReceive(struct AKMDDatagramBatch* batch, int fd, bool wait)
+{
+	const size_t slot = batch->bufferSize / batch->capacity;
+	for (unsigned i = 0; i < batch->capacity; ++i)
+	{
+		struct msghdr* hdr = &batch->msgs[i].msg_hdr;
+		batch->iovs[i].iov_base = batch->buffer + i * slot;
+		batch->iovs[i].iov_len = slot;
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->msg_name = batch->addrs + i;
+		hdr->msg_namelen = sizeof(batch->addrs[i]);
+		hdr->msg_iov = batch->iovs + i;
+		hdr->msg_iovlen = 1;
+		hdr->msg_control = batch->control + i * AKMD_UDP_CONTROL_SIZE;
+		hdr->msg_controllen = AKMD_UDP_CONTROL_SIZE;
+	}
+	int n;
+	do
+		n = recvmmsg(fd, batch->msgs, batch->capacity, wait ? MSG_WAITFORONE : MSG_DONTWAIT, NULL);
+	while (n < 0 && errno == EINTR);
+	batch->num = n > 0 ? (unsigned)n : 0;
+	for (unsigned i = 0; i < batch->num; ++i)
+	{
+		struct msghdr* hdr = &batch->msgs[i].msg_hdr;
+		batch->segmentSizes[i] = (uint16_t)batch->msgs[i].msg_len;
+		for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg))
+		{
+			if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+			{
+				int segmentSize;
+				memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+				if (segmentSize > 0)
+					batch->segmentSizes[i] = (uint16_t)segmentSize;
+			}
+		}
+	}
+	return n;
+}
+
+void AKMDBatchReceived(const struct AKMDDatagramBatch* batch, unsigned i, const uint8_t** data, size_t* size, size_t* segmentSize, const struct sockaddr_in** peer)
+{
+	*data = (const uint8_t*)batch->iovs[i].iov_base;
+	*size = batch->msgs[i].msg_len;
+	*segmentSize = batch->segmentSizes[i] ? batch->segmentSizes[i] : *size;
+	*peer = batch->addrs + i;
+}
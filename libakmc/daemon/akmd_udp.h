@@ -0,0 +1,76 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#ifndef INC_AKMD_UDP_H_
+#define INC_AKMD_UDP_H_
+
+#include "akm.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+// Over UDP every datagram carries exactly one frame in the transmission format, header included
+#define AKMD_UDP_MAX_PAYLOAD 65507
+#define AKMD_UDP_HEADERS_SIZE 28
+#define AKMD_UDP_DEFAULT_MTU 1500
+#define AKMD_UDP_MAX_SEGMENTS 64
+#define AKMD_UDP_BATCH 64
+
+struct mmsghdr;
+struct iovec;
+
+// Datagrams moved by one sendmmsg or recvmmsg call. Datagrams of equal size queued back to back for the same
+// peer are sent as one GSO message when gso is set; received GRO messages are split by their segment size.
+struct AKMDDatagramBatch
+{
+	struct mmsghdr* msgs;
+	struct iovec* iovs;
+	struct sockaddr_in* addrs;
+	uint8_t* control;
+	uint16_t* segmentSizes;
+	uint8_t* buffer;
+	size_t bufferSize;
+	size_t used;
+	unsigned capacity;
+	unsigned num;
+	bool gso;
+};
+
+enum AKMStatus AKMDBatchInit(struct AKMDDatagramBatch* batch, unsigned capacity, size_t bufferSize);
+
+void AKMDBatchFree(struct AKMDDatagramBatch* batch);
+
+// Enables UDP_SEGMENT on sends and UDP_GRO on receives where the kernel has them, returns what was enabled
+bool AKMDUdpEnableGso(int fd);
+bool AKMDUdpEnableGro(int fd);
+
+// Called for a datagram the kernel refused with EMSGSIZE, larger than the path MTU it learned for peer lets
+// through; data is the datagram, or a GSO segment of one
+typedef void (*AKMDDatagramRefused)(void* context, const struct sockaddr_in* peer, const uint8_t* data, size_t size);
+
+// Room for a datagram of size bytes to peer (NULL on connected sockets), NULL if the batch is full
+uint8_t* AKMDBatchAdd(struct AKMDDatagramBatch* batch, const struct sockaddr_in* peer, size_t size);
+
+// Sends and empties the batch, returns the number of datagrams the kernel took; those refused past the path MTU
+// go to refused (if not NULL), the rest is dropped, as UDP may
+int AKMDBatchSend(struct AKMDDatagramBatch* batch, int fd, AKMDDatagramRefused refused, void* context);
+
+// Receives up to capacity messages, each in its own bufferSize / capacity bytes of buffer; waits for the first
+// one if wait is set, otherwise -1 with errno EAGAIN when nothing is pending
+int AKMDBatchReceive(struct AKMDDatagramBatch* batch, int fd, bool wait);
+
+// Received message i, with the segment size GRO coalesced it by (its size if not coalesced)
+void AKMDBatchReceived(const struct AKMDDatagramBatch* batch, unsigned i, const uint8_t** data, size_t* size, size_t* segmentSize, const struct sockaddr_in** peer);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INC_AKMD_UDP_H_ */
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#include <akm_coro.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+typedef akm::Relationship<2, 1> Rel;
+typedef Rel::AddressType Address;
+
+const Address nodeAddresses[] = {
+	Address::fromUInt(3),
+	Address::fromUInt(5),
+	Address::fromUInt(7),
+	Address::fromUInt(9),
+};
+
+// Simulates a host whose key installation and decryption run on an asynchronous crypto offload queue
+struct Session
+{
+	akm::coro::Task<void> operator()(const akm::cmd::SetKey<Rel::sk>& cmd)
+	{
+		keys[cmd.slot] = cmd.key();
+		co_await executor->schedule();
+		++keysInstalled;
+	}
+
+	akm::coro::Task<akm::cmd::RetryResult<Rel::srna>> operator()(const akm::cmd::RetryDec& cmd)
+	{
+		(void)cmd;
+		co_await executor->schedule();
+		co_return akm::cmd::RetryResult<Rel::srna>{ AKMEvRecvSE, nodeAddresses + 0 };
+	}
+
+	void operator()(const akm::cmd::UseKeys& cmd)
+	{
+		encKey = cmd.encKey;
+		decKey = cmd.decKey;
+	}
+
+	void operator()(const akm::cmd::SetSendEvent& cmd)
+	{
+		sendEvent = cmd.akmEvent;
+	}
+
+	akm::coro::Executor* executor = nullptr;
+	Rel relationship;
+	Rel::KeyType keys[4] = {};
+	akm::KeySlot encKey = akm::KeyCSK;
+	akm::KeySlot decKey = akm::KeyCSK;
+	AKMEvent sendEvent = AKMEvNone;
+	int keysInstalled = 0;
+	int steps = 0;
+	bool ok = false;
+};
+
+akm::coro::Task<void> runSession(Session& session)
+{
+	AKMConfigParams params = { 0 };
+	params.NNRT = 1000000000;
+	params.NSET = 1000000000;
+	params.FBSET = 1000000000;
+	params.FSSET = 1000000000;
+	AKMParameterDataVector pdv;
+	for (int i = 0; i < AKM_PARAMETER_DATA_VECTOR_SIZE; ++i)
+		pdv.data[i] = (uint8_t)std::rand();
+	akm_time_t time_ms = 0;
+	if (co_await akm::coro::init(session.relationship, params, pdv, nodeAddresses, 4, nodeAddresses[3], time_ms, session) != AKMStSuccess)
+		co_return;
+	const AKMEvent events[] = { AKMEvRecvSEI, AKMEvRecvSEC, AKMEvRecvSEF, AKMEvRecvSE, AKMEvCannotDecrypt };
+	for (AKMEvent akmEvent : events)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			const Address* src = akmEvent == AKMEvCannotDecrypt ? nullptr : nodeAddresses + i;
+			if (co_await akm::coro::process(session.relationship, akmEvent, src, ++time_ms, session) != AKMStSuccess)
+				co_return;
+			++session.steps;
+			// Let the other relationships progress between received frames
+			co_await session.executor->schedule();
+		}
+	}
+	session.ok = true;
+}
+
+int main(int argc, char** argv)
+{
+	const int sessionNum = argc > 1 ? std::atoi(argv[1]) : 10000;
+	akm::coro::Executor executor;
+	std::vector<Session> sessions(sessionNum);
+	const auto start = std::chrono::steady_clock::now();
+	for (Session& session : sessions)
+	{
+		session.executor = &executor;
+		executor.spawn(runSession(session));
+	}
+	executor.run();
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	int okNum = 0;
+	long steps = 0;
+	long keysInstalled = 0;
+	for (const Session& session : sessions)
+	{
+		okNum += session.ok;
+		steps += session.steps;
+		keysInstalled += session.keysInstalled;
+	}
+	std::cout << okNum << "/" << sessionNum << " relationships established on one thread, "
+		<< steps << " events, " << keysInstalled << " asynchronous key installations in "
+		<< elapsed.count() / 1000.0 << " ms" << std::endl;
+	return okNum == sessionNum ? 0 : 1;
+}
@@ -0,0 +1,452 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#ifndef LIBAKM_HPP
+#define LIBAKM_HPP
+
+#include <akm.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace akm
+{
+
+// Fixed-size byte string, the size is a compile-time constant so copies and comparisons unroll
+template<class Derived, std::size_t Size>
+struct FixedBytes
+{
+	static_assert(Size > 0, "FixedBytes size must be positive");
+
+	static constexpr std::size_t size() { return Size; }
+
+	uint8_t* data() { return bytes.data(); }
+	const uint8_t* data() const { return bytes.data(); }
+
+	static Derived fromRaw(const void* raw)
+	{
+		Derived result{};
+		std::memcpy(result.bytes.data(), raw, Size);
+		return result;
+	}
+
+	friend bool operator==(const FixedBytes& a, const FixedBytes& b) { return a.bytes == b.bytes; }
+	friend bool operator!=(const FixedBytes& a, const FixedBytes& b) { return a.bytes != b.bytes; }
+
+	std::array<uint8_t, Size> bytes;
+};
+
+// Ring Node Address, bytes are in little-endian order like in the address list passed to AKMInit
+template<uint8_t SRNA>
+struct Address : FixedBytes<Address<SRNA>, SRNA>
+{
+	// Lexicographic order of the reversed bytes, the order the node address list must be sorted in
+	friend bool operator<(const Address& a, const Address& b)
+	{
+		for (std::size_t i = SRNA; i-- > 0;)
+		{
+			if (a.bytes[i] != b.bytes[i])
+				return a.bytes[i] < b.bytes[i];
+		}
+		return false;
+	}
+
+	static constexpr Address fromUInt(uint64_t value)
+	{
+		Address result{};
+		for (std::size_t i = 0; i < SRNA; ++i, value >>= 8)
+			result.bytes[i] = (uint8_t)value;
+		return result;
+	}
+};
+
+template<uint8_t SK>
+struct Key : FixedBytes<Key<SK>, SK>
+{
+};
+
+// Key slots used by AKMCmdOpSetKey, AKMCmdOpMoveKey, AKMCmdOpUseKeys and AKMCmdOpRetryDec
+enum KeySlot
+{
+	KeyCSK = 0,
+	KeyNSK = 1,
+	KeyCFSK = 2,
+	KeyNFSK = 3,
+};
+
+namespace cmd
+{
+
+struct SetSendEvent
+{
+	bool sendOk;
+	AKMEvent akmEvent;
+};
+
+template<uint8_t SK>
+struct SetKey
+{
+	KeySlot slot;
+	// Valid only until the next step of the relationship
+	const uint8_t* raw;
+
+	Key<SK> key() const { return Key<SK>::fromRaw(raw); }
+	void copyTo(void* dst) const { std::memcpy(dst, raw, SK); }
+};
+
+struct ResetKey
+{
+	KeySlot slot;
+};
+
+struct MoveKey
+{
+	KeySlot dst;
+	KeySlot src;
+};
+
+struct UseKeys
+{
+	KeySlot encKey;
+	KeySlot decKey;
+};
+
+struct RetryDec
+{
+	KeySlot decTryKey;
+};
+
+struct SetTimer
+{
+	akm_time_t time_ms;
+};
+
+struct ResetTimer
+{
+};
+
+// Outcome of the decryption retry requested by RetryDec: the decrypted frame's event and source,
+// or AKMEvCannotDecrypt with no source if the retry failed as well
+template<uint8_t SRNA>
+struct RetryResult
+{
+	AKMEvent akmEvent;
+	const Address<SRNA>* srcAddr;
+};
+
+} // namespace cmd
+
+// Builds a single visitor out of several lambdas, e.g. overloaded{ [](const cmd::SetKey<1>&) {...}, ... }
+template<class... Ts>
+struct overloaded : Ts...
+{
+	using Ts::operator()...;
+};
+
+template<class... Ts>
+overloaded(Ts...) -> overloaded<Ts...>;
+
+namespace detail
+{
+
+template<class Handler, class Cmd>
+inline void visitIfHandled(Handler& handler, const Cmd& command)
+{
+	if constexpr (std::is_invocable_v<Handler&, const Cmd&>)
+		handler(command);
+	else
+		(void)command;
+}
+
+// RetryDec handlers return a RetryResult, a missing handler counts as a failed retry
+template<uint8_t SRNA, class Handler>
+inline cmd::RetryResult<SRNA> retryDec(Handler& handler, const cmd::RetryDec& command)
+{
+	if constexpr (std::is_invocable_r_v<cmd::RetryResult<SRNA>, Handler&, const cmd::RetryDec&>)
+		return handler(command);
+	else
+		return cmd::RetryResult<SRNA>{ AKMEvCannotDecrypt, nullptr };
+}
+
+} // namespace detail
+
+// Dispatches a yielded command to the handler overload for its type, opcodes without an overload are ignored
+template<uint8_t SK, class Handler>
+inline void visit(const AKMCommand& command, Handler&& handler)
+{
+	switch (command.opcode)
+	{
+	case AKMCmdOpSetSendEvent:
+		detail::visitIfHandled(handler, cmd::SetSendEvent{ command.p1 != 0, (AKMEvent)command.p2 });
+		break;
+	case AKMCmdOpSetKey:
+		detail::visitIfHandled(handler, cmd::SetKey<SK>{ (KeySlot)command.p1, (const uint8_t*)command.data });
+		break;
+	case AKMCmdOpResetKey:
+		detail::visitIfHandled(handler, cmd::ResetKey{ (KeySlot)command.p1 });
+		break;
+	case AKMCmdOpMoveKey:
+		detail::visitIfHandled(handler, cmd::MoveKey{ (KeySlot)command.p1, (KeySlot)command.p2 });
+		break;
+	case AKMCmdOpUseKeys:
+		detail::visitIfHandled(handler, cmd::UseKeys{ (KeySlot)command.p1, (KeySlot)command.p2 });
+		break;
+	case AKMCmdOpRetryDec:
+		detail::visitIfHandled(handler, cmd::RetryDec{ (KeySlot)command.p1 });
+		break;
+	case AKMCmdOpSetTimer:
+		detail::visitIfHandled(handler, cmd::SetTimer{ *(const akm_time_t*)command.data });
+		break;
+	case AKMCmdOpResetTimer:
+		detail::visitIfHandled(handler, cmd::ResetTimer{});
+		break;
+	case AKMCmdOpReturn:
+	default:
+		break;
+	}
+}
+
+// Owning handle of an AKMTemplate, relationships started from it hold their own reference so it may be destroyed first
+template<uint8_t SRNA, uint8_t SK>
+class Template
+{
+public:
+	using AddressType = Address<SRNA>;
+
+	Template() = default;
+	~Template() { AKMTemplateRelease(tmpl_); }
+
+	Template(const Template&) = delete;
+	Template& operator=(const Template&) = delete;
+
+	Template(Template&& other) noexcept : tmpl_(std::exchange(other.tmpl_, nullptr)) {}
+	Template& operator=(Template&& other) noexcept
+	{
+		if (this != &other)
+		{
+			AKMTemplateRelease(tmpl_);
+			tmpl_ = std::exchange(other.tmpl_, nullptr);
+		}
+		return *this;
+	}
+
+	explicit operator bool() const { return tmpl_ != nullptr; }
+
+	AKMTemplate* get() const { return tmpl_; }
+
+	// The node list must be sorted (see Address::operator<), params.SRNA, params.SK and params.N are filled in here
+	AKMStatus create(AKMConfigParams params, const AKMParameterDataVector& pdv, const AddressType* nodeAddresses, uint16_t nodeNum)
+	{
+		static_assert(sizeof(AddressType) == SRNA, "Address must be tightly packed");
+		AKMTemplateRelease(std::exchange(tmpl_, nullptr));
+		params.SRNA = SRNA;
+		params.SK = SK;
+		params.N = nodeNum;
+		AKMConfiguration config = {};
+		config.params = params;
+		config.pdv = &pdv;
+		config.nodeAddresses = nodeAddresses;
+		return AKMTemplateCreate(&tmpl_, &config);
+	}
+
+private:
+	AKMTemplate* tmpl_ = nullptr;
+};
+
+// Owning handle of an AKM Relationship with SRNA and SK fixed at compile time
+template<uint8_t SRNA, uint8_t SK>
+class Relationship
+{
+	static_assert(SRNA > 0, "SRNA must be positive");
+	static_assert(SK > 0, "SK must be positive");
+
+public:
+	using AddressType = Address<SRNA>;
+	using KeyType = Key<SK>;
+
+	static constexpr uint8_t srna = SRNA;
+	static constexpr uint8_t sk = SK;
+
+	Relationship() : ctx_() {}
+	~Relationship() { AKMFree(ctx_.relationship); }
+
+	Relationship(const Relationship&) = delete;
+	Relationship& operator=(const Relationship&) = delete;
+
+	Relationship(Relationship&& other) noexcept : ctx_(other.ctx_) { other.ctx_ = AKMProcessCtx(); }
+	Relationship& operator=(Relationship&& other) noexcept
+	{
+		if (this != &other)
+		{
+			AKMFree(ctx_.relationship);
+			ctx_ = other.ctx_;
+			other.ctx_ = AKMProcessCtx();
+		}
+		return *this;
+	}
+
+	explicit operator bool() const { return ctx_.relationship != nullptr; }
+
+	AKMRelationship* get() const { return ctx_.relationship; }
+
+	// Releases ownership, the caller becomes responsible for calling AKMFree
+	AKMRelationship* release()
+	{
+		AKMRelationship* relationship = ctx_.relationship;
+		ctx_ = AKMProcessCtx();
+		return relationship;
+	}
+
+	// Creates the relationship and runs its initialization, the node list must be sorted (see Address::operator<)
+	// and contain selfNodeAddress; params.SRNA, params.SK and params.N are filled in here
+	template<class Handler>
+	AKMStatus init(const AKMConfigParams& params, const AKMParameterDataVector& pdv, const AddressType* nodeAddresses, uint16_t nodeNum, const AddressType& selfNodeAddress, akm_time_t time_ms, Handler&& handler)
+	{
+		AKMStatus status = start(params, pdv, nodeAddresses, nodeNum, selfNodeAddress, time_ms);
+		if (status == AKMStSuccess)
+			status = run(handler);
+		if (status != AKMStSuccess)
+			reset();
+		return status;
+	}
+
+	// Low-level counterpart of init(), creates the relationship and yields the first initialization command
+	AKMStatus start(AKMConfigParams params, const AKMParameterDataVector& pdv, const AddressType* nodeAddresses, uint16_t nodeNum, const AddressType& selfNodeAddress, akm_time_t time_ms)
+	{
+		static_assert(sizeof(AddressType) == SRNA, "Address must be tightly packed");
+		reset();
+		params.SRNA = SRNA;
+		params.SK = SK;
+		params.N = nodeNum;
+		AKMConfiguration config = {};
+		config.params = params;
+		config.pdv = &pdv;
+		config.nodeAddresses = nodeAddresses;
+		config.selfNodeAddress = &selfNodeAddress;
+		ctx_.time_ms = time_ms;
+		const AKMStatus status = AKMInit(&ctx_, &config);
+		if (status == AKMStSuccess)
+			AKMProcess(&ctx_);
+		return status;
+	}
+
+	// Creates the relationship from a template and runs its initialization, selfNodeAddress must be in its node list
+	template<class Handler>
+	AKMStatus init(const Template<SRNA, SK>& tmpl, const AddressType& selfNodeAddress, akm_time_t time_ms, Handler&& handler)
+	{
+		AKMStatus status = start(tmpl, selfNodeAddress, time_ms);
+		if (status == AKMStSuccess)
+			status = run(handler);
+		if (status != AKMStSuccess)
+			reset();
+		return status;
+	}
+
+	AKMStatus start(const Template<SRNA, SK>& tmpl, const AddressType& selfNodeAddress, akm_time_t time_ms)
+	{
+		reset();
+		ctx_.time_ms = time_ms;
+		const AKMStatus status = AKMInitFromTemplate(&ctx_, tmpl.get(), &selfNodeAddress);
+		if (status == AKMStSuccess)
+			AKMProcess(&ctx_);
+		return status;
+	}
+
+	void reset()
+	{
+		AKMFree(ctx_.relationship);
+		ctx_ = AKMProcessCtx();
+	}
+
+	template<class Handler>
+	AKMStatus process(AKMEvent akmEvent, const AddressType* srcAddr, akm_time_t time_ms, Handler&& handler)
+	{
+		begin(akmEvent, srcAddr, time_ms);
+		return run(handler);
+	}
+
+	// Low-level stepping, begin() feeds an event and returns the first command, next() returns the following ones
+	// until AKMCmdOpReturn whose p1 holds the resulting status; after RetryDec the retry outcome is fed with begin()
+	const AKMCommand& begin(AKMEvent akmEvent, const AddressType* srcAddr, akm_time_t time_ms)
+	{
+		ctx_.akmEvent = akmEvent;
+		ctx_.srcAddr = srcAddr;
+		ctx_.time_ms = time_ms;
+		AKMProcess(&ctx_);
+		return ctx_.cmd;
+	}
+
+	const AKMCommand& next()
+	{
+		AKMProcess(&ctx_);
+		return ctx_.cmd;
+	}
+
+	const AKMCommand& command() const { return ctx_.cmd; }
+
+	akm_time_t time() const { return ctx_.time_ms; }
+
+	// Membership changes, allowed only between events
+	AKMStatus addNodes(const AddressType* nodeAddresses, uint16_t nodeNum, akm_time_t time_ms) { return AKMAddNodes(ctx_.relationship, nodeAddresses, nodeNum, time_ms); }
+	AKMStatus removeNodes(const AddressType* nodeAddresses, uint16_t nodeNum) { return AKMRemoveNodes(ctx_.relationship, nodeAddresses, nodeNum); }
+
+	// Node count changes when nodes time out or are added or removed
+	uint16_t nodeNum() const
+	{
+		AKMConfiguration config = {};
+		AKMGetConfig(ctx_.relationship, &config);
+		return config.params.N;
+	}
+
+	AKMConfigParams params() const
+	{
+		AKMConfiguration config = {};
+		AKMGetConfig(ctx_.relationship, &config);
+		return config.params;
+	}
+
+	// Copies out the node addresses if all of them fit in maxNum, none otherwise; returns the current node count,
+	// so a result above maxNum means nothing was copied
+	uint16_t nodeAddresses(AddressType* nodeAddresses, uint16_t maxNum) const
+	{
+		AKMConfiguration config = {};
+		AKMGetConfig(ctx_.relationship, &config);
+		if (config.params.N > maxNum)
+			return config.params.N;
+		config.nodeAddresses = nodeAddresses;
+		AKMGetConfig(ctx_.relationship, &config);
+		return config.params.N;
+	}
+
+private:
+	template<class Handler>
+	AKMStatus run(Handler& handler)
+	{
+		while (ctx_.cmd.opcode != AKMCmdOpReturn)
+		{
+			if (ctx_.cmd.opcode == AKMCmdOpRetryDec)
+			{
+				const cmd::RetryResult<SRNA> result = detail::retryDec<SRNA>(handler, cmd::RetryDec{ (KeySlot)ctx_.cmd.p1 });
+				ctx_.akmEvent = result.akmEvent;
+				ctx_.srcAddr = result.srcAddr;
+			}
+			else
+			{
+				visit<SK>(ctx_.cmd, handler);
+			}
+			AKMProcess(&ctx_);
+		}
+		return (AKMStatus)ctx_.cmd.p1;
+	}
+
+	AKMProcessCtx ctx_;
+};
+
+} // namespace akm
+
+#endif
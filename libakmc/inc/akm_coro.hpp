@@ -0,0 +1,335 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#ifndef LIBAKM_CORO_HPP
+#define LIBAKM_CORO_HPP
+
+#include <akm.hpp>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace akm::coro
+{
+
+template<class T = void>
+class Task;
+
+namespace detail
+{
+
+struct PromiseBase
+{
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept { return false; }
+
+		template<class Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) const noexcept
+		{
+			std::coroutine_handle<> continuation = handle.promise().continuation;
+			return continuation ? continuation : std::noop_coroutine();
+		}
+
+		void await_resume() const noexcept {}
+	};
+
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+	FinalAwaiter final_suspend() const noexcept { return {}; }
+	void unhandled_exception() const noexcept { std::terminate(); }
+
+	std::coroutine_handle<> continuation;
+};
+
+template<class T>
+struct Promise : PromiseBase
+{
+	Task<T> get_return_object() noexcept;
+	void return_value(T v) { value.emplace(std::move(v)); }
+	T result() { return std::move(*value); }
+
+	std::optional<T> value;
+};
+
+template<>
+struct Promise<void> : PromiseBase
+{
+	Task<void> get_return_object() noexcept;
+	void return_void() const noexcept {}
+	void result() const noexcept {}
+};
+
+} // namespace detail
+
+// Lazily started coroutine, runs when awaited and resumes its awaiter on completion (symmetric transfer)
+template<class T>
+class Task
+{
+public:
+	using promise_type = detail::Promise<T>;
+	using Handle = std::coroutine_handle<promise_type>;
+
+	Task() = default;
+	explicit Task(Handle handle) : handle_(handle) {}
+	~Task()
+	{
+		if (handle_)
+			handle_.destroy();
+	}
+
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (handle_)
+				handle_.destroy();
+			handle_ = std::exchange(other.handle_, {});
+		}
+		return *this;
+	}
+
+	bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		handle_.promise().continuation = awaiting;
+		return handle_;
+	}
+
+	T await_resume() { return handle_.promise().result(); }
+
+private:
+	Handle handle_;
+};
+
+namespace detail
+{
+
+template<class T>
+inline Task<T> Promise<T>::get_return_object() noexcept
+{
+	return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept
+{
+	return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Self-destroying top-level coroutine used by Executor::spawn()
+struct Detached
+{
+	struct promise_type
+	{
+		Detached get_return_object() const noexcept { return {}; }
+		std::suspend_never initial_suspend() const noexcept { return {}; }
+		std::suspend_never final_suspend() const noexcept { return {}; }
+		void return_void() const noexcept {}
+		void unhandled_exception() const noexcept { std::terminate(); }
+	};
+};
+
+template<class T>
+struct Ready
+{
+	bool await_ready() const noexcept { return true; }
+	void await_suspend(std::coroutine_handle<>) const noexcept {}
+	T await_resume() { return std::move(value); }
+
+	T value;
+};
+
+template<>
+struct Ready<void>
+{
+	bool await_ready() const noexcept { return true; }
+	void await_suspend(std::coroutine_handle<>) const noexcept {}
+	void await_resume() const noexcept {}
+};
+
+template<class T>
+struct IsTask : std::false_type
+{
+};
+
+template<class T>
+struct IsTask<Task<T>> : std::true_type
+{
+};
+
+// Turns a handler call into something co_await-able: Tasks are awaited, plain results are passed through
+template<class Handler, class Cmd>
+inline auto invoke(Handler& handler, const Cmd& command)
+{
+	if constexpr (!std::is_invocable_v<Handler&, const Cmd&>)
+	{
+		(void)command;
+		return Ready<void>{};
+	}
+	else
+	{
+		using Result = std::invoke_result_t<Handler&, const Cmd&>;
+		if constexpr (IsTask<Result>::value)
+			return handler(command);
+		else if constexpr (std::is_void_v<Result>)
+		{
+			handler(command);
+			return Ready<void>{};
+		}
+		else
+			return Ready<Result>{ handler(command) };
+	}
+}
+
+template<uint8_t SRNA, class Handler>
+inline auto retryDec(Handler& handler, const cmd::RetryDec& command)
+{
+	using RetryResult = cmd::RetryResult<SRNA>;
+	if constexpr (std::is_invocable_v<Handler&, const cmd::RetryDec&>)
+	{
+		using Result = std::invoke_result_t<Handler&, const cmd::RetryDec&>;
+		if constexpr (std::is_same_v<Result, RetryResult> || std::is_same_v<Result, Task<RetryResult>>)
+			return invoke(handler, command);
+		else
+			return Ready<RetryResult>{ RetryResult{ AKMEvCannotDecrypt, nullptr } };
+	}
+	else
+		return Ready<RetryResult>{ RetryResult{ AKMEvCannotDecrypt, nullptr } };
+}
+
+} // namespace detail
+
+// Single-threaded run queue, coroutines suspended on schedule() are resumed by run() in FIFO order
+class Executor
+{
+public:
+	struct ScheduleAwaiter
+	{
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle) const { executor->ready_.push_back(handle); }
+		void await_resume() const noexcept {}
+
+		Executor* executor;
+	};
+
+	Executor() = default;
+	Executor(const Executor&) = delete;
+	Executor& operator=(const Executor&) = delete;
+
+	ScheduleAwaiter schedule() { return ScheduleAwaiter{ this }; }
+
+	// Starts the task on the executor, it owns the task until completion
+	void spawn(Task<void> task)
+	{
+		[](Executor* executor, Task<void> t) -> detail::Detached
+		{
+			co_await executor->schedule();
+			co_await t;
+		}(this, std::move(task));
+	}
+
+	bool runOne()
+	{
+		if (ready_.empty())
+			return false;
+		std::coroutine_handle<> handle = ready_.front();
+		ready_.pop_front();
+		handle.resume();
+		return true;
+	}
+
+	// Returns when no coroutine is ready, suspended coroutines waiting on something else stay suspended
+	void run()
+	{
+		while (runOne())
+		{
+		}
+	}
+
+	std::size_t readyNum() const { return ready_.size(); }
+
+private:
+	std::deque<std::coroutine_handle<>> ready_;
+};
+
+namespace detail
+{
+
+// Keeps the command a handler task was created with alive until the task has run, the handler may take it by reference
+template<uint8_t SK>
+using HeldCommand = std::variant<std::monostate, cmd::SetSendEvent, cmd::SetKey<SK>, cmd::ResetKey, cmd::MoveKey, cmd::UseKeys, cmd::SetTimer, cmd::ResetTimer>;
+
+// Feeds the current command of the relationship to the handler and steps it until AKMCmdOpReturn. Commands are
+// dispatched by akm::visit(), where plain handlers run; a handler returning a Task only creates it there and the
+// task is awaited here. RetryDec is answered with the retry outcome like in Relationship::process().
+template<uint8_t SRNA, uint8_t SK, class Handler>
+Task<AKMStatus> drive(Relationship<SRNA, SK>& relationship, Handler& handler)
+{
+	const AKMCommand* command = &relationship.command();
+	while (command->opcode != AKMCmdOpReturn)
+	{
+		if (command->opcode == AKMCmdOpRetryDec)
+		{
+			const cmd::RetryResult<SRNA> result = co_await retryDec<SRNA>(handler, cmd::RetryDec{ (KeySlot)command->p1 });
+			command = &relationship.begin(result.akmEvent, result.srcAddr, relationship.time());
+			continue;
+		}
+
+		HeldCommand<SK> held;
+		std::optional<Task<void>> pending;
+		akm::visit<SK>(*command, [&handler, &held, &pending](const auto& typed)
+		{
+			using Cmd = std::decay_t<decltype(typed)>;
+			if constexpr (std::is_same_v<Cmd, cmd::RetryDec>)
+				(void)typed;
+			else if constexpr (IsTask<decltype(invoke(handler, typed))>::value)
+				pending.emplace(invoke(handler, held.template emplace<Cmd>(typed)));
+			else
+				invoke(handler, typed);
+		});
+		if (pending)
+			co_await std::move(*pending);
+		command = &relationship.next();
+	}
+	co_return (AKMStatus)command->p1;
+}
+
+} // namespace detail
+
+// Coroutine counterpart of Relationship::init(), handlers may return Task<void> (or Task<RetryResult> for RetryDec)
+// to suspend processing, e.g. while a key is installed on a crypto offload device.
+// The relationship, the handler and all pointed-to data must outlive the task, and no other step of the same
+// relationship may run until the task completes.
+template<uint8_t SRNA, uint8_t SK, class Handler>
+Task<AKMStatus> init(Relationship<SRNA, SK>& relationship, const AKMConfigParams& params, const AKMParameterDataVector& pdv, const Address<SRNA>* nodeAddresses, uint16_t nodeNum, const Address<SRNA>& selfNodeAddress, akm_time_t time_ms, Handler& handler)
+{
+	AKMStatus status = relationship.start(params, pdv, nodeAddresses, nodeNum, selfNodeAddress, time_ms);
+	if (status == AKMStSuccess)
+		status = co_await detail::drive(relationship, handler);
+	if (status != AKMStSuccess)
+		relationship.reset();
+	co_return status;
+}
+
+// Coroutine counterpart of Relationship::process(), with the same requirements as init()
+template<uint8_t SRNA, uint8_t SK, class Handler>
+Task<AKMStatus> process(Relationship<SRNA, SK>& relationship, AKMEvent akmEvent, const Address<SRNA>* srcAddr, akm_time_t time_ms, Handler& handler)
+{
+	relationship.begin(akmEvent, srcAddr, time_ms);
+	co_return co_await detail::drive(relationship, handler);
+}
+
+} // namespace akm::coro
+
+#endif
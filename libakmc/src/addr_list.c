@@ -4,6 +4,8 @@
 
 
 #include "addr_list.h"
+#include "endianness.h"
+#include "mem_alloc.h"
 #include "utilities.h"
 #include <string.h>
 
@@ -27,6 +29,10 @@ static inline int addrlist_cmp_addrs_rev(const uint8_t* const p, const uint8_t*
 	return 0;
 }
 
+int addrlist_cmp_raw(const uint8_t* const p, const uint8_t* const q, const int addrSize) {
+	return addrlist_cmp_addrs_rev(p + addrSize - 1, q + addrSize - 1, -addrSize);
+}
+
 int addrlist_check_sorted_nodups_raw(const uint8_t* const buffer, const int addrNum, const int addrSize) {
 	if(unlikely(addrSize < 1))
 		return -1;
@@ -45,11 +51,17 @@ int addrlist_check_sorted_nodups_raw(const uint8_t* const buffer, const int addr
 
 static int addrlist_find_idx_raw_generic(const uint8_t* const buffer, const int addrNum, const int addrSize, const uint8_t* const address);
 static int addrlist_find_idx_raw_size_1B(const uint8_t* const buffer, const int addrNum, const int addrSize, const uint8_t* const address);
+static int addrlist_find_idx_raw_size_2B(const uint8_t* const buffer, const int addrNum, const int addrSize, const uint8_t* const address);
+static int addrlist_find_idx_raw_size_4B(const uint8_t* const buffer, const int addrNum, const int addrSize, const uint8_t* const address);
 
 int addrlist_find_idx_raw(const uint8_t* const buffer, const int addrNum, const int addrSize, const uint8_t* const address) {
 	switch(addrSize) {
 		case 1:
 			return addrlist_find_idx_raw_size_1B(buffer, addrNum, addrSize, address);
+		case 2:
+			return addrlist_find_idx_raw_size_2B(buffer, addrNum, addrSize, address);
+		case 4:
+			return addrlist_find_idx_raw_size_4B(buffer, addrNum, addrSize, address);
 		default:
 			return addrlist_find_idx_raw_generic(buffer, addrNum, addrSize, address);
 	}
@@ -93,3 +105,87 @@ int addrlist_find_idx_raw_size_1B(const uint8_t* const buffer, const int addrNum
 	}
 	return -1;
 }
+
+int addrlist_find_idx_raw_size_2B(const uint8_t* const buffer, const int addrNum, const int addrSize, const uint8_t* const address) {
+	(void)addrSize;
+	const uint16_t addressVal = read_le16(address);
+	int l = 0;
+	int r = addrNum;
+	while (l < r) {
+		const int i = l + (r - l) / 2;
+		const uint16_t a = read_le16(buffer + 2 * i);
+		if (addressVal < a)
+			r = i;
+		else if (addressVal > a)
+			l = i + 1;
+		else
+			return i;
+	}
+	return -1;
+}
+
+int addrlist_find_idx_raw_size_4B(const uint8_t* const buffer, const int addrNum, const int addrSize, const uint8_t* const address) {
+	(void)addrSize;
+	const uint32_t addressVal = read_le32(address);
+	int l = 0;
+	int r = addrNum;
+	while (l < r) {
+		const int i = l + (r - l) / 2;
+		const uint32_t a = read_le32(buffer + 4 * i);
+		if (addressVal < a)
+			r = i;
+		else if (addressVal > a)
+			l = i + 1;
+		else
+			return i;
+	}
+	return -1;
+}
+
+int addrlist_sort_dedup_raw(uint8_t* const buffer, const int addrNum, const int addrSize) {
+	if(unlikely(addrSize < 1 || addrNum < 0))
+		return -1;
+	if(addrNum < 2)
+		return addrNum;
+	const size_t bytes = (size_t)addrNum * (size_t)addrSize;
+	uint8_t* const tmp = (uint8_t*)mem_alloc(bytes);
+	if(unlikely(!tmp))
+		return -1;
+	uint8_t* src = buffer;
+	uint8_t* dst = tmp;
+	for(int width = 1; width < addrNum; width *= 2) {
+		for(int lo = 0; lo < addrNum; lo += 2 * width) {
+			const int mid = (lo + width < addrNum) ? lo + width : addrNum;
+			const int hi = (lo + 2 * width < addrNum) ? lo + 2 * width : addrNum;
+			int i = lo;
+			int j = mid;
+			uint8_t* out = dst + (size_t)lo * addrSize;
+			while(i < mid && j < hi) {
+				if(addrlist_cmp_raw(src + (size_t)j * addrSize, src + (size_t)i * addrSize, addrSize) < 0)
+					memcpy(out, src + (size_t)(j++) * addrSize, addrSize);
+				else
+					memcpy(out, src + (size_t)(i++) * addrSize, addrSize);
+				out += addrSize;
+			}
+			memcpy(out, src + (size_t)i * addrSize, (size_t)(mid - i) * addrSize);
+			out += (size_t)(mid - i) * addrSize;
+			memcpy(out, src + (size_t)j * addrSize, (size_t)(hi - j) * addrSize);
+		}
+		uint8_t* const t = src;
+		src = dst;
+		dst = t;
+	}
+	if(src != buffer)
+		memcpy(buffer, src, bytes);
+	mem_free(tmp, bytes);
+	int n = 1;
+	for(int i = 1; i < addrNum; ++i) {
+		const uint8_t* const p = buffer + (size_t)i * addrSize;
+		if(addrlist_cmp_raw(buffer + (size_t)(n - 1) * addrSize, p, addrSize) != 0) {
+			if(n != i)
+				memcpy(buffer + (size_t)n * addrSize, p, addrSize);
+			++n;
+		}
+	}
+	return n;
+}
@@ -15,6 +15,10 @@ int addrlist_check_sorted_nodups_raw(const uint8_t* const buffer, const int addr
 
 int addrlist_find_idx_raw(const uint8_t* const buffer, const int addrNum, const int addrSize, const uint8_t* const address);
 
+int addrlist_cmp_raw(const uint8_t* const p, const uint8_t* const q, const int addrSize);
+
+int addrlist_sort_dedup_raw(uint8_t* const buffer, const int addrNum, const int addrSize);
+
 static inline int addrlist_find_idx_vec(const bytevector* const vec, const int addrSize, const uint8_t* const address)
 {
 	return addrlist_find_idx_raw(vec->buffer, (int)(vec->size / addrSize), addrSize, address);
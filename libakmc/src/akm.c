@@ -5,13 +5,16 @@
 
 #include "akm_internal.h"
 #include "akm_core.h"
+#include "mem_alloc.h"
+#include "utilities.h"
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 
-static void cMain(struct AKMProcessCtx* ctx);
-static void cInit0(struct AKMProcessCtx* ctx);
+#define AKM_STEP_DECL(name) static void c##name(struct AKMProcessCtx* ctx);
+AKM_STEPS(AKM_STEP_DECL)
+#undef AKM_STEP_DECL
 
 static inline int getAddrSize(struct AKMProcessCtx* ctx)
 {
@@ -22,14 +25,14 @@ static inline int findSrcNodeIdx(struct AKMProcessCtx* ctx)
 {
 	if (!ctx->srcAddr)
 		return -1;
-	return addrlist_find_idx_vec(&ctx->relationship->nodeAddresses, getAddrSize(ctx), ctx->srcAddr);
+	return addrlist_find_idx_raw(relNodeAddresses(ctx->relationship), ctx->relationship->config.N, getAddrSize(ctx), ctx->srcAddr);
 }
 
-static void uncountNodeSubCounters(struct RelSubCounters* relCnts, const struct NodeSubCounters* nodeCnts)
+static void uncountNodeSubCounters(struct RelSubCounters* relCnts, unsigned states)
 {
 	for (int i = 0; i < AKM_NUM_OF_STATES; ++i)
 	{
-		if (nodeCnts->cnts[i])
+		if (states & (1u << i))
 		{
 			relCnts->nodes[i]--;
 			assert(relCnts->nodes[i] >= 0);
@@ -37,24 +40,29 @@ static void uncountNodeSubCounters(struct RelSubCounters* relCnts, const struct
 	}
 }
 
-static void uncountNodeCounters(struct RelCounters* relCnts, const struct NodeCounters* nodeCnts)
+static void uncountNodeByIdx(struct AKMRelationship* relationship, int idx)
 {
-	uncountNodeSubCounters(&relCnts->normal, &nodeCnts->normal);
-	uncountNodeSubCounters(&relCnts->fallback, &nodeCnts->fallback);
+	const struct NodeCounters* cnts = NodeCntsVec_elem(&relationship->nodeCounters, (size_t)idx);
+	const unsigned states = nodeCountersStates(cnts, relationship->countersEpoch);
+	if (!states)
+		return;
+	uncountNodeSubCounters(&relationship->relCounters.normal, states);
+	uncountNodeSubCounters(&relationship->relCounters.fallback, states >> AKM_NUM_OF_STATES);
 }
 
-static void uncountNodeByIdx(struct AKMProcessCtx* ctx, int idx)
+static void setRetStatus(struct AKMProcessCtx* ctx, enum AKMStatus status)
 {
-	struct NodeCounters* cnts = NodeCntsVec_elem(&ctx->relationship->nodeCounters, (size_t)idx);
-	uncountNodeCounters(&ctx->relationship->relCounters, cnts);
+	ctx->relationship->proc.status = status;
 }
 
-static void removeNodeByIdx(struct AKMProcessCtx* ctx, int idx)
+static bool removeNodeByIdx(struct AKMProcessCtx* ctx, int idx)
 {
 	if (idx < 0)
-		return;
-	uncountNodeByIdx(ctx, idx);
-	addrlist_remove_by_idx_vec(&ctx->relationship->nodeAddresses, getAddrSize(ctx), idx);
+		return true;
+	if (!relOwnNodeAddresses(ctx->relationship))
+		return false;
+	uncountNodeByIdx(ctx->relationship, idx);
+	NodeAddrVec_erase(&ctx->relationship->nodeAddresses, (size_t)idx * getAddrSize(ctx), getAddrSize(ctx));
 	akm_time_vec_erase(&ctx->relationship->nodeLastRcvTimes, (size_t)idx, 1);
 	NodeCntsVec_erase(&ctx->relationship->nodeCounters, (size_t)idx, 1);
 	ctx->relationship->config.N--;
@@ -65,6 +73,7 @@ static void removeNodeByIdx(struct AKMProcessCtx* ctx, int idx)
 		proc->recvFrameSrcNodeIdx--;
 	else if (idx == proc->recvFrameSrcNodeIdx)
 		proc->recvFrameSrcNodeIdx = -1;
+	return true;
 }
 
 static void setLastReceptionTimeForAllNodes(struct AKMProcessCtx* ctx)
@@ -73,6 +82,7 @@ static void setLastReceptionTimeForAllNodes(struct AKMProcessCtx* ctx)
 	akm_time_t* nodeTimes = akm_time_vec_elem(&ctx->relationship->nodeLastRcvTimes, 0);
 	for (int i = 0; i < nodeCnt; ++i)
 		nodeTimes[i] = ctx->time_ms;
+	ctx->relationship->oldestNodeRcvTime = (nodeCnt > 1) ? ctx->time_ms : AKM_TIME_MAX;
 }
 
 static void removeTimedOutNodes(struct AKMProcessCtx* ctx)
@@ -82,6 +92,7 @@ static void removeTimedOutNodes(struct AKMProcessCtx* ctx)
 	ctx->relationship->proc.skipTimeOutNodesRemoval = true;
 	const akm_time_t timeout = ctx->relationship->config.NNRT;
 	akm_time_t* nodeTimes = akm_time_vec_elem(&ctx->relationship->nodeLastRcvTimes, 0);
+	akm_time_t oldest = AKM_TIME_MAX;
 	for (int i = 0; i < ctx->relationship->config.N; ++i)
 	{
 		if (i == ctx->relationship->selfIdx)
@@ -89,13 +100,22 @@ static void removeTimedOutNodes(struct AKMProcessCtx* ctx)
 		const akm_time_t time_diff_from_last_reception = ctx->time_ms - nodeTimes[i];
 		if (time_diff_from_last_reception > timeout)
 		{
-			removeNodeByIdx(ctx, i);
+			if (!removeNodeByIdx(ctx, i))
+			{
+				setRetStatus(ctx, AKMStNoMemory);
+				return;
+			}
 			--i;
 		}
+		else if (nodeTimes[i] < oldest)
+		{
+			oldest = nodeTimes[i];
+		}
 	}
+	ctx->relationship->oldestNodeRcvTime = oldest;
 }
 
-static bool checkConfiguration(const struct AKMConfiguration* config)
+static bool checkTemplateConfiguration(const struct AKMConfiguration* config)
 {
 	if (!config)
 		return false;
@@ -103,8 +123,6 @@ static bool checkConfiguration(const struct AKMConfiguration* config)
 		return false;
 	if (!config->nodeAddresses)
 		return false;
-	if (!config->selfNodeAddress)
-		return false;
 	if (addrlist_calc_size_check(config->params.N, config->params.SRNA) < 0)
 		return false;
 	if (addrlist_check_sorted_nodups_raw(config->nodeAddresses, config->params.N, config->params.SRNA) < 0)
@@ -112,66 +130,128 @@ static bool checkConfiguration(const struct AKMConfiguration* config)
 	return true;
 }
 
-enum AKMStatus AKMInit(struct AKMProcessCtx* ctx, const struct AKMConfiguration* config)
+static bool checkConfiguration(const struct AKMConfiguration* config)
+{
+	if (!checkTemplateConfiguration(config))
+		return false;
+	if (!config->selfNodeAddress)
+		return false;
+	return true;
+}
+
+enum AKMStatus AKMTemplateCreate(struct AKMTemplate** pTmpl, const struct AKMConfiguration* config)
+{
+	*pTmpl = NULL;
+	if (!checkTemplateConfiguration(config))
+		return AKMStFatalError;
+	int selfNodeIdx = -1;
+	if (config->selfNodeAddress)
+	{
+		selfNodeIdx = addrlist_find_idx_raw(config->nodeAddresses, config->params.N, config->params.SRNA, config->selfNodeAddress);
+		if (selfNodeIdx < 0)
+			return AKMStUnknownSource;
+	}
+	const size_t totalNodeListBytes = (size_t)(config->params.N) * (size_t)(config->params.SRNA);
+	struct AKMTemplate* tmpl = (struct AKMTemplate*)mem_alloc(sizeof(struct AKMTemplate) + totalNodeListBytes);
+	if (!tmpl)
+		return AKMStNoMemory;
+	mem_template_created();
+	tmpl->refCount = 1;
+	memcpy(&tmpl->params, &config->params, sizeof(config->params));
+	memcpy(&tmpl->pdv, config->pdv, sizeof(tmpl->pdv));
+	tmpl->selfIdx = selfNodeIdx;
+	memcpy(tmpl->nodeAddresses, config->nodeAddresses, totalNodeListBytes);
+	*pTmpl = tmpl;
+	return AKMStSuccess;
+}
+
+void AKMTemplateRelease(struct AKMTemplate* tmpl)
+{
+	if (!tmpl)
+		return;
+	if (atomicDecrement(&tmpl->refCount) == 0)
+	{
+		mem_free(tmpl, sizeof(struct AKMTemplate) + (size_t)(tmpl->params.N) * (size_t)(tmpl->params.SRNA));
+		mem_template_freed();
+	}
+}
+
+enum AKMStatus AKMInitFromTemplate(struct AKMProcessCtx* ctx, struct AKMTemplate* tmpl, const void* selfNodeAddress)
 {
 	const akm_time_t tm = ctx->time_ms;
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->time_ms = tm;
-	if (!checkConfiguration(config))
+	if (!tmpl)
 		return AKMStFatalError;
-	const int selfNodeIdx = addrlist_find_idx_raw(config->nodeAddresses, config->params.N, config->params.SRNA, config->selfNodeAddress);
+	int selfNodeIdx = tmpl->selfIdx;
+	if (selfNodeAddress)
+		selfNodeIdx = addrlist_find_idx_raw(tmpl->nodeAddresses, tmpl->params.N, tmpl->params.SRNA, selfNodeAddress);
 	if (selfNodeIdx < 0)
-		return AKMStUnknownSource;
-	struct AKMRelationship* relationship = (struct AKMRelationship*)malloc(sizeof(struct AKMRelationship));
+		return selfNodeAddress ? AKMStUnknownSource : AKMStFatalError;
+	// The key buffer trails the relationship, small rings keep their per-node data inline as well
+	struct AKMRelationship* relationship = (struct AKMRelationship*)mem_alloc(sizeof(struct AKMRelationship) + tmpl->params.SK);
 	if (!relationship)
 		return AKMStNoMemory;
 	memset(relationship, 0, sizeof(*relationship));
+	atomicIncrement(&tmpl->refCount);
+	relationship->tmpl = tmpl;
 	relationship->selfIdx = selfNodeIdx;
-	memcpy(&relationship->config, &config->params, sizeof(config->params));
-	memcpy(&relationship->pdv, config->pdv, sizeof(relationship->pdv));
-	const size_t nodeCnt = config->params.N;
-	const size_t totalNodeListBytes = (size_t)(config->params.N) * (size_t)(config->params.SRNA);
-	relationship->proc.keyBuffer = malloc(config->params.SK);
-	bool mem_ok = !!relationship->proc.keyBuffer;
-	mem_ok = mem_ok && bytevector_resize(&relationship->nodeAddresses, totalNodeListBytes);
-	mem_ok = mem_ok && akm_time_vec_resize(&relationship->nodeLastRcvTimes, nodeCnt);
+	memcpy(&relationship->config, &tmpl->params, sizeof(tmpl->params));
+	const size_t nodeCnt = tmpl->params.N;
+	relationship->proc.keyBuffer = relationship + 1;
+	bool mem_ok = akm_time_vec_resize(&relationship->nodeLastRcvTimes, nodeCnt);
 	mem_ok = mem_ok && NodeCntsVec_resize(&relationship->nodeCounters, nodeCnt);
 	if (!mem_ok)
 	{
 		AKMFree(relationship);
 		return AKMStNoMemory;
 	}
-	memcpy(relationship->nodeAddresses.buffer, config->nodeAddresses, totalNodeListBytes);
+	NodeCntsVec_zero(&relationship->nodeCounters);
 	relationship->proc.machState = AKM_MOffline;
 	relationship->proc.recvFrameSrcNodeIdx = -1;
 	relationship->proc.recvFrameEvent = AKMEvNone;
 	relationship->proc.status = AKMStSuccess;
 	ctx->relationship = relationship;
 	ctx->akmEvent = AKMEvNone;
-	setContinuation(ctx, cInit0);
+	setContinuation(ctx, AKM_StepInit0);
 	return AKMStSuccess;
 }
 
+enum AKMStatus AKMInit(struct AKMProcessCtx* ctx, const struct AKMConfiguration* config)
+{
+	const akm_time_t tm = ctx->time_ms;
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->time_ms = tm;
+	if (!checkConfiguration(config))
+		return AKMStFatalError;
+	struct AKMTemplate* tmpl;
+	enum AKMStatus status = AKMTemplateCreate(&tmpl, config);
+	if (status != AKMStSuccess)
+		return status;
+	status = AKMInitFromTemplate(ctx, tmpl, NULL);
+	AKMTemplateRelease(tmpl);
+	return status;
+}
+
 void AKMGetConfig(struct AKMRelationship* relationship, struct AKMConfiguration* config)
 {
 	memcpy(&config->params, &relationship->config, sizeof(relationship->config));
 	if (config->pdv)
 	{
-		memcpy(config->pdv, &relationship->pdv, sizeof(relationship->pdv));
+		memcpy(config->pdv, relPdv(relationship), sizeof(*config->pdv));
 	}
 	if (config->nodeAddresses)
 	{
 		const size_t addrListLen = (size_t)(relationship->config.N) * (size_t)(relationship->config.SRNA);
-		assert(addrListLen == relationship->nodeAddresses.size);
-		memcpy(config->nodeAddresses, relationship->nodeAddresses.buffer, addrListLen);
+		assert(!relationship->nodeAddresses.vec.buffer || addrListLen == relationship->nodeAddresses.vec.size);
+		memcpy(config->nodeAddresses, relNodeAddresses(relationship), addrListLen);
 	}
 	if (config->selfNodeAddress)
 	{
 		assert(relationship->selfIdx >= 0 && relationship->selfIdx < relationship->config.N);
 		const size_t srna = relationship->config.SRNA;
 		const size_t selfAddrOffset = (size_t)(relationship->selfIdx) * srna;
-		assert(selfAddrOffset + srna <= relationship->nodeAddresses.size);
-		memcpy(config->selfNodeAddress, bytevector_getptr(&relationship->nodeAddresses, selfAddrOffset), srna);
+		memcpy(config->selfNodeAddress, relNodeAddresses(relationship) + selfAddrOffset, srna);
 	}
 }
 
@@ -179,11 +259,178 @@ void AKMFree(struct AKMRelationship* relationship)
 {
 	if (!relationship)
 		return;
-	bytevector_free(&relationship->nodeAddresses);
+	NodeAddrVec_free(&relationship->nodeAddresses);
 	akm_time_vec_free(&relationship->nodeLastRcvTimes);
 	NodeCntsVec_free(&relationship->nodeCounters);
-	free(relationship->proc.keyBuffer);
-	free(relationship);
+	relReplicaFree(relationship);
+	AKMTemplateRelease(relationship->tmpl);
+	mem_free(relationship, sizeof(*relationship) + relationship->config.SK);
+}
+
+static void freeNodeBatch(const struct AKMRelationship* relationship, uint8_t* batch, uint16_t nodeNum)
+{
+	mem_free(batch, (size_t)nodeNum * (size_t)(relationship->config.SRNA));
+}
+
+static enum AKMStatus copySortedNodeBatch(const struct AKMRelationship* relationship, const void* nodeAddresses, uint16_t nodeNum, uint8_t** pBatch, int* pBatchNum)
+{
+	*pBatch = NULL;
+	*pBatchNum = 0;
+	if (!relationship || (nodeNum > 0 && !nodeAddresses) || !isProcessingIdle(relationship))
+		return AKMStFatalError;
+	if (nodeNum < 1)
+		return AKMStSuccess;
+	const int srna = relationship->config.SRNA;
+	uint8_t* const batch = (uint8_t*)mem_alloc((size_t)nodeNum * (size_t)srna);
+	if (!batch)
+		return AKMStNoMemory;
+	memcpy(batch, nodeAddresses, (size_t)nodeNum * (size_t)srna);
+	const int batchNum = addrlist_sort_dedup_raw(batch, nodeNum, srna);
+	if (batchNum < 0)
+	{
+		mem_free(batch, (size_t)nodeNum * (size_t)srna);
+		return AKMStNoMemory;
+	}
+	*pBatch = batch;
+	*pBatchNum = batchNum;
+	return AKMStSuccess;
+}
+
+static bool resizeNodeArrays(struct AKMRelationship* relationship, size_t nodeCnt)
+{
+	const size_t oldNodeCnt = relationship->config.N;
+	const size_t srna = relationship->config.SRNA;
+	bool mem_ok = NodeAddrVec_resize(&relationship->nodeAddresses, nodeCnt * srna);
+	mem_ok = mem_ok && akm_time_vec_resize(&relationship->nodeLastRcvTimes, nodeCnt);
+	mem_ok = mem_ok && NodeCntsVec_resize(&relationship->nodeCounters, nodeCnt);
+	if (!mem_ok)
+	{
+		NodeAddrVec_resize(&relationship->nodeAddresses, oldNodeCnt * srna);
+		akm_time_vec_resize(&relationship->nodeLastRcvTimes, oldNodeCnt);
+		NodeCntsVec_resize(&relationship->nodeCounters, oldNodeCnt);
+	}
+	return mem_ok;
+}
+
+enum AKMStatus AKMAddNodes(struct AKMRelationship* relationship, const void* nodeAddresses, uint16_t nodeNum, akm_time_t time_ms)
+{
+	uint8_t* batch;
+	int batchNum;
+	const enum AKMStatus status = copySortedNodeBatch(relationship, nodeAddresses, nodeNum, &batch, &batchNum);
+	if (status != AKMStSuccess || batchNum < 1)
+		return status;
+	const int srna = relationship->config.SRNA;
+	const int oldNum = relationship->config.N;
+	const uint8_t* const members = relNodeAddresses(relationship);
+	int newNum = 0;
+	for (int i = 0, j = 0; j < batchNum; ++j)
+	{
+		const uint8_t* const addr = batch + (size_t)j * srna;
+		while (i < oldNum && addrlist_cmp_raw(members + (size_t)i * srna, addr, srna) < 0)
+			++i;
+		if (i < oldNum && addrlist_cmp_raw(members + (size_t)i * srna, addr, srna) == 0)
+			continue;
+		if (newNum != j)
+			memcpy(batch + (size_t)newNum * srna, addr, srna);
+		++newNum;
+	}
+	const int totalNum = oldNum + newNum;
+	if (newNum < 1 || totalNum > UINT16_MAX || addrlist_calc_size_check(totalNum, srna) < 0)
+	{
+		freeNodeBatch(relationship, batch, nodeNum);
+		return (newNum < 1) ? AKMStSuccess : AKMStFatalError;
+	}
+	if (!relOwnNodeAddresses(relationship) || !resizeNodeArrays(relationship, (size_t)totalNum))
+	{
+		freeNodeBatch(relationship, batch, nodeNum);
+		return AKMStNoMemory;
+	}
+	uint8_t* const addrs = (uint8_t*)relationship->nodeAddresses.vec.buffer;
+	akm_time_t* const nodeTimes = akm_time_vec_elem(&relationship->nodeLastRcvTimes, 0);
+	struct NodeCounters* const nodeCnts = NodeCntsVec_elem(&relationship->nodeCounters, 0);
+	int selfIdx = relationship->selfIdx;
+	int i = oldNum - 1;
+	int j = newNum - 1;
+	for (int k = totalNum - 1; j >= 0; --k)
+	{
+		if (i >= 0 && addrlist_cmp_raw(addrs + (size_t)i * srna, batch + (size_t)j * srna, srna) > 0)
+		{
+			memcpy(addrs + (size_t)k * srna, addrs + (size_t)i * srna, srna);
+			nodeTimes[k] = nodeTimes[i];
+			nodeCnts[k] = nodeCnts[i];
+			if (i == relationship->selfIdx)
+				selfIdx = k;
+			--i;
+		}
+		else
+		{
+			memcpy(addrs + (size_t)k * srna, batch + (size_t)j * srna, srna);
+			nodeTimes[k] = time_ms;
+			memset(&nodeCnts[k], 0, sizeof(nodeCnts[k]));
+			--j;
+		}
+	}
+	freeNodeBatch(relationship, batch, nodeNum);
+	relationship->config.N = (uint16_t)totalNum;
+	relationship->selfIdx = selfIdx;
+	if (time_ms < relationship->oldestNodeRcvTime)
+		relationship->oldestNodeRcvTime = time_ms;
+	return AKMStSuccess;
+}
+
+enum AKMStatus AKMRemoveNodes(struct AKMRelationship* relationship, const void* nodeAddresses, uint16_t nodeNum)
+{
+	uint8_t* batch;
+	int batchNum;
+	const enum AKMStatus status = copySortedNodeBatch(relationship, nodeAddresses, nodeNum, &batch, &batchNum);
+	if (status != AKMStSuccess || batchNum < 1)
+		return status;
+	const int srna = relationship->config.SRNA;
+	const int oldNum = relationship->config.N;
+	if (addrlist_find_idx_raw(batch, batchNum, srna, relNodeAddresses(relationship) + (size_t)relationship->selfIdx * srna) >= 0)
+	{
+		freeNodeBatch(relationship, batch, nodeNum);
+		return AKMStFatalError;
+	}
+	if (!relOwnNodeAddresses(relationship))
+	{
+		freeNodeBatch(relationship, batch, nodeNum);
+		return AKMStNoMemory;
+	}
+	uint8_t* const addrs = (uint8_t*)relationship->nodeAddresses.vec.buffer;
+	akm_time_t* const nodeTimes = akm_time_vec_elem(&relationship->nodeLastRcvTimes, 0);
+	struct NodeCounters* const nodeCnts = NodeCntsVec_elem(&relationship->nodeCounters, 0);
+	int selfIdx = relationship->selfIdx;
+	int k = 0;
+	for (int i = 0, j = 0; i < oldNum; ++i)
+	{
+		const uint8_t* const addr = addrs + (size_t)i * srna;
+		while (j < batchNum && addrlist_cmp_raw(batch + (size_t)j * srna, addr, srna) < 0)
+			++j;
+		if (j < batchNum && addrlist_cmp_raw(batch + (size_t)j * srna, addr, srna) == 0)
+		{
+			uncountNodeByIdx(relationship, i);
+			++j;
+			continue;
+		}
+		if (k != i)
+		{
+			memcpy(addrs + (size_t)k * srna, addr, srna);
+			nodeTimes[k] = nodeTimes[i];
+			nodeCnts[k] = nodeCnts[i];
+		}
+		if (i == relationship->selfIdx)
+			selfIdx = k;
+		++k;
+	}
+	freeNodeBatch(relationship, batch, nodeNum);
+	if (k != oldNum)
+	{
+		resizeNodeArrays(relationship, (size_t)k);
+		relationship->config.N = (uint16_t)k;
+		relationship->selfIdx = selfIdx;
+	}
+	return AKMStSuccess;
 }
 
 static void yieldProcess(struct AKMProcessCtx* ctx, enum AKMCmdOpcode opcode, int p1, int p2, const void* data)
@@ -196,11 +443,6 @@ static void yieldProcess(struct AKMProcessCtx* ctx, enum AKMCmdOpcode opcode, in
 	ctx->cmd.data = data;
 }
 
-static void setRetStatus(struct AKMProcessCtx* ctx, enum AKMStatus status)
-{
-	ctx->relationship->proc.status = status;
-}
-
 static void yieldOpUseKeys(struct AKMProcessCtx* ctx, enum AKMKey encKey, enum AKMKey decKey)
 {
 	struct ProcessingInfo* proc = &ctx->relationship->proc;
@@ -219,11 +461,58 @@ static void yieldOpRetryDec(struct AKMProcessCtx* ctx, enum AKMKey decTryKey)
 	yieldProcess(ctx, AKMCmdOpRetryDec, decTryKey, 0, NULL);
 }
 
+static inline void runStep(struct AKMProcessCtx* ctx, enum AKMStep step)
+{
+	assume(step > AKM_StepNone && step < AKM_STEPS_NUM);
+	switch (step)
+	{
+#define AKM_STEP_CASE(name) case AKM_Step##name: c##name(ctx); break;
+	AKM_STEPS(AKM_STEP_CASE)
+#undef AKM_STEP_CASE
+	default:
+		assert(false);
+		break;
+	}
+}
+
+#ifndef AKM_NO_FAST_PATH
+
+// True if the event would pass through cMain and handleProcFin without any effect: Established steady state
+// with SE traffic or a timer tick, nothing pending and no node about to time out
+static inline bool isNoOpEvent(const struct AKMProcessCtx* ctx)
+{
+	const struct AKMRelationship* relationship = ctx->relationship;
+	const struct ProcessingInfo* proc = &relationship->proc;
+	return (ctx->akmEvent == AKMEvRecvSE || ctx->akmEvent == AKMEvTimeOut)
+		&& proc->machState == AKM_MEstablished
+		&& proc->contStack.topIdx == 0
+		&& proc->contStack.stack[0] == AKM_StepMain
+		&& proc->status == AKMStSuccess
+		&& !proc->validNextTimeout
+		&& proc->sendOk == 1 && proc->sendEvent == AKM_SE
+		&& proc->decTryKey == proc->decKey
+		&& ctx->time_ms - relationship->oldestNodeRcvTime <= relationship->config.NNRT;
+}
+
+#endif
+
 void AKMProcess(struct AKMProcessCtx* ctx)
 {
+#ifndef AKM_NO_FAST_PATH
+	if (likely(isNoOpEvent(ctx)))
+	{
+		ctx->akmEvent = AKMEvNone;
+		ctx->srcAddr = NULL;
+		ctx->cmd.opcode = AKMCmdOpReturn;
+		ctx->cmd.p1 = AKMStSuccess;
+		ctx->cmd.p2 = 0;
+		ctx->cmd.data = NULL;
+		return;
+	}
+#endif
 	do
 	{
-		getContinuation(ctx)(ctx);
+		runStep(ctx, getContinuation(ctx));
 		ctx->akmEvent = AKMEvNone;
 		ctx->srcAddr = NULL;
 	}
@@ -252,9 +541,19 @@ static void cDoUseNFSK(struct AKMProcessCtx* ctx) { xcDoUseKey(ctx, AKM_NFSK); }
 
 static void incrementNodeCnt(struct AKMProcessCtx* ctx, int nodeIdx, enum AKMSysState sysState)
 {
-	struct NodeSubCounters* cnts = nodeSubCounters(NodeCntsVec_elem(&ctx->relationship->nodeCounters, nodeIdx), ctx->relationship->proc.machState);
-	if (cnts->cnts[sysState]++ < 1)
+	struct NodeCounters* cnts = NodeCntsVec_elem(&ctx->relationship->nodeCounters, nodeIdx);
+	const uint16_t epoch = ctx->relationship->countersEpoch;
+	if (cnts->epoch != epoch)
+	{
+		cnts->epoch = epoch;
+		cnts->states = 0;
+	}
+	const uint8_t bit = nodeStateBit((enum AKMMachState)ctx->relationship->proc.machState, sysState);
+	if (!(cnts->states & bit))
+	{
+		cnts->states |= bit;
 		relSubCounters(&ctx->relationship->relCounters, ctx->relationship->proc.machState)->nodes[sysState]++;
+	}
 }
 
 static void countNodeState(struct AKMProcessCtx* ctx, int nodeIdx, enum AKMSysState nodeSysState)
@@ -305,7 +604,7 @@ static void switchToNormalEstablishing(struct AKMProcessCtx* ctx)
 
 void cInit0(struct AKMProcessCtx* ctx)
 {
-	setContinuation(ctx, cMain);
+	setContinuation(ctx, AKM_StepMain);
 	switchToNormalEstablishing(ctx);
 }
 
@@ -380,12 +679,9 @@ static void handleCannotDecryptFin(struct AKMProcessCtx* ctx)
 	ctx->relationship->proc.decTryKey = ctx->relationship->proc.decKey;
 }
 
-static void cRetryDec(struct AKMProcessCtx* ctx);
-static void cRetryDecTryFb(struct AKMProcessCtx* ctx);
-
 static void retryWithFallbackKey(struct AKMProcessCtx* ctx)
 {
-	pushContinuation(ctx, cRetryDecTryFb);
+	pushContinuation(ctx, AKM_StepRetryDecTryFb);
 	yieldOpRetryDec(ctx, AKM_CFSK);
 }
 
@@ -405,7 +701,7 @@ void handleEvCannotDecrypt(struct AKMProcessCtx* ctx)
 		{
 		case AKM_SEI:
 		case AKM_SEC:
-			pushContinuation(ctx, cRetryDec);
+			pushContinuation(ctx, AKM_StepRetryDec);
 			yieldOpRetryDec(ctx, ((proc->decKey == AKM_CSK) ? AKM_NSK : AKM_CSK));
 			break;
 		default:
@@ -418,7 +714,7 @@ void handleEvCannotDecrypt(struct AKMProcessCtx* ctx)
 		{
 		case AKM_SEI:
 		case AKM_SEC:
-			pushContinuation(ctx, cRetryDec);
+			pushContinuation(ctx, AKM_StepRetryDec);
 			yieldOpRetryDec(ctx, ((proc->decKey == AKM_CFSK) ? AKM_NFSK : AKM_CFSK));
 			break;
 		default:
@@ -439,7 +735,7 @@ void cRetryDec(struct AKMProcessCtx* ctx)
 	case AKMEvRecvSEI:
 	case AKMEvRecvSEC:
 	case AKMEvRecvSEF:
-		pushContinuation(ctx, cDoUseDecTryKeyAsDecKey);
+		pushContinuation(ctx, AKM_StepDoUseDecTryKeyAsDecKey);
 		handleEvRecv(ctx);
 		break;
 	case AKMEvCannotDecrypt:
@@ -449,7 +745,7 @@ void cRetryDec(struct AKMProcessCtx* ctx)
 		}
 		else
 		{
-			pushContinuation(ctx, cRetryDecTryFb);
+			pushContinuation(ctx, AKM_StepRetryDecTryFb);
 			yieldOpRetryDec(ctx, AKM_CFSK);
 		}
 		break;
@@ -481,8 +777,6 @@ void cRetryDecTryFb(struct AKMProcessCtx* ctx)
 	}
 }
 
-static void cDoHandleRecvEv0(struct AKMProcessCtx* ctx);
-
 static void handleEvRecv(struct AKMProcessCtx* ctx)
 {
 	struct ProcessingInfo* proc = &ctx->relationship->proc;
@@ -498,16 +792,14 @@ static void handleEvRecv(struct AKMProcessCtx* ctx)
 	case AKM_MFallbackEstablishing:
 		proc->recvFrameEvent = ctx->akmEvent;
 		proc->recvFrameSrcNodeIdx = findSrcNodeIdx(ctx);
-		pushContinuation(ctx, cDoHandleRecvEv0);
+		pushContinuation(ctx, AKM_StepDoHandleRecvEv0);
 		break;
 	}
 }
 
-static void cDoHandleRecvEv1(struct AKMProcessCtx* ctx);
-
 static void cDoHandleRecvEv0(struct AKMProcessCtx* ctx)
 {
-	setContinuation(ctx, cDoHandleRecvEv1);
+	setContinuation(ctx, AKM_StepDoHandleRecvEv1);
 	handleLocalSEI(ctx);
 }
 
@@ -540,6 +832,8 @@ static void cDoHandleRecvEv1(struct AKMProcessCtx* ctx)
 	else
 	{
 		*akm_time_vec_elem(&ctx->relationship->nodeLastRcvTimes, proc->recvFrameSrcNodeIdx) = ctx->time_ms;
+		if (ctx->time_ms < ctx->relationship->oldestNodeRcvTime && proc->recvFrameSrcNodeIdx != ctx->relationship->selfIdx)
+			ctx->relationship->oldestNodeRcvTime = ctx->time_ms;
 		countNodeState(ctx, proc->recvFrameSrcNodeIdx, recvEventToSysState((enum AKMEvent)proc->recvFrameEvent));
 	}
 }
@@ -547,21 +841,21 @@ static void cDoHandleRecvEv1(struct AKMProcessCtx* ctx)
 static void cDoGenNSK(struct AKMProcessCtx* ctx)
 {
 	popContinuation(ctx);
-	AKM_ProcessRandomDataSet(&ctx->relationship->pdv, ctx->relationship->config.CSS, ctx->relationship->proc.keyBuffer, ctx->relationship->config.SK, &ctx->relationship->config.NSS);
+	AKM_ProcessRandomDataSet(relPdv(ctx->relationship), ctx->relationship->config.CSS, ctx->relationship->proc.keyBuffer, ctx->relationship->config.SK, &ctx->relationship->config.NSS);
 	yieldProcess(ctx, AKMCmdOpSetKey, AKM_NSK, ctx->relationship->config.SK, ctx->relationship->proc.keyBuffer);
 }
 
 static void cDoGenNFSK(struct AKMProcessCtx* ctx)
 {
 	popContinuation(ctx);
-	AKM_ProcessRandomDataSet(&ctx->relationship->pdv, ctx->relationship->config.FSS, ctx->relationship->proc.keyBuffer, ctx->relationship->config.SK, &ctx->relationship->config.NFSS);
+	AKM_ProcessRandomDataSet(relPdv(ctx->relationship), ctx->relationship->config.FSS, ctx->relationship->proc.keyBuffer, ctx->relationship->config.SK, &ctx->relationship->config.NFSS);
 	yieldProcess(ctx, AKMCmdOpSetKey, AKM_NFSK, ctx->relationship->config.SK, ctx->relationship->proc.keyBuffer);
 }
 
 static void cDoGenCFSK(struct AKMProcessCtx* ctx)
 {
 	popContinuation(ctx);
-	AKM_ProcessRandomDataSet(&ctx->relationship->pdv, ctx->relationship->config.SFSS, ctx->relationship->proc.keyBuffer, ctx->relationship->config.SK, &ctx->relationship->config.FSS);
+	AKM_ProcessRandomDataSet(relPdv(ctx->relationship), ctx->relationship->config.SFSS, ctx->relationship->proc.keyBuffer, ctx->relationship->config.SK, &ctx->relationship->config.FSS);
 	yieldProcess(ctx, AKMCmdOpSetKey, AKM_CFSK, ctx->relationship->config.SK, ctx->relationship->proc.keyBuffer);
 }
 
@@ -589,21 +883,21 @@ static void cDoMoveNFSKToCSK(struct AKMProcessCtx* ctx)
 
 static void regenerateKeysDuringNormalEstablishment(struct AKMProcessCtx* ctx)
 {
-	pushContinuation(ctx, cDoClearKeyBuffer);
-	pushContinuation(ctx, cDoGenNFSK);
-	pushContinuation(ctx, cDoGenNSK);
-	pushContinuation(ctx, cDoUseCSK);
-	pushContinuation(ctx, cDoMoveNSKToCSK);
+	pushContinuation(ctx, AKM_StepDoClearKeyBuffer);
+	pushContinuation(ctx, AKM_StepDoGenNFSK);
+	pushContinuation(ctx, AKM_StepDoGenNSK);
+	pushContinuation(ctx, AKM_StepDoUseCSK);
+	pushContinuation(ctx, AKM_StepDoMoveNSKToCSK);
 }
 
 static void regenerateKeysDuringFallbackEstablishment(struct AKMProcessCtx* ctx)
 {
-	pushContinuation(ctx, cDoClearKeyBuffer);
-	pushContinuation(ctx, cDoGenNFSK);
-	pushContinuation(ctx, cDoGenNSK);
-	pushContinuation(ctx, cDoGenCFSK);
-	pushContinuation(ctx, cDoUseCSK);
-	pushContinuation(ctx, cDoMoveNFSKToCSK);
+	pushContinuation(ctx, AKM_StepDoClearKeyBuffer);
+	pushContinuation(ctx, AKM_StepDoGenNFSK);
+	pushContinuation(ctx, AKM_StepDoGenNSK);
+	pushContinuation(ctx, AKM_StepDoGenCFSK);
+	pushContinuation(ctx, AKM_StepDoUseCSK);
+	pushContinuation(ctx, AKM_StepDoMoveNFSKToCSK);
 }
 
 void updateState(struct AKMProcessCtx* ctx)
@@ -651,7 +945,7 @@ void updateState(struct AKMProcessCtx* ctx)
 				incrementNodeCnt(ctx, ctx->relationship->selfIdx, state);
 				if (state == AKM_SEC || state == AKM_SEF)
 				{
-					pushContinuation(ctx, (proc->machState == AKM_MFallbackEstablishing) ? cDoUseNFSK : cDoUseNSK);
+					pushContinuation(ctx, (proc->machState == AKM_MFallbackEstablishing) ? AKM_StepDoUseNFSK : AKM_StepDoUseNSK);
 				}
 				proc->sysState = state;
 				ctx->relationship->lastStateChangeTime = ctx->time_ms;
@@ -771,7 +1065,7 @@ static int checkUpdateSendEvent(struct AKMProcessCtx* ctx, int* pSendEvent)
 
 }
 
-static void doUpdateSendEvent(struct AKMProcessCtx* ctx)
+static void cDoUpdateSendEvent(struct AKMProcessCtx* ctx)
 {
 	popContinuation(ctx);
 	int sendEvent;
@@ -789,7 +1083,7 @@ static void updateSendEvent(struct AKMProcessCtx* ctx)
 	struct ProcessingInfo* proc = &ctx->relationship->proc;
 	if (sendOk != proc->sendOk || sendEvent != proc->sendEvent)
 	{
-		pushContinuation(ctx, doUpdateSendEvent);
+		pushContinuation(ctx, AKM_StepDoUpdateSendEvent);
 	}
 }
 
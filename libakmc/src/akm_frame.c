@@ -0,0 +1,188 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#include "akm.h"
+#include "endianness.h"
+#include "utilities.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define AKM_FRAME_HEADER_FIELDS_NUM AKMFfPayload
+
+static inline bool isHeaderField(enum AKMFrameField field)
+{
+	return (unsigned)field < (unsigned)AKM_FRAME_HEADER_FIELDS_NUM;
+}
+
+static inline size_t lengthFieldEnd(const struct AKMFrameLayout* layout)
+{
+	return (size_t)layout->offset[AKMFfLength] + layout->length[AKMFfLength];
+}
+
+static void writeLengthField(struct AKMFrame* frame)
+{
+	const struct AKMFrameLayout* layout = frame->layout;
+	if (layout->length[AKMFfLength] > 0)
+		write_le_bytes(frame->buffer + layout->offset[AKMFfLength], layout->length[AKMFfLength], (uint64_t)(frame->size - lengthFieldEnd(layout)));
+}
+
+enum AKMStatus AKMFrameLayoutCompile(struct AKMFrameLayout* layout, const struct AKMFrameSchema* schema)
+{
+	memset(layout, 0, sizeof(*layout));
+	if (!schema)
+		return AKMStFatalError;
+	const uint8_t offsets[AKM_FRAME_HEADER_FIELDS_NUM] = {
+		schema->relationshipIdIndex,
+		schema->lengthIndex,
+		schema->sourceAddressIndex,
+		schema->targetAddressIndex,
+		schema->akmEventIndex,
+	};
+	const uint8_t lengths[AKM_FRAME_HEADER_FIELDS_NUM] = {
+		schema->relationshipIdLength,
+		schema->lengthLength,
+		schema->sourceAddressLength,
+		schema->targetAddressLength,
+		schema->akmEventLength,
+	};
+	if (lengths[AKMFfRelationshipId] > sizeof(uint64_t)
+			|| lengths[AKMFfLength] > sizeof(uint64_t)
+			|| lengths[AKMFfEvent] > sizeof(uint64_t))
+		return AKMStFatalError;
+	for (int i = 0; i < AKM_FRAME_HEADER_FIELDS_NUM; ++i)
+	{
+		if (lengths[i] < 1)
+			continue;
+		const int end = offsets[i] + lengths[i];
+		if (end > schema->dataStartIndex)
+			return AKMStFatalError;
+		for (int j = 0; j < i; ++j)
+		{
+			if (lengths[j] < 1)
+				continue;
+			if (offsets[i] < offsets[j] + lengths[j] && offsets[j] < end)
+				return AKMStFatalError;
+		}
+		layout->offset[i] = offsets[i];
+		layout->length[i] = lengths[i];
+	}
+	layout->offset[AKMFfPayload] = schema->dataStartIndex;
+	layout->headerSize = schema->dataStartIndex;
+	layout->length[AKMFfTag] = schema->tagLength;
+	layout->tagSize = schema->tagLength;
+	return AKMStSuccess;
+}
+
+enum AKMStatus AKMFrameParse(struct AKMFrame* frame, const struct AKMFrameLayout* layout, void* buffer, size_t size)
+{
+	frame->layout = layout;
+	frame->buffer = (uint8_t*)buffer;
+	frame->size = 0;
+	frame->capacity = size;
+	const size_t minSize = (size_t)layout->headerSize + layout->tagSize;
+	if (unlikely(size < minSize))
+		return AKMStFatalError;
+	size_t frameSize = size;
+	if (layout->length[AKMFfLength] > 0)
+	{
+		const uint64_t following = read_le_bytes(frame->buffer + layout->offset[AKMFfLength], layout->length[AKMFfLength]);
+		if (unlikely(following > size - lengthFieldEnd(layout)))
+			return AKMStFatalError;
+		frameSize = lengthFieldEnd(layout) + (size_t)following;
+		if (unlikely(frameSize < minSize))
+			return AKMStFatalError;
+	}
+	frame->size = frameSize;
+	return AKMStSuccess;
+}
+
+enum AKMStatus AKMFrameBuild(struct AKMFrame* frame, const struct AKMFrameLayout* layout, void* buffer, size_t capacity, size_t payloadSize)
+{
+	frame->layout = layout;
+	frame->buffer = (uint8_t*)buffer;
+	frame->size = 0;
+	frame->capacity = capacity;
+	const size_t fixedSize = (size_t)layout->headerSize + layout->tagSize;
+	if (unlikely(capacity < fixedSize || payloadSize > capacity - fixedSize))
+		return AKMStNoMemory;
+	frame->size = fixedSize + payloadSize;
+	memset(frame->buffer, 0, layout->headerSize);
+	memset(frame->buffer + frame->size - layout->tagSize, 0, layout->tagSize);
+	writeLengthField(frame);
+	return AKMStSuccess;
+}
+
+enum AKMStatus AKMFrameSetPayloadSize(struct AKMFrame* frame, size_t payloadSize)
+{
+	const size_t fixedSize = (size_t)frame->layout->headerSize + frame->layout->tagSize;
+	if (unlikely(frame->capacity < fixedSize || payloadSize > frame->capacity - fixedSize))
+		return AKMStNoMemory;
+	frame->size = fixedSize + payloadSize;
+	writeLengthField(frame);
+	return AKMStSuccess;
+}
+
+void AKMFrameGetField(const struct AKMFrame* frame, enum AKMFrameField field, struct AKMFrameSpan* span)
+{
+	const struct AKMFrameLayout* layout = frame->layout;
+	switch (field)
+	{
+	case AKMFfPayload:
+		span->data = frame->buffer + layout->headerSize;
+		span->size = frame->size - layout->headerSize - layout->tagSize;
+		break;
+	case AKMFfTag:
+		span->data = frame->buffer + frame->size - layout->tagSize;
+		span->size = layout->tagSize;
+		break;
+	default:
+		assert(isHeaderField(field));
+		span->data = frame->buffer + layout->offset[field];
+		span->size = layout->length[field];
+		break;
+	}
+}
+
+void AKMFrameSetField(struct AKMFrame* frame, enum AKMFrameField field, const void* data, size_t size)
+{
+	struct AKMFrameSpan span;
+	AKMFrameGetField(frame, field, &span);
+	memCpyEx(span.data, span.size, data, size, 0);
+}
+
+uint64_t AKMFrameGetUInt(const struct AKMFrame* frame, enum AKMFrameField field)
+{
+	assert(isHeaderField(field));
+	const struct AKMFrameLayout* layout = frame->layout;
+	const size_t len = layout->length[field];
+	if (len > sizeof(uint64_t))
+		return 0;
+	return read_le_bytes(frame->buffer + layout->offset[field], len);
+}
+
+void AKMFrameSetUInt(struct AKMFrame* frame, enum AKMFrameField field, uint64_t value)
+{
+	assert(isHeaderField(field));
+	const struct AKMFrameLayout* layout = frame->layout;
+	const size_t len = layout->length[field];
+	if (len > sizeof(uint64_t))
+		return;
+	write_le_bytes(frame->buffer + layout->offset[field], len, value);
+}
+
+enum AKMEvent AKMFrameGetEvent(const struct AKMFrame* frame)
+{
+	const size_t len = frame->layout->length[AKMFfEvent];
+	if (len < 1)
+		return AKMEvNone;
+	const uint64_t raw = AKMFrameGetUInt(frame, AKMFfEvent);
+	const unsigned shift = (unsigned)(64 - 8 * len);
+	return (enum AKMEvent)(int)((int64_t)(raw << shift) >> shift);
+}
+
+void AKMFrameSetEvent(struct AKMFrame* frame, enum AKMEvent akmEvent)
+{
+	AKMFrameSetUInt(frame, AKMFfEvent, (uint64_t)(int64_t)akmEvent);
+}
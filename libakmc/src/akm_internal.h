@@ -10,8 +10,27 @@
 #include "addr_list.h"
 #include "bytevector.h"
 #include <string.h>
+#include <assert.h>
 
-DEFINE_VECTOR_T(akm_time_vec,akm_time_t)
+// Number of nodes whose per-node data is kept inside the relationship, larger rings spill to the heap; 0 disables
+#ifndef AKM_SMALL_RING_NODES
+#define AKM_SMALL_RING_NODES 16
+#endif
+
+// Node address size the inline node list is dimensioned for
+#define AKM_SMALL_RING_SRNA 4
+
+#if AKM_SMALL_RING_NODES > 0
+#define DEFINE_NODE_VECTOR_T(VecType,ElemType,ElemsPerNode) DEFINE_SMALL_VECTOR_T(VecType,ElemType,AKM_SMALL_RING_NODES * (ElemsPerNode))
+#else
+#define DEFINE_NODE_VECTOR_T(VecType,ElemType,ElemsPerNode) DEFINE_VECTOR_T(VecType,ElemType)
+#endif
+
+DEFINE_NODE_VECTOR_T(akm_time_vec,akm_time_t,1)
+
+DEFINE_NODE_VECTOR_T(NodeAddrVec,uint8_t,AKM_SMALL_RING_SRNA)
+
+#define AKM_TIME_MAX INT64_MAX
 
 enum AKMKey
 {
@@ -56,20 +75,18 @@ enum AKMMachState
 	AKM_MFallbackEstablishing = 3,
 };
 
-struct NodeSubCounters
-{
-	int cnts[AKM_NUM_OF_STATES];
-};
-
+// Per-node flags of the states the node was counted in, bits 0-3 in normal and bits 4-7 in fallback
+// establishing; the flags are valid only while epoch matches the relationship's countersEpoch
 struct NodeCounters
 {
-	struct NodeSubCounters normal;
-	struct NodeSubCounters fallback;
+	uint16_t epoch;
+	uint8_t states;
 };
 
-static inline struct NodeSubCounters* nodeSubCounters(struct NodeCounters* cnts, enum AKMMachState machState) { return (machState == AKM_MFallbackEstablishing) ? &cnts->fallback : &cnts->normal; }
+static inline uint8_t nodeStateBit(enum AKMMachState machState, enum AKMSysState sysState) { return (uint8_t)(1u << ((machState == AKM_MFallbackEstablishing) ? AKM_NUM_OF_STATES + sysState : sysState)); }
+static inline uint8_t nodeCountersStates(const struct NodeCounters* cnts, uint16_t epoch) { return (cnts->epoch == epoch) ? cnts->states : 0; }
 
-DEFINE_VECTOR_T(NodeCntsVec,struct NodeCounters)
+DEFINE_NODE_VECTOR_T(NodeCntsVec,struct NodeCounters,1)
 
 struct RelSubCounters
 {
@@ -87,18 +104,51 @@ static inline struct RelSubCounters* relSubCounters(struct RelCounters* cnts, en
 
 #define CONTINUATION_STACK_DEPTH 16
 
-typedef void(*cont_func_t)(struct AKMProcessCtx*);
+// Processing steps, each X(name) is implemented by static void c##name(struct AKMProcessCtx*) in akm.c
+#define AKM_STEPS(X) \
+	X(Init0) \
+	X(Main) \
+	X(RetryDec) \
+	X(RetryDecTryFb) \
+	X(DoUseDecTryKeyAsDecKey) \
+	X(DoUseCSK) \
+	X(DoUseNSK) \
+	X(DoUseCFSK) \
+	X(DoUseNFSK) \
+	X(DoHandleRecvEv0) \
+	X(DoHandleRecvEv1) \
+	X(DoGenNSK) \
+	X(DoGenNFSK) \
+	X(DoGenCFSK) \
+	X(DoMoveNSKToCSK) \
+	X(DoMoveNFSKToCSK) \
+	X(DoClearKeyBuffer) \
+	X(DoUpdateSendEvent)
+
+#define AKM_STEP_ENUM_ITEM(name) AKM_Step##name,
+
+enum AKMStep
+{
+	AKM_StepNone = 0,
+	AKM_STEPS(AKM_STEP_ENUM_ITEM)
+	AKM_STEPS_NUM
+};
+
+#undef AKM_STEP_ENUM_ITEM
+
+typedef uint8_t akm_step_t;
 
+// Plain data, can be copied, persisted or shared between processes
 struct ContinuationStack
 {
-	int topIdx;
-	cont_func_t stack[CONTINUATION_STACK_DEPTH];
+	int8_t topIdx;
+	akm_step_t stack[CONTINUATION_STACK_DEPTH];
 };
 
-static inline void contStack_setContinuation(struct ContinuationStack* cs, cont_func_t cont) { cs->stack[cs->topIdx] = cont; }
-static inline void contStack_pushContinuation(struct ContinuationStack* cs, cont_func_t cont) { cs->topIdx++; contStack_setContinuation(cs, cont); }
-static inline void contStack_popContinuation(struct ContinuationStack* cs) { contStack_setContinuation(cs, NULL); cs->topIdx--; }
-static inline cont_func_t contStack_getContinuation(struct ContinuationStack* cs) { return cs->stack[cs->topIdx]; }
+static inline void contStack_setContinuation(struct ContinuationStack* cs, enum AKMStep step) { cs->stack[cs->topIdx] = (akm_step_t)step; }
+static inline void contStack_pushContinuation(struct ContinuationStack* cs, enum AKMStep step) { cs->topIdx++; assert(cs->topIdx < CONTINUATION_STACK_DEPTH); contStack_setContinuation(cs, step); }
+static inline void contStack_popContinuation(struct ContinuationStack* cs) { contStack_setContinuation(cs, AKM_StepNone); cs->topIdx--; }
+static inline enum AKMStep contStack_getContinuation(const struct ContinuationStack* cs) { return (enum AKMStep)cs->stack[cs->topIdx]; }
 
 struct ProcessingInfo
 {
@@ -116,28 +166,75 @@ struct ProcessingInfo
 	struct ContinuationStack contStack;
 };
 
+// Immutable once created, shared by the relationships created from it
+struct AKMTemplate
+{
+	volatile long refCount;
+	struct AKMConfigParams params;
+	struct AKMParameterDataVector pdv;
+	// Index of the template's self node address, -1 if none was given
+	int selfIdx;
+	uint8_t nodeAddresses[];
+};
+
 struct AKMRelationship
 {
 	struct ProcessingInfo proc;
 	int selfIdx;
 	struct AKMConfigParams config;
-	struct AKMParameterDataVector pdv;
-	bytevector nodeAddresses;
+	struct AKMTemplate* tmpl;
+	// Own copy of the node list, empty while the template's list is used (copy-on-write)
+	NodeAddrVec nodeAddresses;
 	akm_time_t lastStateChangeTime;
 	akm_time_vec nodeLastRcvTimes;
+	// Lower bound of nodeLastRcvTimes of the nodes other than self, AKM_TIME_MAX if there are none
+	akm_time_t oldestNodeRcvTime;
 	struct RelCounters relCounters;
+	uint16_t countersEpoch;
 	NodeCntsVec nodeCounters;
+	// State last sent by AKMGetDelta, NULL until it is first called
+	struct ReplicaShadow* replica;
 };
 
-static inline void setContinuation(struct AKMProcessCtx* ctx, cont_func_t cont) { contStack_setContinuation(&ctx->relationship->proc.contStack, cont); }
-static inline void pushContinuation(struct AKMProcessCtx* ctx, cont_func_t cont) { contStack_pushContinuation(&ctx->relationship->proc.contStack, cont); }
+void relReplicaFree(struct AKMRelationship* relationship);
+
+// Between events, the only time the relationship may be inspected or modified from outside
+static inline bool isProcessingIdle(const struct AKMRelationship* relationship)
+{
+	const struct ProcessingInfo* proc = &relationship->proc;
+	return proc->contStack.topIdx == 0 && proc->contStack.stack[0] == AKM_StepMain && !proc->yieldProcess;
+}
+
+static inline const struct AKMParameterDataVector* relPdv(const struct AKMRelationship* relationship) { return &relationship->tmpl->pdv; }
+
+static inline const uint8_t* relNodeAddresses(const struct AKMRelationship* relationship)
+{
+	return relationship->nodeAddresses.vec.buffer ? (const uint8_t*)relationship->nodeAddresses.vec.buffer : relationship->tmpl->nodeAddresses;
+}
+
+// Makes the node list private before it is modified
+static inline bool relOwnNodeAddresses(struct AKMRelationship* relationship)
+{
+	if (relationship->nodeAddresses.vec.buffer)
+		return true;
+	const size_t addrListLen = (size_t)(relationship->config.N) * (size_t)(relationship->config.SRNA);
+	if (!NodeAddrVec_resize(&relationship->nodeAddresses, addrListLen))
+		return false;
+	memcpy(relationship->nodeAddresses.vec.buffer, relationship->tmpl->nodeAddresses, addrListLen);
+	return true;
+}
+
+static inline void setContinuation(struct AKMProcessCtx* ctx, enum AKMStep step) { contStack_setContinuation(&ctx->relationship->proc.contStack, step); }
+static inline void pushContinuation(struct AKMProcessCtx* ctx, enum AKMStep step) { contStack_pushContinuation(&ctx->relationship->proc.contStack, step); }
 static inline void popContinuation(struct AKMProcessCtx* ctx) { contStack_popContinuation(&ctx->relationship->proc.contStack); }
-static inline cont_func_t getContinuation(struct AKMProcessCtx* ctx) { return contStack_getContinuation(&ctx->relationship->proc.contStack); }
+static inline enum AKMStep getContinuation(struct AKMProcessCtx* ctx) { return contStack_getContinuation(&ctx->relationship->proc.contStack); }
 
 static inline void resetCounters(struct AKMProcessCtx* ctx)
 {
 	memset(&ctx->relationship->relCounters, 0, sizeof(ctx->relationship->relCounters));
-	NodeCntsVec_zero(&ctx->relationship->nodeCounters);
+	// Stale node counters are ignored, they need clearing only once the epoch wraps around
+	if (++ctx->relationship->countersEpoch == 0)
+		NodeCntsVec_zero(&ctx->relationship->nodeCounters);
 }
 
 static inline void resetSkipFlags(struct AKMProcessCtx* ctx)
@@ -0,0 +1,404 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#include "akm_internal.h"
+#include "endianness.h"
+#include "mem_alloc.h"
+#include "utilities.h"
+#include <stdbool.h>
+#include <string.h>
+
+// Delta layout: version byte followed by records, each a type byte and a payload of the size fixed per type
+// (AKM_DrNodes: node count, self index and the node list), all integers little-endian
+
+#define AKM_DELTA_VERSION 1
+
+enum AKMDeltaRecord
+{
+	AKM_DrSeeds = 1,
+	AKM_DrState = 2,
+	AKM_DrCounters = 3,
+	AKM_DrNodes = 4,
+	AKM_DrNodeTime = 5,
+	AKM_DrNodeCounters = 6,
+};
+
+#define AKM_DR_SEEDS_SIZE (7 * 4)
+#define AKM_DR_STATE_SIZE (8 + 8 + 1 + 8)
+#define AKM_DR_COUNTERS_SIZE (2 + 2 * (AKM_NUM_OF_STATES + 1) * 4)
+#define AKM_DR_NODES_HEADER_SIZE (2 + 2)
+#define AKM_DR_NODE_TIME_SIZE (2 + 8)
+#define AKM_DR_NODE_COUNTERS_SIZE (2 + 2 + 1)
+
+// Last state sent to the replica
+struct ReplicaShadow
+{
+	uint8_t seeds[AKM_DR_SEEDS_SIZE];
+	uint8_t state[AKM_DR_STATE_SIZE];
+	uint8_t counters[AKM_DR_COUNTERS_SIZE];
+	bool valid;
+	uint16_t nodeNum;
+	bytevector nodeAddresses;
+	akm_time_t* nodeTimes;
+	struct NodeCounters* nodeCounters;
+	size_t nodeCapacity;
+};
+
+struct DeltaWriter
+{
+	// NULL while only the size is computed
+	uint8_t* out;
+	size_t size;
+};
+
+static inline void put(struct DeltaWriter* w, size_t len, uint64_t value)
+{
+	if (w->out)
+		write_le_bytes(w->out + w->size, len, value);
+	w->size += len;
+}
+
+static inline void putBytes(struct DeltaWriter* w, const void* data, size_t len)
+{
+	if (w->out)
+		memcpy(w->out + w->size, data, len);
+	w->size += len;
+}
+
+static void serializeSeeds(const struct AKMRelationship* relationship, uint8_t* out)
+{
+	const struct AKMConfigParams* config = &relationship->config;
+	const uint32_t seeds[7] = { config->CSS, config->NSS, config->FSS, config->NFSS, config->SFSS, config->NSFSS, config->EFSS };
+	for (int i = 0; i < 7; ++i)
+		write_le_bytes(out + 4 * i, 4, seeds[i]);
+}
+
+static void deserializeSeeds(struct AKMRelationship* relationship, const uint8_t* in)
+{
+	struct AKMConfigParams* config = &relationship->config;
+	uint32_t* const seeds[7] = { &config->CSS, &config->NSS, &config->FSS, &config->NFSS, &config->SFSS, &config->NSFSS, &config->EFSS };
+	for (int i = 0; i < 7; ++i)
+		*seeds[i] = (uint32_t)read_le_bytes(in + 4 * i, 4);
+}
+
+static void serializeState(const struct AKMRelationship* relationship, uint8_t* out)
+{
+	const struct ProcessingInfo* proc = &relationship->proc;
+	write_le_bytes(out, 8, (uint64_t)proc->nextTimeout);
+	write_le_bytes(out + 8, 8, (uint64_t)relationship->lastStateChangeTime);
+	out[16] = (uint8_t)((proc->validNextTimeout ? 1 : 0) | (proc->skipTimeOutNodesRemoval ? 2 : 0) | (proc->skipTimeOutSched ? 4 : 0));
+	const int8_t fields[8] = { proc->status, proc->encKey, proc->decKey, proc->decTryKey, proc->sysState, proc->machState, proc->sendEvent, proc->sendOk };
+	memcpy(out + 17, fields, sizeof(fields));
+}
+
+static void deserializeState(struct AKMRelationship* relationship, const uint8_t* in)
+{
+	struct ProcessingInfo* proc = &relationship->proc;
+	proc->nextTimeout = (akm_time_t)read_le_bytes(in, 8);
+	relationship->lastStateChangeTime = (akm_time_t)read_le_bytes(in + 8, 8);
+	proc->validNextTimeout = (in[16] & 1) != 0;
+	proc->skipTimeOutNodesRemoval = (in[16] & 2) != 0;
+	proc->skipTimeOutSched = (in[16] & 4) != 0;
+	int8_t* const fields[8] = { &proc->status, &proc->encKey, &proc->decKey, &proc->decTryKey, &proc->sysState, &proc->machState, &proc->sendEvent, &proc->sendOk };
+	for (int i = 0; i < 8; ++i)
+		*fields[i] = (int8_t)in[17 + i];
+}
+
+static void serializeSubCounters(const struct RelSubCounters* cnts, uint8_t* out)
+{
+	for (int i = 0; i < AKM_NUM_OF_STATES; ++i)
+		write_le_bytes(out + 4 * i, 4, (uint32_t)cnts->nodes[i]);
+	write_le_bytes(out + 4 * AKM_NUM_OF_STATES, 4, (uint32_t)cnts->decryptFails);
+}
+
+static void deserializeSubCounters(struct RelSubCounters* cnts, const uint8_t* in)
+{
+	for (int i = 0; i < AKM_NUM_OF_STATES; ++i)
+		cnts->nodes[i] = (int)(int32_t)read_le_bytes(in + 4 * i, 4);
+	cnts->decryptFails = (int)(int32_t)read_le_bytes(in + 4 * AKM_NUM_OF_STATES, 4);
+}
+
+static void serializeCounters(const struct AKMRelationship* relationship, uint8_t* out)
+{
+	write_le_bytes(out, 2, relationship->countersEpoch);
+	serializeSubCounters(&relationship->relCounters.normal, out + 2);
+	serializeSubCounters(&relationship->relCounters.fallback, out + 2 + 4 * (AKM_NUM_OF_STATES + 1));
+}
+
+static void deserializeCounters(struct AKMRelationship* relationship, const uint8_t* in)
+{
+	relationship->countersEpoch = (uint16_t)read_le_bytes(in, 2);
+	deserializeSubCounters(&relationship->relCounters.normal, in + 2);
+	deserializeSubCounters(&relationship->relCounters.fallback, in + 2 + 4 * (AKM_NUM_OF_STATES + 1));
+}
+
+// Writes a fixed-size record if its serialized form differs from the shadow copy
+static void putRecordIfChanged(struct DeltaWriter* w, enum AKMDeltaRecord type, const uint8_t* current, uint8_t* shadow, size_t len, bool force)
+{
+	if (!force && memcmp(current, shadow, len) == 0)
+		return;
+	put(w, 1, type);
+	putBytes(w, current, len);
+	if (w->out)
+		memcpy(shadow, current, len);
+}
+
+static bool reserveShadowNodes(struct ReplicaShadow* shadow, size_t nodeNum, size_t srna)
+{
+	if (!bytevector_resize(&shadow->nodeAddresses, nodeNum * srna))
+		return false;
+	if (nodeNum <= shadow->nodeCapacity)
+		return true;
+	akm_time_t* times = (akm_time_t*)mem_alloc(nodeNum * sizeof(akm_time_t));
+	struct NodeCounters* cnts = (struct NodeCounters*)mem_alloc(nodeNum * sizeof(struct NodeCounters));
+	if (!times || !cnts)
+	{
+		mem_free(times, nodeNum * sizeof(akm_time_t));
+		mem_free(cnts, nodeNum * sizeof(struct NodeCounters));
+		return false;
+	}
+	mem_free(shadow->nodeTimes, shadow->nodeCapacity * sizeof(akm_time_t));
+	mem_free(shadow->nodeCounters, shadow->nodeCapacity * sizeof(struct NodeCounters));
+	shadow->nodeTimes = times;
+	shadow->nodeCounters = cnts;
+	shadow->nodeCapacity = nodeNum;
+	return true;
+}
+
+static void encodeDelta(struct AKMRelationship* relationship, struct ReplicaShadow* shadow, akm_time_t timeGranularity_ms, struct DeltaWriter* w)
+{
+	const bool force = !shadow->valid;
+	uint8_t seeds[AKM_DR_SEEDS_SIZE];
+	uint8_t state[AKM_DR_STATE_SIZE];
+	uint8_t counters[AKM_DR_COUNTERS_SIZE];
+	serializeSeeds(relationship, seeds);
+	serializeState(relationship, state);
+	serializeCounters(relationship, counters);
+	put(w, 1, AKM_DELTA_VERSION);
+	putRecordIfChanged(w, AKM_DrSeeds, seeds, shadow->seeds, sizeof(seeds), force);
+	putRecordIfChanged(w, AKM_DrState, state, shadow->state, sizeof(state), force);
+	putRecordIfChanged(w, AKM_DrCounters, counters, shadow->counters, sizeof(counters), force);
+	const size_t nodeNum = relationship->config.N;
+	const size_t srna = relationship->config.SRNA;
+	const uint8_t* const addrs = relNodeAddresses(relationship);
+	const bool nodesChanged = force || shadow->nodeNum != nodeNum || memcmp(shadow->nodeAddresses.buffer, addrs, nodeNum * srna) != 0;
+	if (nodesChanged)
+	{
+		put(w, 1, AKM_DrNodes);
+		put(w, 2, nodeNum);
+		put(w, 2, (uint64_t)relationship->selfIdx);
+		putBytes(w, addrs, nodeNum * srna);
+		if (w->out)
+		{
+			memcpy(shadow->nodeAddresses.buffer, addrs, nodeNum * srna);
+			shadow->nodeNum = (uint16_t)nodeNum;
+		}
+	}
+	const akm_time_t* const times = akm_time_vec_elem(&relationship->nodeLastRcvTimes, 0);
+	const struct NodeCounters* const cnts = NodeCntsVec_elem(&relationship->nodeCounters, 0);
+	for (size_t i = 0; i < nodeNum; ++i)
+	{
+		// Reception times are sent once they moved by the granularity, the replica's ones may lag behind by less
+		const akm_time_t diff = nodesChanged ? 0 : times[i] - shadow->nodeTimes[i];
+		if (nodesChanged || (diff != 0 && (diff >= timeGranularity_ms || -diff >= timeGranularity_ms)))
+		{
+			put(w, 1, AKM_DrNodeTime);
+			put(w, 2, i);
+			put(w, 8, (uint64_t)times[i]);
+			if (w->out)
+				shadow->nodeTimes[i] = times[i];
+		}
+		if (nodesChanged || cnts[i].epoch != shadow->nodeCounters[i].epoch || cnts[i].states != shadow->nodeCounters[i].states)
+		{
+			put(w, 1, AKM_DrNodeCounters);
+			put(w, 2, i);
+			put(w, 2, cnts[i].epoch);
+			put(w, 1, cnts[i].states);
+			if (w->out)
+				shadow->nodeCounters[i] = cnts[i];
+		}
+	}
+	// A lone version byte means nothing changed
+	if (w->size == 1)
+		w->size = 0;
+	if (w->out)
+		shadow->valid = true;
+}
+
+enum AKMStatus AKMGetDelta(struct AKMRelationship* relationship, akm_time_t timeGranularity_ms, void* buffer, size_t capacity, size_t* size)
+{
+	*size = 0;
+	if (!relationship || !isProcessingIdle(relationship))
+		return AKMStFatalError;
+	struct ReplicaShadow* shadow = relationship->replica;
+	if (!shadow)
+	{
+		shadow = (struct ReplicaShadow*)mem_alloc(sizeof(struct ReplicaShadow));
+		if (!shadow)
+			return AKMStNoMemory;
+		memset(shadow, 0, sizeof(*shadow));
+		relationship->replica = shadow;
+	}
+	if (!reserveShadowNodes(shadow, relationship->config.N, relationship->config.SRNA))
+		return AKMStNoMemory;
+	struct DeltaWriter w = { NULL, 0 };
+	encodeDelta(relationship, shadow, timeGranularity_ms, &w);
+	*size = w.size;
+	if (w.size > capacity)
+		return AKMStNoMemory;
+	if (w.size > 0)
+	{
+		w.out = (uint8_t*)buffer;
+		w.size = 0;
+		encodeDelta(relationship, shadow, timeGranularity_ms, &w);
+		assert(w.size == *size);
+	}
+	return AKMStSuccess;
+}
+
+void relReplicaFree(struct AKMRelationship* relationship)
+{
+	struct ReplicaShadow* shadow = relationship->replica;
+	if (!shadow)
+		return;
+	bytevector_free(&shadow->nodeAddresses);
+	mem_free(shadow->nodeTimes, shadow->nodeCapacity * sizeof(akm_time_t));
+	mem_free(shadow->nodeCounters, shadow->nodeCapacity * sizeof(struct NodeCounters));
+	mem_free(shadow, sizeof(*shadow));
+	relationship->replica = NULL;
+}
+
+static size_t recordSize(enum AKMDeltaRecord type, const uint8_t* payload, size_t available, size_t srna)
+{
+	switch (type)
+	{
+	case AKM_DrSeeds:
+		return AKM_DR_SEEDS_SIZE;
+	case AKM_DrState:
+		return AKM_DR_STATE_SIZE;
+	case AKM_DrCounters:
+		return AKM_DR_COUNTERS_SIZE;
+	case AKM_DrNodes:
+		if (available < AKM_DR_NODES_HEADER_SIZE)
+			return SIZE_MAX;
+		return AKM_DR_NODES_HEADER_SIZE + read_le16(payload) * srna;
+	case AKM_DrNodeTime:
+		return AKM_DR_NODE_TIME_SIZE;
+	case AKM_DrNodeCounters:
+		return AKM_DR_NODE_COUNTERS_SIZE;
+	default:
+		return SIZE_MAX;
+	}
+}
+
+// Checks the record framing and the indices against the node count in effect at each record
+static bool validateDelta(const struct AKMRelationship* replica, const uint8_t* in, size_t size)
+{
+	const size_t srna = replica->config.SRNA;
+	size_t nodeNum = replica->config.N;
+	size_t pos = 1;
+	while (pos < size)
+	{
+		const enum AKMDeltaRecord type = (enum AKMDeltaRecord)in[pos++];
+		const size_t len = recordSize(type, in + pos, size - pos, srna);
+		if (len > size - pos)
+			return false;
+		const uint8_t* const payload = in + pos;
+		if (type == AKM_DrNodes)
+		{
+			nodeNum = read_le16(payload);
+			if (read_le16(payload + 2) >= nodeNum)
+				return false;
+			if (addrlist_check_sorted_nodups_raw(payload + AKM_DR_NODES_HEADER_SIZE, (int)nodeNum, (int)srna) < 0)
+				return false;
+		}
+		else if ((type == AKM_DrNodeTime || type == AKM_DrNodeCounters) && read_le16(payload) >= nodeNum)
+			return false;
+		pos += len;
+	}
+	return true;
+}
+
+static bool applyNodes(struct AKMRelationship* replica, const uint8_t* payload)
+{
+	const size_t nodeNum = read_le16(payload);
+	const size_t srna = replica->config.SRNA;
+	bool mem_ok = NodeAddrVec_resize(&replica->nodeAddresses, nodeNum * srna);
+	mem_ok = mem_ok && akm_time_vec_resize(&replica->nodeLastRcvTimes, nodeNum);
+	mem_ok = mem_ok && NodeCntsVec_resize(&replica->nodeCounters, nodeNum);
+	if (!mem_ok)
+		return false;
+	memcpy(replica->nodeAddresses.vec.buffer, payload + AKM_DR_NODES_HEADER_SIZE, nodeNum * srna);
+	replica->config.N = (uint16_t)nodeNum;
+	replica->selfIdx = read_le16(payload + 2);
+	return true;
+}
+
+enum AKMStatus AKMApplyDelta(struct AKMRelationship* replica, const void* delta, size_t size)
+{
+	if (!replica)
+		return AKMStFatalError;
+	const struct ProcessingInfo* proc = &replica->proc;
+	const bool fresh = proc->contStack.topIdx == 0 && proc->contStack.stack[0] == AKM_StepInit0;
+	if (!fresh && !isProcessingIdle(replica))
+		return AKMStFatalError;
+	if (size < 1)
+		return AKMStSuccess;
+	const uint8_t* const in = (const uint8_t*)delta;
+	if (in[0] != AKM_DELTA_VERSION || !validateDelta(replica, in, size))
+		return AKMStFatalError;
+	size_t pos = 1;
+	while (pos < size)
+	{
+		const enum AKMDeltaRecord type = (enum AKMDeltaRecord)in[pos++];
+		const uint8_t* const payload = in + pos;
+		pos += recordSize(type, payload, size - pos, replica->config.SRNA);
+		switch (type)
+		{
+		case AKM_DrSeeds:
+			deserializeSeeds(replica, payload);
+			break;
+		case AKM_DrState:
+			deserializeState(replica, payload);
+			break;
+		case AKM_DrCounters:
+			deserializeCounters(replica, payload);
+			break;
+		case AKM_DrNodes:
+			if (!applyNodes(replica, payload))
+				return AKMStNoMemory;
+			break;
+		case AKM_DrNodeTime:
+			*akm_time_vec_elem(&replica->nodeLastRcvTimes, read_le16(payload)) = (akm_time_t)read_le_bytes(payload + 2, 8);
+			break;
+		case AKM_DrNodeCounters:
+		{
+			struct NodeCounters* cnts = NodeCntsVec_elem(&replica->nodeCounters, read_le16(payload));
+			cnts->epoch = read_le16(payload + 2);
+			cnts->states = payload[4];
+			break;
+		}
+		default:
+			unreachable();
+			break;
+		}
+	}
+	// The replica continues as if it had processed the primary's events itself
+	struct ProcessingInfo* replicaProc = &replica->proc;
+	replicaProc->contStack.topIdx = 0;
+	replicaProc->contStack.stack[0] = AKM_StepMain;
+	replicaProc->yieldProcess = false;
+	replicaProc->recvFrameSrcNodeIdx = -1;
+	replicaProc->recvFrameEvent = AKMEvNone;
+	const akm_time_t* const times = akm_time_vec_elem(&replica->nodeLastRcvTimes, 0);
+	akm_time_t oldest = AKM_TIME_MAX;
+	for (int i = 0; i < replica->config.N; ++i)
+	{
+		if (i != replica->selfIdx && times[i] < oldest)
+			oldest = times[i];
+	}
+	replica->oldestNodeRcvTime = oldest;
+	return AKMStSuccess;
+}
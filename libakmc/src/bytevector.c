@@ -4,21 +4,22 @@
 
 
 #include "bytevector.h"
+#include "mem_alloc.h"
 #include <stdlib.h>
 #include <string.h>
 
-bool bytevector_resize(bytevector* vec, size_t newSize)
+bool bytevector_resize_sbo(bytevector* vec, size_t newSize, void* inlineBuffer, size_t inlineCapacity)
 {
 	if (newSize > vec->capacity)
 	{
 		size_t newCapacity = vec->capacity + (vec->capacity >> 1);
 		if (newCapacity < newSize)
 			newCapacity = newSize;
-		if (!bytevector_change_capacity(vec, newCapacity))
+		if (!bytevector_change_capacity_sbo(vec, newCapacity, inlineBuffer, inlineCapacity))
 		{
 			if (newSize < newCapacity)
 			{
-				if (!bytevector_change_capacity(vec, newSize))
+				if (!bytevector_change_capacity_sbo(vec, newSize, inlineBuffer, inlineCapacity))
 					return false;
 			}
 			else
@@ -29,21 +30,40 @@ bool bytevector_resize(bytevector* vec, size_t newSize)
 	return true;
 }
 
-bool bytevector_change_capacity(bytevector* vec, size_t newCapacity)
+bool bytevector_change_capacity_sbo(bytevector* vec, size_t newCapacity, void* inlineBuffer, size_t inlineCapacity)
 {
+	const bool isInline = inlineBuffer && vec->buffer == inlineBuffer;
 	if (newCapacity == vec->capacity)
 		return true;
 	if (newCapacity < 1)
 	{
+		if (vec->buffer && !isInline)
+			mem_free(vec->buffer, vec->capacity);
+		vec->buffer = NULL;
+	}
+	else if (newCapacity <= inlineCapacity)
+	{
+		if (isInline)
+			return true;
 		if (vec->buffer)
 		{
-			free(vec->buffer);
-			vec->buffer = NULL;
+			memcpy(inlineBuffer, vec->buffer, (vec->size < newCapacity) ? vec->size : newCapacity);
+			mem_free(vec->buffer, vec->capacity);
 		}
+		vec->buffer = inlineBuffer;
+		newCapacity = inlineCapacity;
+	}
+	else if (isInline)
+	{
+		void* newBuffer = mem_alloc(newCapacity);
+		if (!newBuffer)
+			return false;
+		memcpy(newBuffer, inlineBuffer, (vec->size < newCapacity) ? vec->size : newCapacity);
+		vec->buffer = newBuffer;
 	}
 	else
 	{
-		void* newBuffer = realloc(vec->buffer, newCapacity);
+		void* newBuffer = mem_realloc(vec->buffer, vec->capacity, newCapacity);
 		if (!newBuffer)
 			return false;
 		vec->buffer = newBuffer;
@@ -54,14 +74,14 @@ bool bytevector_change_capacity(bytevector* vec, size_t newCapacity)
 	return true;
 }
 
-bool bytevector_insert(bytevector* vec, size_t offset, const void* data, size_t len)
+bool bytevector_insert_sbo(bytevector* vec, size_t offset, const void* data, size_t len, void* inlineBuffer, size_t inlineCapacity)
 {
 	if (len < 1)
 		return true;
 	const size_t oldSize = vec->size;
 	if (offset > oldSize)
 		return false;
-	if (!bytevector_resize(vec, oldSize + len))
+	if (!bytevector_resize_sbo(vec, oldSize + len, inlineBuffer, inlineCapacity))
 		return false;
 	if (offset < oldSize)
 		memmove(bytevector_getptr(vec, offset + len), bytevector_getptr(vec, offset), oldSize - offset);
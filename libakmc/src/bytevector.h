@@ -18,9 +18,15 @@ typedef struct bytevector
 } bytevector;
 
 static inline void* bytevector_getptr(bytevector* vec, size_t offset) { return (char*)(vec->buffer) + offset; }
-bool bytevector_change_capacity(bytevector* vec, size_t newCapacity);
-bool bytevector_resize(bytevector* vec, size_t newSize);
-bool bytevector_insert(bytevector* vec, size_t offset, const void* data, size_t len);
+// The _sbo variants keep up to inlineCapacity bytes in inlineBuffer (owned by the caller, next to the vector) instead
+// of on the heap; the vector then points into its owner, which must not be moved
+bool bytevector_change_capacity_sbo(bytevector* vec, size_t newCapacity, void* inlineBuffer, size_t inlineCapacity);
+bool bytevector_resize_sbo(bytevector* vec, size_t newSize, void* inlineBuffer, size_t inlineCapacity);
+bool bytevector_insert_sbo(bytevector* vec, size_t offset, const void* data, size_t len, void* inlineBuffer, size_t inlineCapacity);
+static inline bool bytevector_change_capacity(bytevector* vec, size_t newCapacity) { return bytevector_change_capacity_sbo(vec, newCapacity, NULL, 0); }
+static inline bool bytevector_resize(bytevector* vec, size_t newSize) { return bytevector_resize_sbo(vec, newSize, NULL, 0); }
+static inline bool bytevector_insert(bytevector* vec, size_t offset, const void* data, size_t len) { return bytevector_insert_sbo(vec, offset, data, len, NULL, 0); }
+// Never grows the vector, so it is valid for both kinds
 bool bytevector_erase(bytevector* vec, size_t offset, size_t len);
 static inline bool bytevector_free(bytevector* vec) { return bytevector_change_capacity(vec, 0); }
 static inline bool bytevector_shrink_to_fit(bytevector* vec) { return bytevector_change_capacity(vec, vec->size); }
@@ -41,4 +47,21 @@ static inline void bytevector_zero(bytevector* vec) { if (vec->buffer) { memset(
 	static inline bool VecType ## _shrink_to_fit(VecType* vec) { return bytevector_shrink_to_fit(&vec->vec); }	\
 	static inline void VecType ## _zero(VecType* vec) { bytevector_zero(&vec->vec); }
 
+// Vector holding up to InlineNum elements inside the struct, spilling to the heap beyond that
+#define DEFINE_SMALL_VECTOR_T(VecType,ElemType,InlineNum) \
+	typedef struct VecType	\
+	{	\
+		bytevector vec;	\
+		ElemType inlineElems[InlineNum];	\
+	} VecType;	\
+	\
+	static inline size_t VecType ## _count(VecType* vec) { return vec->vec.size / sizeof(ElemType); }	\
+	static inline ElemType* VecType ## _elem(VecType* vec, size_t idx) { return (ElemType*)bytevector_getptr(&vec->vec, idx * sizeof(ElemType)); }	\
+	static inline bool VecType ## _resize(VecType* vec, size_t newSize) { return bytevector_resize_sbo(&vec->vec, newSize * sizeof(ElemType), vec->inlineElems, sizeof(vec->inlineElems)); }	\
+	static inline bool VecType ## _insert(VecType* vec, size_t idx, const ElemType* elem, size_t cnt) { return bytevector_insert_sbo(&vec->vec, idx * sizeof(ElemType), elem, cnt * sizeof(ElemType), vec->inlineElems, sizeof(vec->inlineElems)); }	\
+	static inline bool VecType ## _erase(VecType* vec, size_t idx, size_t cnt) { return bytevector_erase(&vec->vec, idx * sizeof(ElemType), cnt * sizeof(ElemType) ); }	\
+	static inline bool VecType ## _free(VecType* vec) { return bytevector_change_capacity_sbo(&vec->vec, 0, vec->inlineElems, sizeof(vec->inlineElems)); }	\
+	static inline bool VecType ## _shrink_to_fit(VecType* vec) { return bytevector_change_capacity_sbo(&vec->vec, vec->vec.size, vec->inlineElems, sizeof(vec->inlineElems)); }	\
+	static inline void VecType ## _zero(VecType* vec) { bytevector_zero(&vec->vec); }
+
 #endif
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+// Ahead of utilities.h, whose restrict macro the Windows headers do not take
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include "akm.h"
+#include "mem_alloc.h"
+#include "utilities.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void* defaultAlloc(void* ctx, size_t size)
+{
+	(void)ctx;
+	return malloc(size);
+}
+
+static void* defaultRealloc(void* ctx, void* ptr, size_t oldSize, size_t newSize)
+{
+	(void)ctx;
+	(void)oldSize;
+	return realloc(ptr, newSize);
+}
+
+static void defaultFree(void* ctx, void* ptr, size_t size)
+{
+	(void)ctx;
+	(void)size;
+	free(ptr);
+}
+
+static const struct AKMAllocator defaultAllocator = { defaultAlloc, defaultRealloc, defaultFree, NULL };
+
+static struct AKMAllocator allocator = { defaultAlloc, defaultRealloc, defaultFree, NULL };
+
+static volatile long liveTemplates;
+
+enum AKMStatus AKMSetAllocator(const struct AKMAllocator* newAllocator)
+{
+	if (liveTemplates != 0)
+		return AKMStFatalError;
+	allocator = newAllocator ? *newAllocator : defaultAllocator;
+	return AKMStSuccess;
+}
+
+void mem_template_created(void)
+{
+	atomicIncrement(&liveTemplates);
+}
+
+void mem_template_freed(void)
+{
+	atomicDecrement(&liveTemplates);
+}
+
+void* mem_alloc(size_t size)
+{
+	return allocator.allocate(allocator.ctx, size);
+}
+
+void* mem_realloc(void* ptr, size_t oldSize, size_t newSize)
+{
+	if (!ptr)
+		return allocator.allocate(allocator.ctx, newSize);
+	return allocator.reallocate(allocator.ctx, ptr, oldSize, newSize);
+}
+
+void mem_free(void* ptr, size_t size)
+{
+	if (ptr)
+		allocator.deallocate(allocator.ctx, ptr, size);
+}
+
+// # Pool allocator
+// Blocks up to the largest size class come from per-thread free lists of that class, no locking is needed as
+// every thread only touches its own lists. A block may be freed on another thread than the one that allocated it,
+// it then joins the freeing thread's list. Lists are capped, blocks beyond the cap go back to malloc. A thread
+// registers its lists with a thread-exit destructor before caching its first block, the destructor returns them
+// to malloc when the thread ends.
+
+#define POOL_MIN_CLASS_SHIFT 4
+#define POOL_CLASSES_NUM 7
+#define POOL_MAX_BLOCK_SIZE ((size_t)1 << (POOL_MIN_CLASS_SHIFT + POOL_CLASSES_NUM - 1))
+#define POOL_MAX_CACHED_BLOCKS 1024
+
+struct PoolBlock
+{
+	struct PoolBlock* next;
+};
+
+struct PoolCache
+{
+	struct PoolBlock* head[POOL_CLASSES_NUM];
+	uint32_t count[POOL_CLASSES_NUM];
+	bool registered;
+};
+
+static threadlocal struct PoolCache poolCache;
+
+static void poolCacheRelease(struct PoolCache* cache)
+{
+	for (int idx = 0; idx < POOL_CLASSES_NUM; ++idx)
+	{
+		struct PoolBlock* block = cache->head[idx];
+		while (block)
+		{
+			struct PoolBlock* next = block->next;
+			free(block);
+			block = next;
+		}
+		cache->head[idx] = NULL;
+		cache->count[idx] = 0;
+	}
+	// Blocks freed by destructors running later register the lists again
+	cache->registered = false;
+}
+
+#ifdef _WIN32
+
+static DWORD poolCacheKey = FLS_OUT_OF_INDEXES;
+static INIT_ONCE poolCacheKeyOnce = INIT_ONCE_STATIC_INIT;
+
+static void WINAPI poolCacheDestructor(void* cache)
+{
+	if (cache)
+		poolCacheRelease((struct PoolCache*)cache);
+}
+
+static BOOL CALLBACK poolCacheKeyCreate(PINIT_ONCE once, void* param, void** ctx)
+{
+	(void)once;
+	(void)param;
+	(void)ctx;
+	poolCacheKey = FlsAlloc(poolCacheDestructor);
+	return TRUE;
+}
+
+static bool poolCacheRegister(void)
+{
+	InitOnceExecuteOnce(&poolCacheKeyOnce, poolCacheKeyCreate, NULL, NULL);
+	poolCache.registered = poolCacheKey != FLS_OUT_OF_INDEXES && FlsSetValue(poolCacheKey, &poolCache);
+	return poolCache.registered;
+}
+
+#else
+
+static pthread_key_t poolCacheKey;
+static bool poolCacheKeyCreated;
+static pthread_once_t poolCacheKeyOnce = PTHREAD_ONCE_INIT;
+
+static void poolCacheDestructor(void* cache)
+{
+	poolCacheRelease((struct PoolCache*)cache);
+}
+
+static void poolCacheKeyCreate(void)
+{
+	poolCacheKeyCreated = pthread_key_create(&poolCacheKey, poolCacheDestructor) == 0;
+}
+
+static bool poolCacheRegister(void)
+{
+	pthread_once(&poolCacheKeyOnce, poolCacheKeyCreate);
+	poolCache.registered = poolCacheKeyCreated && pthread_setspecific(poolCacheKey, &poolCache) == 0;
+	return poolCache.registered;
+}
+
+#endif
+
+static inline int poolClassIdx(size_t size)
+{
+	int idx = 0;
+	for (size_t classSize = (size_t)1 << POOL_MIN_CLASS_SHIFT; classSize < size; classSize <<= 1)
+		++idx;
+	return idx;
+}
+
+static inline size_t poolClassSize(int idx)
+{
+	return (size_t)1 << (POOL_MIN_CLASS_SHIFT + idx);
+}
+
+static void* poolAlloc(void* ctx, size_t size)
+{
+	(void)ctx;
+	if (size > POOL_MAX_BLOCK_SIZE)
+		return malloc(size);
+	const int idx = poolClassIdx(size);
+	struct PoolBlock* block = poolCache.head[idx];
+	if (likely(block))
+	{
+		poolCache.head[idx] = block->next;
+		poolCache.count[idx]--;
+		return block;
+	}
+	return malloc(poolClassSize(idx));
+}
+
+static void poolFree(void* ctx, void* ptr, size_t size)
+{
+	(void)ctx;
+	if (size > POOL_MAX_BLOCK_SIZE)
+	{
+		free(ptr);
+		return;
+	}
+	const int idx = poolClassIdx(size);
+	// Blocks are not cached by a thread that could not register its lists, they would leak when it ends
+	if (unlikely(poolCache.count[idx] >= POOL_MAX_CACHED_BLOCKS) || (unlikely(!poolCache.registered) && !poolCacheRegister()))
+	{
+		free(ptr);
+		return;
+	}
+	struct PoolBlock* block = (struct PoolBlock*)ptr;
+	block->next = poolCache.head[idx];
+	poolCache.head[idx] = block;
+	poolCache.count[idx]++;
+}
+
+static void* poolRealloc(void* ctx, void* ptr, size_t oldSize, size_t newSize)
+{
+	if (oldSize > POOL_MAX_BLOCK_SIZE && newSize > POOL_MAX_BLOCK_SIZE)
+		return realloc(ptr, newSize);
+	if (oldSize <= POOL_MAX_BLOCK_SIZE && newSize <= POOL_MAX_BLOCK_SIZE && poolClassIdx(oldSize) == poolClassIdx(newSize))
+		return ptr;
+	void* newPtr = poolAlloc(ctx, newSize);
+	if (!newPtr)
+		return NULL;
+	memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+	poolFree(ctx, ptr, oldSize);
+	return newPtr;
+}
+
+static const struct AKMAllocator poolAllocator = { poolAlloc, poolRealloc, poolFree, NULL };
+
+const struct AKMAllocator* AKMPoolAllocator(void)
+{
+	return &poolAllocator;
+}
@@ -0,0 +1,20 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#ifndef INC_MEM_ALLOC_H_
+#define INC_MEM_ALLOC_H_
+
+#include <stddef.h>
+
+// All libakmc allocations go through these, sizes are the ones the block was allocated (or last reallocated) with
+void* mem_alloc(size_t size);
+void* mem_realloc(void* ptr, size_t oldSize, size_t newSize);
+void mem_free(void* ptr, size_t size);
+
+// Count of live templates, every relationship holds its template so they are covered as well
+void mem_template_created(void);
+void mem_template_freed(void);
+
+#endif /* INC_MEM_ALLOC_H_ */
@@ -33,6 +33,14 @@
 
 #define restrict __restrict
 
+#define threadlocal __declspec(thread)
+
+#include <intrin.h>
+
+static inline long atomicIncrement(volatile long* p) { return _InterlockedIncrement(p); }
+
+static inline long atomicDecrement(volatile long* p) { return _InterlockedDecrement(p); }
+
 #else
 
 #ifdef NDEBUG
@@ -55,6 +63,12 @@
 
 #define unlikely(cond) expect(!!(cond),0)
 
+#define threadlocal __thread
+
+static inline long atomicIncrement(volatile long* p) { return __atomic_add_fetch(p, 1, __ATOMIC_RELAXED); }
+
+static inline long atomicDecrement(volatile long* p) { return __atomic_sub_fetch(p, 1, __ATOMIC_ACQ_REL); }
+
 #endif
 
 bool memIsZero(const void* mem, size_t n);
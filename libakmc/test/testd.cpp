@@ -0,0 +1,676 @@
+/*
+ * Copyright 2020 OlympusSky Technologies S.A. All Rights Reserved.
+ */
+
+
+#include <akmd.h>
+#include <akmd_udp.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+const uint16_t ringNodes[] = { 1, 5 };
+const uint16_t clientAddress = 1;
+const uint16_t daemonAddress = 5;
+const uint16_t firstId = 100;
+const uint32_t relationshipNum = 20000;
+
+const char* const defaultKeys[AKMD_KEYS_NUM] = {
+	"6v9y$B&E)H+MbQeThWmZq4t7w!z%C*F-",
+	"z$C&F)H@McQfTjWnZr4u7x!A%D*G-KaN",
+	"6v9y$B&E)H+MbQeMhWmZq4t7w!z%C*Fo",
+	"z$C&F)H@McQfTjWaZr4u7x!A%D*G-Kat",
+};
+
+typedef bool(*test_func)();
+
+bool test_aes();
+bool test_frame();
+bool test_timers();
+bool test_loopback();
+bool test_datagrams();
+bool test_channels();
+
+test_func tests[] =
+{
+	test_aes,
+	test_frame,
+	test_timers,
+	test_loopback,
+	test_datagrams,
+	test_channels,
+	nullptr,
+};
+
+int main()
+{
+	for (int i = 0; ; ++i)
+	{
+		if (!tests[i])
+			break;
+		if (!tests[i]())
+			break;
+	}
+	return 0;
+}
+
+#define CHECK(x) do { if(!(x)) { std::cout << __LINE__ << ": " << #x << std::endl; return false; } } while(0)
+
+static void makeConfig(AKMConfiguration* config, AKMParameterDataVector* pdv, const uint16_t* self)
+{
+	for (int i = 0; i < AKM_PARAMETER_DATA_VECTOR_SIZE; ++i)
+		pdv->data[i] = (uint8_t)i;
+	*config = AKMConfiguration();
+	config->params.SK = AES256_KEY_SIZE;
+	config->params.SRNA = sizeof(ringNodes[0]);
+	config->params.N = sizeof(ringNodes) / sizeof(ringNodes[0]);
+	config->params.NNRT = 1000000000;
+	config->params.NSET = 1000000000;
+	config->params.FBSET = 1000000000;
+	config->params.FSSET = 1000000000;
+	config->pdv = pdv;
+	config->nodeAddresses = ringNodes;
+	config->selfNodeAddress = self;
+}
+
+static const uint8_t* const* keysOf(const char* const* keys)
+{
+	return reinterpret_cast<const uint8_t* const*>(keys);
+}
+
+bool test_aes()
+{
+	// FIPS-197 C.3
+	uint8_t key[AES256_KEY_SIZE];
+	for (int i = 0; i < AES256_KEY_SIZE; ++i)
+		key[i] = (uint8_t)i;
+	const uint8_t plain[AES_BLOCK_SIZE] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+	const uint8_t cipher[AES_BLOCK_SIZE] = { 0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89 };
+	AES256_Ctx ctx;
+	AES256_init(&ctx, key);
+	uint8_t block[AES_BLOCK_SIZE];
+	AES256_encrypt_block(&ctx, plain, block);
+	CHECK(memcmp(block, cipher, AES_BLOCK_SIZE) == 0);
+	AES256_decrypt_block(&ctx, block, block);
+	CHECK(memcmp(block, plain, AES_BLOCK_SIZE) == 0);
+
+	uint8_t iv[AES_BLOCK_SIZE] = { 0 };
+	uint8_t buffer[64], decrypted[64];
+	for (size_t len = 0; len <= AES256_KEY_SIZE; ++len)
+	{
+		memcpy(buffer, key, len);
+		const size_t size = AES256_cbc_encrypt(&ctx, iv, buffer, len, buffer);
+		CHECK(size == AES256_cbc_size(len) && size % AES_BLOCK_SIZE == 0 && size > len);
+		CHECK(AES256_cbc_decrypt(&ctx, iv, buffer, size, decrypted) == len);
+		CHECK(memcmp(decrypted, key, len) == 0);
+	}
+	CHECK(AES256_cbc_decrypt(&ctx, iv, buffer, 15, decrypted) == SIZE_MAX);
+	return true;
+}
+
+bool test_frame()
+{
+	AKMConfiguration config;
+	AKMParameterDataVector pdv;
+	makeConfig(&config, &pdv, &clientAddress);
+	AKMDNode node;
+	CHECK(AKMDNodeInit(&node, &config, keysOf(defaultKeys), firstId, 2, 0) == AKMStSuccess);
+	AKMDRelationship* rel = AKMDNodeFind(&node, firstId + 1);
+	CHECK(rel && rel->id == firstId + 1 && !AKMDNodeFind(&node, firstId + 2) && !AKMDNodeFind(&node, firstId - 1));
+
+	const char content[] = "hello";
+	std::vector<uint8_t> out(AKMDFrameSealedSize(sizeof(content)));
+	CHECK(AKMDNodeSeal(&node, rel, &daemonAddress, AKMEvNone, content, sizeof(content), out.data()) == out.size());
+	CHECK(out[0] == (uint8_t)(firstId + 1) && out[1] == 0 && out[2] == out.size() - AKMD_HEADER_SIZE);
+
+	AES256_Ctx key;
+	AES256_init(&key, (const uint8_t*)defaultKeys[rel->encKeyIdx]);
+	std::vector<uint8_t> buffer(out.size());
+	AKMFrame plain;
+	const uint8_t* data = out.data() + AKMD_HEADER_SIZE;
+	const size_t dataSize = out.size() - AKMD_HEADER_SIZE;
+	CHECK(AKMDFrameOpen(&plain, &node.plainLayout, &key, firstId + 1, data, dataSize, buffer.data()) == AKMStSuccess);
+	CHECK(AKMFrameGetEvent(&plain) == AKMEvNone && AKMFrameGetUInt(&plain, AKMFfSourceAddress) == clientAddress);
+	CHECK(AKMFrameGetUInt(&plain, AKMFfTargetAddress) == daemonAddress);
+	AKMFrameSpan span;
+	AKMFrameGetField(&plain, AKMFfPayload, &span);
+	CHECK(span.size == sizeof(content) && memcmp(span.data, content, sizeof(content)) == 0);
+	// The hash binds the frame to its relationship
+	CHECK(AKMDFrameOpen(&plain, &node.plainLayout, &key, firstId, data, dataSize, buffer.data()) == AKMStFatalError);
+	out.back() ^= 1;
+	CHECK(AKMDFrameOpen(&plain, &node.plainLayout, &key, firstId + 1, data, dataSize, buffer.data()) == AKMStFatalError);
+	AKMDNodeFree(&node);
+	return true;
+}
+
+bool test_timers()
+{
+	AKMConfiguration config;
+	AKMParameterDataVector pdv;
+	makeConfig(&config, &pdv, &clientAddress);
+	config.params.NSET = 50;
+	AKMDNode node;
+	CHECK(AKMDNodeInit(&node, &config, keysOf(defaultKeys), firstId, 3, 0) == AKMStSuccess);
+	// Created establishing, every relationship waits for NSET to pass
+	akm_time_t deadline;
+	CHECK(node.timerNum == 3 && AKMDNodeNextDeadline(&node, &deadline) && deadline == 51);
+	CHECK(AKMDNodeExpire(&node, 50) == 0);
+	CHECK(AKMDNodeExpire(&node, 75) == 3);
+	CHECK(node.stats.timeouts == 3 && node.timerNum == 3);
+	CHECK(AKMDNodeNextDeadline(&node, &deadline) && deadline > 75);
+	for (uint32_t i = 0; i < node.timerNum; ++i)
+		CHECK(node.relationships[node.timers[i]].timerIndex == i && node.relationships[node.timers[i]].deadline >= deadline);
+	AKMDNodeFree(&node);
+	return true;
+}
+
+static bool sendAll(int fd, const uint8_t* data, size_t size)
+{
+	while (size > 0)
+	{
+		const ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		data += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+static bool recvAll(int fd, uint8_t* data, size_t size)
+{
+	while (size > 0)
+	{
+		const ssize_t n = recv(fd, data, size, 0);
+		if (n <= 0)
+			return false;
+		data += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+static int connectTo(uint16_t port, int type = SOCK_STREAM, uint16_t localPort = 0)
+{
+	const int fd = socket(AF_INET, type, 0);
+	sockaddr_in addr = sockaddr_in();
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(localPort);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (localPort != 0 && bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	addr.sin_port = htons(port);
+	if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	const int one = 1;
+	if (type == SOCK_STREAM)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+static bool sendFrame(int fd, AKMDNode* node, AKMDRelationship* rel, const std::string& content)
+{
+	std::vector<uint8_t> out(AKMDFrameSealedSize(content.size()));
+	return AKMDNodeSeal(node, rel, &daemonAddress, (AKMEvent)rel->sendEvent, content.data(), content.size(), out.data()) == out.size()
+		&& sendAll(fd, out.data(), out.size());
+}
+
+// Passes a frame to its relationship, returns its content or "" if it did not decrypt
+static bool openFrame(AKMDNode* node, const uint8_t* header, const uint8_t* data, std::string* content)
+{
+	const uint16_t relationshipId = (uint16_t)(header[0] | header[1] << 8);
+	uint64_t dataSize = 0;
+	for (int i = 7; i >= 0; --i)
+		dataSize = dataSize << 8 | header[2 + i];
+	std::vector<uint8_t> buffer(dataSize + AKMD_ADDRESS_SIZE);
+	AKMDRelationship* rel = AKMDNodeFind(node, relationshipId);
+	if (!rel)
+		return false;
+	AKMFrame plain;
+	if (AKMDNodeReceive(node, rel, data, dataSize, buffer.data(), 0, &plain) != AKMStSuccess)
+		return false;
+	content->clear();
+	if (plain.size > 0)
+	{
+		AKMFrameSpan span;
+		AKMFrameGetField(&plain, AKMFfPayload, &span);
+		content->assign((const char*)span.data, span.size);
+		if (AKMFrameGetUInt(&plain, AKMFfSourceAddress) != daemonAddress)
+			return false;
+	}
+	return true;
+}
+
+static bool recvFrame(int fd, AKMDNode* node, std::string* content)
+{
+	uint8_t header[AKMD_HEADER_SIZE];
+	if (!recvAll(fd, header, sizeof(header)))
+		return false;
+	uint64_t dataSize = 0;
+	for (int i = 7; i >= 0; --i)
+		dataSize = dataSize << 8 | header[2 + i];
+	if (dataSize > AKMD_MAX_DATA_SIZE)
+		return false;
+	std::vector<uint8_t> data(dataSize);
+	return recvAll(fd, data.data(), data.size()) && openFrame(node, header, data.data(), content);
+}
+
+// A frame is a whole datagram
+static bool recvDatagram(int fd, AKMDNode* node, std::string* content)
+{
+	std::vector<uint8_t> datagram(AKMD_UDP_MAX_PAYLOAD);
+	const ssize_t n = recv(fd, datagram.data(), datagram.size(), 0);
+	return n >= AKMD_HEADER_SIZE && openFrame(node, datagram.data(), datagram.data() + AKMD_HEADER_SIZE, content);
+}
+
+// Where the client sends its frames: a TCP stream, a connected UDP socket or a shared-memory channel
+struct Transport
+{
+	int fd;
+	bool datagrams;
+	AKMDShmChannel* channel;
+};
+
+static bool sendRecord(AKMDShmChannel* channel, AKMDNode* node, AKMDRelationship* rel, const std::string& content)
+{
+	const size_t size = AKMDFrameSealedSize(content.size());
+	uint8_t* out;
+	while (!(out = AKMDRingReserve(&channel->out, size)))
+	{
+		if (AKMDRingProducerSleep(&channel->out, size) && !AKMDShmWait(channel->out.spaceFd, 1000))
+			return false;
+	}
+	if (AKMDNodeSeal(node, rel, &daemonAddress, (AKMEvent)rel->sendEvent, content.data(), content.size(), out) != size)
+		return false;
+	AKMDRingCommit(&channel->out, size);
+	AKMDRingWakeConsumer(&channel->out);
+	return true;
+}
+
+static bool recvRecord(AKMDShmChannel* channel, AKMDNode* node, std::string* content)
+{
+	size_t size;
+	const uint8_t* record;
+	while (!(record = AKMDRingPeek(&channel->in, &size)))
+	{
+		if (AKMDRingConsumerSleep(&channel->in) && !AKMDShmWait(channel->in.dataFd, 1000))
+			return false;
+	}
+	const bool ok = size >= AKMD_HEADER_SIZE && openFrame(node, record, record + AKMD_HEADER_SIZE, content);
+	AKMDRingConsume(&channel->in, size);
+	AKMDRingWakeProducer(&channel->in);
+	return ok;
+}
+
+static bool sendOver(const Transport& transport, AKMDNode* node, AKMDRelationship* rel, const std::string& content)
+{
+	return transport.channel ? sendRecord(transport.channel, node, rel, content) : sendFrame(transport.fd, node, rel, content);
+}
+
+static bool recvOver(const Transport& transport, AKMDNode* node, std::string* content)
+{
+	if (transport.channel)
+		return recvRecord(transport.channel, node, content);
+	return transport.datagrams ? recvDatagram(transport.fd, node, content) : recvFrame(transport.fd, node, content);
+}
+
+// Session establishment started by the client on one relationship, then data echoed with the new keys
+static bool establish(const Transport& transport, AKMDNode* node, uint16_t id)
+{
+	AKMDRelationship* rel = AKMDNodeFind(node, id);
+	CHECK(rel && AKMDNodeLocalSEI(node, rel, 0) == AKMStSuccess);
+	CHECK(rel->sendEvent == AKMEvRecvSEI);
+	const uint64_t keysSet = node->stats.keysSet;
+	for (int round = 0; round < 8; ++round)
+	{
+		const std::string ping = "ping " + std::to_string(id) + " " + std::to_string(round);
+		std::string pong;
+		CHECK(sendOver(transport, node, rel, ping));
+		CHECK(recvOver(transport, node, &pong));
+		CHECK(pong == ping);
+	}
+	CHECK(node->stats.keysSet > keysSet);
+	CHECK(rel->sendEvent == AKMEvNone || rel->sendEvent == AKMEvRecvSE);
+	return true;
+}
+
+bool test_loopback()
+{
+	AKMConfiguration daemonConfig, clientConfig;
+	AKMParameterDataVector daemonPdv, clientPdv;
+	makeConfig(&daemonConfig, &daemonPdv, &daemonAddress);
+	makeConfig(&clientConfig, &clientPdv, &clientAddress);
+	AKMDConfig config = AKMDConfig();
+	config.address = "127.0.0.1";
+	config.firstRelationshipId = firstId;
+	config.relationshipNum = relationshipNum;
+	config.akm = &daemonConfig;
+	for (int i = 0; i < AKMD_KEYS_NUM; ++i)
+		config.keys[i] = (const uint8_t*)defaultKeys[i];
+	config.echo = true;
+	AKMDaemon* daemon;
+	CHECK(AKMDCreate(&daemon, &config) == AKMStSuccess);
+	CHECK(AKMDGetPort(daemon) != 0);
+	std::thread reactor([daemon] { AKMDRun(daemon); });
+
+	AKMDNode client;
+	bool ok = AKMDNodeInit(&client, &clientConfig, keysOf(defaultKeys), firstId, relationshipNum, 0) == AKMStSuccess;
+	const int fd = ok ? connectTo(AKMDGetPort(daemon)) : -1;
+	ok = ok && fd >= 0
+		&& establish({ fd }, &client, firstId)
+		&& establish({ fd }, &client, firstId + relationshipNum / 2)
+		&& establish({ fd }, &client, firstId + relationshipNum - 1);
+
+	if (ok)
+	{
+		// A frame under a key the relationship never had gets no answer, the next one does
+		const char* const wrongKey = "0123456789abcdef0123456789abcdef";
+		const char* wrongKeys[AKMD_KEYS_NUM] = { wrongKey, wrongKey, wrongKey, wrongKey };
+		AKMDNode stranger;
+		ok = AKMDNodeInit(&stranger, &clientConfig, keysOf(wrongKeys), firstId, 1, 0) == AKMStSuccess;
+		std::string pong;
+		ok = ok && sendFrame(fd, &stranger, stranger.relationships, "lost")
+			&& sendFrame(fd, &client, AKMDNodeFind(&client, firstId), "found")
+			&& recvFrame(fd, &client, &pong) && pong == "found";
+		AKMDNodeFree(&stranger);
+	}
+	int closedFd = -1;
+	if (ok)
+	{
+		// A peer not speaking the transmission format is disconnected
+		closedFd = connectTo(AKMDGetPort(daemon));
+		uint8_t garbage[AKMD_HEADER_SIZE] = { 1, 0, 5 };
+		uint8_t byte;
+		ok = closedFd >= 0 && sendAll(closedFd, garbage, sizeof(garbage)) && recv(closedFd, &byte, 1, 0) == 0;
+	}
+
+	if (fd >= 0)
+		close(fd);
+	if (closedFd >= 0)
+		close(closedFd);
+	AKMDStop(daemon);
+	reactor.join();
+	AKMDStats stats;
+	AKMDGetStats(daemon, &stats);
+	AKMDFree(daemon);
+	AKMDNodeFree(&client);
+	CHECK(ok);
+	CHECK(stats.connections == 2 && stats.malformed == 1 && stats.node.cannotDecrypt == 1);
+	CHECK(stats.framesIn == 26 && stats.framesOut == 25 && stats.node.keysSet > 0);
+	return true;
+}
+
+// A window of frames sent in one batch comes back whole, however the kernel segments it
+static bool echoBatch(int fd, AKMDNode* node, uint16_t id, int num)
+{
+	AKMDDatagramBatch batch;
+	CHECK(AKMDBatchInit(&batch, AKMD_UDP_BATCH, AKMD_UDP_BATCH * 64 * 1024) == AKMStSuccess);
+	batch.gso = AKMDUdpEnableGso(fd);
+	AKMDUdpEnableGro(fd);
+	AKMDRelationship* rel = AKMDNodeFind(node, id);
+	const std::string ping(100, 'b');
+	bool ok = true;
+	for (int i = 0; i < num && ok; ++i)
+	{
+		const size_t size = AKMDFrameSealedSize(ping.size());
+		uint8_t* out = AKMDBatchAdd(&batch, nullptr, size);
+		ok = out && AKMDNodeSeal(node, rel, &daemonAddress, (AKMEvent)rel->sendEvent, ping.data(), ping.size(), out) == size;
+	}
+	ok = ok && AKMDBatchSend(&batch, fd, nullptr, nullptr) == num;
+	int received = 0;
+	while (ok && received < num)
+	{
+		const int n = AKMDBatchReceive(&batch, fd, true);
+		ok = n > 0;
+		for (int i = 0; ok && i < n; ++i)
+		{
+			const uint8_t* data;
+			size_t size, segmentSize;
+			const sockaddr_in* peer;
+			AKMDBatchReceived(&batch, (unsigned)i, &data, &size, &segmentSize, &peer);
+			for (size_t pos = 0; ok && pos < size; pos += segmentSize, ++received)
+			{
+				std::string pong;
+				ok = openFrame(node, data + pos, data + pos + AKMD_HEADER_SIZE, &pong) && pong == ping;
+			}
+		}
+	}
+	AKMDBatchFree(&batch);
+	CHECK(ok && received == num);
+	return true;
+}
+
+bool test_datagrams()
+{
+	AKMConfiguration daemonConfig, clientConfig;
+	AKMParameterDataVector daemonPdv, clientPdv;
+	makeConfig(&daemonConfig, &daemonPdv, &daemonAddress);
+	makeConfig(&clientConfig, &clientPdv, &clientAddress);
+	AKMDConfig config = AKMDConfig();
+	config.address = "127.0.0.1";
+	config.firstRelationshipId = firstId;
+	config.relationshipNum = relationshipNum;
+	config.akm = &daemonConfig;
+	for (int i = 0; i < AKMD_KEYS_NUM; ++i)
+		config.keys[i] = (const uint8_t*)defaultKeys[i];
+	config.echo = true;
+	config.udp = true;
+	config.udpOffload = true;
+	config.udpMtu = AKMD_UDP_DEFAULT_MTU;
+	AKMDaemon* daemon;
+	CHECK(AKMDCreate(&daemon, &config) == AKMStSuccess);
+	std::thread reactor([daemon] { AKMDRun(daemon); });
+
+	AKMDNode client;
+	bool ok = AKMDNodeInit(&client, &clientConfig, keysOf(defaultKeys), firstId, relationshipNum, 0) == AKMStSuccess;
+	const int udpFd = ok ? connectTo(AKMDGetPort(daemon), SOCK_DGRAM) : -1;
+	const int tcpFd = ok ? connectTo(AKMDGetPort(daemon)) : -1;
+	ok = ok && udpFd >= 0 && tcpFd >= 0
+		&& establish({ udpFd, true }, &client, firstId)
+		&& establish({ udpFd, true }, &client, firstId + relationshipNum - 1)
+		&& echoBatch(udpFd, &client, firstId, 48);
+
+	if (ok)
+	{
+		// A datagram holding part of a frame is dropped alone, the socket keeps working
+		uint8_t garbage[AKMD_HEADER_SIZE + AKMD_MIN_DATA_SIZE] = { 100, 0, 5 };
+		std::string pong;
+		ok = send(udpFd, garbage, sizeof(garbage), 0) == (ssize_t)sizeof(garbage)
+			&& sendFrame(udpFd, &client, AKMDNodeFind(&client, firstId), "after")
+			&& recvDatagram(udpFd, &client, &pong) && pong == "after";
+	}
+	// A reply past the MTU goes over TCP: over the connection its relationship's frames came over, otherwise over
+	// one from the datagram's own address and port; another connection from the same host does not get it
+	const std::string large(2000, 'l');
+	AKMDRelationship* last = AKMDNodeFind(&client, firstId + relationshipNum - 1);
+	int portFd = -1;
+	if (ok)
+	{
+		std::string pong;
+		uint8_t byte;
+		ok = sendFrame(udpFd, &client, last, large) && sendFrame(udpFd, &client, last, "sync")
+			&& recvDatagram(udpFd, &client, &pong) && pong == "sync" && recv(tcpFd, &byte, 1, MSG_DONTWAIT) < 0 && errno == EAGAIN;
+	}
+	if (ok)
+	{
+		sockaddr_in local;
+		socklen_t len = sizeof(local);
+		std::string pong;
+		ok = getsockname(udpFd, (sockaddr*)&local, &len) == 0
+			&& (portFd = connectTo(AKMDGetPort(daemon), SOCK_STREAM, ntohs(local.sin_port))) >= 0
+			&& sendFrame(udpFd, &client, last, large) && recvFrame(portFd, &client, &pong) && pong == large;
+	}
+	if (ok)
+	{
+		std::string pong;
+		ok = sendFrame(tcpFd, &client, AKMDNodeFind(&client, firstId), "stream") && recvFrame(tcpFd, &client, &pong) && pong == "stream"
+			&& sendFrame(udpFd, &client, AKMDNodeFind(&client, firstId), large) && recvFrame(tcpFd, &client, &pong) && pong == large;
+	}
+
+	if (udpFd >= 0)
+		close(udpFd);
+	if (tcpFd >= 0)
+		close(tcpFd);
+	if (portFd >= 0)
+		close(portFd);
+	AKMDStop(daemon);
+	reactor.join();
+	AKMDStats stats;
+	AKMDGetStats(daemon, &stats);
+	AKMDFree(daemon);
+	AKMDNodeFree(&client);
+	CHECK(ok);
+	CHECK(stats.malformed == 1 && stats.streamFallbacks == 2 && stats.framesDropped == 1 && stats.node.cannotDecrypt == 0);
+	// The dropped reply is made up for by the one to the frame over TCP
+	CHECK(stats.datagramsIn == 8 + 8 + 48 + 1 + 4 && stats.framesOut == stats.datagramsIn);
+	CHECK(stats.datagramsOut == stats.framesOut - 3 && stats.datagramBatches > 0);
+	return true;
+}
+
+static std::string burstContent(size_t i)
+{
+	return std::string(i * 7 % 700, (char)('a' + i % 26));
+}
+
+// Frames of many sizes streamed both ways at once through rings too small for them, wrapping and waiting for
+// room on both sides; replies come in order
+static bool streamBurst(AKMDShmChannel* channel, AKMDNode* node, uint16_t id, size_t num)
+{
+	AKMDRelationship* rel = AKMDNodeFind(node, id);
+	size_t sent = 0, received = 0;
+	while (received < num)
+	{
+		bool progress = false;
+		for (; sent < num; ++sent, progress = true)
+		{
+			const std::string content = burstContent(sent);
+			const size_t size = AKMDFrameSealedSize(content.size());
+			uint8_t* out = AKMDRingReserve(&channel->out, size);
+			if (!out)
+				break;
+			CHECK(AKMDNodeSeal(node, rel, &daemonAddress, (AKMEvent)rel->sendEvent, content.data(), content.size(), out) == size);
+			AKMDRingCommit(&channel->out, size);
+		}
+		AKMDRingWakeConsumer(&channel->out);
+		size_t size;
+		for (const uint8_t* record; (record = AKMDRingPeek(&channel->in, &size)); ++received, progress = true)
+		{
+			std::string pong;
+			CHECK(openFrame(node, record, record + AKMD_HEADER_SIZE, &pong));
+			CHECK(pong == burstContent(received));
+			AKMDRingConsume(&channel->in, size);
+		}
+		AKMDRingWakeProducer(&channel->in);
+		if (!progress && AKMDRingConsumerSleep(&channel->in))
+		{
+			if (sent < num)
+				AKMDRingProducerSleep(&channel->out, AKMDFrameSealedSize(burstContent(sent).size()));
+			pollfd fds[2] = { { channel->in.dataFd, POLLIN, 0 }, { channel->out.spaceFd, POLLIN, 0 } };
+			CHECK(poll(fds, 2, 1000) > 0);
+			uint64_t count;
+			for (const pollfd& fd : fds)
+			{
+				if (fd.revents & POLLIN)
+					CHECK(read(fd.fd, &count, sizeof(count)) == sizeof(count));
+			}
+		}
+	}
+	return true;
+}
+
+bool test_channels()
+{
+	AKMConfiguration daemonConfig, clientConfig;
+	AKMParameterDataVector daemonPdv, clientPdv;
+	makeConfig(&daemonConfig, &daemonPdv, &daemonAddress);
+	makeConfig(&clientConfig, &clientPdv, &clientAddress);
+	const std::string path = "/tmp/akm_testd." + std::to_string(getpid()) + ".sock";
+	AKMDConfig config = AKMDConfig();
+	config.address = "127.0.0.1";
+	config.firstRelationshipId = firstId;
+	config.relationshipNum = relationshipNum;
+	config.akm = &daemonConfig;
+	for (int i = 0; i < AKMD_KEYS_NUM; ++i)
+		config.keys[i] = (const uint8_t*)defaultKeys[i];
+	config.echo = true;
+	config.shmPath = path.c_str();
+	config.shmRingSize = 16 * 1024;
+	AKMDaemon* daemon;
+	CHECK(AKMDCreate(&daemon, &config) == AKMStSuccess);
+	std::thread reactor([daemon] { AKMDRun(daemon); });
+
+	AKMDNode client;
+	AKMDShmChannel channel;
+	bool ok = AKMDNodeInit(&client, &clientConfig, keysOf(defaultKeys), firstId, relationshipNum, 0) == AKMStSuccess;
+	const int fd = ok ? AKMDShmConnect(path.c_str(), &channel) : -1;
+	const Transport transport = { -1, false, &channel };
+	ok = ok && fd >= 0
+		&& establish(transport, &client, firstId)
+		&& establish(transport, &client, firstId + relationshipNum - 1)
+		&& streamBurst(&channel, &client, firstId, 3000);
+
+	if (ok)
+	{
+		// A record that is not one frame is dropped alone, the channel keeps working
+		uint8_t* garbage = AKMDRingReserve(&channel.out, AKMD_HEADER_SIZE + 1);
+		ok = garbage != nullptr;
+		if (ok)
+		{
+			memset(garbage, 0, AKMD_HEADER_SIZE + 1);
+			AKMDRingCommit(&channel.out, AKMD_HEADER_SIZE + 1);
+		}
+		std::string pong;
+		ok = ok && sendRecord(&channel, &client, AKMDNodeFind(&client, firstId), "after")
+			&& recvRecord(&channel, &client, &pong) && pong == "after";
+	}
+
+	if (ok)
+	{
+		// A record size reaching past the ring breaks the channel, the daemon closes it instead of reading beyond
+		uint8_t* forged = AKMDRingReserve(&channel.out, AKMD_HEADER_SIZE);
+		ok = forged != nullptr;
+		if (ok)
+		{
+			memset(forged, 0, AKMD_HEADER_SIZE);
+			AKMDRingCommit(&channel.out, AKMD_HEADER_SIZE);
+			const uint32_t prefix = UINT32_MAX - 16;
+			memcpy(forged - AKMD_RECORD_PREFIX, &prefix, sizeof(prefix));
+			AKMDRingWakeConsumer(&channel.out);
+		}
+		pollfd closed = { fd, POLLIN, 0 };
+		uint8_t byte;
+		ok = ok && poll(&closed, 1, 1000) == 1 && recv(fd, &byte, sizeof(byte), 0) == 0;
+	}
+
+	if (fd >= 0)
+	{
+		close(fd);
+		AKMDShmClose(&channel);
+	}
+	AKMDStop(daemon);
+	reactor.join();
+	AKMDStats stats;
+	AKMDGetStats(daemon, &stats);
+	AKMDFree(daemon);
+	AKMDNodeFree(&client);
+	CHECK(ok);
+	CHECK(access(path.c_str(), F_OK) != 0);
+	CHECK(stats.channels == 1 && stats.malformed == 2 && stats.node.cannotDecrypt == 0);
+	CHECK(stats.framesIn == 8 + 8 + 3000 + 1 && stats.framesOut == stats.framesIn && stats.framesDropped == 0);
+	return true;
+}
@@ -4,8 +4,12 @@
 
 
 #include <akm.h>
+#include <akm.hpp>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <random>
+#include <thread>
 
 const uint16_t nodeAddresses[] = { 3, 5, 7, 9 };
 const uint16_t selfAddress[] = { 9 };
@@ -19,6 +23,13 @@ bool test_fallback(AKMRelationship* relationship);
 bool test_fbk_from_established(AKMRelationship* relationship);
 bool test_decrypt_fails(AKMRelationship* relationship);
 bool test_timeouts(AKMRelationship* relationship);
+bool test_frame_layout(AKMRelationship* relationship);
+bool test_cpp_wrapper(AKMRelationship* relationship);
+bool test_membership(AKMRelationship* relationship);
+bool test_template(AKMRelationship* relationship);
+bool test_allocator(AKMRelationship* relationship);
+bool test_large_ring(AKMRelationship* relationship);
+bool test_replica(AKMRelationship* relationship);
 
 test_func tests[] =
 {
@@ -29,6 +40,12 @@ test_func tests[] =
 	test_fbk_from_established,
 	test_decrypt_fails,
 	test_timeouts,
+	test_frame_layout,
+	test_cpp_wrapper,
+	test_membership,
+	test_template,
+	test_large_ring,
+	test_replica,
 	nullptr,
 };
 
@@ -69,6 +86,9 @@ AKMRelationship* makeRelationship()
 
 int main()
 {
+	// The allocator can be changed only while no relationship exists, ahead of the one shared by the other tests
+	if (!test_allocator(nullptr))
+		return 0;
 	AKMRelationship* relationship = makeRelationship();
 	for (int i = 0; ; ++i)
 	{
@@ -628,3 +648,424 @@ bool test_timeouts(AKMRelationship* relationship)
 	CHECK(ctx.cmd.opcode == AKMCmdOpReturn && ctx.cmd.p1 == AKMStSuccess);
 	return true;
 }
+
+bool test_frame_layout(AKMRelationship* relationship)
+{
+	(void)relationship;
+	AKMFrameSchema schema = { 0 };
+	schema.relationshipIdIndex = 0;
+	schema.relationshipIdLength = 2;
+	schema.sourceAddressIndex = 2;
+	schema.sourceAddressLength = 2;
+	schema.targetAddressIndex = 4;
+	schema.targetAddressLength = 2;
+	schema.akmEventIndex = 6;
+	schema.akmEventLength = 1;
+	schema.dataStartIndex = 7;
+	schema.tagLength = 32;
+	AKMFrameLayout layout;
+	CHECK(AKMFrameLayoutCompile(&layout, &schema) == AKMStSuccess);
+	uint8_t buffer[64];
+	AKMFrame frame;
+	CHECK(AKMFrameBuild(&frame, &layout, buffer, sizeof(buffer), 32) == AKMStNoMemory);
+	CHECK(AKMFrameBuild(&frame, &layout, buffer, sizeof(buffer), 5) == AKMStSuccess);
+	CHECK(frame.size == 7 + 5 + 32);
+	AKMFrameSetUInt(&frame, AKMFfRelationshipId, 1);
+	AKMFrameSetField(&frame, AKMFfSourceAddress, nodeAddresses + 1, sizeof(nodeAddresses[1]));
+	AKMFrameSetField(&frame, AKMFfTargetAddress, nodeAddresses + 3, sizeof(nodeAddresses[3]));
+	AKMFrameSetEvent(&frame, AKMEvNone);
+	AKMFrameSpan span;
+	AKMFrameGetField(&frame, AKMFfPayload, &span);
+	CHECK(span.data == buffer + 7 && span.size == 5);
+	memcpy(span.data, "hello", 5);
+	AKMFrameGetField(&frame, AKMFfTag, &span);
+	CHECK(span.data == buffer + 12 && span.size == 32);
+	CHECK(buffer[0] == 1 && buffer[1] == 0 && buffer[2] == 5 && buffer[4] == 9 && buffer[6] == 0xFF);
+	AKMFrame parsed;
+	CHECK(AKMFrameParse(&parsed, &layout, buffer, frame.size) == AKMStSuccess);
+	CHECK(AKMFrameGetEvent(&parsed) == AKMEvNone);
+	CHECK(AKMFrameGetUInt(&parsed, AKMFfRelationshipId) == 1);
+	AKMFrameGetField(&parsed, AKMFfSourceAddress, &span);
+	CHECK(span.data == buffer + 2 && memcmp(span.data, nodeAddresses + 1, span.size) == 0);
+	AKMFrameGetField(&parsed, AKMFfPayload, &span);
+	CHECK(span.size == 5 && memcmp(span.data, "hello", 5) == 0);
+	CHECK(AKMFrameParse(&parsed, &layout, buffer, 38) == AKMStFatalError);
+
+	AKMFrameSchema envelope = { 0 };
+	envelope.relationshipIdLength = 2;
+	envelope.lengthIndex = 2;
+	envelope.lengthLength = 8;
+	envelope.dataStartIndex = 10;
+	CHECK(AKMFrameLayoutCompile(&layout, &envelope) == AKMStSuccess);
+	CHECK(AKMFrameBuild(&frame, &layout, buffer, sizeof(buffer), 20) == AKMStSuccess);
+	CHECK(AKMFrameGetUInt(&frame, AKMFfLength) == 20);
+	CHECK(AKMFrameSetPayloadSize(&frame, 6) == AKMStSuccess);
+	CHECK(AKMFrameGetUInt(&frame, AKMFfLength) == 6);
+	CHECK(AKMFrameParse(&parsed, &layout, buffer, sizeof(buffer)) == AKMStSuccess);
+	CHECK(parsed.size == 16);
+	CHECK(AKMFrameParse(&parsed, &layout, buffer, 15) == AKMStFatalError);
+
+	envelope.lengthIndex = 1;
+	CHECK(AKMFrameLayoutCompile(&layout, &envelope) == AKMStFatalError);
+	return true;
+}
+
+bool test_cpp_wrapper(AKMRelationship* relationship)
+{
+	(void)relationship;
+	typedef akm::Relationship<2, 1> Rel;
+	const Rel::AddressType nodes[] = {
+		Rel::AddressType::fromUInt(3),
+		Rel::AddressType::fromUInt(5),
+		Rel::AddressType::fromUInt(7),
+		Rel::AddressType::fromUInt(9),
+	};
+	AKMConfigParams params = { 0 };
+	params.NNRT = 1000000000;
+	params.NSET = 1000000000;
+	params.FBSET = 1000000000;
+	params.FSSET = 1000000000;
+	AKMParameterDataVector pdv = { { 0 } };
+	Rel rel;
+	int initCmds = 0;
+	CHECK(rel.init(params, pdv, nodes, 4, nodes[3], 0, [&](const auto&) { ++initCmds; }) == AKMStSuccess);
+	CHECK(rel && initCmds > 0);
+	Rel other(std::move(rel));
+	CHECK(!rel && other && other.nodeNum() == 4);
+	int useKeys = 0;
+	int sendEvents = 0;
+	auto handler = akm::overloaded{
+		[&](const akm::cmd::UseKeys& cmd) { CHECK(cmd.encKey == akm::KeyNSK && cmd.decKey == akm::KeyNSK); ++useKeys; return true; },
+		[&](const akm::cmd::SetSendEvent& cmd) { CHECK(cmd.sendOk && cmd.akmEvent == AKMEvRecvSEC); ++sendEvents; return true; },
+	};
+	CHECK(other.process(AKMEvRecvSEI, nodes + 0, 0, handler) == AKMStSuccess);
+	CHECK(other.process(AKMEvRecvSEI, nodes + 1, 0, handler) == AKMStSuccess);
+	CHECK(useKeys == 0 && sendEvents == 0);
+	CHECK(other.process(AKMEvRecvSEI, nodes + 2, 0, handler) == AKMStSuccess);
+	CHECK(useKeys == 1 && sendEvents == 1);
+	const AKMCommand* cmd = &other.begin(AKMEvRecvSEC, nodes + 0, 0);
+	CHECK(cmd->opcode == AKMCmdOpReturn && cmd->p1 == AKMStSuccess);
+	Rel unknown;
+	CHECK(unknown.init(params, pdv, nodes, 4, Rel::AddressType::fromUInt(4), 0, [](const akm::cmd::ResetTimer&) {}) == AKMStUnknownSource);
+	CHECK(!unknown);
+	return true;
+}
+
+bool test_membership(AKMRelationship* relationship)
+{
+	(void)relationship;
+	AKMRelationship* rel = makeRelationship();
+	CHECK(rel);
+	const uint16_t added[] = { 0x0201, 11, 4, 4, 5, 0x0102 };
+	CHECK(AKMAddNodes(rel, added, 6, 0) == AKMStSuccess);
+	uint16_t nodes[16] = { 0 };
+	uint16_t self = 0;
+	AKMConfiguration config = { 0 };
+	config.nodeAddresses = nodes;
+	config.selfNodeAddress = &self;
+	AKMGetConfig(rel, &config);
+	const uint16_t expected[] = { 3, 4, 5, 7, 9, 11, 0x0102, 0x0201 };
+	CHECK(config.params.N == 8 && self == 9 && memcmp(nodes, expected, sizeof(expected)) == 0);
+	const uint16_t removed[] = { 0x0201, 4, 100 };
+	CHECK(AKMRemoveNodes(rel, removed, 3) == AKMStSuccess);
+	const uint16_t selfOnly[] = { 9 };
+	CHECK(AKMRemoveNodes(rel, selfOnly, 1) == AKMStFatalError);
+	AKMGetConfig(rel, &config);
+	const uint16_t expected2[] = { 3, 5, 7, 9, 11, 0x0102 };
+	CHECK(config.params.N == 6 && self == 9 && memcmp(nodes, expected2, sizeof(expected2)) == 0);
+	const uint16_t others[] = { 3, 5, 7, 11, 0x0102 };
+	AKMProcessCtx ctx = { 0 };
+	ctx.relationship = rel;
+	for (int i = 0; i < 5; ++i)
+	{
+		ctx.srcAddr = others + i;
+		ctx.akmEvent = AKMEvRecvSEI;
+		do
+			AKMProcess(&ctx);
+		while (ctx.cmd.opcode != AKMCmdOpReturn);
+		CHECK(ctx.cmd.p1 == AKMStSuccess);
+	}
+	AKMFree(rel);
+	return true;
+}
+
+bool test_template(AKMRelationship* relationship)
+{
+	(void)relationship;
+	AKMConfiguration config = { 0 };
+	AKMParameterDataVector pdv = { { 0 } };
+	config.nodeAddresses = nodeAddresses;
+	config.pdv = &pdv;
+	config.params.SK = 1;
+	config.params.SRNA = sizeof(selfAddress);
+	config.params.N = sizeof(nodeAddresses) / config.params.SRNA;
+	config.params.NNRT = 1000000000;
+	config.params.NSET = 1000000000;
+	config.params.FBSET = 1000000000;
+	config.params.FSSET = 1000000000;
+	AKMTemplate* tmpl = NULL;
+	CHECK(AKMTemplateCreate(&tmpl, &config) == AKMStSuccess && tmpl);
+	AKMProcessCtx ctx[3] = { 0 };
+	CHECK(AKMInitFromTemplate(&ctx[0], tmpl, NULL) == AKMStFatalError);
+	const uint16_t unknown = 100;
+	CHECK(AKMInitFromTemplate(&ctx[0], tmpl, &unknown) == AKMStUnknownSource);
+	const uint16_t selves[] = { 3, 5, 7 };
+	for (int i = 0; i < 3; ++i)
+	{
+		CHECK(AKMInitFromTemplate(&ctx[i], tmpl, selves + i) == AKMStSuccess);
+		do
+			AKMProcess(&ctx[i]);
+		while (ctx[i].cmd.opcode != AKMCmdOpReturn);
+		CHECK(ctx[i].cmd.p1 == AKMStSuccess);
+	}
+	// Relationships keep the template alive
+	AKMTemplateRelease(tmpl);
+	const uint16_t removed = 9;
+	CHECK(AKMRemoveNodes(ctx[1].relationship, &removed, 1) == AKMStSuccess);
+	uint16_t nodes[8] = { 0 };
+	uint16_t self = 0;
+	config = AKMConfiguration();
+	config.nodeAddresses = nodes;
+	config.selfNodeAddress = &self;
+	AKMGetConfig(ctx[1].relationship, &config);
+	const uint16_t expected1[] = { 3, 5, 7 };
+	CHECK(config.params.N == 3 && self == 5 && memcmp(nodes, expected1, sizeof(expected1)) == 0);
+	AKMGetConfig(ctx[2].relationship, &config);
+	CHECK(config.params.N == 4 && self == 7 && memcmp(nodes, nodeAddresses, sizeof(nodeAddresses)) == 0);
+	for (int i = 0; i < 3; ++i)
+		AKMFree(ctx[i].relationship);
+	typedef akm::Relationship<2, 1> Rel;
+	const Rel::AddressType pair[] = { Rel::AddressType::fromUInt(3), Rel::AddressType::fromUInt(5) };
+	Rel rel;
+	{
+		akm::Template<2, 1> shared;
+		CHECK(shared.create(config.params, pdv, pair, 2) == AKMStSuccess && shared);
+		CHECK(rel.init(shared, pair[1], 0, [](const akm::cmd::ResetTimer&) {}) == AKMStSuccess);
+	}
+	CHECK(rel && rel.nodeNum() == 2);
+	return true;
+}
+
+// Prefixes blocks with their size to check the sizes passed back to the allocator
+struct CountingAllocator
+{
+	long blocks;
+	long bytes;
+	long sizeMismatches;
+
+	static void* allocate(void* ctx, size_t size)
+	{
+		CountingAllocator* self = (CountingAllocator*)ctx;
+		size_t* block = (size_t*)std::malloc(sizeof(size_t) + size);
+		if (!block)
+			return nullptr;
+		*block = size;
+		self->blocks++;
+		self->bytes += (long)size;
+		return block + 1;
+	}
+
+	static void deallocate(void* ctx, void* ptr, size_t size)
+	{
+		CountingAllocator* self = (CountingAllocator*)ctx;
+		size_t* block = (size_t*)ptr - 1;
+		if (*block != size)
+			self->sizeMismatches++;
+		self->blocks--;
+		self->bytes -= (long)*block;
+		std::free(block);
+	}
+
+	static void* reallocate(void* ctx, void* ptr, size_t oldSize, size_t newSize)
+	{
+		void* newPtr = allocate(ctx, newSize);
+		if (!newPtr)
+			return nullptr;
+		std::memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+		deallocate(ctx, ptr, oldSize);
+		return newPtr;
+	}
+};
+
+// Creates a relationship, changes its membership and establishes it, the allocator is exercised on every path
+static bool churnRelationship()
+{
+	AKMRelationship* rel = makeRelationship();
+	CHECK(rel);
+	const uint16_t added[] = { 11, 1, 13 };
+	CHECK(AKMAddNodes(rel, added, 3, 0) == AKMStSuccess);
+	CHECK(AKMRemoveNodes(rel, added, 2) == AKMStSuccess);
+	const uint16_t others[] = { 3, 5, 7, 13 };
+	AKMProcessCtx ctx = { 0 };
+	ctx.relationship = rel;
+	for (int i = 0; i < 4; ++i)
+	{
+		ctx.srcAddr = others + i;
+		ctx.akmEvent = AKMEvRecvSEI;
+		do
+			AKMProcess(&ctx);
+		while (ctx.cmd.opcode != AKMCmdOpReturn);
+		CHECK(ctx.cmd.p1 == AKMStSuccess);
+	}
+	AKMFree(rel);
+	return true;
+}
+
+bool test_allocator(AKMRelationship* relationship)
+{
+	(void)relationship;
+	// A live relationship's blocks must be freed by the allocator they came from
+	AKMRelationship* live = makeRelationship();
+	CHECK(live);
+	const AKMStatus whileLive = AKMSetAllocator(AKMPoolAllocator());
+	AKMFree(live);
+	CHECK(whileLive == AKMStFatalError);
+	CountingAllocator counting = { 0, 0, 0 };
+	const AKMAllocator hooks = { CountingAllocator::allocate, CountingAllocator::reallocate, CountingAllocator::deallocate, &counting };
+	CHECK(AKMSetAllocator(&hooks) == AKMStSuccess);
+	const bool countingOk = churnRelationship();
+	CHECK(AKMSetAllocator(NULL) == AKMStSuccess);
+	CHECK(countingOk);
+	CHECK(counting.blocks == 0 && counting.bytes == 0 && counting.sizeMismatches == 0);
+	CHECK(AKMSetAllocator(AKMPoolAllocator()) == AKMStSuccess);
+	bool poolOk = true;
+	for (int i = 0; i < 3 && poolOk; ++i)
+		poolOk = churnRelationship();
+	// Threads ending with cached blocks hand them back through the thread-exit destructor
+	for (int i = 0; i < 4 && poolOk; ++i)
+	{
+		std::thread worker([&poolOk]() { for (int j = 0; j < 3 && poolOk; ++j) poolOk = churnRelationship(); });
+		worker.join();
+	}
+	CHECK(AKMSetAllocator(NULL) == AKMStSuccess);
+	CHECK(poolOk);
+	return true;
+}
+
+// Grows the ring past the per-node data kept inside the relationship and back
+bool test_large_ring(AKMRelationship* relationship)
+{
+	(void)relationship;
+	AKMRelationship* rel = makeRelationship();
+	CHECK(rel);
+	uint16_t added[60];
+	for (int i = 0; i < 60; ++i)
+		added[i] = (uint16_t)(100 + i);
+	CHECK(AKMAddNodes(rel, added, 60, 0) == AKMStSuccess);
+	uint16_t nodes[64] = { 0 };
+	uint16_t self = 0;
+	AKMConfiguration config = { 0 };
+	config.nodeAddresses = nodes;
+	config.selfNodeAddress = &self;
+	AKMGetConfig(rel, &config);
+	CHECK(config.params.N == 64 && self == 9 && nodes[3] == 9 && nodes[4] == 100 && nodes[63] == 159);
+	CHECK(AKMRemoveNodes(rel, added, 60) == AKMStSuccess);
+	AKMGetConfig(rel, &config);
+	CHECK(config.params.N == 4 && self == 9 && memcmp(nodes, nodeAddresses, sizeof(nodeAddresses)) == 0);
+	AKMFree(rel);
+	return true;
+}
+
+// Feeds an event to the primary, replicates the resulting delta and checks the replica took the same state
+static bool feedReplicated(AKMRelationship* primary, AKMRelationship* replica, AKMEvent akmEvent, const uint16_t* srcAddr, akm_time_t time_ms)
+{
+	AKMProcessCtx ctx = { 0 };
+	ctx.relationship = primary;
+	ctx.akmEvent = akmEvent;
+	ctx.srcAddr = srcAddr;
+	ctx.time_ms = time_ms;
+	do
+		AKMProcess(&ctx);
+	while (ctx.cmd.opcode != AKMCmdOpReturn);
+	CHECK(ctx.cmd.p1 == AKMStSuccess);
+	uint8_t delta[512];
+	size_t size = 0;
+	CHECK(AKMGetDelta(primary, 0, delta, sizeof(delta), &size) == AKMStSuccess);
+	CHECK(AKMApplyDelta(replica, delta, size) == AKMStSuccess);
+	AKMConfiguration a = { 0 };
+	AKMConfiguration b = { 0 };
+	AKMGetConfig(primary, &a);
+	AKMGetConfig(replica, &b);
+	CHECK(memcmp(&a.params, &b.params, sizeof(a.params)) == 0);
+	return true;
+}
+
+bool test_replica(AKMRelationship* relationship)
+{
+	(void)relationship;
+	AKMConfiguration config = { 0 };
+	AKMParameterDataVector pdv;
+	std::random_device rd;
+	std::uniform_int_distribution<> dist(0, 255);
+	for (int i = 0; i < AKM_PARAMETER_DATA_VECTOR_SIZE; ++i)
+		pdv.data[i] = dist(rd);
+	config.nodeAddresses = nodeAddresses;
+	config.selfNodeAddress = selfAddress;
+	config.pdv = &pdv;
+	config.params.SK = 1;
+	config.params.SRNA = sizeof(selfAddress);
+	config.params.N = sizeof(nodeAddresses) / config.params.SRNA;
+	config.params.NNRT = 1000000000;
+	config.params.NSET = 1000000000;
+	config.params.FBSET = 1000000000;
+	config.params.FSSET = 1000000000;
+	AKMProcessCtx pc = { 0 };
+	AKMProcessCtx rc = { 0 };
+	CHECK(AKMInit(&pc, &config) == AKMStSuccess);
+	do
+		AKMProcess(&pc);
+	while (pc.cmd.opcode != AKMCmdOpReturn);
+	// The replica never runs its own initialization, the first delta brings it up to date
+	CHECK(AKMInit(&rc, &config) == AKMStSuccess);
+	AKMRelationship* primary = pc.relationship;
+	AKMRelationship* replica = rc.relationship;
+	uint8_t delta[512];
+	size_t size = 0;
+	CHECK(AKMGetDelta(primary, 0, delta, 4, &size) == AKMStNoMemory && size > 4);
+	const size_t fullSize = size;
+	CHECK(AKMGetDelta(primary, 0, delta, sizeof(delta), &size) == AKMStSuccess && size == fullSize);
+	CHECK(AKMApplyDelta(replica, delta, size) == AKMStSuccess);
+	CHECK(AKMGetDelta(primary, 0, delta, sizeof(delta), &size) == AKMStSuccess && size == 0);
+	const AKMEvent events[] = { AKMEvRecvSEI, AKMEvRecvSEC, AKMEvRecvSEF, AKMEvRecvSE };
+	for (int e = 0; e < 4; ++e)
+	{
+		for (int i = 0; i < 3; ++i)
+			CHECK(feedReplicated(primary, replica, events[e], nodeAddresses + i, 10));
+	}
+	const uint16_t removed = 3;
+	CHECK(AKMRemoveNodes(primary, &removed, 1) == AKMStSuccess);
+	CHECK(feedReplicated(primary, replica, AKMEvRecvSEI, nodeAddresses + 1, 20));
+	// Failover: the replica continues through a rekeying round with the same seeds and yields the same commands
+	AKMProcessCtx p = { 0 };
+	AKMProcessCtx r = { 0 };
+	p.relationship = primary;
+	r.relationship = replica;
+	int setKeys = 0;
+	for (int e = 0; e < 4; ++e)
+	{
+		for (int i = 1; i < 3; ++i)
+		{
+			p.akmEvent = r.akmEvent = events[e];
+			p.srcAddr = r.srcAddr = nodeAddresses + i;
+			p.time_ms = r.time_ms = 30;
+			do
+			{
+				AKMProcess(&p);
+				AKMProcess(&r);
+				CHECK(p.cmd.opcode == r.cmd.opcode && p.cmd.p1 == r.cmd.p1 && p.cmd.p2 == r.cmd.p2);
+				if (p.cmd.opcode == AKMCmdOpSetKey)
+				{
+					CHECK(memcmp(p.cmd.data, r.cmd.data, 1) == 0);
+					++setKeys;
+				}
+			}
+			while (p.cmd.opcode != AKMCmdOpReturn);
+		}
+	}
+	CHECK(setKeys > 0);
+	const uint8_t garbage[] = { 1, 99 };
+	CHECK(AKMApplyDelta(replica, garbage, sizeof(garbage)) == AKMStFatalError);
+	AKMFree(primary);
+	AKMFree(replica);
+	return true;
+}